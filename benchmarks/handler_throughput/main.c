@@ -0,0 +1,291 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Measures how many messages per second the generated framing,
+ * encoding, decoding and dispatch handle when a client and a server
+ * in the same thread exchange small messages. mem:// keeps the
+ * messages in process memory, so the kernel is mostly out of the
+ * picture, while the socket transports are measured for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "chat_server.h"
+#include "chat_client.h"
+
+#define NUMBER_OF_ROUND_TRIPS                     1000000
+#define WINDOW                                        256
+#define BUFFER_SIZE                                  4096
+
+static struct chat_server_t server;
+static struct chat_server_client_t clients[1];
+static uint8_t clients_input[1][BUFFER_SIZE];
+static uint8_t server_message[BUFFER_SIZE];
+static uint8_t server_workspace_in[BUFFER_SIZE];
+static uint8_t server_workspace_out[BUFFER_SIZE];
+static struct chat_client_t client;
+static uint8_t client_encoded_in[BUFFER_SIZE];
+static uint8_t client_workspace_in[BUFFER_SIZE];
+static uint8_t client_encoded_out[BUFFER_SIZE];
+static uint8_t client_workspace_out[BUFFER_SIZE];
+static bool connected;
+static int number_of_sent_messages;
+static int number_of_received_messages;
+
+static void send_message_ind(struct chat_client_t *self_p)
+{
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_client_init_message_ind(self_p);
+    message_p->user_p = "Erik";
+    message_p->text_p = "Hello!";
+    chat_client_send(self_p);
+    number_of_sent_messages++;
+}
+
+static void server_on_connect_req(struct chat_server_t *self_p,
+                                  struct chat_server_client_t *client_p,
+                                  struct chat_connect_req_t *message_p)
+{
+    (void)client_p;
+    (void)message_p;
+
+    chat_server_init_connect_rsp(self_p);
+    chat_server_reply(self_p);
+}
+
+static void server_on_message_ind(struct chat_server_t *self_p,
+                                  struct chat_server_client_t *client_p,
+                                  struct chat_message_ind_t *message_p)
+{
+    struct chat_message_ind_t *reply_p;
+
+    (void)client_p;
+
+    reply_p = chat_server_init_message_ind(self_p);
+    reply_p->user_p = message_p->user_p;
+    reply_p->text_p = message_p->text_p;
+    chat_server_reply(self_p);
+}
+
+static void client_on_connected(struct chat_client_t *self_p)
+{
+    struct chat_connect_req_t *message_p;
+
+    message_p = chat_client_init_connect_req(self_p);
+    message_p->user_p = "Erik";
+    chat_client_send(self_p);
+}
+
+static void client_on_connect_rsp(struct chat_client_t *self_p,
+                                  struct chat_connect_rsp_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+
+    connected = true;
+}
+
+/* Keep given number of messages in flight. */
+static void client_on_message_ind(struct chat_client_t *self_p,
+                                  struct chat_message_ind_t *message_p)
+{
+    (void)message_p;
+
+    number_of_received_messages++;
+
+    if (number_of_sent_messages < NUMBER_OF_ROUND_TRIPS) {
+        send_message_ind(self_p);
+    }
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static void process(int epoll_fd)
+{
+    struct epoll_event events[4];
+    int nfds;
+    int i;
+
+    nfds = epoll_wait(epoll_fd, &events[0], 4, 1000);
+
+    for (i = 0; i < nfds; i++) {
+        chat_server_process(&server, events[i].data.fd, events[i].events);
+        chat_client_process(&client, events[i].data.fd, events[i].events);
+    }
+}
+
+static double now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+static int measure(const char *server_uri_p)
+{
+    char client_uri[128];
+    double start;
+    double elapsed;
+    int epoll_fd;
+    int i;
+    int res;
+
+    epoll_fd = epoll_create1(0);
+    connected = false;
+    number_of_sent_messages = 0;
+    number_of_received_messages = 0;
+
+    res = chat_server_init(&server,
+                           server_uri_p,
+                           &clients[0],
+                           1,
+                           &clients_input[0][0],
+                           sizeof(clients_input[0]),
+                           &server_message[0],
+                           sizeof(server_message),
+                           &server_workspace_in[0],
+                           sizeof(server_workspace_in),
+                           &server_workspace_out[0],
+                           sizeof(server_workspace_out),
+                           NULL,
+                           NULL,
+                           server_on_connect_req,
+                           server_on_message_ind,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    if (chat_server_start(&server) != 0) {
+        return (-1);
+    }
+
+    if (messi_is_mem_uri(server_uri_p) || messi_is_unix_uri(server_uri_p)) {
+        snprintf(&client_uri[0], sizeof(client_uri), "%s", server_uri_p);
+    } else {
+        snprintf(&client_uri[0],
+                 sizeof(client_uri),
+                 "tcp://127.0.0.1:%d",
+                 get_port(server.listener_fd));
+    }
+
+    res = chat_client_init(&client,
+                           &client_uri[0],
+                           &client_encoded_in[0],
+                           sizeof(client_encoded_in),
+                           &client_workspace_in[0],
+                           sizeof(client_workspace_in),
+                           &client_encoded_out[0],
+                           sizeof(client_encoded_out),
+                           &client_workspace_out[0],
+                           sizeof(client_workspace_out),
+                           client_on_connected,
+                           NULL,
+                           client_on_connect_rsp,
+                           client_on_message_ind,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    chat_client_start(&client);
+
+    while (!connected) {
+        process(epoll_fd);
+    }
+
+    start = now();
+
+    for (i = 0; i < WINDOW; i++) {
+        send_message_ind(&client);
+    }
+
+    while (number_of_received_messages < NUMBER_OF_ROUND_TRIPS) {
+        process(epoll_fd);
+    }
+
+    elapsed = (now() - start);
+
+    /* Each round trip is one message in each direction. */
+    printf("%-32s %12.0f %10.1f\n",
+           server_uri_p,
+           2 * NUMBER_OF_ROUND_TRIPS / elapsed,
+           1e9 * elapsed / (2 * NUMBER_OF_ROUND_TRIPS));
+
+    chat_client_stop(&client);
+    chat_server_stop(&server);
+    close(epoll_fd);
+
+    return (0);
+}
+
+int main()
+{
+    printf("Round trips: %d, window: %d\n\n", NUMBER_OF_ROUND_TRIPS, WINDOW);
+    printf("%-32s %12s %10s\n", "URI", "MESSAGES/S", "NS/MESSAGE");
+
+    if (measure("mem://messi-handler-throughput") != 0) {
+        return (1);
+    }
+
+    if (measure("unix://@messi-handler-throughput") != 0) {
+        return (1);
+    }
+
+    if (measure("tcp://127.0.0.1:0") != 0) {
+        return (1);
+    }
+
+    return (0);
+}
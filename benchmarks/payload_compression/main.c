@@ -0,0 +1,286 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Compares bytes on the wire and process CPU time when a server sends
+ * repetitive log-like messages to a client, without and with payload
+ * compression. The server and the client run in the same process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "chat_server.h"
+#include "chat_client.h"
+
+#define NUMBER_OF_MESSAGES                          20000
+#define WINDOW                                         64
+#define BUFFER_SIZE                                  4096
+#define COMPRESSION_THRESHOLD                         128
+
+static struct chat_server_t server;
+static struct chat_server_client_t clients[1];
+static uint8_t clients_input[1][BUFFER_SIZE];
+static uint8_t server_message[BUFFER_SIZE];
+static uint8_t server_workspace_in[BUFFER_SIZE];
+static uint8_t server_workspace_out[BUFFER_SIZE];
+static uint8_t compressed[BUFFER_SIZE];
+static struct chat_client_t client;
+static uint8_t client_encoded_in[BUFFER_SIZE];
+static uint8_t client_workspace_in[BUFFER_SIZE];
+static uint8_t client_encoded_out[BUFFER_SIZE];
+static uint8_t client_workspace_out[BUFFER_SIZE];
+static struct chat_server_client_t *client_p;
+static char text[1024];
+static int number_of_received_messages;
+
+static void on_connect_req(struct chat_server_t *self_p,
+                           struct chat_server_client_t *connected_client_p,
+                           struct chat_connect_req_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+
+    client_p = connected_client_p;
+}
+
+static void on_connected(struct chat_client_t *self_p)
+{
+    struct chat_connect_req_t *message_p;
+
+    message_p = chat_client_init_connect_req(self_p);
+    message_p->user_p = "Erik";
+    chat_client_send(self_p);
+}
+
+static void on_message_ind(struct chat_client_t *self_p,
+                           struct chat_message_ind_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+
+    number_of_received_messages++;
+}
+
+static void create_text(void)
+{
+    size_t size;
+    int i;
+
+    size = 0;
+    i = 0;
+
+    while (size < sizeof(text) - 80) {
+        size += snprintf(&text[size],
+                         sizeof(text) - size,
+                         "2020-06-01 12:00:%02d INFO sensor %d: temperature "
+                         "21.%d C, humidity 40 %%\n",
+                         i % 60,
+                         i % 8,
+                         i % 10);
+        i++;
+    }
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static void process(int epoll_fd)
+{
+    struct epoll_event events[4];
+    int nfds;
+    int i;
+
+    nfds = epoll_wait(epoll_fd, &events[0], 4, 1000);
+
+    for (i = 0; i < nfds; i++) {
+        chat_server_process(&server, events[i].data.fd, events[i].events);
+        chat_client_process(&client, events[i].data.fd, events[i].events);
+    }
+}
+
+static double cpu_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+
+    return ((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+static int run(bool compress)
+{
+    struct chat_message_ind_t *message_p;
+    struct messi_stats_t stats;
+    char uri[64];
+    double start;
+    double elapsed;
+    int epoll_fd;
+    int sent;
+    int i;
+    int res;
+
+    epoll_fd = epoll_create1(0);
+    client_p = NULL;
+    number_of_received_messages = 0;
+
+    res = chat_server_init(&server,
+                           "tcp://127.0.0.1:0",
+                           &clients[0],
+                           1,
+                           &clients_input[0][0],
+                           sizeof(clients_input[0]),
+                           &server_message[0],
+                           sizeof(server_message),
+                           &server_workspace_in[0],
+                           sizeof(server_workspace_in),
+                           &server_workspace_out[0],
+                           sizeof(server_workspace_out),
+                           NULL,
+                           NULL,
+                           on_connect_req,
+                           NULL,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    if (compress) {
+        chat_server_set_compression(&server,
+                                    COMPRESSION_THRESHOLD,
+                                    NULL,
+                                    &compressed[0],
+                                    sizeof(compressed));
+    }
+
+    if (chat_server_start(&server) != 0) {
+        return (-1);
+    }
+
+    snprintf(&uri[0],
+             sizeof(uri),
+             "tcp://127.0.0.1:%d",
+             get_port(server.listener_fd));
+
+    res = chat_client_init(&client,
+                           &uri[0],
+                           &client_encoded_in[0],
+                           sizeof(client_encoded_in),
+                           &client_workspace_in[0],
+                           sizeof(client_workspace_in),
+                           &client_encoded_out[0],
+                           sizeof(client_encoded_out),
+                           &client_workspace_out[0],
+                           sizeof(client_workspace_out),
+                           on_connected,
+                           NULL,
+                           NULL,
+                           on_message_ind,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    chat_client_start(&client);
+
+    while (client_p == NULL) {
+        process(epoll_fd);
+    }
+
+    start = cpu_time();
+    sent = 0;
+
+    while (sent < NUMBER_OF_MESSAGES) {
+        for (i = 0; i < WINDOW; i++) {
+            message_p = chat_server_init_message_ind(&server);
+            message_p->user_p = "sensors";
+            message_p->text_p = &text[0];
+            chat_server_send(&server, client_p);
+            sent++;
+        }
+
+        while (number_of_received_messages < sent) {
+            process(epoll_fd);
+        }
+    }
+
+    elapsed = (cpu_time() - start);
+    chat_client_get_stats(&client, &stats);
+
+    printf("Compression:            %s\n", compress ? "on" : "off");
+    printf("Messages:               %d\n", NUMBER_OF_MESSAGES);
+    printf("Bytes on the wire:      %lu\n", (unsigned long)stats.bytes_in);
+    printf("Bytes/message:          %.1f\n",
+           (double)stats.bytes_in / NUMBER_OF_MESSAGES);
+    printf("CPU time:               %.3f s\n", elapsed);
+    printf("CPU time/message:       %.2f us\n",
+           1e6 * elapsed / NUMBER_OF_MESSAGES);
+    printf("\n");
+
+    chat_client_stop(&client);
+    chat_server_stop(&server);
+    close(epoll_fd);
+
+    return (0);
+}
+
+int main()
+{
+    create_text();
+    printf("Message text size:      %d\n\n", (int)strlen(&text[0]));
+
+    if (run(false) != 0) {
+        return (1);
+    }
+
+    if (run(true) != 0) {
+        return (1);
+    }
+
+    return (0);
+}
@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Measures the cost of dispatching an event to a connected client as
+ * the number of connected clients grows. The dispatched client is
+ * the first connected one, which is the last one in the servers'
+ * list of connected clients.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include "chat_server.h"
+
+#define ITERATIONS 100000
+
+static struct chat_server_client_t *first_client_p = NULL;
+
+static void on_client_connected(struct chat_server_t *self_p,
+                                struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+
+    if (first_client_p == NULL) {
+        first_client_p = client_p;
+    }
+}
+
+static int connect_client(int port)
+{
+    int fd;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+
+        return (-1);
+    }
+
+    return (fd);
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static double measure(struct chat_server_t *server_p)
+{
+    int i;
+    double start;
+
+    start = now();
+
+    for (i = 0; i < ITERATIONS; i++) {
+        chat_server_process(server_p, first_client_p->client_fd, EPOLLIN);
+    }
+
+    return (1e9 * (now() - start) / ITERATIONS);
+}
+
+static int clients_max_from_fd_limit(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return (1000);
+    }
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    /* Three file descriptors per client and some margin. */
+    return ((limit.rlim_cur - 64) / 3);
+}
+
+int main()
+{
+    struct chat_server_t server;
+    struct chat_server_client_t *clients_p;
+    uint8_t *clients_input_buffers_p;
+    uint8_t message[128];
+    uint8_t workspace_in[128];
+    uint8_t workspace_out[128];
+    int epoll_fd;
+    int clients_max;
+    int number_of_clients;
+    int checkpoint;
+    int port;
+    int res;
+
+    clients_max = clients_max_from_fd_limit();
+
+    if (clients_max > 20000) {
+        clients_max = 20000;
+    }
+
+    clients_p = calloc(clients_max, sizeof(*clients_p));
+    clients_input_buffers_p = calloc(clients_max, 128);
+    epoll_fd = epoll_create1(0);
+
+    if ((clients_p == NULL) || (clients_input_buffers_p == NULL)) {
+        return (1);
+    }
+
+    res = chat_server_init(&server,
+                           "tcp://127.0.0.1:0",
+                           clients_p,
+                           clients_max,
+                           clients_input_buffers_p,
+                           128,
+                           &message[0],
+                           sizeof(message),
+                           &workspace_in[0],
+                           sizeof(workspace_in),
+                           &workspace_out[0],
+                           sizeof(workspace_out),
+                           on_client_connected,
+                           NULL,
+                           NULL,
+                           NULL,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (1);
+    }
+
+    if (chat_server_start(&server) != 0) {
+        return (1);
+    }
+
+    port = get_port(server.listener_fd);
+    number_of_clients = 0;
+    checkpoint = 1;
+
+    printf("Clients      ns/event\n");
+
+    while (number_of_clients < clients_max) {
+        if (connect_client(port) == -1) {
+            break;
+        }
+
+        chat_server_process(&server, server.listener_fd, EPOLLIN);
+        number_of_clients++;
+
+        if (number_of_clients == checkpoint) {
+            printf("%7d  %12.1f\n", number_of_clients, measure(&server));
+            checkpoint *= 10;
+        }
+    }
+
+    printf("%7d  %12.1f\n", number_of_clients, measure(&server));
+
+    return (0);
+}
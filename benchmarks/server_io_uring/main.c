@@ -0,0 +1,433 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Compares request-response throughput of the linux and io_uring
+ * servers as the number of connections grows. Load threads keep a
+ * window of messages in flight on each of their connections, and the
+ * server replies to each message. The same program is built once per
+ * platform.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "chat_server.h"
+
+#define CLIENTS_MAX                                    256
+#define BUFFER_SIZE                                    256
+#define LOAD_THREADS                                     4
+#define CONNECTIONS_PER_LOAD_THREAD_MAX                 64
+#define WINDOW                                          16
+#define DURATION_S                                       1
+
+struct connection_t {
+    int fd;
+    uint8_t buf[4096];
+    size_t size;
+};
+
+struct load_t {
+    pthread_t thread;
+    int fds[CONNECTIONS_PER_LOAD_THREAD_MAX];
+    int number_of_connections;
+    long replies;
+};
+
+static struct chat_server_t server;
+static struct chat_server_client_t clients[CLIENTS_MAX];
+static uint8_t clients_input[CLIENTS_MAX][BUFFER_SIZE];
+static uint8_t message[BUFFER_SIZE];
+static uint8_t workspace_in[BUFFER_SIZE];
+static uint8_t workspace_out[BUFFER_SIZE];
+static struct messi_loop_t loop;
+static struct messi_loop_member_t server_member;
+static uint8_t request[64];
+static size_t request_size;
+static volatile bool stopped;
+static int number_of_connected_clients;
+
+static void on_client_connected(struct chat_server_t *self_p,
+                                struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+    (void)client_p;
+
+    __atomic_add_fetch(&number_of_connected_clients, 1, __ATOMIC_RELAXED);
+}
+
+static void on_message_ind(struct chat_server_t *self_p,
+                           struct chat_server_client_t *client_p,
+                           struct chat_message_ind_t *message_p)
+{
+    (void)client_p;
+
+    struct chat_message_ind_t *reply_p;
+
+    reply_p = chat_server_init_message_ind(self_p);
+    reply_p->user_p = message_p->user_p;
+    reply_p->text_p = message_p->text_p;
+    chat_server_reply(self_p);
+}
+
+static int encode_request(void)
+{
+    struct chat_client_to_server_t *message_p;
+    struct messi_header_t *header_p;
+    uint8_t workspace[BUFFER_SIZE];
+    int size;
+
+    message_p = chat_client_to_server_new(&workspace[0], sizeof(workspace));
+
+    if (message_p == NULL) {
+        return (-1);
+    }
+
+    chat_client_to_server_messages_message_ind_alloc(message_p);
+    message_p->messages.value.message_ind_p->user_p = "Erik";
+    message_p->messages.value.message_ind_p->text_p = "Hello.";
+    size = chat_client_to_server_encode(message_p,
+                                        &request[sizeof(*header_p)],
+                                        sizeof(request) - sizeof(*header_p));
+
+    if (size < 0) {
+        return (-1);
+    }
+
+    header_p = (struct messi_header_t *)&request[0];
+    header_p->type = MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER;
+    messi_header_set_size(header_p, size);
+    request_size = (sizeof(*header_p) + size);
+
+    return (0);
+}
+
+static int send_requests(int fd, int count)
+{
+    uint8_t buf[WINDOW * sizeof(request)];
+    size_t size;
+    int i;
+
+    size = 0;
+
+    for (i = 0; i < count; i++) {
+        memcpy(&buf[size], &request[0], request_size);
+        size += request_size;
+    }
+
+    return (write(fd, &buf[0], size) == (ssize_t)size ? 0 : -1);
+}
+
+static int connect_client(int port)
+{
+    int fd;
+    struct sockaddr_in addr;
+    int yes;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+
+        return (-1);
+    }
+
+    yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    return (fd);
+}
+
+/* Count all complete replies in the connection buffer and send one
+   new request per reply. */
+static int handle_replies(struct connection_t *connection_p, long *replies_p)
+{
+    struct messi_header_t *header_p;
+    size_t offset;
+    size_t frame_size;
+    int count;
+
+    offset = 0;
+    count = 0;
+
+    while (connection_p->size - offset >= sizeof(*header_p)) {
+        header_p = (struct messi_header_t *)&connection_p->buf[offset];
+        frame_size = (sizeof(*header_p) + messi_header_get_size(header_p));
+
+        if (connection_p->size - offset < frame_size) {
+            break;
+        }
+
+        offset += frame_size;
+        count++;
+    }
+
+    memmove(&connection_p->buf[0],
+            &connection_p->buf[offset],
+            connection_p->size - offset);
+    connection_p->size -= offset;
+    *replies_p += count;
+
+    if (count == 0) {
+        return (0);
+    }
+
+    return (send_requests(connection_p->fd, count));
+}
+
+static void *load_main(struct load_t *self_p)
+{
+    struct connection_t connections[CONNECTIONS_PER_LOAD_THREAD_MAX];
+    struct epoll_event events[CONNECTIONS_PER_LOAD_THREAD_MAX];
+    struct epoll_event event;
+    struct connection_t *connection_p;
+    int epoll_fd;
+    int nfds;
+    ssize_t size;
+    int i;
+
+    epoll_fd = epoll_create1(0);
+
+    for (i = 0; i < self_p->number_of_connections; i++) {
+        connection_p = &connections[i];
+        connection_p->fd = self_p->fds[i];
+        connection_p->size = 0;
+        event.events = EPOLLIN;
+        event.data.ptr = connection_p;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection_p->fd, &event);
+
+        if (send_requests(connection_p->fd, WINDOW) != 0) {
+            exit(1);
+        }
+    }
+
+    while (!stopped) {
+        nfds = epoll_wait(epoll_fd,
+                          &events[0],
+                          CONNECTIONS_PER_LOAD_THREAD_MAX,
+                          100);
+
+        for (i = 0; i < nfds; i++) {
+            connection_p = events[i].data.ptr;
+            size = read(connection_p->fd,
+                        &connection_p->buf[connection_p->size],
+                        sizeof(connection_p->buf) - connection_p->size);
+
+            if (size <= 0) {
+                exit(1);
+            }
+
+            connection_p->size += size;
+
+            if (handle_replies(connection_p, &self_p->replies) != 0) {
+                exit(1);
+            }
+        }
+    }
+
+    close(epoll_fd);
+
+    return (NULL);
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static void *server_main(void *arg_p)
+{
+    (void)arg_p;
+
+    while (!stopped) {
+        messi_loop_run_once(&loop, 100);
+    }
+
+    return (NULL);
+}
+
+/* Connect all clients, one at a time to not overflow the listen
+   backlog. */
+static void connect_clients(struct load_t *loads_p, int connections_per_thread)
+{
+    int port;
+    int i;
+    int j;
+
+    port = get_port(server.listener_fd);
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        loads_p[i].number_of_connections = connections_per_thread;
+
+        for (j = 0; j < connections_per_thread; j++) {
+            loads_p[i].fds[j] = connect_client(port);
+
+            if (loads_p[i].fds[j] == -1) {
+                exit(1);
+            }
+
+            while (__atomic_load_n(&number_of_connected_clients, __ATOMIC_RELAXED)
+                   < i * connections_per_thread + j + 1) {
+                usleep(100);
+            }
+        }
+    }
+}
+
+static double measure(int connections_per_thread)
+{
+    struct load_t loads[LOAD_THREADS];
+    pthread_t server_thread;
+    long replies;
+    int i;
+    int j;
+    int res;
+
+    res = messi_loop_init(&loop);
+
+    if (res != 0) {
+        exit(1);
+    }
+
+    res = chat_server_init(&server,
+                           "tcp://127.0.0.1:0",
+                           &clients[0],
+                           CLIENTS_MAX,
+                           &clients_input[0][0],
+                           BUFFER_SIZE,
+                           &message[0],
+                           sizeof(message),
+                           &workspace_in[0],
+                           sizeof(workspace_in),
+                           &workspace_out[0],
+                           sizeof(workspace_out),
+                           on_client_connected,
+                           NULL,
+                           NULL,
+                           on_message_ind,
+                           loop.epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        exit(1);
+    }
+
+    if (chat_server_start(&server) != 0) {
+        exit(1);
+    }
+
+    messi_loop_add(&loop,
+                   &server_member,
+                   &server,
+                   (messi_loop_process_t)chat_server_process_event,
+                   (messi_loop_process_deferred_t)chat_server_process_deferred);
+    number_of_connected_clients = 0;
+    stopped = false;
+    pthread_create(&server_thread, NULL, server_main, NULL);
+    connect_clients(&loads[0], connections_per_thread);
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        loads[i].replies = 0;
+        pthread_create(&loads[i].thread,
+                       NULL,
+                       (void *(*)(void *))load_main,
+                       &loads[i]);
+    }
+
+    sleep(DURATION_S);
+    stopped = true;
+    replies = 0;
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        pthread_join(loads[i].thread, NULL);
+        replies += loads[i].replies;
+    }
+
+    pthread_join(server_thread, NULL);
+    chat_server_stop(&server);
+    messi_loop_destroy(&loop);
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        for (j = 0; j < loads[i].number_of_connections; j++) {
+            close(loads[i].fds[j]);
+        }
+    }
+
+    return ((double)replies / DURATION_S);
+}
+
+int main()
+{
+    int connections_per_thread;
+
+    /* Clients disconnect with replies in flight. */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (encode_request() != 0) {
+        return (1);
+    }
+
+    printf("Platform: %s\n", PLATFORM);
+    printf("Connections    Messages/s\n");
+
+    for (connections_per_thread = 1;
+         connections_per_thread <= CONNECTIONS_PER_LOAD_THREAD_MAX;
+         connections_per_thread *= 4) {
+        printf("%11d  %12.0f\n",
+               LOAD_THREADS * connections_per_thread,
+               measure(connections_per_thread));
+    }
+
+    return (0);
+}
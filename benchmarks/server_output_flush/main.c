@@ -0,0 +1,222 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Measures the number of write system calls needed to drain the
+ * output queue of a slow client. Many small messages are sent to a
+ * client that does not read, and are then drained as the client
+ * reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "chat_server.h"
+
+#define NUMBER_OF_MESSAGES 20000
+
+static struct chat_server_client_t *client_p = NULL;
+static int number_of_write_calls = 0;
+
+ssize_t __real_write(int fd, const void *buf_p, size_t size);
+
+ssize_t __real_writev(int fd, const struct iovec *iov_p, int iovcnt);
+
+ssize_t __wrap_write(int fd, const void *buf_p, size_t size)
+{
+    number_of_write_calls++;
+
+    return (__real_write(fd, buf_p, size));
+}
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov_p, int iovcnt)
+{
+    number_of_write_calls++;
+
+    return (__real_writev(fd, iov_p, iovcnt));
+}
+
+static void on_client_connected(struct chat_server_t *self_p,
+                                struct chat_server_client_t *connected_client_p)
+{
+    (void)self_p;
+
+    client_p = connected_client_p;
+}
+
+static int connect_client(int port)
+{
+    int fd;
+    struct sockaddr_in addr;
+    int size;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        return (-1);
+    }
+
+    /* Small receive buffer to make the server enqueue messages. */
+    size = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+
+        return (-1);
+    }
+
+    messi_make_non_blocking(fd);
+
+    return (fd);
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static int output_queue_length(void)
+{
+    return ((int)client_p->output.queue.length);
+}
+
+static void drain_socket(int fd)
+{
+    uint8_t buf[65536];
+
+    while (read(fd, &buf[0], sizeof(buf)) > 0);
+}
+
+int main()
+{
+    struct chat_server_t server;
+    struct chat_server_client_t clients[1];
+    uint8_t clients_input_buffers[1][128];
+    uint8_t message[128];
+    uint8_t workspace_in[128];
+    uint8_t workspace_out[128];
+    struct chat_message_ind_t *message_p;
+    int epoll_fd;
+    int client_fd;
+    int queued;
+    int size;
+    int i;
+    int res;
+
+    epoll_fd = epoll_create1(0);
+
+    res = chat_server_init(&server,
+                           "tcp://127.0.0.1:0",
+                           &clients[0],
+                           1,
+                           &clients_input_buffers[0][0],
+                           sizeof(clients_input_buffers[0]),
+                           &message[0],
+                           sizeof(message),
+                           &workspace_in[0],
+                           sizeof(workspace_in),
+                           &workspace_out[0],
+                           sizeof(workspace_out),
+                           on_client_connected,
+                           NULL,
+                           NULL,
+                           NULL,
+                           epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        return (1);
+    }
+
+    if (chat_server_start(&server) != 0) {
+        return (1);
+    }
+
+    client_fd = connect_client(get_port(server.listener_fd));
+
+    if (client_fd == -1) {
+        return (1);
+    }
+
+    chat_server_process(&server, server.listener_fd, EPOLLIN);
+
+    if (client_p == NULL) {
+        return (1);
+    }
+
+    /* Small send buffer to make the server enqueue messages. */
+    size = 4096;
+    setsockopt(client_p->client_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    /* Send messages to the client, which does not read. Most of them
+       are enqueued. */
+    for (i = 0; i < NUMBER_OF_MESSAGES; i++) {
+        message_p = chat_server_init_message_ind(&server);
+        message_p->user_p = "Erik";
+        message_p->text_p = "Hello.";
+        chat_server_send(&server, client_p);
+    }
+
+    queued = output_queue_length();
+
+    /* Drain the output queue as the client reads. */
+    number_of_write_calls = 0;
+
+    while (!messi_output_queue_is_empty(&client_p->output.queue)) {
+        drain_socket(client_fd);
+        chat_server_process(&server, client_p->client_fd, EPOLLOUT);
+    }
+
+    printf("Messages sent:          %d\n", NUMBER_OF_MESSAGES);
+    printf("Messages enqueued:      %d\n", queued);
+    printf("Write system calls:     %d\n", number_of_write_calls);
+    printf("System calls/message:   %.3f\n",
+           (double)number_of_write_calls / queued);
+
+    return (0);
+}
@@ -0,0 +1,412 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Measures request-response throughput of a multi-reactor server as
+ * the number of reactor threads grows. Load threads keep a window of
+ * messages in flight on each of their connections, and the server
+ * replies to each message.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "chat_server.h"
+
+#define REACTORS_MAX                                     8
+#define CLIENTS_MAX                                     64
+#define BUFFER_SIZE                                    256
+#define LOAD_THREADS                                     4
+#define CONNECTIONS_PER_LOAD_THREAD                     16
+#define WINDOW                                          16
+#define DURATION_S                                       1
+
+struct reactor_buffers_t {
+    struct chat_server_client_t clients[CLIENTS_MAX];
+    uint8_t clients_input[CLIENTS_MAX][BUFFER_SIZE];
+    uint8_t message[BUFFER_SIZE];
+    uint8_t workspace_in[BUFFER_SIZE];
+    uint8_t workspace_out[BUFFER_SIZE];
+};
+
+struct connection_t {
+    int fd;
+    uint8_t buf[4096];
+    size_t size;
+};
+
+struct load_t {
+    pthread_t thread;
+    int fds[CONNECTIONS_PER_LOAD_THREAD];
+    long replies;
+};
+
+static struct reactor_buffers_t buffers[REACTORS_MAX];
+static struct chat_server_t servers[REACTORS_MAX];
+static struct chat_server_reactor_t reactors[REACTORS_MAX];
+static uint8_t request[64];
+static size_t request_size;
+static volatile bool stopped;
+
+static void on_message_ind(struct chat_server_t *self_p,
+                           struct chat_server_client_t *client_p,
+                           struct chat_message_ind_t *message_p)
+{
+    (void)client_p;
+
+    struct chat_message_ind_t *reply_p;
+
+    reply_p = chat_server_init_message_ind(self_p);
+    reply_p->user_p = message_p->user_p;
+    reply_p->text_p = message_p->text_p;
+    chat_server_reply(self_p);
+}
+
+static int encode_request(void)
+{
+    struct chat_client_to_server_t *message_p;
+    struct messi_header_t *header_p;
+    uint8_t workspace[BUFFER_SIZE];
+    int size;
+
+    message_p = chat_client_to_server_new(&workspace[0], sizeof(workspace));
+
+    if (message_p == NULL) {
+        return (-1);
+    }
+
+    chat_client_to_server_messages_message_ind_alloc(message_p);
+    message_p->messages.value.message_ind_p->user_p = "Erik";
+    message_p->messages.value.message_ind_p->text_p = "Hello.";
+    size = chat_client_to_server_encode(message_p,
+                                        &request[sizeof(*header_p)],
+                                        sizeof(request) - sizeof(*header_p));
+
+    if (size < 0) {
+        return (-1);
+    }
+
+    header_p = (struct messi_header_t *)&request[0];
+    header_p->type = MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER;
+    messi_header_set_size(header_p, size);
+    request_size = (sizeof(*header_p) + size);
+
+    return (0);
+}
+
+static int send_requests(int fd, int count)
+{
+    uint8_t buf[WINDOW * sizeof(request)];
+    size_t size;
+    int i;
+
+    size = 0;
+
+    for (i = 0; i < count; i++) {
+        memcpy(&buf[size], &request[0], request_size);
+        size += request_size;
+    }
+
+    return (write(fd, &buf[0], size) == (ssize_t)size ? 0 : -1);
+}
+
+static int connect_client(int port)
+{
+    int fd;
+    struct sockaddr_in addr;
+    int yes;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+
+        return (-1);
+    }
+
+    yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    return (fd);
+}
+
+/* Count all complete replies in the connection buffer and send one
+   new request per reply. */
+static int handle_replies(struct connection_t *connection_p, long *replies_p)
+{
+    struct messi_header_t *header_p;
+    size_t offset;
+    size_t frame_size;
+    int count;
+
+    offset = 0;
+    count = 0;
+
+    while (connection_p->size - offset >= sizeof(*header_p)) {
+        header_p = (struct messi_header_t *)&connection_p->buf[offset];
+        frame_size = (sizeof(*header_p) + messi_header_get_size(header_p));
+
+        if (connection_p->size - offset < frame_size) {
+            break;
+        }
+
+        offset += frame_size;
+        count++;
+    }
+
+    memmove(&connection_p->buf[0],
+            &connection_p->buf[offset],
+            connection_p->size - offset);
+    connection_p->size -= offset;
+    *replies_p += count;
+
+    if (count == 0) {
+        return (0);
+    }
+
+    return (send_requests(connection_p->fd, count));
+}
+
+static void *load_main(struct load_t *self_p)
+{
+    struct connection_t connections[CONNECTIONS_PER_LOAD_THREAD];
+    struct epoll_event events[CONNECTIONS_PER_LOAD_THREAD];
+    struct epoll_event event;
+    struct connection_t *connection_p;
+    int epoll_fd;
+    int nfds;
+    ssize_t size;
+    int i;
+
+    epoll_fd = epoll_create1(0);
+
+    for (i = 0; i < CONNECTIONS_PER_LOAD_THREAD; i++) {
+        connection_p = &connections[i];
+        connection_p->fd = self_p->fds[i];
+        connection_p->size = 0;
+        event.events = EPOLLIN;
+        event.data.ptr = connection_p;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection_p->fd, &event);
+
+        if (send_requests(connection_p->fd, WINDOW) != 0) {
+            exit(1);
+        }
+    }
+
+    while (!stopped) {
+        nfds = epoll_wait(epoll_fd, &events[0], CONNECTIONS_PER_LOAD_THREAD, 100);
+
+        for (i = 0; i < nfds; i++) {
+            connection_p = events[i].data.ptr;
+            size = read(connection_p->fd,
+                        &connection_p->buf[connection_p->size],
+                        sizeof(connection_p->buf) - connection_p->size);
+
+            if (size <= 0) {
+                exit(1);
+            }
+
+            connection_p->size += size;
+
+            if (handle_replies(connection_p, &self_p->replies) != 0) {
+                exit(1);
+            }
+        }
+    }
+
+    for (i = 0; i < CONNECTIONS_PER_LOAD_THREAD; i++) {
+        close(connections[i].fd);
+    }
+
+    close(epoll_fd);
+
+    return (NULL);
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static int total_load(struct chat_server_reactors_t *server_p)
+{
+    int load;
+    int i;
+
+    load = 0;
+
+    for (i = 0; i < server_p->number_of_reactors; i++) {
+        load += __atomic_load_n(&server_p->reactors_p[i].load, __ATOMIC_RELAXED);
+    }
+
+    return (load);
+}
+
+/* Connect all clients, one at a time to not overflow the listen
+   backlog. */
+static void connect_clients(struct chat_server_reactors_t *server_p,
+                            struct load_t *loads_p)
+{
+    int port;
+    int i;
+    int j;
+
+    port = get_port(server_p->acceptor.listener_fd);
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        for (j = 0; j < CONNECTIONS_PER_LOAD_THREAD; j++) {
+            loads_p[i].fds[j] = connect_client(port);
+
+            if (loads_p[i].fds[j] == -1) {
+                exit(1);
+            }
+
+            while (total_load(server_p) < i * CONNECTIONS_PER_LOAD_THREAD + j + 1) {
+                usleep(100);
+            }
+        }
+    }
+}
+
+static double measure(int number_of_reactors)
+{
+    struct chat_server_reactors_t server;
+    struct load_t loads[LOAD_THREADS];
+    long replies;
+    int i;
+    int res;
+
+    for (i = 0; i < number_of_reactors; i++) {
+        res = chat_server_init(&servers[i],
+                               "tcp://127.0.0.1:0",
+                               &buffers[i].clients[0],
+                               CLIENTS_MAX,
+                               &buffers[i].clients_input[0][0],
+                               BUFFER_SIZE,
+                               &buffers[i].message[0],
+                               BUFFER_SIZE,
+                               &buffers[i].workspace_in[0],
+                               BUFFER_SIZE,
+                               &buffers[i].workspace_out[0],
+                               BUFFER_SIZE,
+                               NULL,
+                               NULL,
+                               NULL,
+                               on_message_ind,
+                               -1,
+                               NULL);
+
+        if (res != 0) {
+            exit(1);
+        }
+    }
+
+    if (chat_server_reactors_init(&server,
+                                  &reactors[0],
+                                  &servers[0],
+                                  number_of_reactors) != 0) {
+        exit(1);
+    }
+
+    if (chat_server_reactors_start(&server) != 0) {
+        exit(1);
+    }
+
+    connect_clients(&server, &loads[0]);
+    stopped = false;
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        loads[i].replies = 0;
+        pthread_create(&loads[i].thread,
+                       NULL,
+                       (void *(*)(void *))load_main,
+                       &loads[i]);
+    }
+
+    sleep(DURATION_S);
+    stopped = true;
+    replies = 0;
+
+    for (i = 0; i < LOAD_THREADS; i++) {
+        pthread_join(loads[i].thread, NULL);
+        replies += loads[i].replies;
+    }
+
+    chat_server_reactors_stop(&server);
+
+    return ((double)replies / DURATION_S);
+}
+
+int main()
+{
+    int number_of_reactors;
+
+    /* Clients disconnect with replies in flight. */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (encode_request() != 0) {
+        return (1);
+    }
+
+    printf("Online CPUs: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("Reactors    Messages/s\n");
+
+    for (number_of_reactors = 1;
+         number_of_reactors <= REACTORS_MAX;
+         number_of_reactors *= 2) {
+        printf("%8d  %12.0f\n", number_of_reactors, measure(number_of_reactors));
+    }
+
+    return (0);
+}
@@ -0,0 +1,281 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Messi project.
+ */
+
+/*
+ * Compares request-response round trip latency over TCP loopback,
+ * unix domain sockets and shared memory. A client sends one message
+ * at a time to a server in another thread, which replies to it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "chat_server.h"
+#include "chat_client.h"
+
+#define NUMBER_OF_ROUND_TRIPS                       50000
+#define BUFFER_SIZE                                   256
+
+static struct chat_server_t server;
+static struct chat_server_client_t clients[1];
+static uint8_t clients_input[1][BUFFER_SIZE];
+static uint8_t server_message[BUFFER_SIZE];
+static uint8_t server_workspace_in[BUFFER_SIZE];
+static uint8_t server_workspace_out[BUFFER_SIZE];
+static struct messi_loop_t server_loop;
+static struct messi_loop_member_t server_member;
+static struct chat_client_t client;
+static uint8_t client_encoded_in[BUFFER_SIZE];
+static uint8_t client_workspace_in[BUFFER_SIZE];
+static uint8_t client_encoded_out[BUFFER_SIZE];
+static uint8_t client_workspace_out[BUFFER_SIZE];
+static struct messi_loop_t client_loop;
+static struct messi_loop_member_t client_member;
+static volatile bool stopped;
+static double round_trips[NUMBER_OF_ROUND_TRIPS];
+static int number_of_round_trips;
+static double start;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((double)ts.tv_sec + (double)ts.tv_nsec / 1e9);
+}
+
+static void on_message_ind_server(struct chat_server_t *self_p,
+                                  struct chat_server_client_t *client_p,
+                                  struct chat_message_ind_t *message_p)
+{
+    (void)client_p;
+
+    struct chat_message_ind_t *reply_p;
+
+    reply_p = chat_server_init_message_ind(self_p);
+    reply_p->user_p = message_p->user_p;
+    reply_p->text_p = message_p->text_p;
+    chat_server_reply(self_p);
+}
+
+static void send_request(struct chat_client_t *self_p)
+{
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_client_init_message_ind(self_p);
+    message_p->user_p = "Erik";
+    message_p->text_p = "Hello.";
+    start = now();
+    chat_client_send(self_p);
+}
+
+static void on_connected(struct chat_client_t *self_p)
+{
+    send_request(self_p);
+}
+
+static void on_message_ind_client(struct chat_client_t *self_p,
+                                  struct chat_message_ind_t *message_p)
+{
+    (void)message_p;
+
+    round_trips[number_of_round_trips] = (now() - start);
+    number_of_round_trips++;
+
+    if (number_of_round_trips < NUMBER_OF_ROUND_TRIPS) {
+        send_request(self_p);
+    }
+}
+
+static void *server_main(void *arg_p)
+{
+    (void)arg_p;
+
+    while (!stopped) {
+        messi_loop_run_once(&server_loop, 100);
+    }
+
+    return (NULL);
+}
+
+static int compare(const void *left_p, const void *right_p)
+{
+    double left;
+    double right;
+
+    left = *(const double *)left_p;
+    right = *(const double *)right_p;
+
+    return ((left > right) - (left < right));
+}
+
+static int get_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t size;
+
+    size = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &size) != 0) {
+        return (-1);
+    }
+
+    return (ntohs(addr.sin_port));
+}
+
+static void measure(const char *server_uri_p)
+{
+    pthread_t server_thread;
+    char client_uri[128];
+    double total;
+    int i;
+    int res;
+
+    if (messi_loop_init(&server_loop) != 0) {
+        exit(1);
+    }
+
+    res = chat_server_init(&server,
+                           server_uri_p,
+                           &clients[0],
+                           1,
+                           &clients_input[0][0],
+                           BUFFER_SIZE,
+                           &server_message[0],
+                           sizeof(server_message),
+                           &server_workspace_in[0],
+                           sizeof(server_workspace_in),
+                           &server_workspace_out[0],
+                           sizeof(server_workspace_out),
+                           NULL,
+                           NULL,
+                           NULL,
+                           on_message_ind_server,
+                           server_loop.epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        exit(1);
+    }
+
+    if (chat_server_start(&server) != 0) {
+        exit(1);
+    }
+
+    messi_loop_add(&server_loop,
+                   &server_member,
+                   &server,
+                   (messi_loop_process_t)chat_server_process_event,
+                   (messi_loop_process_deferred_t)chat_server_process_deferred);
+
+    if (messi_is_unix_uri(server_uri_p) || messi_is_shm_uri(server_uri_p)) {
+        snprintf(&client_uri[0], sizeof(client_uri), "%s", server_uri_p);
+    } else {
+        snprintf(&client_uri[0],
+                 sizeof(client_uri),
+                 "tcp://127.0.0.1:%d",
+                 get_port(server.listener_fd));
+    }
+
+    if (messi_loop_init(&client_loop) != 0) {
+        exit(1);
+    }
+
+    res = chat_client_init(&client,
+                           &client_uri[0],
+                           &client_encoded_in[0],
+                           sizeof(client_encoded_in),
+                           &client_workspace_in[0],
+                           sizeof(client_workspace_in),
+                           &client_encoded_out[0],
+                           sizeof(client_encoded_out),
+                           &client_workspace_out[0],
+                           sizeof(client_workspace_out),
+                           on_connected,
+                           NULL,
+                           NULL,
+                           on_message_ind_client,
+                           client_loop.epoll_fd,
+                           NULL);
+
+    if (res != 0) {
+        exit(1);
+    }
+
+    messi_loop_add(&client_loop,
+                   &client_member,
+                   &client,
+                   (messi_loop_process_t)chat_client_process_event,
+                   (messi_loop_process_deferred_t)chat_client_process_deferred);
+    stopped = false;
+    number_of_round_trips = 0;
+    pthread_create(&server_thread, NULL, server_main, NULL);
+    chat_client_start(&client);
+
+    while (number_of_round_trips < NUMBER_OF_ROUND_TRIPS) {
+        messi_loop_run_once(&client_loop, 100);
+    }
+
+    stopped = true;
+    pthread_join(server_thread, NULL);
+    chat_client_stop(&client);
+    chat_server_stop(&server);
+    messi_loop_destroy(&client_loop);
+    messi_loop_destroy(&server_loop);
+
+    total = 0;
+
+    for (i = 0; i < NUMBER_OF_ROUND_TRIPS; i++) {
+        total += round_trips[i];
+    }
+
+    qsort(&round_trips[0], NUMBER_OF_ROUND_TRIPS, sizeof(double), compare);
+
+    printf("%-42s %8.2f %8.2f %8.2f\n",
+           server_uri_p,
+           1e6 * total / NUMBER_OF_ROUND_TRIPS,
+           1e6 * round_trips[NUMBER_OF_ROUND_TRIPS / 2],
+           1e6 * round_trips[(NUMBER_OF_ROUND_TRIPS * 99) / 100]);
+}
+
+int main()
+{
+    printf("Round trips: %d\n\n", NUMBER_OF_ROUND_TRIPS);
+    printf("%-42s %8s %8s %8s\n", "URI", "MEAN US", "P50 US", "P99 US");
+    measure("tcp://127.0.0.1:0");
+    measure("unix:///tmp/messi-transport-latency.sock");
+    measure("unix://@messi-transport-latency");
+    measure("shm://messi-transport-latency");
+
+    return (0);
+}
@@ -108,6 +108,21 @@ static void user_input(struct chat_client_t *self_p)
     }
 }
 
+static int process_user_input(struct chat_client_t *self_p,
+                              int fd,
+                              uint32_t events)
+{
+    (void)events;
+
+    if (fd != STDIN_FILENO) {
+        return (-1);
+    }
+
+    user_input(self_p);
+
+    return (0);
+}
+
 static void parse_args(int argc,
                        const char *argv[],
                        const char **user_pp,
@@ -131,8 +146,9 @@ int main(int argc, const char *argv[])
 {
     struct chat_client_t client;
     const char *uri_p;
-    int epoll_fd;
-    struct epoll_event event;
+    struct messi_loop_t loop;
+    struct messi_loop_member_t client_member;
+    struct messi_loop_member_t user_input_member;
     int res;
     uint8_t encoded_in[128];
     uint8_t encoded_out[128];
@@ -143,16 +159,16 @@ int main(int argc, const char *argv[])
 
     printf("Server URI: %s\n", uri_p);
 
-    epoll_fd = epoll_create1(0);
+    res = messi_loop_init(&loop);
 
-    if (epoll_fd == -1) {
+    if (res != 0) {
         return (1);
     }
 
-    event.data.fd = STDIN_FILENO;
-    event.events = EPOLLIN;
-
-    res = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event);
+    res = messi_epoll_ctl_default(loop.epoll_fd,
+                                  EPOLL_CTL_ADD,
+                                  STDIN_FILENO,
+                                  EPOLLIN);
 
     if (res != 0) {
         return (1);
@@ -174,7 +190,7 @@ int main(int argc, const char *argv[])
                            on_disconnected,
                            on_connect_rsp,
                            on_message_ind,
-                           epoll_fd,
+                           loop.epoll_fd,
                            NULL);
 
     if (res != 0) {
@@ -183,21 +199,20 @@ int main(int argc, const char *argv[])
         return (1);
     }
 
-    chat_client_start(&client);
+    messi_loop_add(&loop,
+                   &client_member,
+                   &client,
+                   (messi_loop_process_t)chat_client_process_event,
+                   (messi_loop_process_deferred_t)chat_client_process_deferred);
+    messi_loop_add(&loop,
+                   &user_input_member,
+                   &client,
+                   (messi_loop_process_t)process_user_input,
+                   NULL);
 
-    while (true) {
-        res = epoll_wait(epoll_fd, &event, 1, -1);
-
-        if (res != 1) {
-            break;
-        }
+    chat_client_start(&client);
 
-        if (event.data.fd == STDIN_FILENO) {
-            user_input(&client);
-        } else {
-            chat_client_process(&client, event.data.fd, event.events);
-        }
-    }
+    messi_loop_run(&loop);
 
     return (0);
 }
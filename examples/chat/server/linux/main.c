@@ -27,7 +27,6 @@
  */
 
 #include <stdio.h>
-#include <sys/epoll.h>
 #include "chat_server.h"
 
 static int number_of_connected_clients = 0;
@@ -91,8 +90,8 @@ int main(int argc, const char *argv[])
     uint8_t message[128];
     uint8_t workspace_in[128];
     uint8_t workspace_out[128];
-    int epoll_fd;
-    struct epoll_event event;
+    struct messi_loop_t loop;
+    struct messi_loop_member_t server_member;
     int res;
     const char *uri_p;
 
@@ -100,9 +99,9 @@ int main(int argc, const char *argv[])
 
     printf("Server URI: %s\n", uri_p);
 
-    epoll_fd = epoll_create1(0);
+    res = messi_loop_init(&loop);
 
-    if (epoll_fd == -1) {
+    if (res != 0) {
         return (1);
     }
 
@@ -122,7 +121,7 @@ int main(int argc, const char *argv[])
                            on_client_disconnected,
                            on_connect_req,
                            on_message_ind,
-                           epoll_fd,
+                           loop.epoll_fd,
                            NULL);
 
     if (res != 0) {
@@ -131,6 +130,12 @@ int main(int argc, const char *argv[])
         return (1);
     }
 
+    messi_loop_add(&loop,
+                   &server_member,
+                   &server,
+                   (messi_loop_process_t)chat_server_process_event,
+                   (messi_loop_process_deferred_t)chat_server_process_deferred);
+
     res = chat_server_start(&server);
 
     if (res != 0) {
@@ -141,15 +146,7 @@ int main(int argc, const char *argv[])
 
     printf("Server started.\n");
 
-    while (true) {
-        res = epoll_wait(epoll_fd, &event, 1, -1);
-
-        if (res != 1) {
-            break;
-        }
-
-        chat_server_process(&server, event.data.fd, event.events);
-    }
+    messi_loop_run(&loop);
 
     return (1);
 }
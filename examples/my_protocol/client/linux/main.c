@@ -28,7 +28,6 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/epoll.h>
 #include "my_protocol_client.h"
 
 static void on_connected(struct my_protocol_client_t *self_p)
@@ -77,17 +76,17 @@ static void on_fie_req(struct my_protocol_client_t *self_p,
 int main()
 {
     struct my_protocol_client_t client;
-    int epoll_fd;
-    struct epoll_event event;
+    struct messi_loop_t loop;
+    struct messi_loop_member_t client_member;
     int res;
     uint8_t encoded_in[128];
     uint8_t encoded_out[128];
     uint8_t workspace_in[128];
     uint8_t workspace_out[128];
 
-    epoll_fd = epoll_create1(0);
+    res = messi_loop_init(&loop);
 
-    if (epoll_fd == -1) {
+    if (res != 0) {
         return (1);
     }
 
@@ -105,7 +104,7 @@ int main()
                                   on_disconnected,
                                   on_foo_rsp,
                                   on_fie_req,
-                                  epoll_fd,
+                                  loop.epoll_fd,
                                   NULL);
 
     if (res != 0) {
@@ -114,17 +113,15 @@ int main()
         return (1);
     }
 
-    my_protocol_client_start(&client);
-
-    while (true) {
-        res = epoll_wait(epoll_fd, &event, 1, -1);
+    messi_loop_add(&loop,
+                   &client_member,
+                   &client,
+                   (messi_loop_process_t)my_protocol_client_process_event,
+                   (messi_loop_process_deferred_t)my_protocol_client_process_deferred);
 
-        if (res != 1) {
-            break;
-        }
+    my_protocol_client_start(&client);
 
-        my_protocol_client_process(&client, event.data.fd, event.events);
-    }
+    messi_loop_run(&loop);
 
     return (0);
 }
@@ -28,7 +28,6 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/epoll.h>
 #include "my_protocol_server.h"
 
 static void on_foo_req(struct my_protocol_server_t *self_p,
@@ -85,13 +84,13 @@ int main()
     uint8_t message[128];
     uint8_t workspace_in[128];
     uint8_t workspace_out[128];
-    int epoll_fd;
-    struct epoll_event event;
+    struct messi_loop_t loop;
+    struct messi_loop_member_t server_member;
     int res;
 
-    epoll_fd = epoll_create1(0);
+    res = messi_loop_init(&loop);
 
-    if (epoll_fd == -1) {
+    if (res != 0) {
         return (1);
     }
 
@@ -112,7 +111,7 @@ int main()
                                   on_foo_req,
                                   on_bar_ind,
                                   on_fie_rsp,
-                                  epoll_fd,
+                                  loop.epoll_fd,
                                   NULL);
 
     if (res != 0) {
@@ -121,6 +120,12 @@ int main()
         return (1);
     }
 
+    messi_loop_add(&loop,
+                   &server_member,
+                   &server,
+                   (messi_loop_process_t)my_protocol_server_process_event,
+                   (messi_loop_process_deferred_t)my_protocol_server_process_deferred);
+
     res = my_protocol_server_start(&server);
 
     if (res != 0) {
@@ -131,15 +136,7 @@ int main()
 
     printf("Server started.\n");
 
-    while (true) {
-        res = epoll_wait(epoll_fd, &event, 1, -1);
-
-        if (res != 1) {
-            break;
-        }
-
-        my_protocol_server_process(&server, event.data.fd, event.events);
-    }
+    messi_loop_run(&loop);
 
     return (1);
 }
@@ -29,14 +29,36 @@
 #ifndef MESSI_H
 #define MESSI_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
 
 /* Message types. */
 #define MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER 1
 #define MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER 2
 #define MESSI_MESSAGE_TYPE_PING                  3
 #define MESSI_MESSAGE_TYPE_PONG                  4
+#define MESSI_MESSAGE_TYPE_EXTENDED              5
+#define MESSI_MESSAGE_TYPE_BATCH                 6
+#define MESSI_MESSAGE_TYPE_COMPRESSED            7
+#define MESSI_MESSAGE_TYPE_REQUEST               8
+#define MESSI_MESSAGE_TYPE_RESPONSE              9
+
+/* Size of the correlation id first in the payload of request and
+   response frames. */
+#define MESSI_REQUEST_ID_SIZE                    4
+
+/* Identifier of the built-in LZ4 block format codec. */
+#define MESSI_CODEC_LZ4                          1
+
+/* Maximum payload size of a frame with a basic header. Larger
+   payloads are sent in extended frames. */
+#define MESSI_HEADER_SIZE_MAX                    0xffffff
 
 typedef int (*messi_epoll_ctl_t)(int epoll_fd, int op, int fd, uint32_t events);
 
@@ -49,16 +71,247 @@ enum messi_disconnect_reason_t {
     messi_disconnect_reason_message_too_big_t
 };
 
+/* How a request completed. */
+enum messi_request_status_t {
+    messi_request_status_ok_t = 0,
+    messi_request_status_timeout_t,
+    messi_request_status_disconnected_t
+};
+
 struct messi_buffer_t {
     uint8_t *buf_p;
     size_t size;
 };
 
+/* Timer wheel dimensions and default tick. */
+#define MESSI_TIMER_WHEEL_LEVEL_0_SLOTS 256
+#define MESSI_TIMER_WHEEL_LEVEL_1_SLOTS 64
+#define MESSI_TIMER_WHEEL_TICK_MS       100
+
+typedef void (*messi_timer_on_timeout_t)(void *obj_p);
+
+struct messi_timer_t {
+    uint64_t expiry;
+    messi_timer_on_timeout_t on_timeout;
+    void *obj_p;
+    struct messi_timer_t *next_p;
+    /* Pointer to the next pointer of the previous timer, or the slot,
+       or NULL if not running. */
+    struct messi_timer_t **prev_next_pp;
+};
+
+/* Two level timer wheel driven by a single periodic timerfd. Level 0
+   has one slot per tick and level 1 one slot per level 0 turn. */
+struct messi_timer_wheel_t {
+    int fd;
+    int tick_ms;
+    uint64_t tick;
+    bool is_armed;
+    int number_of_running_timers;
+    struct messi_timer_t *level_0[MESSI_TIMER_WHEEL_LEVEL_0_SLOTS];
+    struct messi_timer_t *level_1[MESSI_TIMER_WHEEL_LEVEL_1_SLOTS];
+};
+
+/* Exponential backoff of reconnect attempts, optionally with full
+   jitter to spread the attempts of many clients over time. */
+struct messi_backoff_t {
+    int initial_ms;
+    int multiplier;
+    int max_ms;
+    bool jitter;
+    /* Delay before jitter of the last attempt. */
+    int delay_ms;
+    /* Number of attempts since reset. */
+    unsigned int attempt;
+    uint32_t seed;
+};
+
+/* File descriptor to object lookup table. Grows on demand. */
+struct messi_fd_table_t {
+    void **objs_pp;
+    int size;
+};
+
+/* Receive framer. Bytes are read into the buffer in as large chunks
+   as possible and split into complete frames. */
+struct messi_framer_t {
+    struct messi_buffer_t data;
+    /* Number of received bytes in the buffer. */
+    size_t size;
+    /* Offset of the first byte not yet returned as part of a frame. */
+    size_t offset;
+};
+
+/* Byte ring buffer. Data is read out as at most two buffers, as it
+   may wrap around the end. */
+struct messi_ring_t {
+    struct messi_buffer_t data;
+    /* Offset of the first used byte. */
+    size_t head;
+    /* Number of used bytes. */
+    size_t used;
+};
+
+/* Reference counted buffer, shared by output queues. The count is
+   atomic as buffers are shared between server reactor threads. */
+struct messi_shared_buffer_t {
+    int count;
+    size_t size;
+    uint8_t data[1];
+};
+
+struct messi_output_queue_item_t {
+    struct messi_shared_buffer_t *buffer_p;
+    /* Offset of the first byte not yet written. */
+    size_t offset;
+};
+
+/* Queue of references to shared buffers. The item array grows on
+   demand and is reused once grown. */
+struct messi_output_queue_t {
+    struct messi_output_queue_item_t *items_p;
+    size_t max;
+    size_t head;
+    size_t length;
+    /* Number of queued bytes not yet written. */
+    size_t size;
+};
+
+/* Traffic statistics of a connection. Messages are frames, including
+   keep-alive pings and pongs. */
+struct messi_stats_t {
+    uint64_t messages_in;
+    uint64_t messages_out;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t reads;
+    uint64_t writes;
+    /* Number of reads and writes that would have blocked. */
+    uint64_t eagains;
+    /* Enqueued output bytes not yet written, now and at most. */
+    uint64_t output_bytes;
+    uint64_t output_bytes_peak;
+    uint64_t keep_alive_misses;
+};
+
+/* Maximum number of events handled per epoll_wait() call in an event
+   loop. */
+#ifndef MESSI_LOOP_EVENTS_MAX
+#define MESSI_LOOP_EVENTS_MAX 64
+#endif
+
+/* Process an event on given file descriptor. Returns zero(0) if the
+   file descriptor belongs to given object, and non-zero otherwise
+   without doing anything. */
+typedef int (*messi_loop_process_t)(void *obj_p, int fd, uint32_t events);
+
+/* Perform work deferred during a batch of events. */
+typedef void (*messi_loop_process_deferred_t)(void *obj_p);
+
+struct messi_loop_member_t {
+    void *obj_p;
+    messi_loop_process_t process;
+    messi_loop_process_deferred_t process_deferred;
+    bool deferred_pending;
+    struct messi_loop_member_t *next_p;
+    struct messi_loop_member_t *deferred_next_p;
+};
+
+struct messi_loop_t {
+    int epoll_fd;
+    /* Owning member of each file descriptor, learnt from events. */
+    struct messi_fd_table_t owners;
+    struct messi_loop_member_t *members_p;
+    struct messi_loop_member_t *deferred_list_p;
+    struct epoll_event events[MESSI_LOOP_EVENTS_MAX];
+};
+
 struct messi_header_t {
     uint8_t type;
     uint8_t size[3];
 } __attribute__ ((packed));
 
+/* Header of an extended frame. The basic header has type extended
+   and size zero(0), and is followed by the type and 64 bits size of
+   the payload. */
+struct messi_extended_header_t {
+    struct messi_header_t header;
+    uint8_t type;
+    uint8_t size[8];
+} __attribute__ ((packed));
+
+/* A message received in an extended frame. Its payload is received
+   directly into storage of its own, instead of into the input
+   buffer. */
+struct messi_large_input_t {
+    uint8_t type;
+    /* NULL if no message is being received. */
+    uint8_t *buf_p;
+    size_t size;
+    /* Number of received bytes. */
+    size_t offset;
+    /* Allocated from a pool, not provided by the user. */
+    bool pooled;
+    size_t pooled_size;
+};
+
+/* Storage for large messages. The largest released buffer is kept for
+   reuse, as large messages are often of similar size. */
+struct messi_large_pool_t {
+    uint8_t *buf_p;
+    size_t size;
+};
+
+/* Header of a compressed frame. The basic header has type compressed
+   and the size of the rest of the frame, and is followed by the type,
+   codec and 32 bits uncompressed size of the payload. */
+struct messi_compressed_header_t {
+    struct messi_header_t header;
+    uint8_t type;
+    uint8_t codec;
+    uint8_t size[4];
+} __attribute__ ((packed));
+
+/* Size in bytes of each of the two rings of a shared memory
+   connection. */
+#define MESSI_SHM_RING_SIZE                      (256 * 1024)
+
+struct messi_shm_ring_t;
+
+/* One end of a shared memory connection. Frames are exchanged in a
+   pair of single producer single consumer rings in a memfd created by
+   the server and passed to the client over a unix domain socket. The
+   socket is also used to wake up an idle peer, and to detect that the
+   peer has gone. */
+struct messi_shm_t {
+    int fd;
+    struct messi_shm_ring_t *rx_p;
+    struct messi_shm_ring_t *tx_p;
+    void *map_p;
+    bool peer_closed;
+};
+
+/* A payload compression codec. */
+struct messi_codec_t {
+    /* Sent in compressed frames. */
+    uint8_t id;
+    /* Returns the compressed size, or -1 if it does not fit in given
+       destination buffer. */
+    int (*compress)(const uint8_t *src_p,
+                    size_t src_size,
+                    uint8_t *dst_p,
+                    size_t dst_size);
+    /* Returns the decompressed size, or -1 if given data is malformed
+       or does not fit in given destination buffer. */
+    int (*decompress)(const uint8_t *src_p,
+                      size_t src_size,
+                      uint8_t *dst_p,
+                      size_t dst_size);
+};
+
+/* Fast LZ4 block format codec, suitable for repetitive payloads. */
+extern const struct messi_codec_t messi_codec_lz4;
+
 static inline void messi_header_set_size(struct messi_header_t *header_p,
                                          uint32_t size)
 {
@@ -78,10 +331,396 @@ void messi_header_create(struct messi_header_t *header_p,
                          uint8_t message_type,
                          uint32_t size);
 
+/**
+ * Create the header of a frame of given type, whose payload of given
+ * size is encoded at offset sizeof(struct messi_header_t) in given
+ * buffer. The payload is moved to make room for an extended header
+ * if larger than MESSI_HEADER_SIZE_MAX bytes. Returns the frame
+ * size, or -1 if it does not fit in given buffer.
+ */
+int messi_frame_create(uint8_t *buf_p,
+                       size_t size,
+                       uint8_t message_type,
+                       size_t payload_size);
+
+/**
+ * Get the next message in given batch frame payload, which is a
+ * sequence of messages with basic headers. Given offset is advanced
+ * past the message. Returns 1 if a message was found, 0 at the end of
+ * the batch, or -1 if the batch is malformed.
+ */
+int messi_batch_next(struct messi_buffer_t *batch_p,
+                     size_t *offset_p,
+                     uint8_t *type_p,
+                     struct messi_buffer_t *payload_p);
+
+/**
+ * Write given correlation id to given buffer, which has room for
+ * MESSI_REQUEST_ID_SIZE bytes.
+ */
+void messi_request_id_write(uint8_t *buf_p, uint32_t id);
+
+/**
+ * Parse the correlation id first in given request or response frame
+ * payload. The message after it is returned in given message
+ * buffer. Returns zero(0) on success, or -1 if malformed.
+ */
+int messi_request_id_parse(struct messi_buffer_t *payload_p,
+                           uint32_t *id_p,
+                           struct messi_buffer_t *message_p);
+
 int messi_epoll_ctl_default(int epoll_fd, int op, int fd, uint32_t events);
 
 int messi_make_non_blocking(int fd);
 
+/**
+ * Initialize given empty file descriptor table.
+ */
+void messi_fd_table_init(struct messi_fd_table_t *self_p);
+
+/**
+ * Map given file descriptor to given object. Returns zero(0) if
+ * successful.
+ */
+int messi_fd_table_set(struct messi_fd_table_t *self_p, int fd, void *obj_p);
+
+/**
+ * Remove given file descriptor from given table.
+ */
+void messi_fd_table_clear(struct messi_fd_table_t *self_p, int fd);
+
+/**
+ * Returns the object given file descriptor is mapped to, or NULL if
+ * not mapped.
+ */
+static inline void *messi_fd_table_get(struct messi_fd_table_t *self_p, int fd)
+{
+    if ((fd < 0) || (fd >= self_p->size)) {
+        return (NULL);
+    }
+
+    return (self_p->objs_pp[fd]);
+}
+
+/**
+ * Free all memory allocated by given table.
+ */
+void messi_fd_table_destroy(struct messi_fd_table_t *self_p);
+
+/**
+ * Initialize given framer with given receive buffer.
+ */
+void messi_framer_init(struct messi_framer_t *self_p,
+                       uint8_t *buf_p,
+                       size_t size);
+
+/**
+ * Discard all buffered data.
+ */
+void messi_framer_reset(struct messi_framer_t *self_p);
+
+/**
+ * Returns a pointer to the free space in the buffer and its size in
+ * given size pointer. Leftover data of a partially received frame is
+ * first moved to the beginning of the buffer.
+ */
+uint8_t *messi_framer_get_free(struct messi_framer_t *self_p, size_t *size_p);
+
+/**
+ * Add given number of bytes written to the free space to the
+ * buffered data.
+ */
+void messi_framer_commit(struct messi_framer_t *self_p, size_t size);
+
+/**
+ * Get the next complete frame. The payload is valid until the next
+ * call to get free. Returns one(1) if a frame was found, zero(0) if
+ * more data is needed, or -1 if the frame does not fit in the
+ * buffer. Returns two(2) at the start of an extended frame, with its
+ * payload size and payload buffer NULL. Its payload is then taken
+ * with messi_framer_take(), and the rest of it read from the stream
+ * directly.
+ */
+int messi_framer_next(struct messi_framer_t *self_p,
+                      uint8_t *type_p,
+                      struct messi_buffer_t *payload_p);
+
+/**
+ * Move at most given number of buffered bytes to given buffer.
+ * Returns the number of moved bytes.
+ */
+size_t messi_framer_take(struct messi_framer_t *self_p,
+                         uint8_t *buf_p,
+                         size_t size);
+
+/**
+ * Initialize given empty pool.
+ */
+void messi_large_pool_init(struct messi_large_pool_t *self_p);
+
+/**
+ * Returns a buffer of at least given size, and its size in given size
+ * pointer, or NULL on failure.
+ */
+uint8_t *messi_large_pool_alloc(struct messi_large_pool_t *self_p,
+                                size_t *size_p);
+
+/**
+ * Release given buffer allocated from given pool, with the size
+ * returned by messi_large_pool_alloc().
+ */
+void messi_large_pool_free(struct messi_large_pool_t *self_p,
+                           uint8_t *buf_p,
+                           size_t size);
+
+/**
+ * Free all memory kept by given pool.
+ */
+void messi_large_pool_destroy(struct messi_large_pool_t *self_p);
+
+/**
+ * Compress the payload of given frame with a basic header with given
+ * codec, using given buffer for the compressed payload. The frame is
+ * replaced by a compressed frame if smaller. Returns the size of the
+ * resulting frame.
+ */
+size_t messi_frame_compress(uint8_t *buf_p,
+                            size_t size,
+                            const struct messi_codec_t *codec_p,
+                            uint8_t *compressed_buf_p,
+                            size_t compressed_size);
+
+/**
+ * Parse given compressed frame payload. The compressed data is
+ * returned in given data buffer. Returns zero(0) on success, or -1 if
+ * malformed.
+ */
+int messi_compressed_parse(struct messi_buffer_t *payload_p,
+                           uint8_t *type_p,
+                           uint8_t *codec_p,
+                           size_t *size_p,
+                           struct messi_buffer_t *data_p);
+
+/**
+ * Initialize given empty ring with given buffer.
+ */
+void messi_ring_init(struct messi_ring_t *self_p, uint8_t *buf_p, size_t size);
+
+/**
+ * Discard all data in given ring.
+ */
+void messi_ring_reset(struct messi_ring_t *self_p);
+
+static inline size_t messi_ring_used(struct messi_ring_t *self_p)
+{
+    return (self_p->used);
+}
+
+/**
+ * Append given data to given ring. Returns zero(0) if successful, or
+ * -1 if there is not enough free space, in which case nothing is
+ * appended.
+ */
+int messi_ring_write(struct messi_ring_t *self_p,
+                     const uint8_t *buf_p,
+                     size_t size);
+
+/**
+ * Fill given two element array with the used data. Returns the number
+ * of used elements, zero(0) to two(2).
+ */
+int messi_ring_get_iov(struct messi_ring_t *self_p, struct iovec *iov_p);
+
+/**
+ * Remove given number of bytes from the beginning of given ring.
+ */
+void messi_ring_consume(struct messi_ring_t *self_p, size_t size);
+
+/**
+ * Allocate a shared buffer with a copy of given data. The reference
+ * count is one(1). Returns NULL on failure.
+ */
+struct messi_shared_buffer_t *messi_shared_buffer_new(const uint8_t *buf_p,
+                                                      size_t size);
+
+static inline void messi_shared_buffer_ref(struct messi_shared_buffer_t *self_p)
+{
+    __atomic_add_fetch(&self_p->count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Decrement the reference count of given shared buffer and free it
+ * when it reaches zero.
+ */
+void messi_shared_buffer_unref(struct messi_shared_buffer_t *self_p);
+
+/**
+ * Initialize given empty output queue.
+ */
+void messi_output_queue_init(struct messi_output_queue_t *self_p);
+
+static inline bool messi_output_queue_is_empty(struct messi_output_queue_t *self_p)
+{
+    return (self_p->length == 0);
+}
+
+/**
+ * Returns the number of queued bytes not yet written.
+ */
+static inline size_t messi_output_queue_size(struct messi_output_queue_t *self_p)
+{
+    return (self_p->size);
+}
+
+/**
+ * Append a reference to given shared buffer, starting at given
+ * offset. Returns zero(0) if successful.
+ */
+int messi_output_queue_push(struct messi_output_queue_t *self_p,
+                            struct messi_shared_buffer_t *buffer_p,
+                            size_t offset);
+
+/**
+ * Fill given array with at most iovcnt_max elements of queued data,
+ * and the total size in given size pointer. Returns the number of
+ * used elements.
+ */
+int messi_output_queue_get_iov(struct messi_output_queue_t *self_p,
+                               struct iovec *iov_p,
+                               int iovcnt_max,
+                               size_t *size_p);
+
+/**
+ * Remove given number of written bytes from the beginning of given
+ * queue.
+ */
+void messi_output_queue_consume(struct messi_output_queue_t *self_p,
+                                size_t size);
+
+/**
+ * Remove all queued data.
+ */
+void messi_output_queue_clear(struct messi_output_queue_t *self_p);
+
+/**
+ * Remove all queued data and free the item array.
+ */
+void messi_output_queue_destroy(struct messi_output_queue_t *self_p);
+
+/**
+ * Initialize given timer wheel and create its timerfd. The owner adds
+ * the timerfd to its epoll instance and calls process when it is
+ * readable. Returns zero(0) if successful.
+ */
+int messi_timer_wheel_init(struct messi_timer_wheel_t *self_p, int tick_ms);
+
+/**
+ * Initialize given timer wheel without a timerfd. The owner calls
+ * messi_timer_wheel_advance() every tick_ms milliseconds instead.
+ */
+void messi_timer_wheel_init_external(struct messi_timer_wheel_t *self_p,
+                                     int tick_ms);
+
+/**
+ * Read the timerfd and call the timeout callback of all expired
+ * timers. Returns zero(0) if successful.
+ */
+int messi_timer_wheel_process(struct messi_timer_wheel_t *self_p);
+
+/**
+ * Advance given timer wheel given number of ticks and call the
+ * timeout callback of all expired timers. Returns zero(0) if
+ * successful.
+ */
+int messi_timer_wheel_advance(struct messi_timer_wheel_t *self_p,
+                              uint64_t ticks);
+
+/**
+ * Initialize given timer.
+ */
+void messi_timer_init(struct messi_timer_t *self_p,
+                      messi_timer_on_timeout_t on_timeout,
+                      void *obj_p);
+
+/**
+ * (Re)start given timer. It expires in at least given number of
+ * milliseconds. Returns zero(0) if successful.
+ */
+int messi_timer_start(struct messi_timer_wheel_t *wheel_p,
+                      struct messi_timer_t *self_p,
+                      int timeout_ms);
+
+/**
+ * Stop given timer. Does nothing if the timer is not running.
+ */
+void messi_timer_stop(struct messi_timer_wheel_t *wheel_p,
+                      struct messi_timer_t *self_p);
+
+static inline bool messi_timer_is_running(struct messi_timer_t *self_p)
+{
+    return (self_p->prev_next_pp != NULL);
+}
+
+/**
+ * Initialize given backoff. The delay before the first attempt is
+ * initial_ms, and is multiplied by multiplier for each following
+ * attempt, but never exceeds max_ms. With jitter the delay is instead
+ * random between zero(0) and that delay.
+ */
+void messi_backoff_init(struct messi_backoff_t *self_p,
+                        int initial_ms,
+                        int multiplier,
+                        int max_ms,
+                        bool jitter);
+
+/**
+ * Start a new attempt. Returns the delay in milliseconds before it.
+ */
+int messi_backoff_next(struct messi_backoff_t *self_p);
+
+/**
+ * Restart from the initial delay, typically once connected.
+ */
+void messi_backoff_reset(struct messi_backoff_t *self_p);
+
+/**
+ * Initialize given event loop and create its epoll instance. Give
+ * its epoll_fd to the servers and clients it hosts. Returns zero(0)
+ * if successful.
+ */
+int messi_loop_init(struct messi_loop_t *self_p);
+
+/**
+ * Host given object, typically a generated server or client, in
+ * given loop. process() is called for events on file descriptors
+ * owned by given object, and process_deferred(), if not NULL, once
+ * at the end of each batch of events in which it processed at least
+ * one event.
+ */
+void messi_loop_add(struct messi_loop_t *self_p,
+                    struct messi_loop_member_t *member_p,
+                    void *obj_p,
+                    messi_loop_process_t process,
+                    messi_loop_process_deferred_t process_deferred);
+
+/**
+ * Wait at most given number of milliseconds for events, and process
+ * all of them. Returns the number of processed events, or negative
+ * error code.
+ */
+int messi_loop_run_once(struct messi_loop_t *self_p, int timeout_ms);
+
+/**
+ * Process events forever, or until an error occurs. Returns negative
+ * error code.
+ */
+int messi_loop_run(struct messi_loop_t *self_p);
+
+/**
+ * Close the epoll instance of given loop and free its resources.
+ */
+void messi_loop_destroy(struct messi_loop_t *self_p);
+
 /**
  * Parse tcp://<host>:<port>. Returns zero(0) if successful.
  */
@@ -90,6 +729,96 @@ int messi_parse_tcp_uri(const char *uri_p,
                         size_t host_size,
                         int *port_p);
 
+/**
+ * Parse unix://<path>, or unix://@<name> for a socket in the abstract
+ * namespace, into given address and its size. Returns zero(0) if
+ * successful.
+ */
+int messi_parse_unix_uri(const char *uri_p,
+                         struct sockaddr_un *addr_p,
+                         socklen_t *size_p);
+
+static inline bool messi_is_unix_uri(const char *uri_p)
+{
+    return (strncmp(uri_p, "unix://", 7) == 0);
+}
+
+/**
+ * Parse shm://<name> or mem://<name> into the address of the unix
+ * domain socket in the abstract namespace on which shared memory
+ * connections are established. mem:// names are only visible within
+ * the calling process. Returns zero(0) if successful.
+ */
+int messi_parse_shm_uri(const char *uri_p,
+                        struct sockaddr_un *addr_p,
+                        socklen_t *size_p);
+
+static inline bool messi_is_shm_uri(const char *uri_p)
+{
+    return (strncmp(uri_p, "shm://", 6) == 0);
+}
+
+static inline bool messi_is_mem_uri(const char *uri_p)
+{
+    return (strncmp(uri_p, "mem://", 6) == 0);
+}
+
+/**
+ * Initialize given shared memory connection on given connected unix
+ * domain socket. It is opened by messi_shm_create() or
+ * messi_shm_open().
+ */
+void messi_shm_init(struct messi_shm_t *self_p, int fd);
+
+/**
+ * Create the shared memory of given connection, and pass it to the
+ * peer. Called by the server once a connection has been accepted.
+ * Returns zero(0) if successful.
+ */
+int messi_shm_create(struct messi_shm_t *self_p);
+
+/**
+ * Map the shared memory passed by the server. Called by the client
+ * once the socket is readable. Returns zero(0) if successful, or -1
+ * with errno set to EAGAIN if it has not yet been received.
+ */
+int messi_shm_open(struct messi_shm_t *self_p);
+
+static inline bool messi_shm_is_open(struct messi_shm_t *self_p)
+{
+    return (self_p->map_p != NULL);
+}
+
+/**
+ * Unmap the shared memory of given connection, if mapped. The socket
+ * is not closed.
+ */
+void messi_shm_close(struct messi_shm_t *self_p);
+
+/**
+ * Read at most given number of bytes from given connection, with the
+ * semantics of read() on a non-blocking socket. Less than given
+ * number of bytes are only returned once the peer will wake this end
+ * up when more data is written.
+ */
+ssize_t messi_shm_read(struct messi_shm_t *self_p, void *buf_p, size_t size);
+
+/**
+ * Write given data to given connection, with the semantics of write()
+ * on a non-blocking socket. The socket becomes readable when there is
+ * free space again after a partial write.
+ */
+ssize_t messi_shm_write(struct messi_shm_t *self_p,
+                        const void *buf_p,
+                        size_t size);
+
+/**
+ * Like messi_shm_write(), but gathers the data from given buffers.
+ */
+ssize_t messi_shm_writev(struct messi_shm_t *self_p,
+                         const struct iovec *iov_p,
+                         int iovcnt);
+
 /**
  * Get the string for given disconnect reason.
  */
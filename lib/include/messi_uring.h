@@ -0,0 +1,168 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#ifndef MESSI_URING_H
+#define MESSI_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/* A minimal io_uring instance, without any dependency on liburing. */
+struct messi_uring_t {
+    int fd;
+    struct {
+        unsigned *head_p;
+        unsigned *tail_p;
+        unsigned *flags_p;
+        unsigned mask;
+        unsigned entries;
+        struct io_uring_sqe *sqes_p;
+        /* Next entry to fill in. */
+        unsigned tail;
+        /* Number of filled in entries not yet submitted. */
+        unsigned pending;
+    } sq;
+    struct {
+        unsigned *head_p;
+        unsigned *tail_p;
+        unsigned mask;
+        struct io_uring_cqe *cqes_p;
+    } cq;
+    struct {
+        void *sq_ring_p;
+        size_t sq_ring_size;
+        void *cq_ring_p;
+        size_t cq_ring_size;
+        size_t sqes_size;
+    } mmap;
+};
+
+/* A ring of buffers provided to the kernel. Receive operations pick a
+   buffer from the ring when data arrives, so no buffer is tied up in
+   idle connections. */
+struct messi_uring_buf_ring_t {
+    struct io_uring_buf_ring *ring_p;
+    size_t ring_size;
+    uint8_t *bufs_p;
+    size_t buf_size;
+    unsigned entries;
+    uint16_t bgid;
+    uint16_t tail;
+};
+
+/**
+ * Create an io_uring instance with at least given number of
+ * submission and completion queue entries. Returns zero(0) if
+ * successful.
+ */
+int messi_uring_init(struct messi_uring_t *self_p,
+                     unsigned sq_entries,
+                     unsigned cq_entries);
+
+/**
+ * Destroy given io_uring instance. All operations in progress are
+ * cancelled.
+ */
+void messi_uring_destroy(struct messi_uring_t *self_p);
+
+/**
+ * Returns a cleared submission queue entry, or NULL on failure. The
+ * queue is submitted first if full, and NULL is returned if the
+ * kernel still has not consumed any entry.
+ */
+struct io_uring_sqe *messi_uring_get_sqe(struct messi_uring_t *self_p);
+
+/**
+ * Submit all filled in entries to the kernel. Completions that did
+ * not fit in the completion queue are moved to it as space is
+ * made. Returns zero(0) if successful.
+ */
+int messi_uring_submit(struct messi_uring_t *self_p);
+
+/**
+ * Returns the next completion queue entry, or NULL if there is none.
+ */
+static inline struct io_uring_cqe *messi_uring_peek_cqe(
+    struct messi_uring_t *self_p)
+{
+    unsigned head;
+
+    head = *self_p->cq.head_p;
+
+    if (head == __atomic_load_n(self_p->cq.tail_p, __ATOMIC_ACQUIRE)) {
+        return (NULL);
+    }
+
+    return (&self_p->cq.cqes_p[head & self_p->cq.mask]);
+}
+
+/**
+ * Mark the entry returned by messi_uring_peek_cqe() as handled.
+ */
+static inline void messi_uring_cqe_seen(struct messi_uring_t *self_p)
+{
+    __atomic_store_n(self_p->cq.head_p,
+                     *self_p->cq.head_p + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/**
+ * Create given number of buffers of given size and provide them to
+ * given io_uring instance in buffer group bgid. The number of
+ * buffers must be a power of two. Returns zero(0) if successful.
+ */
+int messi_uring_buf_ring_init(struct messi_uring_buf_ring_t *self_p,
+                              struct messi_uring_t *uring_p,
+                              uint16_t bgid,
+                              unsigned entries,
+                              size_t buf_size);
+
+/**
+ * Returns the buffer with given id.
+ */
+static inline uint8_t *messi_uring_buf_ring_get(
+    struct messi_uring_buf_ring_t *self_p,
+    uint16_t bid)
+{
+    return (&self_p->bufs_p[bid * self_p->buf_size]);
+}
+
+/**
+ * Give given buffer back to the kernel once its data has been used.
+ */
+void messi_uring_buf_ring_recycle(struct messi_uring_buf_ring_t *self_p,
+                                  uint16_t bid);
+
+/**
+ * Remove given buffers from given io_uring instance and free them.
+ */
+void messi_uring_buf_ring_destroy(struct messi_uring_buf_ring_t *self_p,
+                                  struct messi_uring_t *uring_p);
+
+#endif
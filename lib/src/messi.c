@@ -26,33 +26,1332 @@
 
 /* This file was generated by Messi. */
 
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
 #include "messi.h"
 
+/* Maximum number of ticks a timer can be started for. */
+#define TIMER_WHEEL_TICKS_MAX                                   \
+    (MESSI_TIMER_WHEEL_LEVEL_0_SLOTS * (MESSI_TIMER_WHEEL_LEVEL_1_SLOTS - 1))
+
 void messi_header_create(struct messi_header_t *header_p,
                          uint8_t message_type,
                          uint32_t size)
 {
-    header_p->type = message_type;
-    messi_header_set_size(header_p, size);
+    header_p->type = message_type;
+    messi_header_set_size(header_p, size);
+}
+
+int messi_frame_create(uint8_t *buf_p,
+                       size_t size,
+                       uint8_t message_type,
+                       size_t payload_size)
+{
+    struct messi_extended_header_t *header_p;
+    int i;
+
+    if (payload_size <= MESSI_HEADER_SIZE_MAX) {
+        messi_header_create((struct messi_header_t *)buf_p,
+                            message_type,
+                            payload_size);
+
+        return (payload_size + sizeof(struct messi_header_t));
+    }
+
+    if ((payload_size + sizeof(*header_p)) > size) {
+        return (-1);
+    }
+
+    memmove(&buf_p[sizeof(*header_p)],
+            &buf_p[sizeof(struct messi_header_t)],
+            payload_size);
+    header_p = (struct messi_extended_header_t *)buf_p;
+    messi_header_create(&header_p->header, MESSI_MESSAGE_TYPE_EXTENDED, 0);
+    header_p->type = message_type;
+
+    for (i = 0; i < 8; i++) {
+        header_p->size[i] = ((uint64_t)payload_size >> (56 - 8 * i));
+    }
+
+    return (payload_size + sizeof(*header_p));
+}
+
+int messi_batch_next(struct messi_buffer_t *batch_p,
+                     size_t *offset_p,
+                     uint8_t *type_p,
+                     struct messi_buffer_t *payload_p)
+{
+    struct messi_header_t *header_p;
+    size_t left;
+
+    left = (batch_p->size - *offset_p);
+
+    if (left == 0) {
+        return (0);
+    }
+
+    if (left < sizeof(*header_p)) {
+        return (-1);
+    }
+
+    header_p = (struct messi_header_t *)&batch_p->buf_p[*offset_p];
+    payload_p->size = messi_header_get_size(header_p);
+
+    if (payload_p->size > (left - sizeof(*header_p))) {
+        return (-1);
+    }
+
+    *type_p = header_p->type;
+    payload_p->buf_p = (uint8_t *)&header_p[1];
+    *offset_p += (sizeof(*header_p) + payload_p->size);
+
+    return (1);
+}
+
+int messi_epoll_ctl_default(int epoll_fd, int op, int fd, uint32_t events)
+{
+    struct epoll_event event;
+
+    event.data.fd = fd;
+    event.events = events;
+
+    return (epoll_ctl(epoll_fd, op, fd, &event));
+}
+
+int messi_make_non_blocking(int fd)
+{
+    return (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK));
+}
+
+static int timer_wheel_set_period(struct messi_timer_wheel_t *self_p,
+                                  int period_ms)
+{
+    struct itimerspec timeout;
+
+    /* Ticked by the owner. */
+    if (self_p->fd == -1) {
+        return (0);
+    }
+
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.it_value.tv_sec = (period_ms / 1000);
+    timeout.it_value.tv_nsec = (1000000L * (period_ms % 1000));
+    timeout.it_interval = timeout.it_value;
+
+    return (timerfd_settime(self_p->fd, 0, &timeout, NULL));
+}
+
+static void timer_wheel_insert(struct messi_timer_wheel_t *self_p,
+                               struct messi_timer_t *timer_p)
+{
+    struct messi_timer_t **slot_pp;
+
+    if ((timer_p->expiry - self_p->tick) < MESSI_TIMER_WHEEL_LEVEL_0_SLOTS) {
+        slot_pp = &self_p->level_0[timer_p->expiry
+                                   % MESSI_TIMER_WHEEL_LEVEL_0_SLOTS];
+    } else {
+        slot_pp = &self_p->level_1[(timer_p->expiry
+                                    / MESSI_TIMER_WHEEL_LEVEL_0_SLOTS)
+                                   % MESSI_TIMER_WHEEL_LEVEL_1_SLOTS];
+    }
+
+    timer_p->next_p = *slot_pp;
+
+    if (timer_p->next_p != NULL) {
+        timer_p->next_p->prev_next_pp = &timer_p->next_p;
+    }
+
+    timer_p->prev_next_pp = slot_pp;
+    *slot_pp = timer_p;
+}
+
+static void timer_wheel_remove(struct messi_timer_t *timer_p)
+{
+    *timer_p->prev_next_pp = timer_p->next_p;
+
+    if (timer_p->next_p != NULL) {
+        timer_p->next_p->prev_next_pp = timer_p->prev_next_pp;
+    }
+
+    timer_p->prev_next_pp = NULL;
+}
+
+static void timer_wheel_cascade(struct messi_timer_wheel_t *self_p)
+{
+    struct messi_timer_t **slot_pp;
+    struct messi_timer_t *timer_p;
+
+    slot_pp = &self_p->level_1[(self_p->tick / MESSI_TIMER_WHEEL_LEVEL_0_SLOTS)
+                               % MESSI_TIMER_WHEEL_LEVEL_1_SLOTS];
+
+    while (*slot_pp != NULL) {
+        timer_p = *slot_pp;
+        timer_wheel_remove(timer_p);
+        timer_wheel_insert(self_p, timer_p);
+    }
+}
+
+static void timer_wheel_tick(struct messi_timer_wheel_t *self_p)
+{
+    struct messi_timer_t **slot_pp;
+    struct messi_timer_t *timer_p;
+
+    self_p->tick++;
+
+    if ((self_p->tick % MESSI_TIMER_WHEEL_LEVEL_0_SLOTS) == 0) {
+        timer_wheel_cascade(self_p);
+    }
+
+    slot_pp = &self_p->level_0[self_p->tick % MESSI_TIMER_WHEEL_LEVEL_0_SLOTS];
+
+    /* The callback may start and stop any timer, so always take the
+       first one in the slot. */
+    while (*slot_pp != NULL) {
+        timer_p = *slot_pp;
+        timer_wheel_remove(timer_p);
+        self_p->number_of_running_timers--;
+        timer_p->on_timeout(timer_p->obj_p);
+    }
+}
+
+int messi_timer_wheel_init(struct messi_timer_wheel_t *self_p, int tick_ms)
+{
+    memset(self_p, 0, sizeof(*self_p));
+    self_p->tick_ms = tick_ms;
+    self_p->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+
+    return (self_p->fd == -1 ? -1 : 0);
+}
+
+void messi_timer_wheel_init_external(struct messi_timer_wheel_t *self_p,
+                                     int tick_ms)
+{
+    memset(self_p, 0, sizeof(*self_p));
+    self_p->tick_ms = tick_ms;
+    self_p->fd = -1;
+}
+
+int messi_timer_wheel_process(struct messi_timer_wheel_t *self_p)
+{
+    ssize_t size;
+    uint64_t ticks;
+
+    size = read(self_p->fd, &ticks, sizeof(ticks));
+
+    if (size != sizeof(ticks)) {
+        return (-1);
+    }
+
+    return (messi_timer_wheel_advance(self_p, ticks));
+}
+
+int messi_timer_wheel_advance(struct messi_timer_wheel_t *self_p,
+                              uint64_t ticks)
+{
+    while ((ticks > 0) && (self_p->number_of_running_timers > 0)) {
+        timer_wheel_tick(self_p);
+        ticks--;
+    }
+
+    /* Advance the time even if there are no timers. */
+    self_p->tick += ticks;
+
+    if ((self_p->number_of_running_timers == 0) && self_p->is_armed) {
+        self_p->is_armed = false;
+
+        return (timer_wheel_set_period(self_p, 0));
+    }
+
+    return (0);
+}
+
+void messi_timer_init(struct messi_timer_t *self_p,
+                      messi_timer_on_timeout_t on_timeout,
+                      void *obj_p)
+{
+    self_p->on_timeout = on_timeout;
+    self_p->obj_p = obj_p;
+    self_p->next_p = NULL;
+    self_p->prev_next_pp = NULL;
+}
+
+int messi_timer_start(struct messi_timer_wheel_t *wheel_p,
+                      struct messi_timer_t *self_p,
+                      int timeout_ms)
+{
+    uint64_t ticks;
+
+    messi_timer_stop(wheel_p, self_p);
+    ticks = ((timeout_ms + wheel_p->tick_ms - 1) / wheel_p->tick_ms);
+
+    if (wheel_p->is_armed) {
+        /* The current tick has already started. */
+        ticks++;
+    } else {
+        if (timer_wheel_set_period(wheel_p, wheel_p->tick_ms) != 0) {
+            return (-1);
+        }
+
+        wheel_p->is_armed = true;
+    }
+
+    if (ticks == 0) {
+        ticks = 1;
+    } else if (ticks > TIMER_WHEEL_TICKS_MAX) {
+        ticks = TIMER_WHEEL_TICKS_MAX;
+    }
+
+    self_p->expiry = (wheel_p->tick + ticks);
+    timer_wheel_insert(wheel_p, self_p);
+    wheel_p->number_of_running_timers++;
+
+    return (0);
+}
+
+void messi_timer_stop(struct messi_timer_wheel_t *wheel_p,
+                      struct messi_timer_t *self_p)
+{
+    if (messi_timer_is_running(self_p)) {
+        timer_wheel_remove(self_p);
+        wheel_p->number_of_running_timers--;
+    }
+}
+
+/* Xorshift pseudo random number generator. Good enough for jitter. */
+static uint32_t backoff_random(struct messi_backoff_t *self_p)
+{
+    uint32_t x;
+
+    x = self_p->seed;
+    x ^= (x << 13);
+    x ^= (x >> 17);
+    x ^= (x << 5);
+    self_p->seed = x;
+
+    return (x);
+}
+
+void messi_backoff_init(struct messi_backoff_t *self_p,
+                        int initial_ms,
+                        int multiplier,
+                        int max_ms,
+                        bool jitter)
+{
+    struct timespec now;
+
+    if (max_ms < initial_ms) {
+        max_ms = initial_ms;
+    }
+
+    if (multiplier < 1) {
+        multiplier = 1;
+    }
+
+    self_p->initial_ms = initial_ms;
+    self_p->multiplier = multiplier;
+    self_p->max_ms = max_ms;
+    self_p->jitter = jitter;
+    self_p->delay_ms = 0;
+    self_p->attempt = 0;
+
+    /* Different in all clients, even if started at the same time. */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    self_p->seed = ((uint32_t)now.tv_nsec
+                    ^ ((uint32_t)getpid() << 16)
+                    ^ (uint32_t)(uintptr_t)self_p);
+
+    if (self_p->seed == 0) {
+        self_p->seed = 1;
+    }
+}
+
+int messi_backoff_next(struct messi_backoff_t *self_p)
+{
+    if (self_p->attempt == 0) {
+        self_p->delay_ms = self_p->initial_ms;
+    } else if (self_p->delay_ms <= (self_p->max_ms / self_p->multiplier)) {
+        self_p->delay_ms *= self_p->multiplier;
+    } else {
+        self_p->delay_ms = self_p->max_ms;
+    }
+
+    self_p->attempt++;
+
+    if (!self_p->jitter) {
+        return (self_p->delay_ms);
+    }
+
+    return ((int)(backoff_random(self_p) % ((uint32_t)self_p->delay_ms + 1)));
+}
+
+void messi_backoff_reset(struct messi_backoff_t *self_p)
+{
+    self_p->attempt = 0;
+}
+
+void messi_framer_init(struct messi_framer_t *self_p,
+                       uint8_t *buf_p,
+                       size_t size)
+{
+    self_p->data.buf_p = buf_p;
+    self_p->data.size = size;
+    messi_framer_reset(self_p);
+}
+
+void messi_framer_reset(struct messi_framer_t *self_p)
+{
+    self_p->size = 0;
+    self_p->offset = 0;
+}
+
+uint8_t *messi_framer_get_free(struct messi_framer_t *self_p, size_t *size_p)
+{
+    if (self_p->offset > 0) {
+        self_p->size -= self_p->offset;
+        memmove(&self_p->data.buf_p[0],
+                &self_p->data.buf_p[self_p->offset],
+                self_p->size);
+        self_p->offset = 0;
+    }
+
+    *size_p = (self_p->data.size - self_p->size);
+
+    return (&self_p->data.buf_p[self_p->size]);
+}
+
+void messi_framer_commit(struct messi_framer_t *self_p, size_t size)
+{
+    self_p->size += size;
+}
+
+static int framer_next_extended(struct messi_framer_t *self_p,
+                                size_t size,
+                                uint8_t *type_p,
+                                struct messi_buffer_t *payload_p)
+{
+    struct messi_extended_header_t *header_p;
+    uint64_t payload_size;
+    int i;
+
+    if (size < sizeof(*header_p)) {
+        return (0);
+    }
+
+    header_p = (struct messi_extended_header_t *)&self_p->data.buf_p[
+        self_p->offset];
+    payload_size = 0;
+
+    for (i = 0; i < 8; i++) {
+        payload_size <<= 8;
+        payload_size |= header_p->size[i];
+    }
+
+    if (payload_size > SIZE_MAX) {
+        return (-1);
+    }
+
+    *type_p = header_p->type;
+    payload_p->buf_p = NULL;
+    payload_p->size = payload_size;
+    self_p->offset += sizeof(*header_p);
+
+    return (2);
+}
+
+int messi_framer_next(struct messi_framer_t *self_p,
+                      uint8_t *type_p,
+                      struct messi_buffer_t *payload_p)
+{
+    struct messi_header_t *header_p;
+    size_t size;
+    size_t frame_size;
+
+    size = (self_p->size - self_p->offset);
+
+    if (size < sizeof(*header_p)) {
+        return (0);
+    }
+
+    header_p = (struct messi_header_t *)&self_p->data.buf_p[self_p->offset];
+
+    if (header_p->type == MESSI_MESSAGE_TYPE_EXTENDED) {
+        return (framer_next_extended(self_p, size, type_p, payload_p));
+    }
+
+    frame_size = (sizeof(*header_p) + messi_header_get_size(header_p));
+
+    if (frame_size > self_p->data.size) {
+        return (-1);
+    }
+
+    if (size < frame_size) {
+        return (0);
+    }
+
+    *type_p = header_p->type;
+    payload_p->buf_p = &self_p->data.buf_p[self_p->offset + sizeof(*header_p)];
+    payload_p->size = (frame_size - sizeof(*header_p));
+    self_p->offset += frame_size;
+
+    return (1);
+}
+
+size_t messi_framer_take(struct messi_framer_t *self_p,
+                         uint8_t *buf_p,
+                         size_t size)
+{
+    size_t buffered;
+
+    buffered = (self_p->size - self_p->offset);
+
+    if (size > buffered) {
+        size = buffered;
+    }
+
+    memcpy(buf_p, &self_p->data.buf_p[self_p->offset], size);
+    self_p->offset += size;
+
+    return (size);
+}
+
+void messi_large_pool_init(struct messi_large_pool_t *self_p)
+{
+    self_p->buf_p = NULL;
+    self_p->size = 0;
+}
+
+uint8_t *messi_large_pool_alloc(struct messi_large_pool_t *self_p,
+                                size_t *size_p)
+{
+    uint8_t *buf_p;
+
+    if ((self_p->buf_p != NULL) && (self_p->size >= *size_p)) {
+        buf_p = self_p->buf_p;
+        *size_p = self_p->size;
+        self_p->buf_p = NULL;
+
+        return (buf_p);
+    }
+
+    if (*size_p == 0) {
+        *size_p = 1;
+    }
+
+    return (malloc(*size_p));
+}
+
+void messi_large_pool_free(struct messi_large_pool_t *self_p,
+                           uint8_t *buf_p,
+                           size_t size)
+{
+    if (self_p->buf_p == NULL) {
+        self_p->buf_p = buf_p;
+        self_p->size = size;
+    } else if (size > self_p->size) {
+        free(self_p->buf_p);
+        self_p->buf_p = buf_p;
+        self_p->size = size;
+    } else {
+        free(buf_p);
+    }
+}
+
+void messi_large_pool_destroy(struct messi_large_pool_t *self_p)
+{
+    free(self_p->buf_p);
+    messi_large_pool_init(self_p);
+}
+
+/* LZ4 block format parameters. */
+#define LZ4_HASH_LOG                                            12
+#define LZ4_MIN_MATCH                                           4
+#define LZ4_LAST_LITERALS                                       5
+#define LZ4_MF_LIMIT                                            12
+#define LZ4_DISTANCE_MAX                                        65535
+
+static uint32_t lz4_read32(const uint8_t *buf_p)
+{
+    uint32_t value;
+
+    memcpy(&value, buf_p, sizeof(value));
+
+    return (value);
+}
+
+static uint32_t lz4_hash(const uint8_t *buf_p)
+{
+    return ((lz4_read32(buf_p) * 2654435761U) >> (32 - LZ4_HASH_LOG));
+}
+
+static uint8_t *lz4_write_length(uint8_t *dst_p, size_t length)
+{
+    while (length >= 255) {
+        *dst_p++ = 255;
+        length -= 255;
+    }
+
+    *dst_p++ = length;
+
+    return (dst_p);
+}
+
+/* Write a sequence of given literals and match, if any. Returns NULL
+   if it does not fit. */
+static uint8_t *lz4_write_sequence(uint8_t *dst_p,
+                                   uint8_t *dst_end_p,
+                                   const uint8_t *literals_p,
+                                   size_t literals_size,
+                                   size_t offset,
+                                   size_t match_size)
+{
+    uint8_t *token_p;
+
+    if ((size_t)(dst_end_p - dst_p) < (literals_size
+                                       + literals_size / 255
+                                       + match_size / 255
+                                       + 5)) {
+        return (NULL);
+    }
+
+    token_p = dst_p++;
+
+    if (literals_size >= 15) {
+        *token_p = (15 << 4);
+        dst_p = lz4_write_length(dst_p, literals_size - 15);
+    } else {
+        *token_p = (literals_size << 4);
+    }
+
+    memcpy(dst_p, literals_p, literals_size);
+    dst_p += literals_size;
+
+    if (offset == 0) {
+        return (dst_p);
+    }
+
+    *dst_p++ = offset;
+    *dst_p++ = (offset >> 8);
+    match_size -= LZ4_MIN_MATCH;
+
+    if (match_size >= 15) {
+        *token_p |= 15;
+        dst_p = lz4_write_length(dst_p, match_size - 15);
+    } else {
+        *token_p |= match_size;
+    }
+
+    return (dst_p);
+}
+
+static int lz4_compress(const uint8_t *src_p,
+                        size_t src_size,
+                        uint8_t *dst_p,
+                        size_t dst_size)
+{
+    uint32_t table[1 << LZ4_HASH_LOG];
+    const uint8_t *ip;
+    const uint8_t *anchor_p;
+    const uint8_t *ref_p;
+    const uint8_t *src_end_p;
+    uint8_t *op;
+    uint8_t *dst_end_p;
+    size_t match_size;
+    uint32_t hash;
+
+    ip = src_p;
+    anchor_p = src_p;
+    src_end_p = &src_p[src_size];
+    op = dst_p;
+    dst_end_p = &dst_p[dst_size];
+    memset(&table[0], 0, sizeof(table));
+
+    if (src_size >= LZ4_MF_LIMIT) {
+        ip++;
+
+        while (ip <= (src_end_p - LZ4_MF_LIMIT)) {
+            hash = lz4_hash(ip);
+            ref_p = &src_p[table[hash]];
+            table[hash] = (ip - src_p);
+
+            if ((ref_p >= ip)
+                || ((ip - ref_p) > LZ4_DISTANCE_MAX)
+                || (lz4_read32(ref_p) != lz4_read32(ip))) {
+                ip++;
+                continue;
+            }
+
+            match_size = LZ4_MIN_MATCH;
+
+            while ((&ip[match_size] < (src_end_p - LZ4_LAST_LITERALS))
+                   && (ref_p[match_size] == ip[match_size])) {
+                match_size++;
+            }
+
+            while ((ip > anchor_p) && (ref_p > src_p) && (ip[-1] == ref_p[-1])) {
+                ip--;
+                ref_p--;
+                match_size++;
+            }
+
+            op = lz4_write_sequence(op,
+                                    dst_end_p,
+                                    anchor_p,
+                                    ip - anchor_p,
+                                    ip - ref_p,
+                                    match_size);
+
+            if (op == NULL) {
+                return (-1);
+            }
+
+            ip += match_size;
+            anchor_p = ip;
+        }
+    }
+
+    /* The last literals. */
+    op = lz4_write_sequence(op,
+                            dst_end_p,
+                            anchor_p,
+                            src_end_p - anchor_p,
+                            0,
+                            0);
+
+    if (op == NULL) {
+        return (-1);
+    }
+
+    return (op - dst_p);
+}
+
+/* Read a length extension. Returns -1 if malformed. */
+static int lz4_read_length(const uint8_t **ip_p,
+                           const uint8_t *src_end_p,
+                           size_t *length_p)
+{
+    uint8_t value;
+
+    do {
+        if (*ip_p >= src_end_p) {
+            return (-1);
+        }
+
+        value = *(*ip_p)++;
+        *length_p += value;
+    } while (value == 255);
+
+    return (0);
+}
+
+static int lz4_decompress(const uint8_t *src_p,
+                          size_t src_size,
+                          uint8_t *dst_p,
+                          size_t dst_size)
+{
+    const uint8_t *ip;
+    const uint8_t *src_end_p;
+    uint8_t *op;
+    uint8_t *dst_end_p;
+    uint8_t token;
+    size_t size;
+    size_t offset;
+
+    ip = src_p;
+    src_end_p = &src_p[src_size];
+    op = dst_p;
+    dst_end_p = &dst_p[dst_size];
+
+    while (ip < src_end_p) {
+        token = *ip++;
+        size = (token >> 4);
+
+        if (size == 15) {
+            if (lz4_read_length(&ip, src_end_p, &size) != 0) {
+                return (-1);
+            }
+        }
+
+        if ((size > (size_t)(src_end_p - ip))
+            || (size > (size_t)(dst_end_p - op))) {
+            return (-1);
+        }
+
+        memcpy(op, ip, size);
+        op += size;
+        ip += size;
+
+        /* The last sequence has no match. */
+        if (ip == src_end_p) {
+            break;
+        }
+
+        if ((src_end_p - ip) < 2) {
+            return (-1);
+        }
+
+        offset = (ip[0] | (ip[1] << 8));
+        ip += 2;
+
+        if ((offset == 0) || (offset > (size_t)(op - dst_p))) {
+            return (-1);
+        }
+
+        size = (token & 15);
+
+        if (size == 15) {
+            if (lz4_read_length(&ip, src_end_p, &size) != 0) {
+                return (-1);
+            }
+        }
+
+        size += LZ4_MIN_MATCH;
+
+        if (size > (size_t)(dst_end_p - op)) {
+            return (-1);
+        }
+
+        /* Byte by byte as the match may overlap the output. */
+        while (size > 0) {
+            *op = op[-offset];
+            op++;
+            size--;
+        }
+    }
+
+    return (op - dst_p);
+}
+
+const struct messi_codec_t messi_codec_lz4 = {
+    .id = MESSI_CODEC_LZ4,
+    .compress = lz4_compress,
+    .decompress = lz4_decompress
+};
+
+size_t messi_frame_compress(uint8_t *buf_p,
+                            size_t size,
+                            const struct messi_codec_t *codec_p,
+                            uint8_t *compressed_buf_p,
+                            size_t compressed_size)
+{
+    struct messi_compressed_header_t *header_p;
+    size_t payload_size;
+    int res;
+
+    payload_size = (size - sizeof(struct messi_header_t));
+
+    /* Only worth sending if smaller. */
+    if (payload_size <= (sizeof(*header_p) - sizeof(struct messi_header_t))) {
+        return (size);
+    }
+
+    if (compressed_size > (size - sizeof(*header_p) - 1)) {
+        compressed_size = (size - sizeof(*header_p) - 1);
+    }
+
+    res = codec_p->compress(&buf_p[sizeof(struct messi_header_t)],
+                            payload_size,
+                            compressed_buf_p,
+                            compressed_size);
+
+    if (res < 0) {
+        return (size);
+    }
+
+    header_p = (struct messi_compressed_header_t *)buf_p;
+    header_p->type = header_p->header.type;
+    header_p->codec = codec_p->id;
+    header_p->size[0] = (payload_size >> 24);
+    header_p->size[1] = (payload_size >> 16);
+    header_p->size[2] = (payload_size >> 8);
+    header_p->size[3] = (payload_size >> 0);
+    messi_header_create(&header_p->header,
+                        MESSI_MESSAGE_TYPE_COMPRESSED,
+                        res + sizeof(*header_p) - sizeof(struct messi_header_t));
+    memcpy(&header_p[1], compressed_buf_p, res);
+
+    return (res + sizeof(*header_p));
+}
+
+void messi_request_id_write(uint8_t *buf_p, uint32_t id)
+{
+    buf_p[0] = (id >> 24);
+    buf_p[1] = (id >> 16);
+    buf_p[2] = (id >> 8);
+    buf_p[3] = (id >> 0);
+}
+
+int messi_request_id_parse(struct messi_buffer_t *payload_p,
+                           uint32_t *id_p,
+                           struct messi_buffer_t *message_p)
+{
+    uint8_t *buf_p;
+
+    if (payload_p->size < MESSI_REQUEST_ID_SIZE) {
+        return (-1);
+    }
+
+    buf_p = payload_p->buf_p;
+    *id_p = (((uint32_t)buf_p[0] << 24)
+             | ((uint32_t)buf_p[1] << 16)
+             | ((uint32_t)buf_p[2] << 8)
+             | ((uint32_t)buf_p[3] << 0));
+    message_p->buf_p = &buf_p[MESSI_REQUEST_ID_SIZE];
+    message_p->size = (payload_p->size - MESSI_REQUEST_ID_SIZE);
+
+    return (0);
+}
+
+int messi_compressed_parse(struct messi_buffer_t *payload_p,
+                           uint8_t *type_p,
+                           uint8_t *codec_p,
+                           size_t *size_p,
+                           struct messi_buffer_t *data_p)
+{
+    uint8_t *buf_p;
+    size_t size;
+
+    size = (sizeof(struct messi_compressed_header_t)
+            - sizeof(struct messi_header_t));
+
+    if (payload_p->size < size) {
+        return (-1);
+    }
+
+    buf_p = payload_p->buf_p;
+    *type_p = buf_p[0];
+    *codec_p = buf_p[1];
+    *size_p = (((size_t)buf_p[2] << 24)
+               | ((size_t)buf_p[3] << 16)
+               | ((size_t)buf_p[4] << 8)
+               | ((size_t)buf_p[5] << 0));
+    data_p->buf_p = &buf_p[size];
+    data_p->size = (payload_p->size - size);
+
+    return (0);
+}
+
+void messi_ring_init(struct messi_ring_t *self_p, uint8_t *buf_p, size_t size)
+{
+    self_p->data.buf_p = buf_p;
+    self_p->data.size = size;
+    messi_ring_reset(self_p);
+}
+
+void messi_ring_reset(struct messi_ring_t *self_p)
+{
+    self_p->head = 0;
+    self_p->used = 0;
+}
+
+int messi_ring_write(struct messi_ring_t *self_p,
+                     const uint8_t *buf_p,
+                     size_t size)
+{
+    size_t tail;
+    size_t size_to_end;
+
+    if (size > (self_p->data.size - self_p->used)) {
+        return (-1);
+    }
+
+    tail = (self_p->head + self_p->used);
+
+    if (tail >= self_p->data.size) {
+        tail -= self_p->data.size;
+    }
+
+    size_to_end = (self_p->data.size - tail);
+
+    if (size <= size_to_end) {
+        memcpy(&self_p->data.buf_p[tail], buf_p, size);
+    } else {
+        memcpy(&self_p->data.buf_p[tail], buf_p, size_to_end);
+        memcpy(&self_p->data.buf_p[0], &buf_p[size_to_end], size - size_to_end);
+    }
+
+    self_p->used += size;
+
+    return (0);
+}
+
+int messi_ring_get_iov(struct messi_ring_t *self_p, struct iovec *iov_p)
+{
+    size_t size_to_end;
+
+    if (self_p->used == 0) {
+        return (0);
+    }
+
+    size_to_end = (self_p->data.size - self_p->head);
+    iov_p[0].iov_base = &self_p->data.buf_p[self_p->head];
+
+    if (self_p->used <= size_to_end) {
+        iov_p[0].iov_len = self_p->used;
+
+        return (1);
+    }
+
+    iov_p[0].iov_len = size_to_end;
+    iov_p[1].iov_base = &self_p->data.buf_p[0];
+    iov_p[1].iov_len = (self_p->used - size_to_end);
+
+    return (2);
+}
+
+void messi_ring_consume(struct messi_ring_t *self_p, size_t size)
+{
+    self_p->used -= size;
+
+    if (self_p->used == 0) {
+        /* Start over to keep the data contiguous. */
+        self_p->head = 0;
+    } else {
+        self_p->head += size;
+
+        if (self_p->head >= self_p->data.size) {
+            self_p->head -= self_p->data.size;
+        }
+    }
+}
+
+struct messi_shared_buffer_t *messi_shared_buffer_new(const uint8_t *buf_p,
+                                                      size_t size)
+{
+    struct messi_shared_buffer_t *self_p;
+
+    self_p = malloc(sizeof(*self_p) + size - 1);
+
+    if (self_p == NULL) {
+        return (NULL);
+    }
+
+    self_p->count = 1;
+    self_p->size = size;
+    memcpy(&self_p->data[0], buf_p, size);
+
+    return (self_p);
+}
+
+void messi_shared_buffer_unref(struct messi_shared_buffer_t *self_p)
+{
+    if (__atomic_sub_fetch(&self_p->count, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(self_p);
+    }
+}
+
+void messi_output_queue_init(struct messi_output_queue_t *self_p)
+{
+    self_p->items_p = NULL;
+    self_p->max = 0;
+    self_p->head = 0;
+    self_p->length = 0;
+    self_p->size = 0;
+}
+
+static int output_queue_grow(struct messi_output_queue_t *self_p)
+{
+    struct messi_output_queue_item_t *items_p;
+    size_t max;
+    size_t i;
+
+    max = (self_p->max > 0 ? 2 * self_p->max : 16);
+    items_p = malloc(max * sizeof(*items_p));
+
+    if (items_p == NULL) {
+        return (-1);
+    }
+
+    for (i = 0; i < self_p->length; i++) {
+        items_p[i] = self_p->items_p[(self_p->head + i) % self_p->max];
+    }
+
+    free(self_p->items_p);
+    self_p->items_p = items_p;
+    self_p->max = max;
+    self_p->head = 0;
+
+    return (0);
+}
+
+int messi_output_queue_push(struct messi_output_queue_t *self_p,
+                            struct messi_shared_buffer_t *buffer_p,
+                            size_t offset)
+{
+    struct messi_output_queue_item_t *item_p;
+
+    if (self_p->length == self_p->max) {
+        if (output_queue_grow(self_p) != 0) {
+            return (-1);
+        }
+    }
+
+    item_p = &self_p->items_p[(self_p->head + self_p->length) % self_p->max];
+    item_p->buffer_p = buffer_p;
+    item_p->offset = offset;
+    messi_shared_buffer_ref(buffer_p);
+    self_p->length++;
+    self_p->size += (buffer_p->size - offset);
+
+    return (0);
+}
+
+int messi_output_queue_get_iov(struct messi_output_queue_t *self_p,
+                               struct iovec *iov_p,
+                               int iovcnt_max,
+                               size_t *size_p)
+{
+    struct messi_output_queue_item_t *item_p;
+    int iovcnt;
+
+    *size_p = 0;
+
+    for (iovcnt = 0; (size_t)iovcnt < self_p->length; iovcnt++) {
+        if (iovcnt == iovcnt_max) {
+            break;
+        }
+
+        item_p = &self_p->items_p[(self_p->head + iovcnt) % self_p->max];
+        iov_p[iovcnt].iov_base = &item_p->buffer_p->data[item_p->offset];
+        iov_p[iovcnt].iov_len = (item_p->buffer_p->size - item_p->offset);
+        *size_p += iov_p[iovcnt].iov_len;
+    }
+
+    return (iovcnt);
+}
+
+static void output_queue_pop(struct messi_output_queue_t *self_p)
+{
+    messi_shared_buffer_unref(self_p->items_p[self_p->head].buffer_p);
+    self_p->head = ((self_p->head + 1) % self_p->max);
+    self_p->length--;
+}
+
+void messi_output_queue_consume(struct messi_output_queue_t *self_p,
+                                size_t size)
+{
+    struct messi_output_queue_item_t *item_p;
+    size_t left;
+
+    self_p->size -= size;
+
+    while (size > 0) {
+        item_p = &self_p->items_p[self_p->head];
+        left = (item_p->buffer_p->size - item_p->offset);
+
+        if (size >= left) {
+            size -= left;
+            output_queue_pop(self_p);
+        } else {
+            item_p->offset += size;
+            size = 0;
+        }
+    }
+}
+
+void messi_output_queue_clear(struct messi_output_queue_t *self_p)
+{
+    while (self_p->length > 0) {
+        output_queue_pop(self_p);
+    }
+
+    self_p->head = 0;
+    self_p->size = 0;
+}
+
+void messi_output_queue_destroy(struct messi_output_queue_t *self_p)
+{
+    messi_output_queue_clear(self_p);
+    free(self_p->items_p);
+    messi_output_queue_init(self_p);
+}
+
+void messi_fd_table_init(struct messi_fd_table_t *self_p)
+{
+    self_p->objs_pp = NULL;
+    self_p->size = 0;
+}
+
+int messi_fd_table_set(struct messi_fd_table_t *self_p, int fd, void *obj_p)
+{
+    void **objs_pp;
+    int size;
+
+    if (fd < 0) {
+        return (-1);
+    }
+
+    if (fd >= self_p->size) {
+        size = (self_p->size > 0 ? self_p->size : 64);
+
+        while (fd >= size) {
+            size *= 2;
+        }
+
+        objs_pp = realloc(self_p->objs_pp, size * sizeof(*objs_pp));
+
+        if (objs_pp == NULL) {
+            return (-1);
+        }
+
+        memset(&objs_pp[self_p->size],
+               0,
+               (size - self_p->size) * sizeof(*objs_pp));
+        self_p->objs_pp = objs_pp;
+        self_p->size = size;
+    }
+
+    self_p->objs_pp[fd] = obj_p;
+
+    return (0);
+}
+
+void messi_fd_table_clear(struct messi_fd_table_t *self_p, int fd)
+{
+    if ((fd >= 0) && (fd < self_p->size)) {
+        self_p->objs_pp[fd] = NULL;
+    }
 }
 
-int messi_epoll_ctl_default(int epoll_fd, int op, int fd, uint32_t events)
+void messi_fd_table_destroy(struct messi_fd_table_t *self_p)
 {
-    struct epoll_event event;
+    free(self_p->objs_pp);
+    messi_fd_table_init(self_p);
+}
 
-    event.data.fd = fd;
-    event.events = events;
+int messi_loop_init(struct messi_loop_t *self_p)
+{
+    self_p->epoll_fd = epoll_create1(0);
 
-    return (epoll_ctl(epoll_fd, op, fd, &event));
+    if (self_p->epoll_fd == -1) {
+        return (-1);
+    }
+
+    messi_fd_table_init(&self_p->owners);
+    self_p->members_p = NULL;
+    self_p->deferred_list_p = NULL;
+
+    return (0);
 }
 
-int messi_make_non_blocking(int fd)
+void messi_loop_add(struct messi_loop_t *self_p,
+                    struct messi_loop_member_t *member_p,
+                    void *obj_p,
+                    messi_loop_process_t process,
+                    messi_loop_process_deferred_t process_deferred)
 {
-    return (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK));
+    member_p->obj_p = obj_p;
+    member_p->process = process;
+    member_p->process_deferred = process_deferred;
+    member_p->deferred_pending = false;
+    member_p->next_p = self_p->members_p;
+    self_p->members_p = member_p;
+}
+
+static void loop_defer(struct messi_loop_t *self_p,
+                       struct messi_loop_member_t *member_p)
+{
+    if (member_p->deferred_pending || (member_p->process_deferred == NULL)) {
+        return;
+    }
+
+    member_p->deferred_pending = true;
+    member_p->deferred_next_p = self_p->deferred_list_p;
+    self_p->deferred_list_p = member_p;
+}
+
+/* Dispatch given event to the owner of its file descriptor. The owner
+   is remembered, so only the first event on a file descriptor, or
+   one that has been closed and reused by another member, asks all
+   members. */
+static void loop_dispatch(struct messi_loop_t *self_p,
+                          int fd,
+                          uint32_t events)
+{
+    struct messi_loop_member_t *member_p;
+
+    member_p = messi_fd_table_get(&self_p->owners, fd);
+
+    if (member_p != NULL) {
+        if (member_p->process(member_p->obj_p, fd, events) == 0) {
+            loop_defer(self_p, member_p);
+
+            return;
+        }
+    }
+
+    member_p = self_p->members_p;
+
+    while (member_p != NULL) {
+        if (member_p->process(member_p->obj_p, fd, events) == 0) {
+            messi_fd_table_set(&self_p->owners, fd, member_p);
+            loop_defer(self_p, member_p);
+
+            return;
+        }
+
+        member_p = member_p->next_p;
+    }
+}
+
+int messi_loop_run_once(struct messi_loop_t *self_p, int timeout_ms)
+{
+    struct messi_loop_member_t *member_p;
+    int nfds;
+    int i;
+
+    nfds = epoll_wait(self_p->epoll_fd,
+                      &self_p->events[0],
+                      MESSI_LOOP_EVENTS_MAX,
+                      timeout_ms);
+
+    if (nfds == -1) {
+        return (errno == EINTR ? 0 : -errno);
+    }
+
+    for (i = 0; i < nfds; i++) {
+        loop_dispatch(self_p,
+                      self_p->events[i].data.fd,
+                      self_p->events[i].events);
+    }
+
+    /* Deferred work once per batch instead of once per event. */
+    while (self_p->deferred_list_p != NULL) {
+        member_p = self_p->deferred_list_p;
+        self_p->deferred_list_p = member_p->deferred_next_p;
+        member_p->deferred_pending = false;
+        member_p->process_deferred(member_p->obj_p);
+    }
+
+    return (nfds);
+}
+
+int messi_loop_run(struct messi_loop_t *self_p)
+{
+    int res;
+
+    do {
+        res = messi_loop_run_once(self_p, -1);
+    } while (res >= 0);
+
+    return (res);
+}
+
+void messi_loop_destroy(struct messi_loop_t *self_p)
+{
+    close(self_p->epoll_fd);
+    messi_fd_table_destroy(&self_p->owners);
 }
 
 int messi_parse_tcp_uri(const char *uri_p,
@@ -91,6 +1390,554 @@ int messi_parse_tcp_uri(const char *uri_p,
     return (0);
 }
 
+int messi_parse_unix_uri(const char *uri_p,
+                         struct sockaddr_un *addr_p,
+                         socklen_t *size_p)
+{
+    size_t size;
+
+    if (!messi_is_unix_uri(uri_p)) {
+        return (-1);
+    }
+
+    uri_p += 7;
+    size = strlen(uri_p);
+
+    if ((size == 0) || (size >= sizeof(addr_p->sun_path))) {
+        return (-1);
+    }
+
+    memset(addr_p, 0, sizeof(*addr_p));
+    addr_p->sun_family = AF_UNIX;
+    memcpy(&addr_p->sun_path[0], uri_p, size);
+
+    /* The abstract namespace name starts with a null byte and is not
+       null terminated. */
+    if (uri_p[0] == '@') {
+        if (size == 1) {
+            return (-1);
+        }
+
+        addr_p->sun_path[0] = '\0';
+        *size_p = (offsetof(struct sockaddr_un, sun_path) + size);
+    } else {
+        *size_p = (offsetof(struct sockaddr_un, sun_path) + size + 1);
+    }
+
+    return (0);
+}
+
+/* Both shm:// and mem:// connections are established over a unix
+   domain socket in the abstract namespace. The name of a mem://
+   socket includes the process id, so that only servers in this
+   process are found. */
+int messi_parse_shm_uri(const char *uri_p,
+                        struct sockaddr_un *addr_p,
+                        socklen_t *size_p)
+{
+    int size;
+    bool is_mem;
+
+    is_mem = messi_is_mem_uri(uri_p);
+
+    if (!messi_is_shm_uri(uri_p) && !is_mem) {
+        return (-1);
+    }
+
+    uri_p += 6;
+
+    if (uri_p[0] == '\0') {
+        return (-1);
+    }
+
+    memset(addr_p, 0, sizeof(*addr_p));
+    addr_p->sun_family = AF_UNIX;
+
+    if (is_mem) {
+        size = snprintf(&addr_p->sun_path[1],
+                        sizeof(addr_p->sun_path) - 1,
+                        "messi-mem-%d-%s",
+                        (int)getpid(),
+                        uri_p);
+    } else {
+        size = snprintf(&addr_p->sun_path[1],
+                        sizeof(addr_p->sun_path) - 1,
+                        "messi-shm-%s",
+                        uri_p);
+    }
+
+    if ((size < 0) || ((size_t)size >= sizeof(addr_p->sun_path) - 1)) {
+        return (-1);
+    }
+
+    *size_p = (offsetof(struct sockaddr_un, sun_path) + 1 + size);
+
+    return (0);
+}
+
+/* One direction of a shared memory connection. The positions are
+   free running byte counters, each written by one end only, and kept
+   in cache lines of their own. An end sets its flag before waiting to
+   be woken up, and the other end clears it and wakes it up. */
+struct messi_shm_ring_t {
+    uint64_t head;
+    uint8_t padding_1[56];
+    uint64_t tail;
+    uint8_t padding_2[56];
+    uint32_t reader_idle;
+    uint32_t writer_blocked;
+    uint8_t padding_3[56];
+    uint8_t data[MESSI_SHM_RING_SIZE];
+};
+
+/* Client to server ring first, then server to client ring. */
+#define SHM_MAP_SIZE (2 * sizeof(struct messi_shm_ring_t))
+
+static int shm_map(struct messi_shm_t *self_p, int memfd, bool is_server)
+{
+    struct messi_shm_ring_t *rings_p;
+
+    rings_p = mmap(NULL,
+                   SHM_MAP_SIZE,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED,
+                   memfd,
+                   0);
+
+    if (rings_p == MAP_FAILED) {
+        return (-1);
+    }
+
+    self_p->map_p = rings_p;
+
+    if (is_server) {
+        self_p->rx_p = &rings_p[0];
+        self_p->tx_p = &rings_p[1];
+    } else {
+        self_p->rx_p = &rings_p[1];
+        self_p->tx_p = &rings_p[0];
+    }
+
+    return (0);
+}
+
+/* Wake up the peer. A full socket buffer means that it has not yet
+   handled earlier wake ups, so it is awake anyway. A peer that has
+   gone is noticed by the next read instead. */
+static int shm_wake_up_peer(struct messi_shm_t *self_p)
+{
+    uint8_t value;
+
+    value = 0;
+
+    if (send(self_p->fd, &value, 1, MSG_DONTWAIT | MSG_NOSIGNAL) == 1) {
+        return (0);
+    }
+
+    if ((errno == EAGAIN) || (errno == EPIPE) || (errno == ECONNRESET)) {
+        return (0);
+    }
+
+    return (-1);
+}
+
+/* Discard all wake ups, and find out if the peer has gone. */
+static int shm_drain_wake_ups(struct messi_shm_t *self_p)
+{
+    uint8_t buf[64];
+    ssize_t size;
+
+    while (!self_p->peer_closed) {
+        size = recv(self_p->fd, &buf[0], sizeof(buf), MSG_DONTWAIT);
+
+        /* A peer closing with unread wake ups resets the
+           connection. Data in the ring is still valid. */
+        if ((size == 0) || ((size == -1) && (errno == ECONNRESET))) {
+            self_p->peer_closed = true;
+        } else if (size == -1) {
+            if (errno == EAGAIN) {
+                break;
+            }
+
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+static void shm_copy_out(struct messi_shm_ring_t *ring_p,
+                         uint64_t head,
+                         uint8_t *buf_p,
+                         size_t size)
+{
+    size_t offset;
+    size_t left;
+
+    offset = (head % MESSI_SHM_RING_SIZE);
+    left = (MESSI_SHM_RING_SIZE - offset);
+
+    if (size <= left) {
+        memcpy(buf_p, &ring_p->data[offset], size);
+    } else {
+        memcpy(buf_p, &ring_p->data[offset], left);
+        memcpy(&buf_p[left], &ring_p->data[0], size - left);
+    }
+}
+
+static void shm_copy_in(struct messi_shm_ring_t *ring_p,
+                        uint64_t tail,
+                        const uint8_t *buf_p,
+                        size_t size)
+{
+    size_t offset;
+    size_t left;
+
+    offset = (tail % MESSI_SHM_RING_SIZE);
+    left = (MESSI_SHM_RING_SIZE - offset);
+
+    if (size <= left) {
+        memcpy(&ring_p->data[offset], buf_p, size);
+    } else {
+        memcpy(&ring_p->data[offset], buf_p, left);
+        memcpy(&ring_p->data[0], &buf_p[left], size - left);
+    }
+}
+
+void messi_shm_init(struct messi_shm_t *self_p, int fd)
+{
+    self_p->fd = fd;
+    self_p->rx_p = NULL;
+    self_p->tx_p = NULL;
+    self_p->map_p = NULL;
+    self_p->peer_closed = false;
+}
+
+int messi_shm_create(struct messi_shm_t *self_p)
+{
+    int memfd;
+    uint8_t value;
+    struct iovec iov;
+    struct msghdr msg;
+    union {
+        struct cmsghdr header;
+        uint8_t buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg_p;
+    int res;
+
+    memfd = (int)syscall(SYS_memfd_create, "messi-shm", MFD_CLOEXEC);
+
+    if (memfd == -1) {
+        return (-1);
+    }
+
+    res = ftruncate(memfd, SHM_MAP_SIZE);
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    res = shm_map(self_p, memfd, true);
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    /* Both ends are idle until they have read something. */
+    self_p->rx_p->reader_idle = 1;
+    self_p->tx_p->reader_idle = 1;
+
+    value = 0;
+    iov.iov_base = &value;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control.buf[0];
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg_p = CMSG_FIRSTHDR(&msg);
+    cmsg_p->cmsg_level = SOL_SOCKET;
+    cmsg_p->cmsg_type = SCM_RIGHTS;
+    cmsg_p->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg_p), &memfd, sizeof(int));
+
+    if (sendmsg(self_p->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != 1) {
+        goto out2;
+    }
+
+    close(memfd);
+
+    return (0);
+
+ out2:
+    messi_shm_close(self_p);
+
+ out1:
+    close(memfd);
+
+    return (-1);
+}
+
+int messi_shm_open(struct messi_shm_t *self_p)
+{
+    int memfd;
+    uint8_t value;
+    struct iovec iov;
+    struct msghdr msg;
+    union {
+        struct cmsghdr header;
+        uint8_t buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg_p;
+    struct stat statbuf;
+    ssize_t size;
+    int res;
+
+    iov.iov_base = &value;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control.buf[0];
+    msg.msg_controllen = sizeof(control.buf);
+    size = recvmsg(self_p->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+
+    if (size == -1) {
+        return (-1);
+    }
+
+    cmsg_p = CMSG_FIRSTHDR(&msg);
+
+    if ((size != 1)
+        || (cmsg_p == NULL)
+        || (cmsg_p->cmsg_level != SOL_SOCKET)
+        || (cmsg_p->cmsg_type != SCM_RIGHTS)
+        || (cmsg_p->cmsg_len != CMSG_LEN(sizeof(int)))) {
+        errno = EPROTO;
+
+        return (-1);
+    }
+
+    memcpy(&memfd, CMSG_DATA(cmsg_p), sizeof(int));
+    res = fstat(memfd, &statbuf);
+
+    if ((res == 0) && ((size_t)statbuf.st_size == SHM_MAP_SIZE)) {
+        res = shm_map(self_p, memfd, false);
+    } else {
+        errno = EPROTO;
+        res = -1;
+    }
+
+    close(memfd);
+
+    return (res);
+}
+
+void messi_shm_close(struct messi_shm_t *self_p)
+{
+    if (self_p->map_p != NULL) {
+        munmap(self_p->map_p, SHM_MAP_SIZE);
+        self_p->map_p = NULL;
+        self_p->rx_p = NULL;
+        self_p->tx_p = NULL;
+    }
+}
+
+ssize_t messi_shm_read(struct messi_shm_t *self_p, void *buf_p, size_t size)
+{
+    struct messi_shm_ring_t *ring_p;
+    uint64_t head;
+    uint64_t used;
+    size_t offset;
+    size_t chunk_size;
+    bool idle;
+
+    if (shm_drain_wake_ups(self_p) != 0) {
+        return (-1);
+    }
+
+    ring_p = self_p->rx_p;
+
+    if (ring_p == NULL) {
+        errno = ENOTCONN;
+
+        return (-1);
+    }
+
+    head = ring_p->head;
+    offset = 0;
+    idle = false;
+
+    while (true) {
+        used = (__atomic_load_n(&ring_p->tail, __ATOMIC_ACQUIRE) - head);
+
+        if (used > MESSI_SHM_RING_SIZE) {
+            errno = EPROTO;
+
+            return (-1);
+        }
+
+        if (used == 0) {
+            /* Wait for the writer unless it wrote something after
+               being told so. */
+            if (idle) {
+                break;
+            }
+
+            __atomic_store_n(&ring_p->reader_idle, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            idle = true;
+            continue;
+        }
+
+        if (offset == size) {
+            break;
+        }
+
+        if (idle) {
+            __atomic_store_n(&ring_p->reader_idle, 0, __ATOMIC_RELAXED);
+            idle = false;
+        }
+
+        chunk_size = (size - offset);
+
+        if (chunk_size > used) {
+            chunk_size = used;
+        }
+
+        shm_copy_out(ring_p, head, &((uint8_t *)buf_p)[offset], chunk_size);
+        head += chunk_size;
+        offset += chunk_size;
+        __atomic_store_n(&ring_p->head, head, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (__atomic_exchange_n(&ring_p->writer_blocked, 0, __ATOMIC_SEQ_CST)) {
+            if (shm_wake_up_peer(self_p) != 0) {
+                return (-1);
+            }
+        }
+    }
+
+    if (offset > 0) {
+        return (offset);
+    }
+
+    if (self_p->peer_closed) {
+        return (0);
+    }
+
+    errno = EAGAIN;
+
+    return (-1);
+}
+
+ssize_t messi_shm_writev(struct messi_shm_t *self_p,
+                         const struct iovec *iov_p,
+                         int iovcnt)
+{
+    struct messi_shm_ring_t *ring_p;
+    uint64_t tail;
+    uint64_t used;
+    size_t offset;
+    size_t chunk_size;
+    size_t written;
+    bool blocked;
+    int i;
+
+    ring_p = self_p->tx_p;
+
+    if (ring_p == NULL) {
+        errno = ENOTCONN;
+
+        return (-1);
+    }
+
+    tail = ring_p->tail;
+    written = 0;
+    blocked = false;
+    i = 0;
+    offset = 0;
+
+    while (i < iovcnt) {
+        if (offset == iov_p[i].iov_len) {
+            i++;
+            offset = 0;
+            continue;
+        }
+
+        used = (tail - __atomic_load_n(&ring_p->head, __ATOMIC_ACQUIRE));
+
+        if (used > MESSI_SHM_RING_SIZE) {
+            errno = EPROTO;
+
+            return (-1);
+        }
+
+        if (used == MESSI_SHM_RING_SIZE) {
+            /* Wait for the reader unless it read something after
+               being told so. */
+            if (blocked) {
+                break;
+            }
+
+            __atomic_store_n(&ring_p->writer_blocked, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            blocked = true;
+            continue;
+        }
+
+        if (blocked) {
+            __atomic_store_n(&ring_p->writer_blocked, 0, __ATOMIC_RELAXED);
+            blocked = false;
+        }
+
+        chunk_size = (iov_p[i].iov_len - offset);
+
+        if (chunk_size > MESSI_SHM_RING_SIZE - used) {
+            chunk_size = (MESSI_SHM_RING_SIZE - used);
+        }
+
+        shm_copy_in(ring_p,
+                    tail,
+                    &((const uint8_t *)iov_p[i].iov_base)[offset],
+                    chunk_size);
+        tail += chunk_size;
+        offset += chunk_size;
+        written += chunk_size;
+        __atomic_store_n(&ring_p->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (written == 0) {
+        errno = EAGAIN;
+
+        return (-1);
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_exchange_n(&ring_p->reader_idle, 0, __ATOMIC_SEQ_CST)) {
+        if (shm_wake_up_peer(self_p) != 0) {
+            return (-1);
+        }
+    }
+
+    return (written);
+}
+
+ssize_t messi_shm_write(struct messi_shm_t *self_p,
+                        const void *buf_p,
+                        size_t size)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)buf_p;
+    iov.iov_len = size;
+
+    return (messi_shm_writev(self_p, &iov, 1));
+}
+
 const char *messi_disconnect_reason_string(
     enum messi_disconnect_reason_t disconnect_reason)
 {
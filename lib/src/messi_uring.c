@@ -0,0 +1,339 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "messi_uring.h"
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params_p)
+{
+    return ((int)syscall(__NR_io_uring_setup, entries, params_p));
+}
+
+static int io_uring_enter(int fd,
+                          unsigned to_submit,
+                          unsigned min_complete,
+                          unsigned flags)
+{
+    return ((int)syscall(__NR_io_uring_enter,
+                         fd,
+                         to_submit,
+                         min_complete,
+                         flags,
+                         NULL,
+                         0));
+}
+
+static int io_uring_register(int fd,
+                             unsigned opcode,
+                             void *arg_p,
+                             unsigned nr_args)
+{
+    return ((int)syscall(__NR_io_uring_register, fd, opcode, arg_p, nr_args));
+}
+
+static void *map_ring(int fd, size_t size, off_t offset)
+{
+    void *ring_p;
+
+    ring_p = mmap(NULL,
+                  size,
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE,
+                  fd,
+                  offset);
+
+    if (ring_p == MAP_FAILED) {
+        ring_p = NULL;
+    }
+
+    return (ring_p);
+}
+
+static void unmap_rings(struct messi_uring_t *self_p)
+{
+    if (self_p->mmap.sqes_size > 0) {
+        munmap(self_p->sq.sqes_p, self_p->mmap.sqes_size);
+    }
+
+    if ((self_p->mmap.cq_ring_p != NULL)
+        && (self_p->mmap.cq_ring_p != self_p->mmap.sq_ring_p)) {
+        munmap(self_p->mmap.cq_ring_p, self_p->mmap.cq_ring_size);
+    }
+
+    munmap(self_p->mmap.sq_ring_p, self_p->mmap.sq_ring_size);
+}
+
+int messi_uring_init(struct messi_uring_t *self_p,
+                     unsigned sq_entries,
+                     unsigned cq_entries)
+{
+    struct io_uring_params params;
+    uint8_t *sq_ring_p;
+    uint8_t *cq_ring_p;
+    unsigned *array_p;
+    unsigned i;
+
+    memset(self_p, 0, sizeof(*self_p));
+    memset(&params, 0, sizeof(params));
+    params.flags = (IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE);
+    params.cq_entries = cq_entries;
+    self_p->fd = io_uring_setup(sq_entries, &params);
+
+    if (self_p->fd == -1) {
+        return (-1);
+    }
+
+    self_p->mmap.sq_ring_size = (params.sq_off.array
+                                 + params.sq_entries * sizeof(unsigned));
+    self_p->mmap.cq_ring_size = (params.cq_off.cqes
+                                 + params.cq_entries * sizeof(struct io_uring_cqe));
+
+    /* Both rings in one mapping if supported. */
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (self_p->mmap.cq_ring_size > self_p->mmap.sq_ring_size) {
+            self_p->mmap.sq_ring_size = self_p->mmap.cq_ring_size;
+        }
+
+        self_p->mmap.cq_ring_size = self_p->mmap.sq_ring_size;
+    }
+
+    sq_ring_p = map_ring(self_p->fd,
+                         self_p->mmap.sq_ring_size,
+                         IORING_OFF_SQ_RING);
+
+    if (sq_ring_p == NULL) {
+        goto out1;
+    }
+
+    self_p->mmap.sq_ring_p = sq_ring_p;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_p = sq_ring_p;
+    } else {
+        cq_ring_p = map_ring(self_p->fd,
+                             self_p->mmap.cq_ring_size,
+                             IORING_OFF_CQ_RING);
+
+        if (cq_ring_p == NULL) {
+            goto out2;
+        }
+    }
+
+    self_p->mmap.cq_ring_p = cq_ring_p;
+    self_p->sq.sqes_p = map_ring(self_p->fd,
+                                 params.sq_entries * sizeof(struct io_uring_sqe),
+                                 IORING_OFF_SQES);
+
+    if (self_p->sq.sqes_p == NULL) {
+        goto out2;
+    }
+
+    self_p->mmap.sqes_size = (params.sq_entries * sizeof(struct io_uring_sqe));
+    self_p->sq.head_p = (unsigned *)&sq_ring_p[params.sq_off.head];
+    self_p->sq.tail_p = (unsigned *)&sq_ring_p[params.sq_off.tail];
+    self_p->sq.flags_p = (unsigned *)&sq_ring_p[params.sq_off.flags];
+    self_p->sq.mask = *(unsigned *)&sq_ring_p[params.sq_off.ring_mask];
+    self_p->sq.entries = params.sq_entries;
+    self_p->sq.tail = *self_p->sq.tail_p;
+    self_p->cq.head_p = (unsigned *)&cq_ring_p[params.cq_off.head];
+    self_p->cq.tail_p = (unsigned *)&cq_ring_p[params.cq_off.tail];
+    self_p->cq.mask = *(unsigned *)&cq_ring_p[params.cq_off.ring_mask];
+    self_p->cq.cqes_p = (struct io_uring_cqe *)&cq_ring_p[params.cq_off.cqes];
+
+    /* Submission queue entry i is always in array slot i. */
+    array_p = (unsigned *)&sq_ring_p[params.sq_off.array];
+
+    for (i = 0; i < params.sq_entries; i++) {
+        array_p[i] = i;
+    }
+
+    return (0);
+
+ out2:
+    unmap_rings(self_p);
+
+ out1:
+    close(self_p->fd);
+    self_p->fd = -1;
+
+    return (-1);
+}
+
+void messi_uring_destroy(struct messi_uring_t *self_p)
+{
+    unmap_rings(self_p);
+    close(self_p->fd);
+    self_p->fd = -1;
+}
+
+/* Returns the number of submission queue entries not yet consumed by
+   the kernel. The kernel may leave submitted entries unconsumed, so
+   the pending count cannot tell if an entry is free. */
+static unsigned sq_used(struct messi_uring_t *self_p)
+{
+    return (self_p->sq.tail
+            - __atomic_load_n(self_p->sq.head_p, __ATOMIC_ACQUIRE));
+}
+
+struct io_uring_sqe *messi_uring_get_sqe(struct messi_uring_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    if (sq_used(self_p) == self_p->sq.entries) {
+        if (messi_uring_submit(self_p) != 0) {
+            return (NULL);
+        }
+
+        if (sq_used(self_p) == self_p->sq.entries) {
+            return (NULL);
+        }
+    }
+
+    sqe_p = &self_p->sq.sqes_p[self_p->sq.tail & self_p->sq.mask];
+    memset(sqe_p, 0, sizeof(*sqe_p));
+    self_p->sq.tail++;
+    self_p->sq.pending++;
+
+    return (sqe_p);
+}
+
+int messi_uring_submit(struct messi_uring_t *self_p)
+{
+    int res;
+    unsigned flags;
+
+    /* Overflowed completions are only flushed when asking for
+       completions. */
+    if (__atomic_load_n(self_p->sq.flags_p, __ATOMIC_RELAXED)
+        & IORING_SQ_CQ_OVERFLOW) {
+        flags = IORING_ENTER_GETEVENTS;
+    } else if (self_p->sq.pending == 0) {
+        return (0);
+    } else {
+        flags = 0;
+    }
+
+    __atomic_store_n(self_p->sq.tail_p, self_p->sq.tail, __ATOMIC_RELEASE);
+    res = io_uring_enter(self_p->fd, self_p->sq.pending, 0, flags);
+
+    if (res < 0) {
+        return (-1);
+    }
+
+    self_p->sq.pending -= (unsigned)res;
+
+    return (0);
+}
+
+int messi_uring_buf_ring_init(struct messi_uring_buf_ring_t *self_p,
+                              struct messi_uring_t *uring_p,
+                              uint16_t bgid,
+                              unsigned entries,
+                              size_t buf_size)
+{
+    int res;
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    self_p->ring_size = (entries * sizeof(struct io_uring_buf));
+    self_p->ring_p = mmap(NULL,
+                          self_p->ring_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE,
+                          -1,
+                          0);
+
+    if (self_p->ring_p == MAP_FAILED) {
+        return (-1);
+    }
+
+    self_p->bufs_p = malloc(entries * buf_size);
+
+    if (self_p->bufs_p == NULL) {
+        goto out1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)self_p->ring_p;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+
+    res = io_uring_register(uring_p->fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+
+    if (res != 0) {
+        goto out2;
+    }
+
+    self_p->buf_size = buf_size;
+    self_p->entries = entries;
+    self_p->bgid = bgid;
+    self_p->tail = 0;
+
+    for (i = 0; i < entries; i++) {
+        messi_uring_buf_ring_recycle(self_p, (uint16_t)i);
+    }
+
+    return (0);
+
+ out2:
+    free(self_p->bufs_p);
+
+ out1:
+    munmap(self_p->ring_p, self_p->ring_size);
+
+    return (-1);
+}
+
+void messi_uring_buf_ring_recycle(struct messi_uring_buf_ring_t *self_p,
+                                  uint16_t bid)
+{
+    struct io_uring_buf *buf_p;
+
+    buf_p = &self_p->ring_p->bufs[self_p->tail & (self_p->entries - 1)];
+    buf_p->addr = (uintptr_t)messi_uring_buf_ring_get(self_p, bid);
+    buf_p->len = (uint32_t)self_p->buf_size;
+    buf_p->bid = bid;
+    self_p->tail++;
+    __atomic_store_n(&self_p->ring_p->tail, self_p->tail, __ATOMIC_RELEASE);
+}
+
+void messi_uring_buf_ring_destroy(struct messi_uring_buf_ring_t *self_p,
+                                  struct messi_uring_t *uring_p)
+{
+    struct io_uring_buf_reg reg;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = self_p->bgid;
+    io_uring_register(uring_p->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(self_p->ring_p, self_p->ring_size);
+    free(self_p->bufs_p);
+}
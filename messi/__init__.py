@@ -38,7 +38,7 @@ def main():
                                       help='Generate C source code.')
     subparser.add_argument(
         '-p', '--platform',
-        choices=('linux', 'async'),
+        choices=('linux', 'io_uring', 'async'),
         default='linux',
         help='Platform to generate code for (default: %(default)s).')
     subparser.add_argument(
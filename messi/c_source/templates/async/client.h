@@ -43,11 +43,6 @@ typedef void (*NAME_client_on_disconnected_t)(
     enum messi_disconnect_reason_t disconnect_reason);
 
 ON_MESSAGE_TYPEDEFS
-enum NAME_client_input_state_t {
-    NAME_client_input_state_header_t = 0,
-    NAME_client_input_state_payload_t
-};
-
 struct NAME_client_t {
     struct {
         char address[16];
@@ -62,16 +57,14 @@ ON_MESSAGE_MEMBERS
     struct async_stcp_client_t stcp;
     struct async_timer_t keep_alive_timer;
     struct async_timer_t reconnect_timer;
+    /* Delay before each reconnect attempt. Reset once anything is
+       received from the server. */
+    struct messi_backoff_t backoff;
     bool pong_received;
     struct {
         struct NAME_server_to_client_t *message_p;
         struct messi_buffer_t workspace;
-        struct {
-            struct messi_buffer_t data;
-            size_t size;
-            size_t left;
-            enum NAME_client_input_state_t state;
-        } encoded;
+        struct messi_framer_t encoded;
     } input;
     struct {
         struct NAME_client_to_server_t *message_p;
@@ -99,6 +92,31 @@ int NAME_client_init(
 ON_MESSAGE_PARAMS
     struct async_t *async_p);
 
+/**
+ * Wait initial_ms milliseconds before the first reconnect attempt,
+ * and multiplier times longer before each following attempt, but at
+ * most max_ms milliseconds. With jitter, the delay is instead random
+ * between zero(0) and that delay. Restarts from initial_ms once
+ * anything is received from the server. Defaults to a fixed delay of
+ * 1000 ms without jitter. Call before start.
+ */
+void NAME_client_set_reconnect_backoff(struct NAME_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter);
+
+/**
+ * Returns the number of the next reconnect attempt, starting at one
+ * when the connection is lost or a connection attempt fails, and
+ * increasing until anything is received from the server. Failed
+ * connection attempts do not call the disconnected callback, so the
+ * number seen there is one unless the connection was lost before
+ * anything was received from the server. Read it when connected to
+ * see how many attempts were needed.
+ */
+unsigned int NAME_client_get_reconnect_attempt(struct NAME_client_t *self_p);
+
 /**
  * Connect to the server. The connected callback is called once
  * connected. Automatic reconnect if disconnected.
@@ -38,11 +38,6 @@ struct NAME_server_t;
 struct NAME_server_client_t;
 
 ON_MESSAGE_TYPEDEFS
-enum NAME_server_client_input_state_t {
-    NAME_server_client_input_state_header_t = 0,
-    NAME_server_client_input_state_payload_t
-};
-
 typedef void (*NAME_server_on_client_connected_t)(
     struct NAME_server_t *self_p,
     struct NAME_server_client_t *client_p);
@@ -83,12 +78,7 @@ struct NAME_server_client_t {
     struct NAME_server_t *server_p;
     struct async_stcp_server_client_t stcp;
     struct async_timer_t keep_alive_timer;
-    struct {
-        enum NAME_server_client_input_state_t state;
-        struct messi_buffer_t data;
-        size_t size;
-        size_t left;
-    } input;
+    struct messi_framer_t input;
     struct NAME_server_client_t *next_p;
     struct NAME_server_client_t *prev_p;
 };
@@ -0,0 +1,1601 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include "messi.h"
+#include "messi_uring.h"
+#include "NAME_server.h"
+
+/* Number of submission queue entries. The queue is submitted when
+   full, so this only limits batching. */
+#define URING_ENTRIES                                   256
+
+/* Completion queue entries per client, as a client may have
+   completed receives and a send at the same time. */
+#define URING_CQ_ENTRIES_PER_CLIENT                       4
+
+/* Minimum and maximum number of provided receive buffers. */
+#define INPUT_BUFFERS_MIN                                 8
+#define INPUT_BUFFERS_MAX                             32768
+
+/* The operation is stored in the two lowest bits of the user data,
+   and the client pointer, if any, in the rest. */
+#define OPERATION_ACCEPT                                  0
+#define OPERATION_TICK                                    1
+#define OPERATION_RECV                                    2
+#define OPERATION_SEND                                    3
+#define OPERATION_MASK                                    3
+
+static uint64_t make_user_data(void *obj_p, int operation)
+{
+    return ((uintptr_t)obj_p | (uintptr_t)operation);
+}
+
+static struct NAME_server_client_t *alloc_client(struct NAME_server_t *self_p)
+{
+    struct NAME_server_client_t *client_p;
+
+    client_p = self_p->clients.free_list_p;
+
+    if (client_p != NULL) {
+        /* Remove from free list. */
+        self_p->clients.free_list_p = client_p->next_p;
+
+        /* Add to connected list. */
+        client_p->next_p = self_p->clients.connected_list_p;
+
+        if (self_p->clients.connected_list_p != NULL) {
+            self_p->clients.connected_list_p->prev_p = client_p;
+        }
+
+        self_p->clients.connected_list_p = client_p;
+    }
+
+    return (client_p);
+}
+
+static void remove_client_from_list(struct NAME_server_client_t **list_pp,
+                                    struct NAME_server_client_t *client_p)
+{
+    if (client_p == *list_pp) {
+        *list_pp = client_p->next_p;
+    } else {
+        client_p->prev_p->next_p = client_p->next_p;
+    }
+
+    if (client_p->next_p != NULL) {
+        client_p->next_p->prev_p = client_p->prev_p;
+    }
+}
+
+static void add_client_to_list(struct NAME_server_client_t **list_pp,
+                               struct NAME_server_client_t *client_p)
+{
+    client_p->next_p = *list_pp;
+
+    if (*list_pp != NULL) {
+        (*list_pp)->prev_p = client_p;
+    }
+
+    *list_pp = client_p;
+}
+
+/* Release the storage of any large message being received. */
+static void client_large_input_release(struct NAME_server_client_t *self_p,
+                                       struct NAME_server_t *server_p)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->large_input;
+
+    if (large_p->buf_p == NULL) {
+        return;
+    }
+
+    if (large_p->pooled) {
+        messi_large_pool_free(&server_p->large.pool,
+                              large_p->buf_p,
+                              large_p->pooled_size);
+    }
+
+    large_p->buf_p = NULL;
+}
+
+/* Return given client to the free list. Its output is released as no
+   operation uses it anymore. */
+static void free_client(struct NAME_server_t *self_p,
+                        struct NAME_server_client_t *client_p)
+{
+    client_large_input_release(client_p, self_p);
+    messi_output_queue_clear(&client_p->output.queue);
+    client_p->output.size = 0;
+    client_p->next_p = self_p->clients.free_list_p;
+    self_p->clients.free_list_p = client_p;
+}
+
+static void free_connected_client(struct NAME_server_t *self_p,
+                                  struct NAME_server_client_t *client_p)
+{
+    remove_client_from_list(&self_p->clients.connected_list_p,
+                            client_p);
+    free_client(self_p, client_p);
+}
+
+static void move_client_to_pending_disconnect_list(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p)
+{
+    remove_client_from_list(&self_p->clients.connected_list_p,
+                            client_p);
+    add_client_to_list(&self_p->clients.pending_disconnect_list_p, client_p);
+}
+
+static int epoll_ctl_add(struct NAME_server_t *self_p, int fd)
+{
+    return (self_p->epoll_ctl(self_p->epoll_fd, EPOLL_CTL_ADD, fd, EPOLLIN));
+}
+
+static int epoll_ctl_del(struct NAME_server_t *self_p, int fd)
+{
+    return (self_p->epoll_ctl(self_p->epoll_fd, EPOLL_CTL_DEL, fd, 0));
+}
+
+/* Submit queued operations, unless completions are being processed,
+   in which case they are submitted once all are processed. */
+static void submit(struct NAME_server_t *self_p)
+{
+    if (!self_p->processing) {
+        messi_uring_submit(&self_p->uring);
+    }
+}
+
+static int prepare_accept(struct NAME_server_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_ACCEPT;
+    sqe_p->fd = self_p->listener_fd;
+    sqe_p->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe_p->user_data = make_user_data(NULL, OPERATION_ACCEPT);
+
+    return (0);
+}
+
+static int prepare_tick(struct NAME_server_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_TIMEOUT;
+    sqe_p->fd = -1;
+    sqe_p->addr = (uintptr_t)&self_p->tick;
+    sqe_p->len = 1;
+    sqe_p->user_data = make_user_data(NULL, OPERATION_TICK);
+
+    return (0);
+}
+
+/* Receive into buffers picked from the provided buffer ring for as
+   long as the connection is open. */
+static int client_prepare_recv(struct NAME_server_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->server_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_RECV;
+    sqe_p->fd = self_p->client_fd;
+    sqe_p->flags = IOSQE_BUFFER_SELECT;
+    sqe_p->ioprio = IORING_RECV_MULTISHOT;
+    sqe_p->buf_group = self_p->server_p->input_buffers.bgid;
+    sqe_p->user_data = make_user_data(self_p, OPERATION_RECV);
+    self_p->operations++;
+
+    return (0);
+}
+
+/* Send all queued data in one operation, unless one is already in
+   progress. Only one send is in progress at a time, so a short send
+   is simply followed by another one with the rest. */
+static int client_prepare_send(struct NAME_server_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+    int iovcnt;
+
+    if ((self_p->output.size > 0)
+        || messi_output_queue_is_empty(&self_p->output.queue)) {
+        return (0);
+    }
+
+    sqe_p = messi_uring_get_sqe(&self_p->server_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    iovcnt = messi_output_queue_get_iov(&self_p->output.queue,
+                                        &self_p->output.iov[0],
+                                        NAME_UPPER_SERVER_CLIENT_IOV_MAX,
+                                        &self_p->output.size);
+    memset(&self_p->output.msg, 0, sizeof(self_p->output.msg));
+    self_p->output.msg.msg_iov = &self_p->output.iov[0];
+    self_p->output.msg.msg_iovlen = iovcnt;
+    sqe_p->opcode = IORING_OP_SENDMSG;
+    sqe_p->fd = self_p->client_fd;
+    sqe_p->addr = (uintptr_t)&self_p->output.msg;
+    sqe_p->len = 1;
+    sqe_p->msg_flags = MSG_NOSIGNAL;
+    sqe_p->user_data = make_user_data(self_p, OPERATION_SEND);
+    self_p->operations++;
+
+    return (0);
+}
+
+static int client_start_keep_alive_timer(struct NAME_server_client_t *self_p)
+{
+    return (messi_timer_start(&self_p->server_p->timers,
+                              &self_p->keep_alive_timer,
+                              self_p->server_p->keep_alive_timeout_ms));
+}
+
+static int client_init(struct NAME_server_client_t *self_p,
+                       struct NAME_server_t *server_p,
+                       int client_fd)
+{
+    int res;
+
+    self_p->client_fd = client_fd;
+    self_p->operations = 0;
+    self_p->output.size = 0;
+    self_p->output.writable = true;
+    memset(&self_p->stats, 0, sizeof(self_p->stats));
+    messi_framer_reset(&self_p->input);
+
+    res = client_start_keep_alive_timer(self_p);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    res = client_prepare_recv(self_p);
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    return (0);
+
+ out1:
+    messi_timer_stop(&server_p->timers, &self_p->keep_alive_timer);
+
+    return (-1);
+}
+
+/* An operation of given client is completed. A disconnected client
+   is freed once all its operations are completed. */
+static void client_operation_completed(struct NAME_server_client_t *self_p,
+                                       struct NAME_server_t *server_p)
+{
+    self_p->operations--;
+
+    if ((self_p->operations == 0) && self_p->closing) {
+        remove_client_from_list(&server_p->clients.closing_list_p, self_p);
+        self_p->closing = false;
+        free_client(server_p, self_p);
+    }
+}
+
+static void destroy_pending_disconnect_clients(struct NAME_server_t *self_p)
+{
+    struct NAME_server_client_t *client_p;
+    struct NAME_server_client_t *next_client_p;
+
+    client_p = self_p->clients.pending_disconnect_list_p;
+
+    while (client_p != NULL) {
+        self_p->on_client_disconnected(self_p, client_p);
+        next_client_p = client_p->next_p;
+        remove_client_from_list(&self_p->clients.pending_disconnect_list_p,
+                                client_p);
+
+        /* Operations in progress still use the client. */
+        if (client_p->operations == 0) {
+            free_client(self_p, client_p);
+        } else {
+            client_p->closing = true;
+            add_client_to_list(&self_p->clients.closing_list_p, client_p);
+        }
+
+        client_p = next_client_p;
+    }
+}
+
+static void client_pending_disconnect(struct NAME_server_client_t *self_p,
+                                      struct NAME_server_t *server_p)
+{
+    /* Already pending disconnect? */
+    if (self_p->client_fd == -1) {
+        return;
+    }
+
+    /* Operations not yet submitted must not use the file descriptor
+       once closed, as it may be reused. Shutdown completes all
+       operations in progress. */
+    messi_uring_submit(&server_p->uring);
+    shutdown(self_p->client_fd, SHUT_RDWR);
+    close(self_p->client_fd);
+    self_p->client_fd = -1;
+    messi_timer_stop(&server_p->timers, &self_p->keep_alive_timer);
+    move_client_to_pending_disconnect_list(server_p, self_p);
+}
+
+/* Serve given accepted client socket. TCP_NODELAY is inherited from
+   the listener socket. The socket is closed on failure. */
+static int add_client(struct NAME_server_t *self_p, int client_fd)
+{
+    int res;
+    struct NAME_server_client_t *client_p;
+
+    client_p = alloc_client(self_p);
+
+    if (client_p == NULL) {
+        goto out1;
+    }
+
+    res = client_init(client_p, self_p, client_fd);
+
+    if (res != 0) {
+        goto out2;
+    }
+
+    self_p->on_client_connected(self_p, client_p);
+
+    return (0);
+
+ out2:
+    free_connected_client(self_p, client_p);
+
+ out1:
+    close(client_fd);
+
+    return (-1);
+}
+
+static void process_accept(struct NAME_server_t *self_p,
+                           int res,
+                           uint32_t flags)
+{
+    if (res >= 0) {
+        add_client(self_p, res);
+    }
+
+    /* Accept again if the multishot accept was terminated. */
+    if (!(flags & IORING_CQE_F_MORE)) {
+        prepare_accept(self_p);
+    }
+}
+
+static void process_tick(struct NAME_server_t *self_p)
+{
+    messi_timer_wheel_advance(&self_p->timers, 1);
+    prepare_tick(self_p);
+}
+
+static void client_set_writable(struct NAME_server_client_t *self_p,
+                                struct NAME_server_t *server_p,
+                                bool writable)
+{
+    self_p->output.writable = writable;
+    server_p->watermarks.on_client_writable_changed(server_p,
+                                                    self_p,
+                                                    writable);
+}
+
+/* Enqueue a reference to given shared buffer, which is created from
+   given data by the first client that needs it. A message broadcast
+   to many clients is thereby only copied once. */
+static int client_output_append_shared(struct NAME_server_client_t *self_p,
+                                       uint8_t *buf_p,
+                                       size_t size,
+                                       struct messi_shared_buffer_t **shared_pp)
+{
+    if (*shared_pp == NULL) {
+        *shared_pp = messi_shared_buffer_new(buf_p, size);
+
+        if (*shared_pp == NULL) {
+            return (-1);
+        }
+    }
+
+    return (messi_output_queue_push(&self_p->output.queue, *shared_pp, 0));
+}
+
+/* Enqueue given data and send it. Enqueued data references
+   *shared_pp, which is created if NULL. The caller releases it with
+   messi_shared_buffer_unref(). */
+static void client_write(struct NAME_server_t *self_p,
+                         struct NAME_server_client_t *client_p,
+                         uint8_t *buf_p,
+                         size_t size,
+                         struct messi_shared_buffer_t **shared_pp)
+{
+    int res;
+    size_t output_size;
+
+    if (client_p->client_fd == -1) {
+        return;
+    }
+
+    client_p->stats.messages_out++;
+    res = client_output_append_shared(client_p, buf_p, size, shared_pp);
+
+    if (res == 0) {
+        res = client_prepare_send(client_p);
+    }
+
+    if (res != 0) {
+        client_pending_disconnect(client_p, self_p);
+
+        return;
+    }
+
+    output_size = messi_output_queue_size(&client_p->output.queue);
+
+    if (output_size > client_p->stats.output_bytes_peak) {
+        client_p->stats.output_bytes_peak = output_size;
+    }
+
+    if (client_p->output.writable
+        && (self_p->watermarks.high > 0)
+        && (output_size >= self_p->watermarks.high)) {
+        client_set_writable(client_p, self_p, false);
+    }
+}
+
+static int handle_message_user(struct NAME_server_t *self_p,
+                               struct NAME_server_client_t *client_p,
+                               struct messi_buffer_t *payload_p,
+                               struct messi_buffer_t *workspace_p)
+{
+    int res;
+    struct NAME_client_to_server_t *message_p;
+
+    self_p->input.message_p = NAME_client_to_server_new(
+        &workspace_p->buf_p[0],
+        workspace_p->size);
+    message_p = self_p->input.message_p;
+
+    if (message_p == NULL) {
+        return (-1);
+    }
+
+    res = NAME_client_to_server_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
+
+    if (res != (int)payload_p->size) {
+        return (-1);
+    }
+
+    self_p->current_client_p = client_p;
+
+    switch (message_p->messages.choice) {
+
+HANDLE_CASES
+    default:
+        break;
+    }
+
+    self_p->current_client_p = NULL;
+
+    return (0);
+}
+
+static int handle_message_ping(struct NAME_server_t *self_p,
+                               struct NAME_server_client_t *client_p)
+{
+    struct messi_header_t header;
+    struct messi_shared_buffer_t *shared_p;
+
+    header.type = MESSI_MESSAGE_TYPE_PONG;
+    messi_header_set_size(&header, 0);
+    shared_p = NULL;
+    client_write(self_p,
+                 client_p,
+                 (uint8_t *)&header,
+                 sizeof(header),
+                 &shared_p);
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+
+    return (0);
+}
+
+/* Handle all messages in given batch in order. */
+static int handle_message_batch(struct NAME_server_t *self_p,
+                                struct NAME_server_client_t *client_p,
+                                struct messi_buffer_t *batch_p)
+{
+    int res;
+    uint8_t type;
+    size_t offset;
+    struct messi_buffer_t payload;
+
+    offset = 0;
+
+    while (true) {
+        res = messi_batch_next(batch_p, &offset, &type, &payload);
+
+        if (res == 0) {
+            break;
+        }
+
+        if ((res == -1) || (type != MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER)) {
+            return (-1);
+        }
+
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  &payload,
+                                  &self_p->input.workspace);
+
+        if (res != 0) {
+            return (res);
+        }
+
+        /* Disconnected by the user? */
+        if (client_p->client_fd == -1) {
+            break;
+        }
+    }
+
+    return (0);
+}
+
+/* Handle given request. Replies to it are responses with its
+   correlation id. */
+static int handle_message_request(struct NAME_server_t *self_p,
+                                  struct NAME_server_client_t *client_p,
+                                  struct messi_buffer_t *payload_p,
+                                  struct messi_buffer_t *workspace_p)
+{
+    int res;
+    struct messi_buffer_t message;
+
+    res = messi_request_id_parse(payload_p,
+                                 &self_p->input.request_id,
+                                 &message);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    self_p->input.is_request = true;
+    res = handle_message_user(self_p, client_p, &message, workspace_p);
+    self_p->input.is_request = false;
+
+    return (res);
+}
+
+static int handle_message(struct NAME_server_t *self_p,
+                          struct NAME_server_client_t *client_p,
+                          uint32_t type,
+                          struct messi_buffer_t *payload_p)
+{
+    int res;
+
+    switch (type) {
+
+    case MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER:
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  payload_p,
+                                  &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_BATCH:
+        res = handle_message_batch(self_p, client_p, payload_p);
+        break;
+
+    case MESSI_MESSAGE_TYPE_REQUEST:
+        res = handle_message_request(self_p,
+                                     client_p,
+                                     payload_p,
+                                     &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_PING:
+        res = handle_message_ping(self_p, client_p);
+        break;
+
+    default:
+        res = -1;
+        break;
+    }
+
+    return (res);
+}
+
+/* Decode and handle the received large message of given client, and
+   release its storage. */
+static int client_large_input_complete(struct NAME_server_t *self_p,
+                                       struct NAME_server_client_t *client_p)
+{
+    int res;
+    struct messi_buffer_t payload;
+
+    payload.buf_p = client_p->large_input.buf_p;
+    payload.size = client_p->large_input.size;
+    client_p->stats.messages_in++;
+
+    if (client_p->large_input.type == MESSI_MESSAGE_TYPE_REQUEST) {
+        res = handle_message_request(self_p,
+                                     client_p,
+                                     &payload,
+                                     &self_p->large.workspace);
+    } else {
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  &payload,
+                                  &self_p->large.workspace);
+    }
+
+    /* Released later if disconnected by the user. */
+    if (client_p->client_fd != -1) {
+        client_large_input_release(client_p, self_p);
+    }
+
+    return (res);
+}
+
+/* Start receiving a large message of given size. Its payload is moved
+   from the input buffer to its storage, and the rest copied directly
+   into it as received. */
+static int client_large_input_begin(struct NAME_server_t *self_p,
+                                    struct NAME_server_client_t *client_p,
+                                    uint8_t type,
+                                    size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    if (((type != MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER)
+         && (type != MESSI_MESSAGE_TYPE_REQUEST))
+        || (size > self_p->large.max_size)) {
+        return (-1);
+    }
+
+    large_p = &client_p->large_input;
+    large_p->type = type;
+    large_p->size = size;
+    large_p->buf_p = self_p->large.on_client_large_message(self_p,
+                                                           client_p,
+                                                           size);
+    large_p->pooled = (large_p->buf_p == NULL);
+
+    if (large_p->pooled) {
+        large_p->pooled_size = size;
+        large_p->buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &large_p->pooled_size);
+
+        if (large_p->buf_p == NULL) {
+            return (-1);
+        }
+    }
+
+    large_p->offset = messi_framer_take(&client_p->input, large_p->buf_p, size);
+
+    if (large_p->offset == size) {
+        return (client_large_input_complete(self_p, client_p));
+    }
+
+    return (0);
+}
+
+/* Copy as much as possible of given received data to the storage of
+   a large message. Returns the number of copied bytes, or -1 if no
+   more data can be handled. */
+static ssize_t client_large_input(struct NAME_server_t *self_p,
+                                  struct NAME_server_client_t *client_p,
+                                  uint8_t *buf_p,
+                                  size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &client_p->large_input;
+
+    if (size > (large_p->size - large_p->offset)) {
+        size = (large_p->size - large_p->offset);
+    }
+
+    memcpy(&large_p->buf_p[large_p->offset], buf_p, size);
+    large_p->offset += size;
+
+    if (large_p->offset == large_p->size) {
+        if (client_large_input_complete(self_p, client_p) != 0) {
+            client_pending_disconnect(client_p, self_p);
+
+            return (-1);
+        }
+
+        /* Disconnected by the user? */
+        if (client_p->client_fd == -1) {
+            return (-1);
+        }
+    }
+
+    return (size);
+}
+
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be received from the client. */
+static int process_client_frames(struct NAME_server_t *self_p,
+                                 struct NAME_server_client_t *client_p)
+{
+    int res;
+    uint8_t type;
+    struct messi_buffer_t payload;
+
+    while (true) {
+        res = messi_framer_next(&client_p->input, &type, &payload);
+
+        if (res == 0) {
+            break;
+        } else if (res == 1) {
+            client_p->stats.messages_in++;
+            res = handle_message(self_p, client_p, type, &payload);
+        } else if (res == 2) {
+            res = client_large_input_begin(self_p,
+                                           client_p,
+                                           type,
+                                           payload.size);
+        }
+
+        if (res != 0) {
+            client_pending_disconnect(client_p, self_p);
+
+            return (-1);
+        }
+
+        /* Disconnected by the user? */
+        if (client_p->client_fd == -1) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/* Copy given received data to the input buffer of given client and
+   handle all complete frames. */
+static void client_input(struct NAME_server_t *self_p,
+                         struct NAME_server_client_t *client_p,
+                         uint8_t *buf_p,
+                         size_t size)
+{
+    size_t free_size;
+    uint8_t *free_p;
+    ssize_t res;
+
+    /* Any received data proves that the client is alive. */
+    if (client_start_keep_alive_timer(client_p) != 0) {
+        client_pending_disconnect(client_p, self_p);
+
+        return;
+    }
+
+    while (size > 0) {
+        if (client_p->large_input.buf_p != NULL) {
+            res = client_large_input(self_p, client_p, buf_p, size);
+
+            if (res < 0) {
+                break;
+            }
+
+            buf_p += res;
+            size -= res;
+
+            continue;
+        }
+
+        free_p = messi_framer_get_free(&client_p->input, &free_size);
+
+        if (free_size == 0) {
+            client_pending_disconnect(client_p, self_p);
+            break;
+        }
+
+        if (free_size > size) {
+            free_size = size;
+        }
+
+        memcpy(free_p, buf_p, free_size);
+        messi_framer_commit(&client_p->input, free_size);
+
+        if (process_client_frames(self_p, client_p) != 0) {
+            break;
+        }
+
+        buf_p += free_size;
+        size -= free_size;
+    }
+}
+
+static void process_client_recv(struct NAME_server_t *self_p,
+                                struct NAME_server_client_t *client_p,
+                                int res,
+                                uint32_t flags)
+{
+    uint16_t bid;
+
+    client_p->stats.reads++;
+
+    if (res > 0) {
+        client_p->stats.bytes_in += res;
+    } else if ((res == -EAGAIN) || (res == -ENOBUFS)) {
+        client_p->stats.eagains++;
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if ((res > 0) && (client_p->client_fd != -1)) {
+            client_input(self_p,
+                         client_p,
+                         messi_uring_buf_ring_get(&self_p->input_buffers, bid),
+                         (size_t)res);
+        }
+
+        messi_uring_buf_ring_recycle(&self_p->input_buffers, bid);
+    }
+
+    /* Out of buffers terminates the receive, but not the
+       connection. */
+    if ((res == 0) || ((res < 0) && (res != -ENOBUFS))) {
+        client_pending_disconnect(client_p, self_p);
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        if (client_p->client_fd != -1) {
+            if (client_prepare_recv(client_p) != 0) {
+                client_pending_disconnect(client_p, self_p);
+            }
+        }
+
+        client_operation_completed(client_p, self_p);
+    }
+}
+
+static void process_client_send(struct NAME_server_t *self_p,
+                                struct NAME_server_client_t *client_p,
+                                int res)
+{
+    client_p->output.size = 0;
+    client_p->stats.writes++;
+
+    if (res > 0) {
+        client_p->stats.bytes_out += res;
+    }
+
+    if (client_p->client_fd != -1) {
+        if (res < 0) {
+            client_pending_disconnect(client_p, self_p);
+        } else {
+            messi_output_queue_consume(&client_p->output.queue, (size_t)res);
+
+            if (client_prepare_send(client_p) != 0) {
+                client_pending_disconnect(client_p, self_p);
+            } else if (!client_p->output.writable
+                       && (messi_output_queue_size(&client_p->output.queue)
+                           <= self_p->watermarks.low)) {
+                client_set_writable(client_p, self_p, true);
+            }
+        }
+    }
+
+    client_operation_completed(client_p, self_p);
+}
+
+static void process_completion(struct NAME_server_t *self_p,
+                               uint64_t user_data,
+                               int res,
+                               uint32_t flags)
+{
+    struct NAME_server_client_t *client_p;
+
+    client_p = (struct NAME_server_client_t *)(uintptr_t)(user_data
+                                                          & ~OPERATION_MASK);
+
+    switch (user_data & OPERATION_MASK) {
+
+    case OPERATION_ACCEPT:
+        process_accept(self_p, res, flags);
+        break;
+
+    case OPERATION_TICK:
+        process_tick(self_p);
+        break;
+
+    case OPERATION_RECV:
+        process_client_recv(self_p, client_p, res, flags);
+        break;
+
+    default:
+        process_client_send(self_p, client_p, res);
+        break;
+    }
+}
+
+/* Handle all completed operations, and then submit all operations
+   they started with a single system call. */
+static void process_completions(struct NAME_server_t *self_p)
+{
+    struct io_uring_cqe *cqe_p;
+    uint64_t user_data;
+    int res;
+    uint32_t flags;
+
+    self_p->processing = true;
+
+    while (true) {
+        cqe_p = messi_uring_peek_cqe(&self_p->uring);
+
+        if (cqe_p == NULL) {
+            break;
+        }
+
+        user_data = cqe_p->user_data;
+        res = cqe_p->res;
+        flags = cqe_p->flags;
+        messi_uring_cqe_seen(&self_p->uring);
+        process_completion(self_p, user_data, res, flags);
+    }
+
+    self_p->processing = false;
+    submit(self_p);
+}
+
+static void on_client_keep_alive_timeout(struct NAME_server_client_t *client_p)
+{
+    client_p->stats.keep_alive_misses++;
+    client_pending_disconnect(client_p, client_p->server_p);
+}
+
+ON_DEFAULTS
+/* Encode the output message into a frame. A response starts with the
+   correlation id of the request being handled. */
+static int encode_user_message(struct NAME_server_t *self_p, bool is_response)
+{
+    int payload_size;
+    int size;
+    size_t offset;
+    uint8_t type;
+
+    offset = sizeof(struct messi_header_t);
+    type = MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER;
+
+    if (is_response) {
+        messi_request_id_write(&self_p->output.encoded.buf_p[offset],
+                               self_p->input.request_id);
+        offset += MESSI_REQUEST_ID_SIZE;
+        type = MESSI_MESSAGE_TYPE_RESPONSE;
+    }
+
+    payload_size = NAME_server_to_client_encode(
+        self_p->output.message_p,
+        &self_p->output.encoded.buf_p[offset],
+        self_p->output.encoded.size - offset);
+
+    if (payload_size < 0) {
+        return (payload_size);
+    }
+
+    payload_size += (offset - sizeof(struct messi_header_t));
+    size = messi_frame_create(self_p->output.encoded.buf_p,
+                              self_p->output.encoded.size,
+                              type,
+                              payload_size);
+
+    if ((size > 0)
+        && (self_p->compression.threshold > 0)
+        && ((size_t)payload_size >= self_p->compression.threshold)
+        && (payload_size <= MESSI_HEADER_SIZE_MAX)) {
+        size = messi_frame_compress(self_p->output.encoded.buf_p,
+                                    size,
+                                    self_p->compression.codec_p,
+                                    self_p->compression.buffer.buf_p,
+                                    self_p->compression.buffer.size);
+    }
+
+    return (size);
+}
+
+static void on_client_connected_default(struct NAME_server_t *self_p,
+                                        struct NAME_server_client_t *client_p)
+{
+        (void)self_p;
+        (void)client_p;
+}
+
+static void on_client_disconnected_default(struct NAME_server_t *self_p,
+                                           struct NAME_server_client_t *client_p)
+{
+        (void)self_p;
+        (void)client_p;
+}
+
+static uint8_t *on_client_large_message_default(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p,
+    size_t size)
+{
+        (void)self_p;
+        (void)client_p;
+        (void)size;
+
+        return (NULL);
+}
+
+static void on_client_writable_changed_default(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p,
+    bool writable)
+{
+        (void)self_p;
+        (void)client_p;
+        (void)writable;
+}
+
+void NAME_server_new_output_message(struct NAME_server_t *self_p)
+{
+    self_p->output.message_p = NAME_server_to_client_new(
+        &self_p->output.workspace.buf_p[0],
+        self_p->output.workspace.size);
+}
+
+/* Initialize all clients as free. */
+static void init_clients(struct NAME_server_t *self_p)
+{
+    struct NAME_server_client_t *clients_p;
+    int i;
+
+    clients_p = self_p->clients.clients_p;
+
+    for (i = 0; i < self_p->clients.max; i++) {
+        clients_p[i].next_p = &clients_p[i + 1];
+        clients_p[i].client_fd = -1;
+        clients_p[i].operations = 0;
+        clients_p[i].closing = false;
+        clients_p[i].output.size = 0;
+    }
+
+    clients_p[self_p->clients.max - 1].next_p = NULL;
+    self_p->clients.free_list_p = &clients_p[0];
+    self_p->clients.connected_list_p = NULL;
+    self_p->clients.pending_disconnect_list_p = NULL;
+    self_p->clients.closing_list_p = NULL;
+}
+
+int NAME_server_init(
+    struct NAME_server_t *self_p,
+    const char *server_uri_p,
+    struct NAME_server_client_t *clients_p,
+    int clients_max,
+    uint8_t *clients_input_bufs_p,
+    size_t client_input_size,
+    uint8_t *message_buf_p,
+    size_t message_size,
+    uint8_t *workspace_in_buf_p,
+    size_t workspace_in_size,
+    uint8_t *workspace_out_buf_p,
+    size_t workspace_out_size,
+    NAME_server_on_client_connected_t on_client_connected,
+    NAME_server_on_client_disconnected_t on_client_disconnected,
+ON_MESSAGE_PARAMS
+    int epoll_fd,
+    messi_epoll_ctl_t epoll_ctl)
+{
+    int i;
+    int res;
+
+ON_PARAMS_DEFAULT
+    if (on_client_connected == NULL) {
+        on_client_connected = on_client_connected_default;
+    }
+
+    if (on_client_disconnected == NULL) {
+        on_client_disconnected = on_client_disconnected_default;
+    }
+
+    if (epoll_ctl == NULL) {
+        epoll_ctl = messi_epoll_ctl_default;
+    }
+
+    res = messi_parse_tcp_uri(server_uri_p,
+                              &self_p->server.address[0],
+                              sizeof(self_p->server.address),
+                              &self_p->server.port);
+
+    if (res != 0) {
+        return (res);
+    }
+
+ON_PARAMS_ASSIGN
+    self_p->epoll_fd = epoll_fd;
+    self_p->epoll_ctl = epoll_ctl;
+    self_p->listener_fd = -1;
+    self_p->listen_backlog = 5;
+    self_p->keep_alive_timeout_ms = 3000;
+    self_p->watermarks.high = 0;
+    self_p->watermarks.low = 0;
+    self_p->watermarks.on_client_writable_changed =
+        on_client_writable_changed_default;
+    self_p->large.max_size = 0;
+    self_p->large.workspace.buf_p = NULL;
+    self_p->large.workspace.size = 0;
+    messi_large_pool_init(&self_p->large.pool);
+    self_p->large.on_client_large_message = on_client_large_message_default;
+    self_p->compression.threshold = 0;
+    self_p->compression.codec_p = &messi_codec_lz4;
+    self_p->compression.buffer.buf_p = NULL;
+    self_p->compression.buffer.size = 0;
+    self_p->uring.fd = -1;
+    self_p->processing = false;
+    self_p->tick.tv_sec = 0;
+    self_p->tick.tv_nsec = (1000000L * MESSI_TIMER_WHEEL_TICK_MS);
+
+    /* Lists of clients. */
+    self_p->clients.clients_p = clients_p;
+    self_p->clients.max = clients_max;
+    self_p->clients.input_buffer_size = client_input_size;
+
+    for (i = 0; i < clients_max; i++) {
+        clients_p[i].server_p = self_p;
+        messi_framer_init(&clients_p[i].input,
+                          &clients_input_bufs_p[i * client_input_size],
+                          client_input_size);
+        clients_p[i].large_input.buf_p = NULL;
+        messi_output_queue_init(&clients_p[i].output.queue);
+        messi_timer_init(&clients_p[i].keep_alive_timer,
+                         (messi_timer_on_timeout_t)on_client_keep_alive_timeout,
+                         &clients_p[i]);
+    }
+
+    init_clients(self_p);
+    self_p->input.workspace.buf_p = workspace_in_buf_p;
+    self_p->input.workspace.size = workspace_in_size;
+    self_p->output.encoded.buf_p = message_buf_p;
+    self_p->output.encoded.size = message_size;
+    self_p->output.workspace.buf_p = workspace_out_buf_p;
+    self_p->output.workspace.size = workspace_out_size;
+    self_p->on_client_connected = on_client_connected;
+    self_p->on_client_disconnected = on_client_disconnected;
+    self_p->current_client_p = NULL;
+
+    return (0);
+}
+
+void NAME_server_set_listen_backlog(struct NAME_server_t *self_p, int backlog)
+{
+    self_p->listen_backlog = backlog;
+}
+
+void NAME_server_set_keep_alive_timeout(struct NAME_server_t *self_p,
+                                        int timeout_ms)
+{
+    self_p->keep_alive_timeout_ms = timeout_ms;
+}
+
+void NAME_server_set_client_output_watermarks(
+    struct NAME_server_t *self_p,
+    size_t high,
+    size_t low,
+    NAME_server_on_client_writable_changed_t on_client_writable_changed)
+{
+    if (on_client_writable_changed == NULL) {
+        on_client_writable_changed = on_client_writable_changed_default;
+    }
+
+    self_p->watermarks.high = high;
+    self_p->watermarks.low = low;
+    self_p->watermarks.on_client_writable_changed = on_client_writable_changed;
+}
+
+void NAME_server_set_compression(struct NAME_server_t *self_p,
+                                 size_t threshold,
+                                 const struct messi_codec_t *codec_p,
+                                 uint8_t *buf_p,
+                                 size_t size)
+{
+    if (codec_p == NULL) {
+        codec_p = &messi_codec_lz4;
+    }
+
+    self_p->compression.threshold = threshold;
+    self_p->compression.codec_p = codec_p;
+    self_p->compression.buffer.buf_p = buf_p;
+    self_p->compression.buffer.size = size;
+}
+
+void NAME_server_set_large_messages(
+    struct NAME_server_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    NAME_server_on_client_large_message_t on_client_large_message)
+{
+    if (on_client_large_message == NULL) {
+        on_client_large_message = on_client_large_message_default;
+    }
+
+    self_p->large.max_size = max_size;
+    self_p->large.workspace.buf_p = workspace_buf_p;
+    self_p->large.workspace.size = workspace_size;
+    self_p->large.on_client_large_message = on_client_large_message;
+}
+
+/* Create a listener socket bound to the server address. Accepted
+   sockets inherit its TCP_NODELAY. Returns the socket, or -1 on
+   failure. */
+static int listener_open(struct NAME_server_t *self_p)
+{
+    int res;
+    int listener_fd;
+    struct sockaddr_in addr;
+    int enable;
+
+    listener_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (listener_fd == -1) {
+        return (-1);
+    }
+
+    enable = 1;
+
+    res = setsockopt(listener_fd,
+                     SOL_SOCKET,
+                     SO_REUSEADDR,
+                     &enable,
+                     sizeof(enable));
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    res = setsockopt(listener_fd,
+                     IPPROTO_TCP,
+                     TCP_NODELAY,
+                     &enable,
+                     sizeof(enable));
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((short)self_p->server.port);
+
+    if (strlen(&self_p->server.address[0]) > 0) {
+        res = inet_aton(&self_p->server.address[0],
+                        (struct in_addr *)&addr.sin_addr.s_addr);
+
+        if (res != 1) {
+            goto out1;
+        }
+    } else {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
+    res = bind(listener_fd, (struct sockaddr *)&addr, sizeof(addr));
+
+    if (res == -1) {
+        goto out1;
+    }
+
+    res = listen(listener_fd, self_p->listen_backlog);
+
+    if (res == -1) {
+        goto out1;
+    }
+
+    return (listener_fd);
+
+ out1:
+    close(listener_fd);
+
+    return (-1);
+}
+
+/* One provided receive buffer per client, rounded up to a power of
+   two. Buffers are only used while received data is handled, so
+   fewer are needed if most clients are idle. */
+static unsigned input_buffers_count(struct NAME_server_t *self_p)
+{
+    unsigned count;
+
+    count = INPUT_BUFFERS_MIN;
+
+    while ((count < (unsigned)self_p->clients.max)
+           && (count < INPUT_BUFFERS_MAX)) {
+        count *= 2;
+    }
+
+    return (count);
+}
+
+int NAME_server_start(struct NAME_server_t *self_p)
+{
+    int res;
+
+    self_p->listener_fd = listener_open(self_p);
+
+    if (self_p->listener_fd == -1) {
+        return (-1);
+    }
+
+    res = messi_uring_init(&self_p->uring,
+                           URING_ENTRIES,
+                           (2 * URING_ENTRIES
+                            + URING_CQ_ENTRIES_PER_CLIENT * self_p->clients.max));
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    res = messi_uring_buf_ring_init(&self_p->input_buffers,
+                                    &self_p->uring,
+                                    0,
+                                    input_buffers_count(self_p),
+                                    self_p->clients.input_buffer_size);
+
+    if (res != 0) {
+        goto out2;
+    }
+
+    res = epoll_ctl_add(self_p, self_p->uring.fd);
+
+    if (res == -1) {
+        goto out3;
+    }
+
+    messi_timer_wheel_init_external(&self_p->timers, MESSI_TIMER_WHEEL_TICK_MS);
+
+    if (prepare_accept(self_p) != 0) {
+        goto out4;
+    }
+
+    if (prepare_tick(self_p) != 0) {
+        goto out4;
+    }
+
+    if (messi_uring_submit(&self_p->uring) != 0) {
+        goto out4;
+    }
+
+    return (0);
+
+ out4:
+    epoll_ctl_del(self_p, self_p->uring.fd);
+
+ out3:
+    messi_uring_buf_ring_destroy(&self_p->input_buffers, &self_p->uring);
+
+ out2:
+    messi_uring_destroy(&self_p->uring);
+
+ out1:
+    close(self_p->listener_fd);
+    self_p->listener_fd = -1;
+
+    return (-1);
+}
+
+void NAME_server_stop(struct NAME_server_t *self_p)
+{
+    struct NAME_server_client_t *client_p;
+    int i;
+
+    /* Destroying the io_uring instance cancels all operations. */
+    epoll_ctl_del(self_p, self_p->uring.fd);
+    messi_uring_buf_ring_destroy(&self_p->input_buffers, &self_p->uring);
+    messi_uring_destroy(&self_p->uring);
+    close(self_p->listener_fd);
+    self_p->listener_fd = -1;
+    client_p = self_p->clients.connected_list_p;
+
+    while (client_p != NULL) {
+        close(client_p->client_fd);
+        messi_timer_stop(&self_p->timers, &client_p->keep_alive_timer);
+        client_p = client_p->next_p;
+    }
+
+    for (i = 0; i < self_p->clients.max; i++) {
+        messi_output_queue_destroy(&self_p->clients.clients_p[i].output.queue);
+        client_large_input_release(&self_p->clients.clients_p[i], self_p);
+    }
+
+    messi_large_pool_destroy(&self_p->large.pool);
+    init_clients(self_p);
+}
+
+int NAME_server_process_event(struct NAME_server_t *self_p,
+                              int fd,
+                              uint32_t events)
+{
+    (void)events;
+
+    if (fd != self_p->uring.fd) {
+        return (-1);
+    }
+
+    process_completions(self_p);
+
+    return (0);
+}
+
+void NAME_server_process_deferred(struct NAME_server_t *self_p)
+{
+    destroy_pending_disconnect_clients(self_p);
+}
+
+void NAME_server_process(struct NAME_server_t *self_p, int fd, uint32_t events)
+{
+    NAME_server_process_event(self_p, fd, events);
+    NAME_server_process_deferred(self_p);
+}
+
+static void send_to_client(struct NAME_server_t *self_p,
+                           struct NAME_server_client_t *client_p,
+                           bool is_response)
+{
+    int res;
+    struct messi_shared_buffer_t *shared_p;
+
+    res = encode_user_message(self_p, is_response);
+
+    if (res < 0) {
+        return;
+    }
+
+    shared_p = NULL;
+    client_write(self_p, client_p, self_p->output.encoded.buf_p, res, &shared_p);
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+
+    submit(self_p);
+}
+
+void NAME_server_send(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p)
+{
+    send_to_client(self_p, client_p, false);
+}
+
+void NAME_server_reply(struct NAME_server_t *self_p)
+{
+    if (self_p->current_client_p != NULL) {
+        send_to_client(self_p,
+                       self_p->current_client_p,
+                       self_p->input.is_request);
+    }
+}
+
+void NAME_server_broadcast(struct NAME_server_t *self_p)
+{
+    int res;
+    struct NAME_server_client_t *client_p;
+    struct NAME_server_client_t *next_client_p;
+    struct messi_shared_buffer_t *shared_p;
+
+    /* Create the message. */
+    res = encode_user_message(self_p, false);
+
+    if (res < 0) {
+        return;
+    }
+
+    /* Send it to all clients. They all share one copy. */
+    shared_p = NULL;
+    client_p = self_p->clients.connected_list_p;
+
+    while (client_p != NULL) {
+        next_client_p = client_p->next_p;
+        client_write(self_p, client_p, self_p->output.encoded.buf_p, res, &shared_p);
+        client_p = next_client_p;
+    }
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+
+    submit(self_p);
+}
+
+size_t NAME_server_client_output_bytes(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p)
+{
+    (void)self_p;
+
+    return (messi_output_queue_size(&client_p->output.queue));
+}
+
+void NAME_server_client_get_stats(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p,
+    struct messi_stats_t *stats_p)
+{
+    (void)self_p;
+
+    *stats_p = client_p->stats;
+    stats_p->output_bytes = messi_output_queue_size(&client_p->output.queue);
+}
+
+void NAME_server_disconnect(
+    struct NAME_server_t *self_p,
+    struct NAME_server_client_t *client_p)
+{
+    if (client_p == NULL) {
+        client_p = self_p->current_client_p;
+    }
+
+    if (client_p == NULL) {
+        return;
+    }
+
+    client_pending_disconnect(client_p, self_p);
+}
+
+INIT_MESSAGES
@@ -29,13 +29,18 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/timerfd.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include "messi.h"
 #include "NAME_client.h"
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 static int epoll_ctl_add(struct NAME_client_t *self_p, int fd)
 {
     return (self_p->epoll_ctl(self_p->epoll_fd, EPOLL_CTL_ADD, fd, EPOLLIN));
@@ -52,13 +57,6 @@ static void close_fd(struct NAME_client_t *self_p, int fd)
     close(fd);
 }
 
-static void reset_input_encoded(struct NAME_client_t *self_p)
-{
-    self_p->input.encoded.state = NAME_client_input_state_header_t;
-    self_p->input.encoded.size = 0;
-    self_p->input.encoded.left = sizeof(struct messi_header_t);
-}
-
 static void pending_disconnect(struct NAME_client_t *self_p,
                                enum messi_disconnect_reason_t disconnect_reason)
 {
@@ -68,34 +66,296 @@ static void pending_disconnect(struct NAME_client_t *self_p,
 
     self_p->disconnect_reason = disconnect_reason;
     close_fd(self_p, self_p->server_fd);
+    messi_shm_close(&self_p->shm);
     self_p->server_fd = -1;
     self_p->pending_disconnect = true;
 }
 
-static void handle_message_user(struct NAME_client_t *self_p)
+/* Read from the server, over the socket or the shared memory. */
+static ssize_t transport_read(struct NAME_client_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_read(&self_p->shm, buf_p, size));
+    }
+
+    return (read(self_p->server_fd, buf_p, size));
+}
+
+/* Write to the server, over the socket or the shared memory. */
+static ssize_t transport_write(struct NAME_client_t *self_p,
+                               const void *buf_p,
+                               size_t size)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_write(&self_p->shm, buf_p, size));
+    }
+
+    return (write(self_p->server_fd, buf_p, size));
+}
+
+static ssize_t transport_writev(struct NAME_client_t *self_p,
+                                const struct iovec *iov_p,
+                                int iovcnt)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_writev(&self_p->shm, iov_p, iovcnt));
+    }
+
+    return (writev(self_p->server_fd, iov_p, iovcnt));
+}
+
+static bool output_is_empty(struct NAME_client_t *self_p)
+{
+    return (messi_output_queue_is_empty(&self_p->output.queue)
+            && (messi_ring_used(&self_p->output.ring) == 0));
+}
+
+/* Number of enqueued bytes not yet written. */
+static size_t output_size(struct NAME_client_t *self_p)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        return (messi_ring_used(&self_p->output.ring));
+    }
+
+    return (messi_output_queue_size(&self_p->output.queue));
+}
+
+static void output_clear(struct NAME_client_t *self_p)
+{
+    messi_ring_reset(&self_p->output.ring);
+    messi_output_queue_clear(&self_p->output.queue);
+    self_p->output.writable = true;
+}
+
+static void set_writable(struct NAME_client_t *self_p, bool writable)
+{
+    self_p->output.writable = writable;
+    self_p->watermarks.on_writable_changed(self_p, writable);
+}
+
+static int output_append_queue(struct NAME_client_t *self_p,
+                               const uint8_t *buf_p,
+                               size_t size)
+{
+    struct messi_shared_buffer_t *shared_p;
+    int res;
+
+    shared_p = messi_shared_buffer_new(buf_p, size);
+
+    if (shared_p == NULL) {
+        return (-1);
+    }
+
+    res = messi_output_queue_push(&self_p->output.queue, shared_p, 0);
+    messi_shared_buffer_unref(shared_p);
+
+    return (res);
+}
+
+/* Enqueue given data that could not be written. The client is
+   disconnected if it does not fit, as the stream would be corrupt if
+   any data was dropped. */
+static void output_append(struct NAME_client_t *self_p,
+                          const uint8_t *buf_p,
+                          size_t size)
+{
+    int res;
+    bool was_empty;
+    size_t size_now;
+
+    was_empty = output_is_empty(self_p);
+
+    if (self_p->output.ring.data.buf_p != NULL) {
+        res = messi_ring_write(&self_p->output.ring, buf_p, size);
+    } else {
+        res = output_append_queue(self_p, buf_p, size);
+    }
+
+    if (res != 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_connection_closed_t);
+
+        return;
+    }
+
+    /* The socket is made readable instead of writable when there is
+       free space in shared memory again, and a connecting socket
+       already waits for EPOLLOUT. */
+    if (was_empty && !self_p->server.shm && !self_p->connecting) {
+        self_p->epoll_ctl(self_p->epoll_fd,
+                          EPOLL_CTL_MOD,
+                          self_p->server_fd,
+                          EPOLLIN | EPOLLOUT);
+    }
+
+    size_now = output_size(self_p);
+
+    if (size_now > self_p->stats.output_bytes_peak) {
+        self_p->stats.output_bytes_peak = size_now;
+    }
+
+    if (self_p->output.writable
+        && (self_p->watermarks.high > 0)
+        && (size_now >= self_p->watermarks.high)) {
+        set_writable(self_p, false);
+    }
+}
+
+/* Write given frame to the server, or enqueue what could not be
+   written. Data is enqueued after earlier enqueued data, and while
+   connecting. */
+static void write_output(struct NAME_client_t *self_p,
+                         const uint8_t *buf_p,
+                         size_t size)
+{
+    size_t offset;
+    ssize_t res;
+
+    self_p->stats.messages_out++;
+    self_p->keep_alive.output_tick = self_p->timers.tick;
+
+    if (!output_is_empty(self_p) || self_p->connecting) {
+        output_append(self_p, buf_p, size);
+
+        return;
+    }
+
+    offset = 0;
+
+    while (offset < size) {
+        res = transport_write(self_p, &buf_p[offset], size - offset);
+        self_p->stats.writes++;
+
+        if (res > 0) {
+            offset += res;
+            self_p->stats.bytes_out += res;
+        } else if ((res == -1) && (errno == EAGAIN)) {
+            self_p->stats.eagains++;
+            output_append(self_p, &buf_p[offset], size - offset);
+            break;
+        } else {
+            pending_disconnect(self_p,
+                               messi_disconnect_reason_connection_closed_t);
+            break;
+        }
+    }
+}
+
+/* Fill given array with enqueued data. Returns the number of used
+   elements. */
+static int output_get_iov(struct NAME_client_t *self_p,
+                          struct iovec *iov_p,
+                          size_t *size_p)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        *size_p = messi_ring_used(&self_p->output.ring);
+
+        return (messi_ring_get_iov(&self_p->output.ring, iov_p));
+    }
+
+    return (messi_output_queue_get_iov(&self_p->output.queue,
+                                       iov_p,
+                                       IOV_MAX,
+                                       size_p));
+}
+
+/* Remove given number of written bytes from the output. */
+static void output_consume(struct NAME_client_t *self_p, size_t size)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        messi_ring_consume(&self_p->output.ring, size);
+    } else {
+        messi_output_queue_consume(&self_p->output.queue, size);
+    }
+}
+
+static void process_socket_out(struct NAME_client_t *self_p)
+{
+    struct iovec iov[IOV_MAX];
+    int iovcnt;
+    size_t size;
+    ssize_t res;
+
+    while (!output_is_empty(self_p)) {
+        iovcnt = output_get_iov(self_p, &iov[0], &size);
+        res = transport_writev(self_p, &iov[0], iovcnt);
+        self_p->stats.writes++;
+
+        if (res > 0) {
+            output_consume(self_p, res);
+            self_p->stats.bytes_out += res;
+
+            /* The socket buffer is full if not everything was
+               written. Wait for the next EPOLLOUT. */
+            if ((size_t)res < size) {
+                break;
+            }
+        } else if ((res == -1) && (errno == EAGAIN)) {
+            self_p->stats.eagains++;
+            break;
+        } else {
+            pending_disconnect(self_p,
+                               messi_disconnect_reason_connection_closed_t);
+
+            return;
+        }
+    }
+
+    if (output_is_empty(self_p) && !self_p->server.shm) {
+        self_p->epoll_ctl(self_p->epoll_fd,
+                          EPOLL_CTL_MOD,
+                          self_p->server_fd,
+                          EPOLLIN);
+    }
+
+    if (!self_p->output.writable
+        && (output_size(self_p) <= self_p->watermarks.low)) {
+        set_writable(self_p, true);
+    }
+}
+
+/* Decode given message into given workspace. Returns NULL on
+   failure. */
+static struct NAME_server_to_client_t *decode_message(
+    struct NAME_client_t *self_p,
+    struct messi_buffer_t *payload_p,
+    struct messi_buffer_t *workspace_p)
 {
     int res;
     struct NAME_server_to_client_t *message_p;
-    uint8_t *payload_buf_p;
-    size_t payload_size;
 
     self_p->input.message_p = NAME_server_to_client_new(
-        &self_p->input.workspace.buf_p[0],
-        self_p->input.workspace.size);
+        &workspace_p->buf_p[0],
+        workspace_p->size);
     message_p = self_p->input.message_p;
 
     if (message_p == NULL) {
-        return;
+        return (NULL);
     }
 
-    payload_buf_p = &self_p->input.encoded.data.buf_p[sizeof(struct messi_header_t)];
-    payload_size = (self_p->input.encoded.size - sizeof(struct messi_header_t));
-
-    res = NAME_server_to_client_decode(message_p, payload_buf_p, payload_size);
+    res = NAME_server_to_client_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
 
-    if (res != (int)payload_size) {
+    if (res != (int)payload_p->size) {
         pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
 
+        return (NULL);
+    }
+
+    return (message_p);
+}
+
+static void handle_message_user(struct NAME_client_t *self_p,
+                                struct messi_buffer_t *payload_p,
+                                struct messi_buffer_t *workspace_p)
+{
+    struct NAME_server_to_client_t *message_p;
+
+    message_p = decode_message(self_p, payload_p, workspace_p);
+
+    if (message_p == NULL) {
         return;
     }
 
@@ -107,22 +367,231 @@ HANDLE_CASES
     }
 }
 
-static void handle_message_pong(struct NAME_client_t *self_p)
+/* Remove given request from the window. */
+static void request_release(struct NAME_client_t *self_p,
+                            struct NAME_client_request_t *request_p)
+{
+    messi_timer_stop(&self_p->timers, &request_p->timer);
+    request_p->on_response = NULL;
+    request_p->next_free_p = self_p->requests.free_list_p;
+    self_p->requests.free_list_p = request_p;
+    self_p->requests.length--;
+}
+
+/* Release given request before calling its response callback, which
+   may send a new request. */
+static void request_complete(struct NAME_client_t *self_p,
+                             struct NAME_client_request_t *request_p,
+                             enum messi_request_status_t status,
+                             struct NAME_server_to_client_t *message_p)
+{
+    NAME_client_on_response_t on_response;
+    void *obj_p;
+
+    on_response = request_p->on_response;
+    obj_p = request_p->obj_p;
+    request_release(self_p, request_p);
+    on_response(self_p, status, message_p, obj_p);
+}
+
+/* Complete all requests in flight with given status. */
+static void requests_complete(struct NAME_client_t *self_p,
+                              enum messi_request_status_t status)
+{
+    size_t i;
+    struct NAME_client_request_t *request_p;
+
+    for (i = 0; i < self_p->requests.max; i++) {
+        request_p = &self_p->requests.requests_p[i];
+
+        if (request_p->on_response != NULL) {
+            request_complete(self_p, request_p, status, NULL);
+        }
+    }
+}
+
+static void on_request_timeout(struct NAME_client_request_t *request_p)
+{
+    request_complete(request_p->client_p,
+                     request_p,
+                     messi_request_status_timeout_t,
+                     NULL);
+}
+
+/* Returns the request in flight with given id, or NULL if none. A
+   response may arrive after its request timed out. */
+static struct NAME_client_request_t *request_find(struct NAME_client_t *self_p,
+                                                  uint32_t id)
+{
+    size_t index;
+    struct NAME_client_request_t *request_p;
+
+    index = (id & 0xffff);
+
+    if (index >= self_p->requests.max) {
+        return (NULL);
+    }
+
+    request_p = &self_p->requests.requests_p[index];
+
+    if ((request_p->on_response == NULL) || (request_p->id != id)) {
+        return (NULL);
+    }
+
+    return (request_p);
+}
+
+static void handle_message_response(struct NAME_client_t *self_p,
+                                    struct messi_buffer_t *payload_p,
+                                    struct messi_buffer_t *workspace_p)
+{
+    int res;
+    uint32_t id;
+    struct messi_buffer_t message;
+    struct NAME_server_to_client_t *message_p;
+    struct NAME_client_request_t *request_p;
+
+    res = messi_request_id_parse(payload_p, &id, &message);
+
+    if (res != 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+
+        return;
+    }
+
+    message_p = decode_message(self_p, &message, workspace_p);
+
+    if (message_p == NULL) {
+        return;
+    }
+
+    request_p = request_find(self_p, id);
+
+    if (request_p != NULL) {
+        request_complete(self_p, request_p, messi_request_status_ok_t, message_p);
+    }
+}
+
+/* Handle all messages in given batch in order. */
+static void handle_message_batch(struct NAME_client_t *self_p,
+                                 struct messi_buffer_t *batch_p)
+{
+    int res;
+    uint8_t type;
+    size_t offset;
+    struct messi_buffer_t payload;
+
+    offset = 0;
+
+    while (true) {
+        res = messi_batch_next(batch_p, &offset, &type, &payload);
+
+        if (res == 0) {
+            break;
+        }
+
+        if ((res == -1) || (type != MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER)) {
+            pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+            break;
+        }
+
+        handle_message_user(self_p, &payload, &self_p->input.workspace);
+
+        /* Disconnected? */
+        if (self_p->server_fd == -1) {
+            break;
+        }
+    }
+}
+
+/* Decompress given compressed frame payload into storage from the
+   large messages pool, and handle it. */
+static void handle_message_compressed(struct NAME_client_t *self_p,
+                                      struct messi_buffer_t *payload_p)
 {
-    self_p->pong_received = true;
+    int res;
+    uint8_t type;
+    uint8_t codec;
+    size_t size;
+    size_t size_max;
+    size_t pooled_size;
+    struct messi_buffer_t data;
+    struct messi_buffer_t decompressed;
+
+    res = messi_compressed_parse(payload_p, &type, &codec, &size, &data);
+
+    /* At most as large as an uncompressed message. */
+    size_max = self_p->input.encoded.data.size;
+
+    if (self_p->large.max_size > size_max) {
+        size_max = self_p->large.max_size;
+    }
+
+    if ((res != 0)
+        || (codec != self_p->input.codec_p->id)
+        || (size > size_max)) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+
+        return;
+    }
+
+    pooled_size = size;
+    decompressed.buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &pooled_size);
+
+    if (decompressed.buf_p == NULL) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+        return;
+    }
+
+    res = self_p->input.codec_p->decompress(data.buf_p,
+                                            data.size,
+                                            decompressed.buf_p,
+                                            size);
+    decompressed.size = size;
+
+    if (res != (int)size) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+    } else if (type == MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER) {
+        handle_message_user(self_p, &decompressed, &self_p->input.workspace);
+    } else if (type == MESSI_MESSAGE_TYPE_RESPONSE) {
+        handle_message_response(self_p, &decompressed, &self_p->input.workspace);
+    } else if (type == MESSI_MESSAGE_TYPE_BATCH) {
+        handle_message_batch(self_p, &decompressed);
+    } else {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+    }
+
+    messi_large_pool_free(&self_p->large.pool,
+                          decompressed.buf_p,
+                          pooled_size);
 }
 
 static void handle_message(struct NAME_client_t *self_p,
-                           uint32_t type)
+                           uint32_t type,
+                           struct messi_buffer_t *payload_p)
 {
     switch (type) {
 
     case MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER:
-        handle_message_user(self_p);
+        handle_message_user(self_p, payload_p, &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_RESPONSE:
+        handle_message_response(self_p, payload_p, &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_BATCH:
+        handle_message_batch(self_p, payload_p);
+        break;
+
+    case MESSI_MESSAGE_TYPE_COMPRESSED:
+        handle_message_compressed(self_p, payload_p);
         break;
 
     case MESSI_MESSAGE_TYPE_PONG:
-        handle_message_pong(self_p);
+        /* Any input proves that the server is alive. */
         break;
 
     default:
@@ -130,119 +599,409 @@ static void handle_message(struct NAME_client_t *self_p,
     }
 }
 
-static int start_timer(int fd, int seconds)
+/* Release the storage of any large message being received. */
+static void large_input_release(struct NAME_client_t *self_p)
 {
-    struct itimerspec timeout;
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->input.large;
 
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = seconds;
+    if (large_p->buf_p == NULL) {
+        return;
+    }
 
-    return (timerfd_settime(fd, 0, &timeout, NULL));
+    if (large_p->pooled) {
+        messi_large_pool_free(&self_p->large.pool,
+                              large_p->buf_p,
+                              large_p->pooled_size);
+    }
+
+    large_p->buf_p = NULL;
 }
 
 static void disconnect(struct NAME_client_t *self_p)
 {
+    large_input_release(self_p);
+    self_p->output.batch_size = 0;
+    output_clear(self_p);
     pending_disconnect(self_p, 0);
-    close_fd(self_p, self_p->keep_alive_timer_fd);
-    self_p->keep_alive_timer_fd = -1;
+    messi_timer_stop(&self_p->timers, &self_p->keep_alive_timer);
+    messi_timer_stop(&self_p->timers, &self_p->connect_timer);
+    self_p->connecting = false;
     self_p->pending_disconnect = false;
+    requests_complete(self_p, messi_request_status_disconnected_t);
 }
 
 static int start_keep_alive_timer(struct NAME_client_t *self_p)
 {
-    return (start_timer(self_p->keep_alive_timer_fd, 2));
+    return (messi_timer_start(&self_p->timers, &self_p->keep_alive_timer,
+                              self_p->keep_alive.interval_ms));
 }
 
 static int start_reconnect_timer(struct NAME_client_t *self_p)
+{
+    return (messi_timer_start(&self_p->timers,
+                              &self_p->reconnect_timer,
+                              messi_backoff_next(&self_p->backoff)));
+}
+
+static int start_connect_timer(struct NAME_client_t *self_p)
+{
+    return (messi_timer_start(&self_p->timers, &self_p->connect_timer, 3000));
+}
+
+/* The socket is connected to the server. Shared memory clients are
+   connected once the shared memory has been received. */
+static void connection_established(struct NAME_client_t *self_p)
+{
+    self_p->keep_alive.input_tick = self_p->timers.tick;
+    self_p->keep_alive.output_tick = self_p->timers.tick;
+    self_p->keep_alive.ping_sent = false;
+    messi_framer_reset(&self_p->input.encoded);
+    messi_shm_init(&self_p->shm, self_p->server_fd);
+
+    if (!self_p->server.shm) {
+        self_p->on_connected(self_p);
+    }
+}
+
+/* The connection attempt failed or timed out. The disconnected
+   callback is not called, as the client was never connected. */
+static void connect_failed(struct NAME_client_t *self_p)
+{
+    messi_timer_stop(&self_p->timers, &self_p->connect_timer);
+    close_fd(self_p, self_p->server_fd);
+    self_p->server_fd = -1;
+    self_p->connecting = false;
+    output_clear(self_p);
+    start_reconnect_timer(self_p);
+    requests_complete(self_p, messi_request_status_disconnected_t);
+}
+
+/* The socket is writable, or has an error, once the non-blocking
+   connect has completed. */
+static void process_connect(struct NAME_client_t *self_p)
 {
     int res;
+    int error;
+    socklen_t size;
+    uint32_t events;
 
-    self_p->reconnect_timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    size = sizeof(error);
+    res = getsockopt(self_p->server_fd, SOL_SOCKET, SO_ERROR, &error, &size);
 
-    if (self_p->reconnect_timer_fd == -1) {
-        return (-1);
+    if ((res != 0) || (error != 0)) {
+        connect_failed(self_p);
+
+        return;
     }
 
-    res = epoll_ctl_add(self_p, self_p->reconnect_timer_fd);
+    /* Output enqueued while connecting is written once writable. */
+    if (output_is_empty(self_p)) {
+        events = EPOLLIN;
+    } else {
+        events = (EPOLLIN | EPOLLOUT);
+    }
 
-    if (res == -1) {
-        goto out;
+    res = self_p->epoll_ctl(self_p->epoll_fd,
+                            EPOLL_CTL_MOD,
+                            self_p->server_fd,
+                            events);
+
+    if (res != 0) {
+        connect_failed(self_p);
+
+        return;
+    }
+
+    /* Start the keep alive timer first to keep the timers armed. */
+    res = start_keep_alive_timer(self_p);
+
+    if (res != 0) {
+        connect_failed(self_p);
+
+        return;
     }
 
-    return (start_timer(self_p->reconnect_timer_fd, 1));
+    messi_timer_stop(&self_p->timers, &self_p->connect_timer);
+    self_p->connecting = false;
+    connection_established(self_p);
+}
 
- out:
-    close(self_p->reconnect_timer_fd);
-    self_p->reconnect_timer_fd = -1;
+static void on_connect_timeout(struct NAME_client_t *self_p)
+{
+    connect_failed(self_p);
+}
 
-    return (-1);
+/* Decode and handle the received large message, and release its
+   storage. */
+static void large_input_complete(struct NAME_client_t *self_p)
+{
+    struct messi_buffer_t payload;
+
+    payload.buf_p = self_p->input.large.buf_p;
+    payload.size = self_p->input.large.size;
+    self_p->stats.messages_in++;
+
+    if (self_p->input.large.type == MESSI_MESSAGE_TYPE_RESPONSE) {
+        handle_message_response(self_p, &payload, &self_p->large.workspace);
+    } else {
+        handle_message_user(self_p, &payload, &self_p->large.workspace);
+    }
+
+    /* Released later if disconnected. */
+    if (!self_p->pending_disconnect) {
+        large_input_release(self_p);
+    }
 }
 
-static void process_socket(struct NAME_client_t *self_p, uint32_t events)
+/* Start receiving a large message of given size. Its payload is moved
+   from the input buffer to its storage, and the rest read directly
+   into it. */
+static void large_input_begin(struct NAME_client_t *self_p,
+                              uint8_t type,
+                              size_t size)
 {
-    (void)events;
+    struct messi_large_input_t *large_p;
 
-    ssize_t size;
-    struct messi_header_t *header_p;
+    if (((type != MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER)
+         && (type != MESSI_MESSAGE_TYPE_RESPONSE))
+        || (size > self_p->large.max_size)) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_too_big_t);
 
-    header_p = (struct messi_header_t *)self_p->input.encoded.data.buf_p;
+        return;
+    }
+
+    large_p = &self_p->input.large;
+    large_p->type = type;
+    large_p->size = size;
+    large_p->buf_p = self_p->large.on_large_message(self_p, size);
+    large_p->pooled = (large_p->buf_p == NULL);
+
+    if (large_p->pooled) {
+        large_p->pooled_size = size;
+        large_p->buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &large_p->pooled_size);
+
+        if (large_p->buf_p == NULL) {
+            pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+            return;
+        }
+    }
+
+    large_p->offset = messi_framer_take(&self_p->input.encoded,
+                                        large_p->buf_p,
+                                        size);
+
+    if (large_p->offset == size) {
+        large_input_complete(self_p);
+    }
+}
+
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be read from the server. */
+static int process_frames(struct NAME_client_t *self_p)
+{
+    int res;
+    uint8_t type;
+    struct messi_buffer_t payload;
 
     while (true) {
-        size = read(self_p->server_fd,
-                    &self_p->input.encoded.data.buf_p[self_p->input.encoded.size],
-                    self_p->input.encoded.left);
+        res = messi_framer_next(&self_p->input.encoded, &type, &payload);
+
+        if (res == 0) {
+            break;
+        } else if (res == -1) {
+            pending_disconnect(self_p, messi_disconnect_reason_message_too_big_t);
+        } else if (res == 2) {
+            large_input_begin(self_p, type, payload.size);
+        } else {
+            self_p->stats.messages_in++;
+            handle_message(self_p, type, &payload);
+        }
+
+        /* Disconnected? */
+        if (self_p->server_fd == -1) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/* Add given number of bytes read into the storage of a large
+   message. Returns zero(0) if more data can be read from the
+   server. */
+static int process_large_input(struct NAME_client_t *self_p, size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->input.large;
+    large_p->offset += size;
+
+    if (large_p->offset == large_p->size) {
+        large_input_complete(self_p);
+    }
+
+    /* Disconnected? */
+    if (self_p->server_fd == -1) {
+        return (-1);
+    }
+
+    return (0);
+}
+
+/* The server sends the shared memory over the socket once
+   connected. The client is not connected until it is received. */
+static int open_shm(struct NAME_client_t *self_p)
+{
+    int res;
+
+    res = messi_shm_open(&self_p->shm);
+
+    if (res != 0) {
+        if (errno != EAGAIN) {
+            pending_disconnect(self_p,
+                               messi_disconnect_reason_connection_closed_t);
+        }
+
+        return (-1);
+    }
+
+    self_p->on_connected(self_p);
+
+    return (0);
+}
+
+static void process_socket_in(struct NAME_client_t *self_p)
+{
+    ssize_t size;
+    size_t free_size;
+    uint8_t *buf_p;
+    struct messi_large_input_t *large_p;
+    int res;
+
+    large_p = &self_p->input.large;
+
+    do {
+        if (large_p->buf_p != NULL) {
+            buf_p = &large_p->buf_p[large_p->offset];
+            free_size = (large_p->size - large_p->offset);
+        } else {
+            buf_p = messi_framer_get_free(&self_p->input.encoded, &free_size);
+        }
+
+        size = transport_read(self_p, buf_p, free_size);
+        self_p->stats.reads++;
 
         if ((size == -1) && (errno == EAGAIN)) {
+            self_p->stats.eagains++;
             break;
         } else if (size <= 0) {
             pending_disconnect(self_p, messi_disconnect_reason_connection_closed_t);
             break;
         }
 
-        self_p->input.encoded.size += size;
-        self_p->input.encoded.left -= size;
+        self_p->stats.bytes_in += size;
+        self_p->keep_alive.input_tick = self_p->timers.tick;
+        self_p->keep_alive.ping_sent = false;
+        messi_backoff_reset(&self_p->backoff);
 
-        if (self_p->input.encoded.left > 0) {
-            continue;
+        if (large_p->buf_p != NULL) {
+            res = process_large_input(self_p, size);
+        } else {
+            messi_framer_commit(&self_p->input.encoded, size);
+            res = process_frames(self_p);
         }
 
-        if (self_p->input.encoded.state == NAME_client_input_state_header_t) {
-            self_p->input.encoded.left = messi_header_get_size(header_p);
+        if (res != 0) {
+            break;
+        }
 
-            if ((self_p->input.encoded.left + sizeof(*header_p))
-                > self_p->input.encoded.data.size) {
-                pending_disconnect(self_p,
-                                   messi_disconnect_reason_message_too_big_t);
-                break;
-            }
+        /* The socket is drained if the buffer was not filled. More
+           data is signalled by epoll. */
+    } while ((size_t)size == free_size);
+}
+
+static void process_socket(struct NAME_client_t *self_p, uint32_t events)
+{
+    if (self_p->connecting) {
+        process_connect(self_p);
 
-            self_p->input.encoded.state = NAME_client_input_state_payload_t;
+        return;
+    }
+
+    if (self_p->server.shm && !messi_shm_is_open(&self_p->shm)) {
+        if (open_shm(self_p) != 0) {
+            return;
         }
 
-        if (self_p->input.encoded.left == 0) {
-            handle_message(self_p, header_p->type);
-            reset_input_encoded(self_p);
+        /* Disconnected by the on connected callback. */
+        if (self_p->server_fd == -1) {
+            return;
         }
+
+        events |= EPOLLIN;
+    }
+
+    if (self_p->server.shm
+        && (events & EPOLLIN)
+        && !output_is_empty(self_p)) {
+        events |= EPOLLOUT;
+    }
+
+    if (events & EPOLLOUT) {
+        process_socket_out(self_p);
+
+        if (self_p->server_fd == -1) {
+            return;
+        }
+    }
+
+    if (events & EPOLLIN) {
+        process_socket_in(self_p);
     }
 }
 
-static void process_keep_alive_timer(struct NAME_client_t *self_p)
+static void on_keep_alive_timeout(struct NAME_client_t *self_p)
 {
     int res;
     struct messi_header_t header;
-    ssize_t size;
-    uint64_t value;
+    uint64_t last_tick;
+    uint64_t idle_ticks;
+    uint64_t interval_ticks;
+    int tick_ms;
 
-    size = read(self_p->keep_alive_timer_fd, &value, sizeof(value));
+    if (self_p->keep_alive.ping_sent) {
+        self_p->stats.keep_alive_misses++;
+        pending_disconnect(self_p, messi_disconnect_reason_keep_alive_timeout_t);
 
-    if (size != sizeof(value)) {
-        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+        return;
+    }
+
+    /* Ping if nothing has been sent, or nothing received, for an
+       interval. Only received data proves that the server is alive,
+       and only sent data restarts the server's keep alive timer.
+       Otherwise wait for the rest of the interval. */
+    tick_ms = self_p->timers.tick_ms;
+    interval_ticks = ((self_p->keep_alive.interval_ms + tick_ms - 1) / tick_ms);
+    last_tick = self_p->keep_alive.input_tick;
 
-        return;
+    if (self_p->keep_alive.output_tick < last_tick) {
+        last_tick = self_p->keep_alive.output_tick;
     }
 
-    if (!self_p->pong_received) {
-        pending_disconnect(self_p, messi_disconnect_reason_keep_alive_timeout_t);
+    idle_ticks = (self_p->timers.tick - last_tick);
+
+    if (idle_ticks < interval_ticks) {
+        res = messi_timer_start(&self_p->timers,
+                                &self_p->keep_alive_timer,
+                                (int)(interval_ticks - idle_ticks) * tick_ms);
+
+        if (res != 0) {
+            pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+        }
 
         return;
     }
@@ -251,85 +1010,120 @@ static void process_keep_alive_timer(struct NAME_client_t *self_p)
 
     if (res == 0) {
         messi_header_create(&header, MESSI_MESSAGE_TYPE_PING, 0);
+        write_output(self_p, (uint8_t *)&header, sizeof(header));
+        self_p->keep_alive.ping_sent = true;
+    } else {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+    }
+}
 
-        size = write(self_p->server_fd, &header, sizeof(header));
+/* The server is reached over TCP, over a unix domain socket, which
+   avoids the TCP stack for co-located processes, or over shared
+   memory set up on a unix domain socket (shm:// and mem://). */
+static int parse_server_uri(struct NAME_client_t *self_p,
+                            const char *server_uri_p)
+{
+    self_p->server.shm = (messi_is_shm_uri(server_uri_p)
+                          || messi_is_mem_uri(server_uri_p));
 
-        if (size != sizeof(header)) {
-            pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+    if (self_p->server.shm) {
+        self_p->server.domain = AF_UNIX;
 
-            return;
-        }
+        return (messi_parse_shm_uri(server_uri_p,
+                                    &self_p->server.local_addr,
+                                    &self_p->server.local_addr_size));
+    }
 
-        self_p->pong_received = false;
-    } else {
-        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+    if (messi_is_unix_uri(server_uri_p)) {
+        self_p->server.domain = AF_UNIX;
+
+        return (messi_parse_unix_uri(server_uri_p,
+                                     &self_p->server.local_addr,
+                                     &self_p->server.local_addr_size));
     }
+
+    self_p->server.domain = AF_INET;
+
+    return (messi_parse_tcp_uri(server_uri_p,
+                                &self_p->server.address[0],
+                                sizeof(self_p->server.address),
+                                &self_p->server.port));
 }
 
+/* Connect to the server without blocking. The connect usually
+   completes later, signalled by epoll, and is aborted if it takes
+   too long. */
 static int connect_to_server(struct NAME_client_t *self_p)
 {
     int res;
     int server_fd;
     struct sockaddr_in addr;
+    bool connecting;
 
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd = socket(self_p->server.domain, SOCK_STREAM, 0);
 
     if (server_fd == -1) {
         return (-1);
     }
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons((short)self_p->server.port);
-    inet_aton(&self_p->server.address[0], (struct in_addr *)&addr.sin_addr.s_addr);
-
-    res = connect(server_fd, (struct sockaddr *)&addr, sizeof(addr));
-
-    if (res == -1) {
-        goto out1;
-    }
-
     res = messi_make_non_blocking(server_fd);
 
     if (res == -1) {
         goto out1;
     }
 
-    res = epoll_ctl_add(self_p, server_fd);
+    if (self_p->server.domain == AF_UNIX) {
+        res = connect(server_fd,
+                      (struct sockaddr *)&self_p->server.local_addr,
+                      self_p->server.local_addr_size);
+    } else {
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((short)self_p->server.port);
+        inet_aton(&self_p->server.address[0],
+                  (struct in_addr *)&addr.sin_addr.s_addr);
+        res = connect(server_fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
 
-    if (res == -1) {
+    if (res == 0) {
+        connecting = false;
+    } else if (errno == EINPROGRESS) {
+        connecting = true;
+    } else {
         goto out1;
     }
 
-    self_p->keep_alive_timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-
-    if (self_p->keep_alive_timer_fd == -1) {
-        goto out2;
+    if (connecting) {
+        res = self_p->epoll_ctl(self_p->epoll_fd,
+                                EPOLL_CTL_ADD,
+                                server_fd,
+                                EPOLLOUT);
+    } else {
+        res = epoll_ctl_add(self_p, server_fd);
     }
 
-    res = epoll_ctl_add(self_p, self_p->keep_alive_timer_fd);
-
     if (res == -1) {
-        goto out3;
+        goto out1;
     }
 
-    res = start_keep_alive_timer(self_p);
+    if (connecting) {
+        res = start_connect_timer(self_p);
+    } else {
+        res = start_keep_alive_timer(self_p);
+    }
 
     if (res != 0) {
-        goto out4;
+        goto out2;
     }
 
     self_p->server_fd = server_fd;
-    self_p->pong_received = true;
-    self_p->on_connected(self_p);
-
-    return (0);
+    self_p->connecting = connecting;
 
- out4:
-    epoll_ctl_del(self_p, self_p->keep_alive_timer_fd);
+    if (!connecting) {
+        connection_established(self_p);
+    }
 
- out3:
-    close(self_p->keep_alive_timer_fd);
+    return (0);
 
  out2:
     epoll_ctl_del(self_p, server_fd);
@@ -340,11 +1134,8 @@ static int connect_to_server(struct NAME_client_t *self_p)
     return (-1);
 }
 
-static void process_reconnect_timer(struct NAME_client_t *self_p)
+static void on_reconnect_timeout(struct NAME_client_t *self_p)
 {
-    close_fd(self_p, self_p->reconnect_timer_fd);
-    self_p->reconnect_timer_fd = -1;
-
     if (connect_to_server(self_p) != 0) {
         start_reconnect_timer(self_p);
     }
@@ -355,6 +1146,22 @@ static void on_connected_default(struct NAME_client_t *self_p)
     (void)self_p;
 }
 
+static uint8_t *on_large_message_default(struct NAME_client_t *self_p,
+                                         size_t size)
+{
+    (void)self_p;
+    (void)size;
+
+    return (NULL);
+}
+
+static void on_writable_changed_default(struct NAME_client_t *self_p,
+                                       bool writable)
+{
+    (void)self_p;
+    (void)writable;
+}
+
 static void on_disconnected_default(
     struct NAME_client_t *self_p,
     enum messi_disconnect_reason_t disconnect_reason)
@@ -363,6 +1170,18 @@ static void on_disconnected_default(
     (void)disconnect_reason;
 }
 
+static void request_on_response_default(
+    struct NAME_client_t *self_p,
+    enum messi_request_status_t status,
+    struct NAME_server_to_client_t *message_p,
+    void *obj_p)
+{
+    (void)self_p;
+    (void)status;
+    (void)message_p;
+    (void)obj_p;
+}
+
 void NAME_client_new_output_message(struct NAME_client_t *self_p)
 {
     self_p->output.message_p = NAME_client_to_server_new(
@@ -403,10 +1222,7 @@ ON_PARAMS_DEFAULT
         epoll_ctl = messi_epoll_ctl_default;
     }
 
-    res = messi_parse_tcp_uri(server_uri_p,
-                              &self_p->server.address[0],
-                              sizeof(self_p->server.address),
-                              &self_p->server.port);
+    res = parse_server_uri(self_p, server_uri_p);
 
     if (res != 0) {
         return (res);
@@ -417,63 +1233,241 @@ ON_PARAMS_DEFAULT
 ON_PARAMS_ASSIGN
     self_p->epoll_fd = epoll_fd;
     self_p->epoll_ctl = epoll_ctl;
-    self_p->input.encoded.data.buf_p = encoded_in_buf_p;
-    self_p->input.encoded.data.size = encoded_in_size;
-    reset_input_encoded(self_p);
+    messi_framer_init(&self_p->input.encoded,
+                      encoded_in_buf_p,
+                      encoded_in_size);
     self_p->input.workspace.buf_p = workspace_in_buf_p;
     self_p->input.workspace.size = workspace_in_size;
     self_p->output.encoded.buf_p = encoded_out_buf_p;
     self_p->output.encoded.size = encoded_out_size;
+    self_p->output.batch_size = 0;
+    messi_output_queue_init(&self_p->output.queue);
+    messi_ring_init(&self_p->output.ring, NULL, 0);
+    self_p->output.writable = true;
+    self_p->watermarks.high = 0;
+    self_p->watermarks.low = 0;
+    self_p->watermarks.on_writable_changed = on_writable_changed_default;
     self_p->output.workspace.buf_p = workspace_out_buf_p;
     self_p->output.workspace.size = workspace_out_size;
     self_p->server_fd = -1;
-    self_p->keep_alive_timer_fd = -1;
-    self_p->reconnect_timer_fd = -1;
+    messi_shm_init(&self_p->shm, -1);
+    self_p->timers.fd = -1;
+    messi_timer_init(&self_p->keep_alive_timer,
+                     (messi_timer_on_timeout_t)on_keep_alive_timeout,
+                     self_p);
+    messi_timer_init(&self_p->reconnect_timer,
+                     (messi_timer_on_timeout_t)on_reconnect_timeout,
+                     self_p);
+    messi_timer_init(&self_p->connect_timer,
+                     (messi_timer_on_timeout_t)on_connect_timeout,
+                     self_p);
+    self_p->connecting = false;
     self_p->pending_disconnect = false;
+    self_p->keep_alive.interval_ms = 2000;
+    messi_backoff_init(&self_p->backoff, 1000, 1, 1000, false);
+    memset(&self_p->stats, 0, sizeof(self_p->stats));
+    self_p->input.large.buf_p = NULL;
+    self_p->large.max_size = 0;
+    self_p->large.workspace.buf_p = NULL;
+    self_p->large.workspace.size = 0;
+    messi_large_pool_init(&self_p->large.pool);
+    self_p->large.on_large_message = on_large_message_default;
+    self_p->input.codec_p = &messi_codec_lz4;
+    self_p->requests.requests_p = NULL;
+    self_p->requests.max = 0;
+    self_p->requests.length = 0;
+    self_p->requests.free_list_p = NULL;
+    self_p->requests.sequence = 0;
 
     return (0);
 }
 
+void NAME_client_set_codec(struct NAME_client_t *self_p,
+                           const struct messi_codec_t *codec_p)
+{
+    self_p->input.codec_p = codec_p;
+}
+
+void NAME_client_set_output_buffer(struct NAME_client_t *self_p,
+                                   uint8_t *buf_p,
+                                   size_t size)
+{
+    messi_ring_init(&self_p->output.ring, buf_p, size);
+}
+
+void NAME_client_set_output_watermarks(
+    struct NAME_client_t *self_p,
+    size_t high,
+    size_t low,
+    NAME_client_on_writable_changed_t on_writable_changed)
+{
+    if (on_writable_changed == NULL) {
+        on_writable_changed = on_writable_changed_default;
+    }
+
+    self_p->watermarks.high = high;
+    self_p->watermarks.low = low;
+    self_p->watermarks.on_writable_changed = on_writable_changed;
+}
+
+void NAME_client_set_large_messages(
+    struct NAME_client_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    NAME_client_on_large_message_t on_large_message)
+{
+    if (on_large_message == NULL) {
+        on_large_message = on_large_message_default;
+    }
+
+    self_p->large.max_size = max_size;
+    self_p->large.workspace.buf_p = workspace_buf_p;
+    self_p->large.workspace.size = workspace_size;
+    self_p->large.on_large_message = on_large_message;
+}
+
+void NAME_client_set_requests(struct NAME_client_t *self_p,
+                              struct NAME_client_request_t *requests_p,
+                              size_t length)
+{
+    size_t i;
+
+    if (length > 65536) {
+        length = 65536;
+    }
+
+    self_p->requests.requests_p = requests_p;
+    self_p->requests.max = length;
+    self_p->requests.free_list_p = NULL;
+
+    for (i = length; i > 0; i--) {
+        requests_p[i - 1].id = (i - 1);
+        requests_p[i - 1].on_response = NULL;
+        requests_p[i - 1].client_p = self_p;
+        messi_timer_init(&requests_p[i - 1].timer,
+                         (messi_timer_on_timeout_t)on_request_timeout,
+                         &requests_p[i - 1]);
+        requests_p[i - 1].next_free_p = self_p->requests.free_list_p;
+        self_p->requests.free_list_p = &requests_p[i - 1];
+    }
+}
+
+void NAME_client_set_keep_alive_interval(struct NAME_client_t *self_p,
+                                         int interval_ms)
+{
+    self_p->keep_alive.interval_ms = interval_ms;
+}
+
+void NAME_client_set_reconnect_backoff(struct NAME_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter)
+{
+    messi_backoff_init(&self_p->backoff, initial_ms, multiplier, max_ms, jitter);
+}
+
+unsigned int NAME_client_get_reconnect_attempt(struct NAME_client_t *self_p)
+{
+    return (self_p->backoff.attempt);
+}
+
 void NAME_client_start(struct NAME_client_t *self_p)
 {
+    int res;
+
+    messi_backoff_reset(&self_p->backoff);
+    res = messi_timer_wheel_init(&self_p->timers, MESSI_TIMER_WHEEL_TICK_MS);
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    res = epoll_ctl_add(self_p, self_p->timers.fd);
+
+    if (res == -1) {
+        goto out2;
+    }
+
     if (connect_to_server(self_p) != 0) {
         start_reconnect_timer(self_p);
     }
+
+    return;
+
+ out2:
+    close(self_p->timers.fd);
+    self_p->timers.fd = -1;
+
+ out1:
+    self_p->on_disconnected(self_p, messi_disconnect_reason_general_error_t);
 }
 
 void NAME_client_stop(struct NAME_client_t *self_p)
 {
     disconnect(self_p);
+    messi_timer_stop(&self_p->timers, &self_p->reconnect_timer);
+    messi_large_pool_destroy(&self_p->large.pool);
+    messi_output_queue_destroy(&self_p->output.queue);
 
-    if (self_p->reconnect_timer_fd != -1) {
-        close_fd(self_p, self_p->reconnect_timer_fd);
-        self_p->reconnect_timer_fd = -1;
+    if (self_p->timers.fd != -1) {
+        close_fd(self_p, self_p->timers.fd);
+        self_p->timers.fd = -1;
     }
 }
 
-void NAME_client_process(struct NAME_client_t *self_p, int fd, uint32_t events)
+size_t NAME_client_output_bytes(struct NAME_client_t *self_p)
+{
+    return (output_size(self_p));
+}
+
+void NAME_client_get_stats(struct NAME_client_t *self_p,
+                           struct messi_stats_t *stats_p)
+{
+    *stats_p = self_p->stats;
+    stats_p->output_bytes = output_size(self_p);
+}
+
+int NAME_client_process_event(struct NAME_client_t *self_p,
+                              int fd,
+                              uint32_t events)
 {
     if (fd == self_p->server_fd) {
         process_socket(self_p, events);
-    } else if (fd == self_p->keep_alive_timer_fd) {
-        process_keep_alive_timer(self_p);
-    } else if (fd == self_p->reconnect_timer_fd) {
-        process_reconnect_timer(self_p);
+    } else if (fd == self_p->timers.fd) {
+        messi_timer_wheel_process(&self_p->timers);
+    } else {
+        return (-1);
     }
 
+    return (0);
+}
+
+void NAME_client_process_deferred(struct NAME_client_t *self_p)
+{
     if (self_p->pending_disconnect) {
         disconnect(self_p);
-        self_p->on_disconnected(self_p, self_p->disconnect_reason);
+        /* Started first for the reconnect attempt number, and to be
+           stopped if the client is stopped by the callback. */
         start_reconnect_timer(self_p);
+        self_p->on_disconnected(self_p, self_p->disconnect_reason);
     }
 }
 
+void NAME_client_process(struct NAME_client_t *self_p, int fd, uint32_t events)
+{
+    NAME_client_process_event(self_p, fd, events);
+    NAME_client_process_deferred(self_p);
+}
+
 void NAME_client_send(struct NAME_client_t *self_p)
 {
     int res;
-    ssize_t size;
     struct messi_header_t *header_p;
 
+    NAME_client_send_batch(self_p);
+
     res = NAME_client_to_server_encode(
         self_p->output.message_p,
         &self_p->output.encoded.buf_p[sizeof(*header_p)],
@@ -485,16 +1479,266 @@ void NAME_client_send(struct NAME_client_t *self_p)
         return;
     }
 
-    header_p = (struct messi_header_t *)&self_p->output.encoded.buf_p[0];
+    res = messi_frame_create(self_p->output.encoded.buf_p,
+                             self_p->output.encoded.size,
+                             MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER,
+                             res);
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_encode_error_t);
+
+        return;
+    }
+
+    write_output(self_p, self_p->output.encoded.buf_p, res);
+}
+
+/* Maximum size of a batch frame, with a basic header. */
+static size_t batch_size_max(struct NAME_client_t *self_p)
+{
+    size_t size;
+
+    size = (sizeof(struct messi_header_t) + MESSI_HEADER_SIZE_MAX);
+
+    if (size > self_p->output.encoded.size) {
+        size = self_p->output.encoded.size;
+    }
+
+    return (size);
+}
+
+void NAME_client_add_to_batch(struct NAME_client_t *self_p)
+{
+    int res;
+    size_t offset;
+    size_t size;
+    uint8_t *buf_p;
+    struct messi_header_t *header_p;
+
+    buf_p = self_p->output.encoded.buf_p;
+
+    if (self_p->output.batch_size == 0) {
+        self_p->output.batch_size = sizeof(struct messi_header_t);
+    }
+
+    offset = (self_p->output.batch_size + sizeof(struct messi_header_t));
+    size = batch_size_max(self_p);
+    res = -1;
+
+    if (offset <= size) {
+        res = NAME_client_to_server_encode(self_p->output.message_p,
+                                           &buf_p[offset],
+                                           size - offset);
+    }
+
+    if (res < 0) {
+        if (self_p->output.batch_size > sizeof(struct messi_header_t)) {
+            /* Does not fit. Send the batch and start a new one. */
+            NAME_client_send_batch(self_p);
+            NAME_client_add_to_batch(self_p);
+        } else {
+            self_p->output.batch_size = 0;
+            pending_disconnect(self_p,
+                               messi_disconnect_reason_message_encode_error_t);
+        }
+
+        return;
+    }
+
+    header_p = (struct messi_header_t *)&buf_p[self_p->output.batch_size];
     messi_header_create(header_p, MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER, res);
+    self_p->output.batch_size = (offset + res);
+}
+
+void NAME_client_send_batch(struct NAME_client_t *self_p)
+{
+    size_t size;
 
-    size = write(self_p->server_fd,
-                 &self_p->output.encoded.buf_p[0],
-                 res + sizeof(*header_p));
+    size = self_p->output.batch_size;
 
-    if (size != (ssize_t)(res + sizeof(*header_p))) {
-        pending_disconnect(self_p, messi_disconnect_reason_connection_closed_t);
+    if (size == 0) {
+        return;
+    }
+
+    self_p->output.batch_size = 0;
+    messi_header_create((struct messi_header_t *)self_p->output.encoded.buf_p,
+                        MESSI_MESSAGE_TYPE_BATCH,
+                        size - sizeof(struct messi_header_t));
+    write_output(self_p, self_p->output.encoded.buf_p, size);
+}
+
+int NAME_client_request(struct NAME_client_t *self_p,
+                        int timeout_ms,
+                        NAME_client_on_response_t on_response,
+                        void *obj_p)
+{
+    int res;
+    size_t offset;
+    struct NAME_client_request_t *request_p;
+
+    request_p = self_p->requests.free_list_p;
+
+    if ((request_p == NULL)
+        || (self_p->server_fd == -1)
+        || self_p->pending_disconnect) {
+        return (-1);
+    }
+
+    if (on_response == NULL) {
+        on_response = request_on_response_default;
+    }
+
+    NAME_client_send_batch(self_p);
+
+    offset = (sizeof(struct messi_header_t) + MESSI_REQUEST_ID_SIZE);
+    res = NAME_client_to_server_encode(self_p->output.message_p,
+                                       &self_p->output.encoded.buf_p[offset],
+                                       self_p->output.encoded.size - offset);
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_encode_error_t);
+
+        return (-1);
+    }
+
+    self_p->requests.sequence++;
+    request_p->id = (((uint32_t)self_p->requests.sequence << 16)
+                     | (request_p->id & 0xffff));
+    messi_request_id_write(
+        &self_p->output.encoded.buf_p[sizeof(struct messi_header_t)],
+        request_p->id);
+    res = messi_frame_create(self_p->output.encoded.buf_p,
+                             self_p->output.encoded.size,
+                             MESSI_MESSAGE_TYPE_REQUEST,
+                             res + MESSI_REQUEST_ID_SIZE);
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_encode_error_t);
+
+        return (-1);
+    }
+
+    if (messi_timer_start(&self_p->timers, &request_p->timer, timeout_ms) != 0) {
+        return (-1);
+    }
+
+    self_p->requests.free_list_p = request_p->next_free_p;
+    self_p->requests.length++;
+    request_p->on_response = on_response;
+    request_p->obj_p = obj_p;
+    write_output(self_p, self_p->output.encoded.buf_p, res);
+
+    return (0);
+}
+
+size_t NAME_client_requests_in_flight(struct NAME_client_t *self_p)
+{
+    return (self_p->requests.length);
+}
+
+bool NAME_client_is_connected(struct NAME_client_t *self_p)
+{
+    if ((self_p->server_fd == -1)
+        || self_p->connecting
+        || self_p->pending_disconnect) {
+        return (false);
+    }
+
+    return (!self_p->server.shm || messi_shm_is_open(&self_p->shm));
+}
+
+int NAME_client_group_init(struct NAME_client_group_t *self_p,
+                           struct NAME_client_t *clients_p,
+                           size_t length)
+{
+    if (length == 0) {
+        return (-1);
+    }
+
+    self_p->clients_p = clients_p;
+    self_p->length = length;
+    self_p->next = 0;
+
+    return (0);
+}
+
+void NAME_client_group_start(struct NAME_client_group_t *self_p)
+{
+    size_t i;
+
+    for (i = 0; i < self_p->length; i++) {
+        NAME_client_start(&self_p->clients_p[i]);
+    }
+}
+
+void NAME_client_group_stop(struct NAME_client_group_t *self_p)
+{
+    size_t i;
+
+    for (i = 0; i < self_p->length; i++) {
+        NAME_client_stop(&self_p->clients_p[i]);
+    }
+}
+
+struct NAME_client_t *NAME_client_group_next(
+    struct NAME_client_group_t *self_p)
+{
+    size_t i;
+    struct NAME_client_t *client_p;
+
+    for (i = 0; i < self_p->length; i++) {
+        client_p = &self_p->clients_p[self_p->next];
+        self_p->next++;
+
+        if (self_p->next == self_p->length) {
+            self_p->next = 0;
+        }
+
+        if (NAME_client_is_connected(client_p)) {
+            return (client_p);
+        }
+    }
+
+    return (NULL);
+}
+
+struct NAME_client_t *NAME_client_group_select(
+    struct NAME_client_group_t *self_p,
+    uint32_t key_hash)
+{
+    return (&self_p->clients_p[key_hash % self_p->length]);
+}
+
+int NAME_client_group_process_event(struct NAME_client_group_t *self_p,
+                                    int fd,
+                                    uint32_t events)
+{
+    size_t i;
+
+    for (i = 0; i < self_p->length; i++) {
+        if (NAME_client_process_event(&self_p->clients_p[i], fd, events) == 0) {
+            return (0);
+        }
+    }
+
+    return (-1);
+}
+
+void NAME_client_group_process_deferred(struct NAME_client_group_t *self_p)
+{
+    size_t i;
+
+    for (i = 0; i < self_p->length; i++) {
+        NAME_client_process_deferred(&self_p->clients_p[i]);
     }
 }
 
+void NAME_client_group_process(struct NAME_client_group_t *self_p,
+                               int fd,
+                               uint32_t events)
+{
+    NAME_client_group_process_event(self_p, fd, events);
+    NAME_client_group_process_deferred(self_p);
+}
+
 INIT_MESSAGES
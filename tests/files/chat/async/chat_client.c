@@ -29,19 +29,19 @@
 #include "messi.h"
 #include "chat_client.h"
 
-static void reset_input_encoded(struct chat_client_t *self_p)
+static void start_reconnect_timer(struct chat_client_t *self_p)
 {
-    self_p->input.encoded.state = chat_client_input_state_header_t;
-    self_p->input.encoded.size = 0;
-    self_p->input.encoded.left = sizeof(struct messi_header_t);
+    async_timer_set_initial(&self_p->reconnect_timer,
+                            messi_backoff_next(&self_p->backoff));
+    async_timer_start(&self_p->reconnect_timer);
 }
 
 static void on_disconnected(struct chat_client_t *self_p, void *arg_p)
 {
     (void)arg_p;
 
+    start_reconnect_timer(self_p);
     self_p->on_disconnected(self_p, self_p->disconnect_reason);
-    async_timer_start(&self_p->reconnect_timer);
 }
 
 static void disconnect_and_start_reconnect_timer(
@@ -59,12 +59,11 @@ static void disconnect_and_start_reconnect_timer(
     async_call(self_p->async_p, (async_func_t)on_disconnected, self_p, NULL);
 }
 
-static void handle_message_user(struct chat_client_t *self_p)
+static void handle_message_user(struct chat_client_t *self_p,
+                                struct messi_buffer_t *payload_p)
 {
     int res;
     struct chat_server_to_client_t *message_p;
-    uint8_t *payload_buf_p;
-    size_t payload_size;
 
     self_p->input.message_p = chat_server_to_client_new(
         &self_p->input.workspace.buf_p[0],
@@ -75,12 +74,11 @@ static void handle_message_user(struct chat_client_t *self_p)
         return;
     }
 
-    payload_buf_p = &self_p->input.encoded.data.buf_p[sizeof(struct messi_header_t)];
-    payload_size = self_p->input.encoded.size - sizeof(struct messi_header_t);
-
-    res = chat_server_to_client_decode(message_p, payload_buf_p, payload_size);
+    res = chat_server_to_client_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
 
-    if (res != (int)payload_size) {
+    if (res != (int)payload_p->size) {
         disconnect_and_start_reconnect_timer(
             self_p,
             messi_disconnect_reason_message_decode_error_t);
@@ -113,12 +111,13 @@ static void handle_message_pong(struct chat_client_t *self_p)
 }
 
 static void handle_message(struct chat_client_t *self_p,
-                           uint32_t type)
+                           uint32_t type,
+                           struct messi_buffer_t *payload_p)
 {
     switch (type) {
 
     case MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER:
-        handle_message_user(self_p);
+        handle_message_user(self_p, payload_p);
         break;
 
     case MESSI_MESSAGE_TYPE_PONG:
@@ -157,9 +156,10 @@ static void on_stcp_connected(struct async_stcp_client_t *stcp_p,
         async_timer_start(&self_p->keep_alive_timer);
         self_p->pong_received = true;
         self_p->is_connected = true;
+        messi_framer_reset(&self_p->input.encoded);
         self_p->on_connected(self_p);
     } else {
-        async_timer_start(&self_p->reconnect_timer);
+        start_reconnect_timer(self_p);
     }
 }
 
@@ -174,52 +174,73 @@ static void on_stcp_disconnected(struct async_stcp_client_t *stcp_p)
         messi_disconnect_reason_connection_closed_t);
 }
 
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be read from the server. */
+static int process_frames(struct chat_client_t *self_p)
+{
+    int res;
+    uint8_t type;
+    struct messi_buffer_t payload;
+
+    while (true) {
+        res = messi_framer_next(&self_p->input.encoded, &type, &payload);
+
+        if (res == 0) {
+            break;
+        } else if (res == 1) {
+            handle_message(self_p, type, &payload);
+        } else {
+            /* Too big, or an extended frame, which is not supported
+               by this platform. */
+            disconnect_and_start_reconnect_timer(
+                self_p,
+                messi_disconnect_reason_message_too_big_t);
+        }
+
+        if (!self_p->is_connected) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
 static void on_stcp_input(struct async_stcp_client_t *stcp_p)
 {
-    ssize_t size;
-    struct messi_header_t *header_p;
+    size_t size;
+    size_t free_size;
+    uint8_t *buf_p;
     struct chat_client_t *self_p;
 
     self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
 
-    header_p = (struct messi_header_t *)self_p->input.encoded.data.buf_p;
-
-    while (true) {
-        size = async_stcp_client_read(
-            stcp_p,
-            &self_p->input.encoded.data.buf_p[self_p->input.encoded.size],
-            self_p->input.encoded.left);
+    do {
+        buf_p = messi_framer_get_free(&self_p->input.encoded, &free_size);
+        size = async_stcp_client_read(stcp_p, buf_p, free_size);
 
         if (size == 0) {
             break;
         }
 
-        self_p->input.encoded.size += size;
-        self_p->input.encoded.left -= size;
+        messi_framer_commit(&self_p->input.encoded, size);
+        messi_backoff_reset(&self_p->backoff);
 
-        if (self_p->input.encoded.left > 0) {
-            continue;
+        if (process_frames(self_p) != 0) {
+            break;
         }
+    } while (size == free_size);
+}
 
-        if (self_p->input.encoded.state == chat_client_input_state_header_t) {
-            self_p->input.encoded.left = messi_header_get_size(header_p);
-
-            if ((self_p->input.encoded.left + sizeof(*header_p))
-                > self_p->input.encoded.data.size) {
-                disconnect_and_start_reconnect_timer(
-                    self_p,
-                    messi_disconnect_reason_message_too_big_t);
-                break;
-            }
-
-            self_p->input.encoded.state = chat_client_input_state_payload_t;
-        }
+static void connect_to_server(struct chat_client_t *self_p)
+{
+    async_stcp_client_connect(&self_p->stcp,
+                              &self_p->server.address[0],
+                              self_p->server.port);
+}
 
-        if (self_p->input.encoded.left == 0) {
-            handle_message(self_p, header_p->type);
-            reset_input_encoded(self_p);
-        }
-    }
+static void on_reconnect_timeout(struct chat_client_t *self_p)
+{
+    connect_to_server(self_p);
 }
 
 static void on_connected_default(struct chat_client_t *self_p)
@@ -308,9 +329,9 @@ int chat_client_init(
     self_p->async_p = async_p;
     self_p->on_connect_rsp = on_connect_rsp;
     self_p->on_message_ind = on_message_ind;
-    self_p->input.encoded.data.buf_p = encoded_in_buf_p;
-    self_p->input.encoded.data.size = encoded_in_size;
-    reset_input_encoded(self_p);
+    messi_framer_init(&self_p->input.encoded,
+                      encoded_in_buf_p,
+                      encoded_in_size);
     self_p->input.workspace.buf_p = workspace_in_buf_p;
     self_p->input.workspace.size = workspace_in_size;
     self_p->output.encoded.buf_p = encoded_out_buf_p;
@@ -330,20 +351,34 @@ int chat_client_init(
                      0,
                      async_p);
     async_timer_init(&self_p->reconnect_timer,
-                     (async_timer_timeout_t)chat_client_start,
+                     (async_timer_timeout_t)on_reconnect_timeout,
                      self_p,
                      1000,
                      0,
                      async_p);
+    messi_backoff_init(&self_p->backoff, 1000, 1, 1000, false);
 
     return (0);
 }
 
+void chat_client_set_reconnect_backoff(struct chat_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter)
+{
+    messi_backoff_init(&self_p->backoff, initial_ms, multiplier, max_ms, jitter);
+}
+
+unsigned int chat_client_get_reconnect_attempt(struct chat_client_t *self_p)
+{
+    return (self_p->backoff.attempt);
+}
+
 void chat_client_start(struct chat_client_t *self_p)
 {
-    async_stcp_client_connect(&self_p->stcp,
-                              &self_p->server.address[0],
-                              self_p->server.port);
+    messi_backoff_reset(&self_p->backoff);
+    connect_to_server(self_p);
 }
 
 void chat_client_stop(struct chat_client_t *self_p)
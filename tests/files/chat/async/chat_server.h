@@ -47,11 +47,6 @@ typedef void (*chat_server_on_message_ind_t)(
     struct chat_server_client_t *client_p,
     struct chat_message_ind_t *message_p);
 
-enum chat_server_client_input_state_t {
-    chat_server_client_input_state_header_t = 0,
-    chat_server_client_input_state_payload_t
-};
-
 typedef void (*chat_server_on_client_connected_t)(
     struct chat_server_t *self_p,
     struct chat_server_client_t *client_p);
@@ -93,12 +88,7 @@ struct chat_server_client_t {
     struct chat_server_t *server_p;
     struct async_stcp_server_client_t stcp;
     struct async_timer_t keep_alive_timer;
-    struct {
-        enum chat_server_client_input_state_t state;
-        struct messi_buffer_t data;
-        size_t size;
-        size_t left;
-    } input;
+    struct messi_framer_t input;
     struct chat_server_client_t *next_p;
     struct chat_server_client_t *prev_p;
 };
@@ -0,0 +1,1261 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include "messi.h"
+#include "messi_uring.h"
+#include "chat_client.h"
+
+/* Number of submission queue entries. The queue is submitted when
+   full, so this only limits batching. */
+#define URING_ENTRIES                                    64
+
+/* Number of provided receive buffers. */
+#define INPUT_BUFFERS                                     8
+
+#define OPERATION_CONNECT                                 0
+#define OPERATION_TICK                                    1
+#define OPERATION_RECV                                    2
+#define OPERATION_SEND                                    3
+
+static int epoll_ctl_add(struct chat_client_t *self_p, int fd)
+{
+    return (self_p->epoll_ctl(self_p->epoll_fd, EPOLL_CTL_ADD, fd, EPOLLIN));
+}
+
+static void epoll_ctl_del(struct chat_client_t *self_p, int fd)
+{
+    self_p->epoll_ctl(self_p->epoll_fd, EPOLL_CTL_DEL, fd, 0);
+}
+
+/* Submit queued operations, unless completions are being processed,
+   in which case they are submitted once all are processed. */
+static void submit(struct chat_client_t *self_p)
+{
+    if (!self_p->processing) {
+        messi_uring_submit(&self_p->uring);
+    }
+}
+
+static void pending_disconnect(struct chat_client_t *self_p,
+                               enum messi_disconnect_reason_t disconnect_reason)
+{
+    if (self_p->pending_disconnect) {
+        return;
+    }
+
+    self_p->disconnect_reason = disconnect_reason;
+
+    /* Operations not yet submitted must not use the file descriptor
+       once closed, as it may be reused. Shutdown completes all
+       operations in progress. */
+    if (self_p->server_fd != -1) {
+        messi_uring_submit(&self_p->uring);
+        shutdown(self_p->server_fd, SHUT_RDWR);
+        close(self_p->server_fd);
+        self_p->server_fd = -1;
+    }
+
+    self_p->connected = false;
+    self_p->pending_disconnect = true;
+}
+
+static int prepare_tick(struct chat_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_TIMEOUT;
+    sqe_p->fd = -1;
+    sqe_p->addr = (uintptr_t)&self_p->tick;
+    sqe_p->len = 1;
+    sqe_p->user_data = OPERATION_TICK;
+
+    return (0);
+}
+
+static int prepare_connect(struct chat_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_CONNECT;
+    sqe_p->fd = self_p->server_fd;
+    sqe_p->addr = (uintptr_t)&self_p->server.addr;
+    sqe_p->off = sizeof(self_p->server.addr);
+    sqe_p->user_data = OPERATION_CONNECT;
+    self_p->operations++;
+
+    return (0);
+}
+
+/* Receive into buffers picked from the provided buffer ring for as
+   long as the connection is open. */
+static int prepare_recv(struct chat_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    sqe_p->opcode = IORING_OP_RECV;
+    sqe_p->fd = self_p->server_fd;
+    sqe_p->flags = IOSQE_BUFFER_SELECT;
+    sqe_p->ioprio = IORING_RECV_MULTISHOT;
+    sqe_p->buf_group = self_p->input_buffers.bgid;
+    sqe_p->user_data = OPERATION_RECV;
+    self_p->operations++;
+
+    return (0);
+}
+
+/* Send all queued data in one operation, unless one is already in
+   progress. Only one send is in progress at a time, so a short send
+   is simply followed by another one with the rest. */
+static int prepare_send(struct chat_client_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+    int iovcnt;
+
+    if ((self_p->output.size > 0)
+        || messi_output_queue_is_empty(&self_p->output.queue)) {
+        return (0);
+    }
+
+    sqe_p = messi_uring_get_sqe(&self_p->uring);
+
+    if (sqe_p == NULL) {
+        return (-1);
+    }
+
+    iovcnt = messi_output_queue_get_iov(&self_p->output.queue,
+                                        &self_p->output.iov[0],
+                                        CHAT_CLIENT_IOV_MAX,
+                                        &self_p->output.size);
+    memset(&self_p->output.msg, 0, sizeof(self_p->output.msg));
+    self_p->output.msg.msg_iov = &self_p->output.iov[0];
+    self_p->output.msg.msg_iovlen = iovcnt;
+    sqe_p->opcode = IORING_OP_SENDMSG;
+    sqe_p->fd = self_p->server_fd;
+    sqe_p->addr = (uintptr_t)&self_p->output.msg;
+    sqe_p->len = 1;
+    sqe_p->msg_flags = MSG_NOSIGNAL;
+    sqe_p->user_data = OPERATION_SEND;
+    self_p->operations++;
+
+    return (0);
+}
+
+/* Enqueue a copy of given data and send it. */
+static void write_to_server(struct chat_client_t *self_p,
+                            uint8_t *buf_p,
+                            size_t size)
+{
+    int res;
+    struct messi_shared_buffer_t *shared_p;
+    size_t output_size;
+
+    self_p->stats.messages_out++;
+    shared_p = messi_shared_buffer_new(buf_p, size);
+
+    if (shared_p == NULL) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+        return;
+    }
+
+    res = messi_output_queue_push(&self_p->output.queue, shared_p, 0);
+    messi_shared_buffer_unref(shared_p);
+
+    if (res == 0) {
+        res = prepare_send(self_p);
+    }
+
+    if (res != 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+    }
+
+    output_size = messi_output_queue_size(&self_p->output.queue);
+
+    if (output_size > self_p->stats.output_bytes_peak) {
+        self_p->stats.output_bytes_peak = output_size;
+    }
+
+    submit(self_p);
+}
+
+static void handle_message_user(struct chat_client_t *self_p,
+                                struct messi_buffer_t *payload_p,
+                                struct messi_buffer_t *workspace_p)
+{
+    int res;
+    struct chat_server_to_client_t *message_p;
+
+    self_p->input.message_p = chat_server_to_client_new(
+        &workspace_p->buf_p[0],
+        workspace_p->size);
+    message_p = self_p->input.message_p;
+
+    if (message_p == NULL) {
+        return;
+    }
+
+    res = chat_server_to_client_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
+
+    if (res != (int)payload_p->size) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+
+        return;
+    }
+
+    switch (message_p->messages.choice) {
+
+    case chat_server_to_client_messages_choice_connect_rsp_e:
+        self_p->on_connect_rsp(
+            self_p,
+            message_p->messages.value.connect_rsp_p);
+        break;
+
+    case chat_server_to_client_messages_choice_message_ind_e:
+        self_p->on_message_ind(
+            self_p,
+            message_p->messages.value.message_ind_p);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void handle_message_pong(struct chat_client_t *self_p)
+{
+    self_p->pong_received = true;
+}
+
+/* Handle all messages in given batch in order. */
+static void handle_message_batch(struct chat_client_t *self_p,
+                                 struct messi_buffer_t *batch_p)
+{
+    int res;
+    uint8_t type;
+    size_t offset;
+    struct messi_buffer_t payload;
+
+    offset = 0;
+
+    while (true) {
+        res = messi_batch_next(batch_p, &offset, &type, &payload);
+
+        if (res == 0) {
+            break;
+        }
+
+        if ((res == -1) || (type != MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER)) {
+            pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+            break;
+        }
+
+        handle_message_user(self_p, &payload, &self_p->input.workspace);
+
+        /* Disconnected? */
+        if (!self_p->connected) {
+            break;
+        }
+    }
+}
+
+/* Decompress given compressed frame payload into storage from the
+   large messages pool, and handle it. */
+static void handle_message_compressed(struct chat_client_t *self_p,
+                                      struct messi_buffer_t *payload_p)
+{
+    int res;
+    uint8_t type;
+    uint8_t codec;
+    size_t size;
+    size_t size_max;
+    size_t pooled_size;
+    struct messi_buffer_t data;
+    struct messi_buffer_t decompressed;
+
+    res = messi_compressed_parse(payload_p, &type, &codec, &size, &data);
+
+    /* At most as large as an uncompressed message. */
+    size_max = self_p->input.encoded.data.size;
+
+    if (self_p->large.max_size > size_max) {
+        size_max = self_p->large.max_size;
+    }
+
+    if ((res != 0)
+        || (codec != self_p->input.codec_p->id)
+        || (size > size_max)) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+
+        return;
+    }
+
+    pooled_size = size;
+    decompressed.buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &pooled_size);
+
+    if (decompressed.buf_p == NULL) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+        return;
+    }
+
+    res = self_p->input.codec_p->decompress(data.buf_p,
+                                            data.size,
+                                            decompressed.buf_p,
+                                            size);
+    decompressed.size = size;
+
+    if (res != (int)size) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+    } else if (type == MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER) {
+        handle_message_user(self_p, &decompressed, &self_p->input.workspace);
+    } else if (type == MESSI_MESSAGE_TYPE_BATCH) {
+        handle_message_batch(self_p, &decompressed);
+    } else {
+        pending_disconnect(self_p, messi_disconnect_reason_message_decode_error_t);
+    }
+
+    messi_large_pool_free(&self_p->large.pool,
+                          decompressed.buf_p,
+                          pooled_size);
+}
+
+static void handle_message(struct chat_client_t *self_p,
+                           uint32_t type,
+                           struct messi_buffer_t *payload_p)
+{
+    switch (type) {
+
+    case MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER:
+        handle_message_user(self_p, payload_p, &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_BATCH:
+        handle_message_batch(self_p, payload_p);
+        break;
+
+    case MESSI_MESSAGE_TYPE_COMPRESSED:
+        handle_message_compressed(self_p, payload_p);
+        break;
+
+    case MESSI_MESSAGE_TYPE_PONG:
+        handle_message_pong(self_p);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Output may only be released once no operation uses it. */
+static void release_output_if_unused(struct chat_client_t *self_p)
+{
+    if (self_p->output.size == 0) {
+        messi_output_queue_clear(&self_p->output.queue);
+    }
+}
+
+/* Release the storage of any large message being received. */
+static void large_input_release(struct chat_client_t *self_p)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->input.large;
+
+    if (large_p->buf_p == NULL) {
+        return;
+    }
+
+    if (large_p->pooled) {
+        messi_large_pool_free(&self_p->large.pool,
+                              large_p->buf_p,
+                              large_p->pooled_size);
+    }
+
+    large_p->buf_p = NULL;
+}
+
+static void disconnect(struct chat_client_t *self_p)
+{
+    large_input_release(self_p);
+    self_p->output.batch_size = 0;
+    pending_disconnect(self_p, 0);
+    messi_timer_stop(&self_p->timers, &self_p->keep_alive_timer);
+    release_output_if_unused(self_p);
+    self_p->pending_disconnect = false;
+}
+
+static int start_keep_alive_timer(struct chat_client_t *self_p)
+{
+    return (messi_timer_start(&self_p->timers, &self_p->keep_alive_timer, 2000));
+}
+
+static int start_reconnect_timer(struct chat_client_t *self_p)
+{
+    return (messi_timer_start(&self_p->timers,
+                              &self_p->reconnect_timer,
+                              messi_backoff_next(&self_p->backoff)));
+}
+
+/* Decode and handle the received large message, and release its
+   storage. */
+static void large_input_complete(struct chat_client_t *self_p)
+{
+    struct messi_buffer_t payload;
+
+    payload.buf_p = self_p->input.large.buf_p;
+    payload.size = self_p->input.large.size;
+    self_p->stats.messages_in++;
+    handle_message_user(self_p, &payload, &self_p->large.workspace);
+
+    /* Released later if disconnected. */
+    if (!self_p->pending_disconnect) {
+        large_input_release(self_p);
+    }
+}
+
+/* Start receiving a large message of given size. Its payload is moved
+   from the input buffer to its storage, and the rest copied directly
+   into it as received. */
+static void large_input_begin(struct chat_client_t *self_p,
+                              uint8_t type,
+                              size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    if ((type != MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER)
+        || (size > self_p->large.max_size)) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_too_big_t);
+
+        return;
+    }
+
+    large_p = &self_p->input.large;
+    large_p->type = type;
+    large_p->size = size;
+    large_p->buf_p = self_p->large.on_large_message(self_p, size);
+    large_p->pooled = (large_p->buf_p == NULL);
+
+    if (large_p->pooled) {
+        large_p->pooled_size = size;
+        large_p->buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &large_p->pooled_size);
+
+        if (large_p->buf_p == NULL) {
+            pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+            return;
+        }
+    }
+
+    large_p->offset = messi_framer_take(&self_p->input.encoded,
+                                        large_p->buf_p,
+                                        size);
+
+    if (large_p->offset == size) {
+        large_input_complete(self_p);
+    }
+}
+
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be received from the server. */
+static int process_frames(struct chat_client_t *self_p)
+{
+    int res;
+    uint8_t type;
+    struct messi_buffer_t payload;
+
+    while (true) {
+        res = messi_framer_next(&self_p->input.encoded, &type, &payload);
+
+        if (res == 0) {
+            break;
+        } else if (res == -1) {
+            pending_disconnect(self_p, messi_disconnect_reason_message_too_big_t);
+        } else if (res == 2) {
+            large_input_begin(self_p, type, payload.size);
+        } else {
+            self_p->stats.messages_in++;
+            handle_message(self_p, type, &payload);
+        }
+
+        /* Disconnected? */
+        if (!self_p->connected) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/* Copy as much as possible of given received data to the storage of
+   a large message. Returns the number of copied bytes. */
+static size_t process_large_input(struct chat_client_t *self_p,
+                                  uint8_t *buf_p,
+                                  size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->input.large;
+
+    if (size > (large_p->size - large_p->offset)) {
+        size = (large_p->size - large_p->offset);
+    }
+
+    memcpy(&large_p->buf_p[large_p->offset], buf_p, size);
+    large_p->offset += size;
+
+    if (large_p->offset == large_p->size) {
+        large_input_complete(self_p);
+    }
+
+    return (size);
+}
+
+/* Copy given received data to the input buffer, or to the storage of
+   a large message, and handle all complete frames. */
+static void process_input(struct chat_client_t *self_p,
+                          uint8_t *buf_p,
+                          size_t size)
+{
+    size_t free_size;
+    uint8_t *free_p;
+
+    while (size > 0) {
+        if (self_p->input.large.buf_p != NULL) {
+            free_size = process_large_input(self_p, buf_p, size);
+
+            /* Disconnected? */
+            if (!self_p->connected) {
+                break;
+            }
+
+            buf_p += free_size;
+            size -= free_size;
+
+            continue;
+        }
+
+        free_p = messi_framer_get_free(&self_p->input.encoded, &free_size);
+
+        if (free_size == 0) {
+            pending_disconnect(self_p, messi_disconnect_reason_message_too_big_t);
+            break;
+        }
+
+        if (free_size > size) {
+            free_size = size;
+        }
+
+        memcpy(free_p, buf_p, free_size);
+        messi_framer_commit(&self_p->input.encoded, free_size);
+
+        if (process_frames(self_p) != 0) {
+            break;
+        }
+
+        buf_p += free_size;
+        size -= free_size;
+    }
+}
+
+static void on_connect_failed(struct chat_client_t *self_p)
+{
+    close(self_p->server_fd);
+    self_p->server_fd = -1;
+    start_reconnect_timer(self_p);
+}
+
+static void process_connect(struct chat_client_t *self_p, int res)
+{
+    self_p->operations--;
+
+    /* Stopped while connecting? */
+    if (self_p->server_fd == -1) {
+        return;
+    }
+
+    if (res != 0) {
+        on_connect_failed(self_p);
+
+        return;
+    }
+
+    if (start_keep_alive_timer(self_p) != 0) {
+        on_connect_failed(self_p);
+
+        return;
+    }
+
+    if (prepare_recv(self_p) != 0) {
+        messi_timer_stop(&self_p->timers, &self_p->keep_alive_timer);
+        on_connect_failed(self_p);
+
+        return;
+    }
+
+    self_p->connected = true;
+    self_p->pong_received = true;
+    messi_framer_reset(&self_p->input.encoded);
+    self_p->on_connected(self_p);
+}
+
+static void process_recv(struct chat_client_t *self_p, int res, uint32_t flags)
+{
+    uint16_t bid;
+
+    self_p->stats.reads++;
+
+    if (res > 0) {
+        self_p->stats.bytes_in += res;
+        messi_backoff_reset(&self_p->backoff);
+    } else if ((res == -EAGAIN) || (res == -ENOBUFS)) {
+        self_p->stats.eagains++;
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if ((res > 0) && self_p->connected) {
+            process_input(self_p,
+                          messi_uring_buf_ring_get(&self_p->input_buffers, bid),
+                          (size_t)res);
+        }
+
+        messi_uring_buf_ring_recycle(&self_p->input_buffers, bid);
+    }
+
+    /* Out of buffers terminates the receive, but not the
+       connection. */
+    if ((res == 0) || ((res < 0) && (res != -ENOBUFS))) {
+        pending_disconnect(self_p, messi_disconnect_reason_connection_closed_t);
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        self_p->operations--;
+
+        if (self_p->connected) {
+            if (prepare_recv(self_p) != 0) {
+                pending_disconnect(self_p,
+                                   messi_disconnect_reason_general_error_t);
+            }
+        }
+    }
+}
+
+static void process_send(struct chat_client_t *self_p, int res)
+{
+    self_p->operations--;
+    self_p->output.size = 0;
+    self_p->stats.writes++;
+
+    if (res > 0) {
+        self_p->stats.bytes_out += res;
+    }
+
+    if (!self_p->connected) {
+        release_output_if_unused(self_p);
+
+        return;
+    }
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_connection_closed_t);
+
+        return;
+    }
+
+    messi_output_queue_consume(&self_p->output.queue, (size_t)res);
+
+    if (prepare_send(self_p) != 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+    }
+}
+
+static void process_completion(struct chat_client_t *self_p,
+                               uint64_t user_data,
+                               int res,
+                               uint32_t flags)
+{
+    switch (user_data) {
+
+    case OPERATION_CONNECT:
+        process_connect(self_p, res);
+        break;
+
+    case OPERATION_TICK:
+        messi_timer_wheel_advance(&self_p->timers, 1);
+        prepare_tick(self_p);
+        break;
+
+    case OPERATION_RECV:
+        process_recv(self_p, res, flags);
+        break;
+
+    default:
+        process_send(self_p, res);
+        break;
+    }
+}
+
+/* Handle all completed operations, and then submit all operations
+   they started with a single system call. */
+static void process_completions(struct chat_client_t *self_p)
+{
+    struct io_uring_cqe *cqe_p;
+    uint64_t user_data;
+    int res;
+    uint32_t flags;
+
+    self_p->processing = true;
+
+    while (true) {
+        cqe_p = messi_uring_peek_cqe(&self_p->uring);
+
+        if (cqe_p == NULL) {
+            break;
+        }
+
+        user_data = cqe_p->user_data;
+        res = cqe_p->res;
+        flags = cqe_p->flags;
+        messi_uring_cqe_seen(&self_p->uring);
+        process_completion(self_p, user_data, res, flags);
+    }
+
+    self_p->processing = false;
+    submit(self_p);
+}
+
+static void on_keep_alive_timeout(struct chat_client_t *self_p)
+{
+    struct messi_header_t header;
+
+    if (!self_p->pong_received) {
+        self_p->stats.keep_alive_misses++;
+        pending_disconnect(self_p, messi_disconnect_reason_keep_alive_timeout_t);
+
+        return;
+    }
+
+    if (start_keep_alive_timer(self_p) != 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_general_error_t);
+
+        return;
+    }
+
+    messi_header_create(&header, MESSI_MESSAGE_TYPE_PING, 0);
+    write_to_server(self_p, (uint8_t *)&header, sizeof(header));
+    self_p->pong_received = false;
+}
+
+/* Start connecting to the server. The connected callback is called
+   once the connect operation completes. */
+static int connect_to_server(struct chat_client_t *self_p)
+{
+    /* Wait for operations of the previous connection. */
+    if (self_p->operations > 0) {
+        return (-1);
+    }
+
+    self_p->server_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (self_p->server_fd == -1) {
+        return (-1);
+    }
+
+    if (prepare_connect(self_p) != 0) {
+        close(self_p->server_fd);
+        self_p->server_fd = -1;
+
+        return (-1);
+    }
+
+    submit(self_p);
+
+    return (0);
+}
+
+static void on_reconnect_timeout(struct chat_client_t *self_p)
+{
+    if (connect_to_server(self_p) != 0) {
+        start_reconnect_timer(self_p);
+    }
+}
+
+static void on_connected_default(struct chat_client_t *self_p)
+{
+    (void)self_p;
+}
+
+static uint8_t *on_large_message_default(struct chat_client_t *self_p,
+                                         size_t size)
+{
+    (void)self_p;
+    (void)size;
+
+    return (NULL);
+}
+
+static void on_disconnected_default(
+    struct chat_client_t *self_p,
+    enum messi_disconnect_reason_t disconnect_reason)
+{
+    (void)self_p;
+    (void)disconnect_reason;
+}
+
+void chat_client_new_output_message(struct chat_client_t *self_p)
+{
+    self_p->output.message_p = chat_client_to_server_new(
+        &self_p->output.workspace.buf_p[0],
+        self_p->output.workspace.size);
+}
+
+static void on_connect_rsp_default(
+    struct chat_client_t *self_p,
+    struct chat_connect_rsp_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+}
+
+static void on_message_ind_default(
+    struct chat_client_t *self_p,
+    struct chat_message_ind_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+}
+
+int chat_client_init(
+    struct chat_client_t *self_p,
+    const char *server_uri_p,
+    uint8_t *encoded_in_buf_p,
+    size_t encoded_in_size,
+    uint8_t *workspace_in_buf_p,
+    size_t workspace_in_size,
+    uint8_t *encoded_out_buf_p,
+    size_t encoded_out_size,
+    uint8_t *workspace_out_buf_p,
+    size_t workspace_out_size,
+    chat_client_on_connected_t on_connected,
+    chat_client_on_disconnected_t on_disconnected,
+    chat_client_on_connect_rsp_t on_connect_rsp,
+    chat_client_on_message_ind_t on_message_ind,
+    int epoll_fd,
+    messi_epoll_ctl_t epoll_ctl)
+{
+    int res;
+
+    if (on_connect_rsp == NULL) {
+        on_connect_rsp = on_connect_rsp_default;
+    }
+
+    if (on_message_ind == NULL) {
+        on_message_ind = on_message_ind_default;
+    }
+
+    if (on_connected == NULL) {
+        on_connected = on_connected_default;
+    }
+
+    if (on_disconnected == NULL) {
+        on_disconnected = on_disconnected_default;
+    }
+
+    if (epoll_ctl == NULL) {
+        epoll_ctl = messi_epoll_ctl_default;
+    }
+
+    res = messi_parse_tcp_uri(server_uri_p,
+                              &self_p->server.address[0],
+                              sizeof(self_p->server.address),
+                              &self_p->server.port);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    memset(&self_p->server.addr, 0, sizeof(self_p->server.addr));
+    self_p->server.addr.sin_family = AF_INET;
+    self_p->server.addr.sin_port = htons((short)self_p->server.port);
+    inet_aton(&self_p->server.address[0],
+              (struct in_addr *)&self_p->server.addr.sin_addr.s_addr);
+    self_p->on_connected = on_connected;
+    self_p->on_disconnected = on_disconnected;
+    self_p->on_connect_rsp = on_connect_rsp;
+    self_p->on_message_ind = on_message_ind;
+    self_p->epoll_fd = epoll_fd;
+    self_p->epoll_ctl = epoll_ctl;
+    messi_framer_init(&self_p->input.encoded,
+                      encoded_in_buf_p,
+                      encoded_in_size);
+    self_p->input.workspace.buf_p = workspace_in_buf_p;
+    self_p->input.workspace.size = workspace_in_size;
+    self_p->output.encoded.buf_p = encoded_out_buf_p;
+    self_p->output.encoded.size = encoded_out_size;
+    self_p->output.batch_size = 0;
+    self_p->output.workspace.buf_p = workspace_out_buf_p;
+    self_p->output.workspace.size = workspace_out_size;
+    messi_output_queue_init(&self_p->output.queue);
+    self_p->output.size = 0;
+    self_p->server_fd = -1;
+    self_p->connected = false;
+    self_p->uring.fd = -1;
+    self_p->processing = false;
+    self_p->operations = 0;
+    self_p->tick.tv_sec = 0;
+    self_p->tick.tv_nsec = (1000000L * MESSI_TIMER_WHEEL_TICK_MS);
+    messi_timer_wheel_init_external(&self_p->timers, MESSI_TIMER_WHEEL_TICK_MS);
+    messi_timer_init(&self_p->keep_alive_timer,
+                     (messi_timer_on_timeout_t)on_keep_alive_timeout,
+                     self_p);
+    messi_timer_init(&self_p->reconnect_timer,
+                     (messi_timer_on_timeout_t)on_reconnect_timeout,
+                     self_p);
+    messi_backoff_init(&self_p->backoff, 1000, 1, 1000, false);
+    self_p->pending_disconnect = false;
+    memset(&self_p->stats, 0, sizeof(self_p->stats));
+    self_p->input.large.buf_p = NULL;
+    self_p->large.max_size = 0;
+    self_p->large.workspace.buf_p = NULL;
+    self_p->large.workspace.size = 0;
+    messi_large_pool_init(&self_p->large.pool);
+    self_p->large.on_large_message = on_large_message_default;
+    self_p->input.codec_p = &messi_codec_lz4;
+
+    return (0);
+}
+
+void chat_client_set_codec(struct chat_client_t *self_p,
+                           const struct messi_codec_t *codec_p)
+{
+    self_p->input.codec_p = codec_p;
+}
+
+void chat_client_set_reconnect_backoff(struct chat_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter)
+{
+    messi_backoff_init(&self_p->backoff, initial_ms, multiplier, max_ms, jitter);
+}
+
+unsigned int chat_client_get_reconnect_attempt(struct chat_client_t *self_p)
+{
+    return (self_p->backoff.attempt);
+}
+
+void chat_client_set_large_messages(
+    struct chat_client_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    chat_client_on_large_message_t on_large_message)
+{
+    if (on_large_message == NULL) {
+        on_large_message = on_large_message_default;
+    }
+
+    self_p->large.max_size = max_size;
+    self_p->large.workspace.buf_p = workspace_buf_p;
+    self_p->large.workspace.size = workspace_size;
+    self_p->large.on_large_message = on_large_message;
+}
+
+void chat_client_start(struct chat_client_t *self_p)
+{
+    int res;
+
+    messi_backoff_reset(&self_p->backoff);
+    res = messi_uring_init(&self_p->uring, URING_ENTRIES, 2 * URING_ENTRIES);
+
+    if (res != 0) {
+        goto out1;
+    }
+
+    res = messi_uring_buf_ring_init(&self_p->input_buffers,
+                                    &self_p->uring,
+                                    0,
+                                    INPUT_BUFFERS,
+                                    self_p->input.encoded.data.size);
+
+    if (res != 0) {
+        goto out2;
+    }
+
+    res = epoll_ctl_add(self_p, self_p->uring.fd);
+
+    if (res == -1) {
+        goto out3;
+    }
+
+    if (prepare_tick(self_p) != 0) {
+        goto out4;
+    }
+
+    self_p->operations = 0;
+
+    if (connect_to_server(self_p) != 0) {
+        start_reconnect_timer(self_p);
+    }
+
+    messi_uring_submit(&self_p->uring);
+
+    return;
+
+ out4:
+    epoll_ctl_del(self_p, self_p->uring.fd);
+
+ out3:
+    messi_uring_buf_ring_destroy(&self_p->input_buffers, &self_p->uring);
+
+ out2:
+    messi_uring_destroy(&self_p->uring);
+
+ out1:
+    self_p->on_disconnected(self_p, messi_disconnect_reason_general_error_t);
+}
+
+void chat_client_stop(struct chat_client_t *self_p)
+{
+    disconnect(self_p);
+    messi_timer_stop(&self_p->timers, &self_p->reconnect_timer);
+
+    if (self_p->uring.fd != -1) {
+        /* Destroying the io_uring instance cancels all operations. */
+        epoll_ctl_del(self_p, self_p->uring.fd);
+        messi_uring_buf_ring_destroy(&self_p->input_buffers, &self_p->uring);
+        messi_uring_destroy(&self_p->uring);
+    }
+
+    self_p->operations = 0;
+    self_p->output.size = 0;
+    messi_output_queue_destroy(&self_p->output.queue);
+    messi_large_pool_destroy(&self_p->large.pool);
+}
+
+void chat_client_get_stats(struct chat_client_t *self_p,
+                           struct messi_stats_t *stats_p)
+{
+    *stats_p = self_p->stats;
+    stats_p->output_bytes = messi_output_queue_size(&self_p->output.queue);
+}
+
+int chat_client_process_event(struct chat_client_t *self_p,
+                              int fd,
+                              uint32_t events)
+{
+    (void)events;
+
+    if (fd != self_p->uring.fd) {
+        return (-1);
+    }
+
+    process_completions(self_p);
+
+    return (0);
+}
+
+void chat_client_process_deferred(struct chat_client_t *self_p)
+{
+    if (self_p->pending_disconnect) {
+        disconnect(self_p);
+        /* Started first for the reconnect attempt number, and to be
+           stopped if the client is stopped by the callback. */
+        start_reconnect_timer(self_p);
+        self_p->on_disconnected(self_p, self_p->disconnect_reason);
+    }
+}
+
+void chat_client_process(struct chat_client_t *self_p, int fd, uint32_t events)
+{
+    chat_client_process_event(self_p, fd, events);
+    chat_client_process_deferred(self_p);
+}
+
+void chat_client_send(struct chat_client_t *self_p)
+{
+    int res;
+    struct messi_header_t *header_p;
+
+    if (!self_p->connected) {
+        return;
+    }
+
+    chat_client_send_batch(self_p);
+    res = chat_client_to_server_encode(
+        self_p->output.message_p,
+        &self_p->output.encoded.buf_p[sizeof(*header_p)],
+        self_p->output.encoded.size - sizeof(*header_p));
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_encode_error_t);
+
+        return;
+    }
+
+    res = messi_frame_create(self_p->output.encoded.buf_p,
+                             self_p->output.encoded.size,
+                             MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER,
+                             res);
+
+    if (res < 0) {
+        pending_disconnect(self_p, messi_disconnect_reason_message_encode_error_t);
+
+        return;
+    }
+
+    write_to_server(self_p, &self_p->output.encoded.buf_p[0], res);
+}
+
+/* Maximum size of a batch frame, with a basic header. */
+static size_t batch_size_max(struct chat_client_t *self_p)
+{
+    size_t size;
+
+    size = (sizeof(struct messi_header_t) + MESSI_HEADER_SIZE_MAX);
+
+    if (size > self_p->output.encoded.size) {
+        size = self_p->output.encoded.size;
+    }
+
+    return (size);
+}
+
+void chat_client_add_to_batch(struct chat_client_t *self_p)
+{
+    int res;
+    size_t offset;
+    size_t size;
+    uint8_t *buf_p;
+    struct messi_header_t *header_p;
+
+    if (!self_p->connected) {
+        return;
+    }
+
+    buf_p = self_p->output.encoded.buf_p;
+
+    if (self_p->output.batch_size == 0) {
+        self_p->output.batch_size = sizeof(struct messi_header_t);
+    }
+
+    offset = (self_p->output.batch_size + sizeof(struct messi_header_t));
+    size = batch_size_max(self_p);
+    res = -1;
+
+    if (offset <= size) {
+        res = chat_client_to_server_encode(self_p->output.message_p,
+                                           &buf_p[offset],
+                                           size - offset);
+    }
+
+    if (res < 0) {
+        if (self_p->output.batch_size > sizeof(struct messi_header_t)) {
+            /* Does not fit. Send the batch and start a new one. */
+            chat_client_send_batch(self_p);
+            chat_client_add_to_batch(self_p);
+        } else {
+            self_p->output.batch_size = 0;
+            pending_disconnect(self_p,
+                               messi_disconnect_reason_message_encode_error_t);
+        }
+
+        return;
+    }
+
+    header_p = (struct messi_header_t *)&buf_p[self_p->output.batch_size];
+    messi_header_create(header_p, MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER, res);
+    self_p->output.batch_size = (offset + res);
+}
+
+void chat_client_send_batch(struct chat_client_t *self_p)
+{
+    size_t size;
+
+    size = self_p->output.batch_size;
+
+    if (size == 0) {
+        return;
+    }
+
+    self_p->output.batch_size = 0;
+    messi_header_create((struct messi_header_t *)self_p->output.encoded.buf_p,
+                        MESSI_MESSAGE_TYPE_BATCH,
+                        size - sizeof(struct messi_header_t));
+    write_to_server(self_p, self_p->output.encoded.buf_p, size);
+}
+
+struct chat_connect_req_t *chat_client_init_connect_req(
+    struct chat_client_t *self_p)
+{
+    chat_client_new_output_message(self_p);
+    chat_client_to_server_messages_connect_req_alloc(self_p->output.message_p);
+
+    return (self_p->output.message_p->messages.value.connect_req_p);
+}
+
+struct chat_message_ind_t *chat_client_init_message_ind(
+    struct chat_client_t *self_p)
+{
+    chat_client_new_output_message(self_p);
+    chat_client_to_server_messages_message_ind_alloc(self_p->output.message_p);
+
+    return (self_p->output.message_p->messages.value.message_ind_p);
+}
+
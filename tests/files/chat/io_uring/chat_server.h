@@ -0,0 +1,341 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#ifndef CHAT_SERVER_H
+#define CHAT_SERVER_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include "messi.h"
+#include "messi_uring.h"
+#include "chat.h"
+
+struct chat_server_t;
+struct chat_server_client_t;
+
+typedef void (*chat_server_on_connect_req_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    struct chat_connect_req_t *message_p);
+
+typedef void (*chat_server_on_message_ind_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    struct chat_message_ind_t *message_p);
+
+typedef void (*chat_server_on_client_connected_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+typedef void (*chat_server_on_client_disconnected_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+typedef void (*chat_server_on_client_writable_changed_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    bool writable);
+
+typedef uint8_t *(*chat_server_on_client_large_message_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    size_t size);
+
+struct chat_server_t {
+    struct {
+        char address[16];
+        int port;
+    } server;
+    chat_server_on_client_connected_t on_client_connected;
+    chat_server_on_client_disconnected_t on_client_disconnected;
+    chat_server_on_connect_req_t on_connect_req;
+    chat_server_on_message_ind_t on_message_ind;
+    int epoll_fd;
+    messi_epoll_ctl_t epoll_ctl;
+    int listener_fd;
+    int listen_backlog;
+    /* Clients are disconnected if nothing is received within this
+       time. */
+    int keep_alive_timeout_ms;
+    /* Client output watermarks in bytes. Disabled if high is zero(0). */
+    struct {
+        size_t high;
+        size_t low;
+        chat_server_on_client_writable_changed_t on_client_writable_changed;
+    } watermarks;
+    /* Messages received in extended frames. Disabled if max_size is
+       zero(0). */
+    struct {
+        size_t max_size;
+        struct messi_buffer_t workspace;
+        struct messi_large_pool_t pool;
+        chat_server_on_client_large_message_t on_client_large_message;
+    } large;
+    struct messi_uring_t uring;
+    struct messi_uring_buf_ring_t input_buffers;
+    struct __kernel_timespec tick;
+    /* Submission is delayed until all completions are handled. */
+    bool processing;
+    /* Compression of user messages. Disabled if threshold is
+       zero(0). */
+    struct {
+        size_t threshold;
+        const struct messi_codec_t *codec_p;
+        struct messi_buffer_t buffer;
+    } compression;
+    struct messi_timer_wheel_t timers;
+    struct chat_server_client_t *current_client_p;
+    struct {
+        struct chat_server_client_t *clients_p;
+        int max;
+        struct chat_server_client_t *connected_list_p;
+        struct chat_server_client_t *free_list_p;
+        struct chat_server_client_t *pending_disconnect_list_p;
+        /* Disconnected clients with operations in progress. */
+        struct chat_server_client_t *closing_list_p;
+        size_t input_buffer_size;
+    } clients;
+    struct {
+        struct chat_client_to_server_t *message_p;
+        struct messi_buffer_t workspace;
+        /* Correlation id of the request being handled, echoed by
+           reply. */
+        bool is_request;
+        uint32_t request_id;
+    } input;
+    struct {
+        struct chat_server_to_client_t *message_p;
+        struct messi_buffer_t workspace;
+        struct messi_buffer_t encoded;
+    } output;
+};
+
+/* Maximum number of buffers sent in one operation. */
+#define CHAT_SERVER_CLIENT_IOV_MAX 64
+
+struct chat_server_client_t {
+    struct chat_server_t *server_p;
+    int client_fd;
+    /* Number of operations in progress. The client is not reused
+       until they are completed. */
+    int operations;
+    bool closing;
+    struct messi_timer_t keep_alive_timer;
+    struct messi_framer_t input;
+    struct messi_large_input_t large_input;
+    struct {
+        struct messi_output_queue_t queue;
+        /* The operation in progress sends the first size bytes. */
+        size_t size;
+        struct msghdr msg;
+        struct iovec iov[CHAT_SERVER_CLIENT_IOV_MAX];
+        /* False from reaching the high watermark until drained to
+           the low watermark. */
+        bool writable;
+    } output;
+    struct messi_stats_t stats;
+    struct chat_server_client_t *next_p;
+    struct chat_server_client_t *prev_p;
+};
+
+/**
+ * Initialize given server. The server owns one io_uring instance,
+ * whose file descriptor is added to given epoll instance.
+ */
+int chat_server_init(
+    struct chat_server_t *self_p,
+    const char *server_uri_p,
+    struct chat_server_client_t *clients_p,
+    int clients_max,
+    uint8_t *clients_input_bufs_p,
+    size_t client_input_size,
+    uint8_t *message_buf_p,
+    size_t message_size,
+    uint8_t *workspace_in_buf_p,
+    size_t workspace_in_size,
+    uint8_t *workspace_out_buf_p,
+    size_t workspace_out_size,
+    chat_server_on_client_connected_t on_client_connected,
+    chat_server_on_client_disconnected_t on_client_disconnected,
+    chat_server_on_connect_req_t on_connect_req,
+    chat_server_on_message_ind_t on_message_ind,
+    int epoll_fd,
+    messi_epoll_ctl_t epoll_ctl);
+
+/**
+ * Set the maximum number of connections waiting to be accepted by
+ * the listener socket. Defaults to 5. Call before start.
+ */
+void chat_server_set_listen_backlog(struct chat_server_t *self_p, int backlog);
+
+/**
+ * Disconnect clients that have sent nothing for given number of
+ * milliseconds. Any received data proves that a client is alive, and
+ * clients only ping the server when idle. Defaults to 3000 ms. Call
+ * before start.
+ */
+void chat_server_set_keep_alive_timeout(struct chat_server_t *self_p,
+                                        int timeout_ms);
+
+/**
+ * Call given callback with writable false when the output of a client
+ * not yet written reaches high bytes, and with writable true when it
+ * has been written down to low bytes. Stop producing messages for a
+ * client that is not writable, or its output keeps growing. The
+ * callback is called from within send, reply and broadcast when
+ * writable becomes false, and must then not send messages. Call
+ * before start.
+ */
+void chat_server_set_client_output_watermarks(
+    struct chat_server_t *self_p,
+    size_t high,
+    size_t low,
+    chat_server_on_client_writable_changed_t on_client_writable_changed);
+
+/**
+ * Receive messages of at most max_size bytes sent in extended
+ * frames, which may be larger than the client input buffer. The
+ * payload of such a message is received into storage of its size
+ * returned by given callback, or into storage allocated from a pool
+ * if the callback is NULL or returns NULL. It is decoded into given
+ * workspace once received. Messages larger than
+ * MESSI_HEADER_SIZE_MAX bytes are always sent in extended
+ * frames. Call before start.
+ */
+void chat_server_set_large_messages(
+    struct chat_server_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    chat_server_on_client_large_message_t on_client_large_message);
+
+/**
+ * Send user messages with payloads of at least threshold bytes in
+ * compressed frames, if smaller once compressed with given codec, or
+ * the built-in LZ4 codec if NULL. The compressed payload is written
+ * to given buffer, which should be as large as the encoded message
+ * buffer. All clients must support compressed frames. Call before
+ * start.
+ */
+void chat_server_set_compression(struct chat_server_t *self_p,
+                                 size_t threshold,
+                                 const struct messi_codec_t *codec_p,
+                                 uint8_t *buf_p,
+                                 size_t size);
+
+/**
+ * Start serving clients.
+ */
+int chat_server_start(struct chat_server_t *self_p);
+
+/**
+ * Stop serving clients.
+ */
+void chat_server_stop(struct chat_server_t *self_p);
+
+/**
+ * Process any pending events on given file descriptor if it belongs
+ * to given server.
+ */
+void chat_server_process(struct chat_server_t *self_p, int fd, uint32_t events);
+
+/**
+ * As chat_server_process(), but work that can be done once for many
+ * events, such as destroying disconnected clients, is deferred until
+ * chat_server_process_deferred() is called. Returns zero(0) if given
+ * file descriptor belongs to given server. Suitable as the process
+ * function of a messi_loop_t member.
+ */
+int chat_server_process_event(struct chat_server_t *self_p,
+                              int fd,
+                              uint32_t events);
+
+/**
+ * Perform work deferred by chat_server_process_event().
+ */
+void chat_server_process_deferred(struct chat_server_t *self_p);
+
+/**
+ * Send prepared message to given client.
+ */
+void chat_server_send(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+/**
+ * Send prepared message to current client. If the message being
+ * handled is a request, the reply is its response.
+ */
+void chat_server_reply(struct chat_server_t *self_p);
+
+/**
+ * Broadcast prepared message to all clients.
+ */
+void chat_server_broadcast(struct chat_server_t *self_p);
+
+/**
+ * Returns the number of bytes of given client's output not yet
+ * written to its socket.
+ */
+size_t chat_server_client_output_bytes(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+/**
+ * Copy the traffic statistics of given client's connection to given
+ * structure. Reads and writes are completed receive and send
+ * operations.
+ */
+void chat_server_client_get_stats(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    struct messi_stats_t *stats_p);
+
+/**
+ * Disconnect given client. If given client is NULL, the currect
+ * client is disconnected.
+ */
+void chat_server_disconnect(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+/**
+ * Prepare a connect_rsp message. Call `send()`, `reply()` or `broadcast()`
+ * to send it.
+ */
+struct chat_connect_rsp_t *chat_server_init_connect_rsp(
+    struct chat_server_t *self_p);
+
+/**
+ * Prepare a message_ind message. Call `send()`, `reply()` or `broadcast()`
+ * to send it.
+ */
+struct chat_message_ind_t *chat_server_init_message_ind(
+    struct chat_server_t *self_p);
+
+#endif
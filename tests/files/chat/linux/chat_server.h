@@ -30,11 +30,15 @@
 #define CHAT_SERVER_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include "messi.h"
 #include "chat.h"
 
 struct chat_server_t;
 struct chat_server_client_t;
+struct chat_server_client_slab_t;
+struct chat_server_reactor_t;
+struct chat_server_reactors_t;
 
 typedef void (*chat_server_on_connect_req_t)(
     struct chat_server_t *self_p,
@@ -46,11 +50,6 @@ typedef void (*chat_server_on_message_ind_t)(
     struct chat_server_client_t *client_p,
     struct chat_message_ind_t *message_p);
 
-enum chat_server_client_input_state_t {
-    chat_server_client_input_state_header_t = 0,
-    chat_server_client_input_state_payload_t
-};
-
 typedef void (*chat_server_on_client_connected_t)(
     struct chat_server_t *self_p,
     struct chat_server_client_t *client_p);
@@ -59,10 +58,24 @@ typedef void (*chat_server_on_client_disconnected_t)(
     struct chat_server_t *self_p,
     struct chat_server_client_t *client_p);
 
+typedef void (*chat_server_on_client_writable_changed_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    bool writable);
+
+typedef uint8_t *(*chat_server_on_client_large_message_t)(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    size_t size);
+
 struct chat_server_t {
     struct {
+        int domain;
         char address[16];
         int port;
+        struct sockaddr_un local_addr;
+        socklen_t local_addr_size;
+        bool shm;
     } server;
     chat_server_on_client_connected_t on_client_connected;
     chat_server_on_client_disconnected_t on_client_disconnected;
@@ -71,16 +84,65 @@ struct chat_server_t {
     int epoll_fd;
     messi_epoll_ctl_t epoll_ctl;
     int listener_fd;
+    int listen_backlog;
+    /* Clients are disconnected if nothing is received within this
+       time. */
+    int keep_alive_timeout_ms;
+    /* Maximum number of connections accepted per listener event, or
+       zero(0) for all pending. */
+    int accepts_per_event;
+    /* Client output watermarks in bytes. Disabled if high is zero(0). */
+    struct {
+        size_t high;
+        size_t low;
+        chat_server_on_client_writable_changed_t on_client_writable_changed;
+    } watermarks;
+    /* Messages received in extended frames. Disabled if max_size is
+       zero(0). */
+    struct {
+        size_t max_size;
+        struct messi_buffer_t workspace;
+        struct messi_large_pool_t pool;
+        chat_server_on_client_large_message_t on_client_large_message;
+    } large;
+    /* Compression of user messages. Disabled if threshold is
+       zero(0). */
+    struct {
+        size_t threshold;
+        const struct messi_codec_t *codec_p;
+        struct messi_buffer_t buffer;
+    } compression;
+    struct messi_timer_wheel_t timers;
+    struct chat_server_reactor_t *reactor_p;
     struct chat_server_client_t *current_client_p;
     struct {
+        struct chat_server_client_t *clients_p;
+        int max;
         struct chat_server_client_t *connected_list_p;
         struct chat_server_client_t *free_list_p;
         struct chat_server_client_t *pending_disconnect_list_p;
         size_t input_buffer_size;
+        struct messi_fd_table_t fds;
+        /* Clients allocated in slabs once all given clients are
+           connected. Disabled if clients_per_slab is zero(0). */
+        struct {
+            int clients_per_slab;
+            /* Maximum number of clients, including given clients. */
+            int clients_max;
+            /* Number of clients in all slabs. */
+            int size;
+            /* Number of slabs without connected clients. */
+            int number_of_empty;
+            struct chat_server_client_slab_t *list_p;
+        } slabs;
     } clients;
     struct {
         struct chat_client_to_server_t *message_p;
         struct messi_buffer_t workspace;
+        /* Correlation id of the request being handled, echoed by
+           reply. */
+        bool is_request;
+        uint32_t request_id;
     } input;
     struct {
         struct chat_server_to_client_t *message_p;
@@ -89,30 +151,80 @@ struct chat_server_t {
     } output;
 };
 
-struct chat_server_client_output_item_t {
-    size_t offset;
-    size_t size;
-    struct chat_server_client_output_item_t *next_p;
-    uint8_t data[1];
-};
-
 struct chat_server_client_t {
+    struct chat_server_t *server_p;
     int client_fd;
-    int keep_alive_timer_fd;
-    struct {
-        enum chat_server_client_input_state_t state;
-        struct messi_buffer_t data;
-        size_t size;
-        size_t left;
-    } input;
+    struct messi_timer_t keep_alive_timer;
+    struct messi_framer_t input;
+    struct messi_large_input_t large_input;
     struct {
-        struct chat_server_client_output_item_t *head_p;
-        struct chat_server_client_output_item_t *tail_p;
+        struct messi_output_queue_t queue;
+        struct messi_ring_t ring;
+        /* False from reaching the high watermark until drained to
+           the low watermark. */
+        bool writable;
     } output;
+    struct messi_stats_t stats;
+    /* Only used by shm:// servers. */
+    struct messi_shm_t shm;
+    /* NULL if one of the clients given to init. */
+    struct chat_server_client_slab_t *slab_p;
     struct chat_server_client_t *next_p;
     struct chat_server_client_t *prev_p;
 };
 
+/* Clients allocated together, followed by their input buffers. */
+struct chat_server_client_slab_t {
+    struct chat_server_client_slab_t *next_p;
+    struct chat_server_client_slab_t *prev_p;
+    struct chat_server_client_t *free_list_p;
+    /* Number of clients not in the free list. */
+    int used;
+    int length;
+    struct chat_server_client_t clients[];
+};
+
+/* Work posted to a reactor by other threads. */
+struct chat_server_reactor_work_t {
+    /* An accepted client socket, or -1 for a broadcast. */
+    int client_fd;
+    struct messi_shared_buffer_t *buffer_p;
+};
+
+struct chat_server_reactor_work_list_t {
+    struct chat_server_reactor_work_t *items_p;
+    size_t length;
+    size_t max;
+};
+
+struct chat_server_reactor_t {
+    struct chat_server_t *server_p;
+    struct chat_server_reactors_t *reactors_p;
+    pthread_t thread;
+    int epoll_fd;
+    int event_fd;
+    pthread_mutex_t mutex;
+    /* Protected by the mutex. */
+    struct chat_server_reactor_work_list_t posted;
+    /* Only used by the reactor thread. */
+    struct chat_server_reactor_work_list_t work;
+    /* Number of clients placed on this reactor. */
+    int load;
+};
+
+struct chat_server_reactors_t {
+    struct chat_server_reactor_t *reactors_p;
+    int number_of_reactors;
+    bool reuse_port;
+    bool stopped;
+    struct {
+        pthread_t thread;
+        int listener_fd;
+        int epoll_fd;
+        int event_fd;
+    } acceptor;
+};
+
 /**
  * Initialize given server.
  */
@@ -136,6 +248,101 @@ int chat_server_init(
     int epoll_fd,
     messi_epoll_ctl_t epoll_ctl);
 
+/**
+ * Use given preallocated buffer for output that can not be written
+ * immediately, instead of allocating memory for it. Each client gets
+ * client_output_size bytes of given buffer, which must be at least
+ * clients_max * client_output_size bytes. A client is disconnected if
+ * its output buffer is full. Call before start.
+ */
+void chat_server_set_clients_output_buffers(
+    struct chat_server_t *self_p,
+    uint8_t *clients_output_bufs_p,
+    size_t client_output_size);
+
+/**
+ * Allocate more clients in slabs of given number of clients when all
+ * clients given to init are connected, up to clients_max clients in
+ * total. Slab clients use output queues, not the preallocated output
+ * buffers. A slab is freed when its last client disconnects, except
+ * that one empty slab is kept to absorb connection churn. Clients
+ * never move, so client pointers are valid until disconnected. Call
+ * before start.
+ */
+void chat_server_set_client_slabs(struct chat_server_t *self_p,
+                                  int clients_per_slab,
+                                  int clients_max);
+
+/**
+ * Set the maximum number of connections waiting to be accepted by
+ * the listener socket. Defaults to 5. Call before start.
+ */
+void chat_server_set_listen_backlog(struct chat_server_t *self_p, int backlog);
+
+/**
+ * Disconnect clients that have sent nothing for given number of
+ * milliseconds. Any received data proves that a client is alive, and
+ * clients only ping the server when idle. Defaults to 3000 ms. Call
+ * before start.
+ */
+void chat_server_set_keep_alive_timeout(struct chat_server_t *self_p,
+                                        int timeout_ms);
+
+/**
+ * Accept at most given number of connections each time the listener
+ * socket is readable. The rest are accepted on later events, so
+ * connected clients are served in between when many clients connect
+ * at once. Zero(0), the default, accepts all waiting connections.
+ */
+void chat_server_set_accept_pacing(struct chat_server_t *self_p,
+                                   int accepts_per_event);
+
+/**
+ * Call given callback with writable false when the output of a client
+ * not yet written reaches high bytes, and with writable true when it
+ * has been written down to low bytes. Stop producing messages for a
+ * client that is not writable, or its output keeps growing. The
+ * callback is called from within send, reply and broadcast when
+ * writable becomes false, and must then not send messages. Call
+ * before start.
+ */
+void chat_server_set_client_output_watermarks(
+    struct chat_server_t *self_p,
+    size_t high,
+    size_t low,
+    chat_server_on_client_writable_changed_t on_client_writable_changed);
+
+/**
+ * Receive messages of at most max_size bytes sent in extended
+ * frames, which may be larger than the client input buffer. The
+ * payload of such a message is received into storage of its size
+ * returned by given callback, or into storage allocated from a pool
+ * if the callback is NULL or returns NULL. It is decoded into given
+ * workspace once received. Messages larger than
+ * MESSI_HEADER_SIZE_MAX bytes are always sent in extended
+ * frames. Call before start.
+ */
+void chat_server_set_large_messages(
+    struct chat_server_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    chat_server_on_client_large_message_t on_client_large_message);
+
+/**
+ * Send user messages with payloads of at least threshold bytes in
+ * compressed frames, if smaller once compressed with given codec, or
+ * the built-in LZ4 codec if NULL. The compressed payload is written
+ * to given buffer, which should be as large as the encoded message
+ * buffer. All clients must support compressed frames. Call before
+ * start.
+ */
+void chat_server_set_compression(struct chat_server_t *self_p,
+                                 size_t threshold,
+                                 const struct messi_codec_t *codec_p,
+                                 uint8_t *buf_p,
+                                 size_t size);
+
 /**
  * Start serving clients.
  */
@@ -152,6 +359,22 @@ void chat_server_stop(struct chat_server_t *self_p);
  */
 void chat_server_process(struct chat_server_t *self_p, int fd, uint32_t events);
 
+/**
+ * As chat_server_process(), but work that can be done once for many
+ * events, such as destroying disconnected clients, is deferred until
+ * chat_server_process_deferred() is called. Returns zero(0) if given
+ * file descriptor belongs to given server. Suitable as the process
+ * function of a messi_loop_t member.
+ */
+int chat_server_process_event(struct chat_server_t *self_p,
+                              int fd,
+                              uint32_t events);
+
+/**
+ * Perform work deferred by chat_server_process_event().
+ */
+void chat_server_process_deferred(struct chat_server_t *self_p);
+
 /**
  * Send prepared message to given client.
  */
@@ -160,7 +383,8 @@ void chat_server_send(
     struct chat_server_client_t *client_p);
 
 /**
- * Send prepared message to current client.
+ * Send prepared message to current client. If the message being
+ * handled is a request, the reply is its response.
  */
 void chat_server_reply(struct chat_server_t *self_p);
 
@@ -169,6 +393,23 @@ void chat_server_reply(struct chat_server_t *self_p);
  */
 void chat_server_broadcast(struct chat_server_t *self_p);
 
+/**
+ * Returns the number of bytes of given client's output not yet
+ * written to its socket.
+ */
+size_t chat_server_client_output_bytes(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p);
+
+/**
+ * Copy the traffic statistics of given client's connection to given
+ * structure.
+ */
+void chat_server_client_get_stats(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p,
+    struct messi_stats_t *stats_p);
+
 /**
  * Disconnect given client. If given client is NULL, the currect
  * client is disconnected.
@@ -177,6 +418,39 @@ void chat_server_disconnect(
     struct chat_server_t *self_p,
     struct chat_server_client_t *client_p);
 
+/**
+ * Initialize given multi-reactor server. Each of given servers runs
+ * in its own event loop thread and owns the clients placed on
+ * it. The servers must be initialized with the same URI, epoll_fd -1
+ * and epoll_ctl NULL. Callbacks are called in the thread of the
+ * server they belong to, and a server may only be used from its own
+ * thread. Broadcast reaches the clients of all servers, in the same
+ * order as broadcast was called by any one server.
+ */
+int chat_server_reactors_init(
+    struct chat_server_reactors_t *self_p,
+    struct chat_server_reactor_t *reactors_p,
+    struct chat_server_t *servers_p,
+    int number_of_reactors);
+
+/**
+ * Let each reactor accept its own connections on a listener socket
+ * with SO_REUSEPORT, instead of one acceptor thread placing new
+ * connections on the least loaded reactor. TCP only. Call before
+ * start.
+ */
+void chat_server_reactors_set_reuse_port(struct chat_server_reactors_t *self_p);
+
+/**
+ * Start all reactor threads.
+ */
+int chat_server_reactors_start(struct chat_server_reactors_t *self_p);
+
+/**
+ * Stop and join all reactor threads, and stop their servers.
+ */
+void chat_server_reactors_stop(struct chat_server_reactors_t *self_p);
+
 /**
  * Prepare a connect_rsp message. Call `send()`, `reply()` or `broadcast()`
  * to send it.
@@ -26,17 +26,202 @@
 
 /* This file was generated by Messi. */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/epoll.h>
-#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <netinet/tcp.h>
 #include "messi.h"
 #include "imported_server.h"
 
+/* Maximum number of buffers written in one writev() call. */
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* Maximum number of events handled per epoll_wait() in a reactor
+   thread. */
+#define REACTOR_EVENTS_MAX 64
+
+static void on_client_keep_alive_timeout(struct imported_server_client_t *client_p);
+
+/* Prepare given client for its first connection. */
+static void client_setup(struct imported_server_client_t *self_p,
+                         struct imported_server_t *server_p,
+                         struct imported_server_client_slab_t *slab_p,
+                         uint8_t *input_buf_p)
+{
+    self_p->server_p = server_p;
+    self_p->slab_p = slab_p;
+    messi_framer_init(&self_p->input,
+                      input_buf_p,
+                      server_p->clients.input_buffer_size);
+    self_p->large_input.buf_p = NULL;
+    messi_ring_init(&self_p->output.ring, NULL, 0);
+    messi_output_queue_init(&self_p->output.queue);
+    messi_shm_init(&self_p->shm, -1);
+    messi_timer_init(&self_p->keep_alive_timer,
+                     (messi_timer_on_timeout_t)on_client_keep_alive_timeout,
+                     self_p);
+}
+
+/* Allocate a slab of at most clients_per_slab clients, limited by
+   the maximum number of clients. Returns NULL if the limit is
+   reached or out of memory. */
+static struct imported_server_client_slab_t *slab_new(struct imported_server_t *self_p)
+{
+    struct imported_server_client_slab_t *slab_p;
+    uint8_t *input_bufs_p;
+    size_t input_size;
+    int length;
+    int i;
+
+    length = (self_p->clients.slabs.clients_max
+              - self_p->clients.max
+              - self_p->clients.slabs.size);
+
+    if (length > self_p->clients.slabs.clients_per_slab) {
+        length = self_p->clients.slabs.clients_per_slab;
+    }
+
+    if (length <= 0) {
+        return (NULL);
+    }
+
+    input_size = self_p->clients.input_buffer_size;
+    slab_p = malloc(sizeof(*slab_p)
+                    + length * (sizeof(slab_p->clients[0]) + input_size));
+
+    if (slab_p == NULL) {
+        return (NULL);
+    }
+
+    input_bufs_p = (uint8_t *)&slab_p->clients[length];
+
+    for (i = 0; i < length; i++) {
+        client_setup(&slab_p->clients[i],
+                     self_p,
+                     slab_p,
+                     &input_bufs_p[i * input_size]);
+        slab_p->clients[i].next_p = &slab_p->clients[i + 1];
+    }
+
+    slab_p->clients[length - 1].next_p = NULL;
+    slab_p->free_list_p = &slab_p->clients[0];
+    slab_p->used = 0;
+    slab_p->length = length;
+
+    /* Add to list of slabs. */
+    slab_p->prev_p = NULL;
+    slab_p->next_p = self_p->clients.slabs.list_p;
+
+    if (slab_p->next_p != NULL) {
+        slab_p->next_p->prev_p = slab_p;
+    }
+
+    self_p->clients.slabs.list_p = slab_p;
+    self_p->clients.slabs.size += length;
+    self_p->clients.slabs.number_of_empty++;
+
+    return (slab_p);
+}
+
+static void slab_delete(struct imported_server_t *self_p,
+                        struct imported_server_client_slab_t *slab_p)
+{
+    int i;
+
+    if (slab_p->prev_p == NULL) {
+        self_p->clients.slabs.list_p = slab_p->next_p;
+    } else {
+        slab_p->prev_p->next_p = slab_p->next_p;
+    }
+
+    if (slab_p->next_p != NULL) {
+        slab_p->next_p->prev_p = slab_p->prev_p;
+    }
+
+    for (i = 0; i < slab_p->length; i++) {
+        messi_output_queue_destroy(&slab_p->clients[i].output.queue);
+    }
+
+    self_p->clients.slabs.size -= slab_p->length;
+    self_p->clients.slabs.number_of_empty--;
+    free(slab_p);
+}
+
+/* Take a client from the first slab with a free client, or from a
+   new slab. */
+static struct imported_server_client_t *slabs_alloc_client(
+    struct imported_server_t *self_p)
+{
+    struct imported_server_client_slab_t *slab_p;
+    struct imported_server_client_t *client_p;
+
+    slab_p = self_p->clients.slabs.list_p;
+
+    while ((slab_p != NULL) && (slab_p->free_list_p == NULL)) {
+        slab_p = slab_p->next_p;
+    }
+
+    if (slab_p == NULL) {
+        slab_p = slab_new(self_p);
+
+        if (slab_p == NULL) {
+            return (NULL);
+        }
+    }
+
+    client_p = slab_p->free_list_p;
+    slab_p->free_list_p = client_p->next_p;
+
+    if (slab_p->used == 0) {
+        self_p->clients.slabs.number_of_empty--;
+    }
+
+    slab_p->used++;
+
+    return (client_p);
+}
+
+/* Add given client to its free list. An empty slab is freed if
+   another one is already empty. */
+static void push_free_client(struct imported_server_t *self_p,
+                             struct imported_server_client_t *client_p)
+{
+    struct imported_server_client_slab_t *slab_p;
+
+    slab_p = client_p->slab_p;
+
+    if (slab_p == NULL) {
+        client_p->next_p = self_p->clients.free_list_p;
+        self_p->clients.free_list_p = client_p;
+
+        return;
+    }
+
+    client_p->next_p = slab_p->free_list_p;
+    slab_p->free_list_p = client_p;
+    slab_p->used--;
+
+    if (slab_p->used == 0) {
+        self_p->clients.slabs.number_of_empty++;
+
+        if (self_p->clients.slabs.number_of_empty > 1) {
+            slab_delete(self_p, slab_p);
+        }
+    }
+}
+
 static struct imported_server_client_t *alloc_client(struct imported_server_t *self_p)
 {
     struct imported_server_client_t *client_p;
@@ -46,7 +231,11 @@ static struct imported_server_client_t *alloc_client(struct imported_server_t *s
     if (client_p != NULL) {
         /* Remove from free list. */
         self_p->clients.free_list_p = client_p->next_p;
+    } else if (self_p->clients.slabs.clients_per_slab > 0) {
+        client_p = slabs_alloc_client(self_p);
+    }
 
+    if (client_p != NULL) {
         /* Add to connected list. */
         client_p->next_p = self_p->clients.connected_list_p;
 
@@ -79,21 +268,37 @@ static void free_connected_client(struct imported_server_t *self_p,
 {
     remove_client_from_list(&self_p->clients.connected_list_p,
                             client_p);
+    push_free_client(self_p, client_p);
+}
+
+/* Release the storage of any large message being received. */
+static void client_large_input_release(struct imported_server_client_t *self_p,
+                                       struct imported_server_t *server_p)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &self_p->large_input;
+
+    if (large_p->buf_p == NULL) {
+        return;
+    }
+
+    if (large_p->pooled) {
+        messi_large_pool_free(&server_p->large.pool,
+                              large_p->buf_p,
+                              large_p->pooled_size);
+    }
 
-    /* Add to free list. */
-    client_p->next_p = self_p->clients.free_list_p;
-    self_p->clients.free_list_p = client_p;
+    large_p->buf_p = NULL;
 }
 
 static void free_pending_disconnect_client(struct imported_server_t *self_p,
                                            struct imported_server_client_t *client_p)
 {
+    client_large_input_release(client_p, self_p);
     remove_client_from_list(&self_p->clients.pending_disconnect_list_p,
                             client_p);
-
-    /* Add to free list. */
-    client_p->next_p = self_p->clients.free_list_p;
-    self_p->clients.free_list_p = client_p;
+    push_free_client(self_p, client_p);
 }
 
 static void move_client_to_pending_disconnect_list(
@@ -129,21 +334,11 @@ static void close_fd(struct imported_server_t *self_p, int fd)
     close(fd);
 }
 
-static void client_reset_input(struct imported_server_client_t *self_p)
-{
-    self_p->input.state = imported_server_client_input_state_header_t;
-    self_p->input.size = 0;
-    self_p->input.left = sizeof(struct messi_header_t);
-}
-
 static int client_start_keep_alive_timer(struct imported_server_client_t *self_p)
 {
-    struct itimerspec timeout;
-
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 3;
-
-    return (timerfd_settime(self_p->keep_alive_timer_fd, 0, &timeout, NULL));
+    return (messi_timer_start(&self_p->server_p->timers,
+                              &self_p->keep_alive_timer,
+                              self_p->server_p->keep_alive_timeout_ms));
 }
 
 static int client_init(struct imported_server_client_t *self_p,
@@ -153,43 +348,61 @@ static int client_init(struct imported_server_client_t *self_p,
     int res;
 
     self_p->client_fd = client_fd;
-    client_reset_input(self_p);
-    self_p->output.head_p = NULL;
-    self_p->keep_alive_timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    messi_shm_init(&self_p->shm, client_fd);
+    messi_framer_reset(&self_p->input);
+    messi_ring_reset(&self_p->output.ring);
+    self_p->output.writable = true;
+    memset(&self_p->stats, 0, sizeof(self_p->stats));
 
-    if (self_p->keep_alive_timer_fd == -1) {
+    res = messi_fd_table_set(&server_p->clients.fds, client_fd, self_p);
+
+    if (res != 0) {
         return (-1);
     }
 
     res = client_start_keep_alive_timer(self_p);
 
-    if (res == -1) {
+    if (res != 0) {
         goto out1;
     }
 
-    res = epoll_ctl_add(server_p, self_p->keep_alive_timer_fd);
+    res = epoll_ctl_add(server_p, client_fd);
 
     if (res == -1) {
-        goto out1;
+        goto out2;
     }
 
-    res = epoll_ctl_add(server_p, client_fd);
+    if (server_p->server.shm) {
+        res = messi_shm_create(&self_p->shm);
 
-    if (res == -1) {
-        goto out2;
+        if (res != 0) {
+            goto out3;
+        }
     }
 
     return (0);
 
+ out3:
+    epoll_ctl_del(server_p, client_fd);
+
  out2:
-    epoll_ctl_del(server_p, self_p->keep_alive_timer_fd);
+    messi_timer_stop(&server_p->timers, &self_p->keep_alive_timer);
 
  out1:
-    close(self_p->keep_alive_timer_fd);
+    messi_fd_table_clear(&server_p->clients.fds, client_fd);
 
     return (-1);
 }
 
+/* Update the number of clients placed on the reactor running given
+   server, if any. */
+static void reactor_load_add(struct imported_server_t *self_p, int value)
+{
+    if (self_p->reactor_p != NULL) {
+        __atomic_add_fetch(&self_p->reactor_p->load, value, __ATOMIC_RELAXED);
+    }
+}
+
 static void destroy_pending_disconnect_clients(struct imported_server_t *self_p)
 {
     struct imported_server_client_t *client_p;
@@ -198,9 +411,8 @@ static void destroy_pending_disconnect_clients(struct imported_server_t *self_p)
     client_p = self_p->clients.pending_disconnect_list_p;
 
     while (client_p != NULL) {
-        close_fd(self_p, client_p->keep_alive_timer_fd);
-        client_p->keep_alive_timer_fd = -1;
         self_p->on_client_disconnected(self_p, client_p);
+        reactor_load_add(self_p, -1);
         next_client_p = client_p->next_p;
         free_pending_disconnect_client(self_p, client_p);
         client_p = next_client_p;
@@ -209,17 +421,8 @@ static void destroy_pending_disconnect_clients(struct imported_server_t *self_p)
 
 static void free_client_output(struct imported_server_client_t *self_p)
 {
-    struct imported_server_client_output_item_t *item_p;
-    struct imported_server_client_output_item_t *next_p;
-
-    item_p = self_p->output.head_p;
-    self_p->output.head_p = NULL;
-
-    while (item_p != NULL) {
-        next_p = item_p->next_p;
-        free(item_p);
-        item_p = next_p;
-    }
+    messi_ring_reset(&self_p->output.ring);
+    messi_output_queue_clear(&self_p->output.queue);
 }
 
 static void client_pending_disconnect(struct imported_server_client_t *self_p,
@@ -230,44 +433,22 @@ static void client_pending_disconnect(struct imported_server_client_t *self_p,
         return;
     }
 
+    messi_fd_table_clear(&server_p->clients.fds, self_p->client_fd);
     close_fd(server_p, self_p->client_fd);
+    messi_shm_close(&self_p->shm);
     self_p->client_fd = -1;
+    messi_timer_stop(&server_p->timers, &self_p->keep_alive_timer);
     free_client_output(self_p);
     move_client_to_pending_disconnect_list(server_p, self_p);
 }
 
-static void process_listener(struct imported_server_t *self_p, uint32_t events)
+/* Serve given accepted non-blocking client socket. TCP_NODELAY is
+   inherited from a TCP listener socket. The socket is closed on
+   failure. */
+static int add_client(struct imported_server_t *self_p, int client_fd)
 {
-    (void)events;
-
     int res;
-    int client_fd;
     struct imported_server_client_t *client_p;
-    int yes;
-
-    client_fd = accept(self_p->listener_fd, NULL, 0);
-
-    if (client_fd == -1) {
-        return;
-    }
-
-    res = messi_make_non_blocking(client_fd);
-
-    if (res == -1) {
-        goto out1;
-    }
-
-    yes = 1;
-
-    res = setsockopt(client_fd,
-                     IPPROTO_TCP,
-                     TCP_NODELAY,
-                     (void *)&yes,
-                     sizeof(yes));
-
-    if (res != 0) {
-        goto out1;
-    }
 
     client_p = alloc_client(self_p);
 
@@ -283,69 +464,222 @@ static void process_listener(struct imported_server_t *self_p, uint32_t events)
 
     self_p->on_client_connected(self_p, client_p);
 
-    return;
+    return (0);
 
  out2:
     free_connected_client(self_p, client_p);
 
  out1:
     close(client_fd);
+
+    return (-1);
+}
+
+/* Accept all waiting connections, or at most accepts_per_event if
+   paced. Connections left in the queue make the listener readable
+   again. */
+static void process_listener(struct imported_server_t *self_p, uint32_t events)
+{
+    (void)events;
+
+    int client_fd;
+    int accepted;
+
+    accepted = 0;
+
+    while ((self_p->accepts_per_event == 0)
+           || (accepted < self_p->accepts_per_event)) {
+        client_fd = accept4(self_p->listener_fd, NULL, 0, SOCK_NONBLOCK);
+
+        if (client_fd == -1) {
+            break;
+        }
+
+        accepted++;
+
+        if (add_client(self_p, client_fd) == 0) {
+            reactor_load_add(self_p, 1);
+        }
+    }
+}
+
+static bool client_output_is_empty(struct imported_server_client_t *self_p)
+{
+    return (messi_output_queue_is_empty(&self_p->output.queue)
+            && (messi_ring_used(&self_p->output.ring) == 0));
+}
+
+/* Number of enqueued bytes not yet written. */
+static size_t client_output_size(struct imported_server_client_t *self_p)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        return (messi_ring_used(&self_p->output.ring));
+    }
+
+    return (messi_output_queue_size(&self_p->output.queue));
+}
+
+static void client_set_writable(struct imported_server_client_t *self_p,
+                                struct imported_server_t *server_p,
+                                bool writable)
+{
+    self_p->output.writable = writable;
+    server_p->watermarks.on_client_writable_changed(server_p,
+                                                    self_p,
+                                                    writable);
 }
 
+/* Enqueue a reference to given shared buffer, which is created from
+   given data by the first client that needs it. A message broadcast
+   to many slow clients is thereby only copied once. */
+static int client_output_append_shared(struct imported_server_client_t *self_p,
+                                       uint8_t *buf_p,
+                                       size_t size,
+                                       size_t offset,
+                                       struct messi_shared_buffer_t **shared_pp)
+{
+    if (*shared_pp == NULL) {
+        *shared_pp = messi_shared_buffer_new(buf_p, size);
+
+        if (*shared_pp == NULL) {
+            return (-1);
+        }
+    }
+
+    return (messi_output_queue_push(&self_p->output.queue, *shared_pp, offset));
+}
+
+/* Read from given client, over its socket or its shared memory. */
+static ssize_t transport_read(struct imported_server_t *self_p,
+                              struct imported_server_client_t *client_p,
+                              void *buf_p,
+                              size_t size)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_read(&client_p->shm, buf_p, size));
+    }
+
+    return (read(client_p->client_fd, buf_p, size));
+}
+
+/* Write to given client, over its socket or its shared memory. */
+static ssize_t transport_write(struct imported_server_t *self_p,
+                               struct imported_server_client_t *client_p,
+                               const void *buf_p,
+                               size_t size)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_write(&client_p->shm, buf_p, size));
+    }
+
+    return (write(client_p->client_fd, buf_p, size));
+}
+
+static ssize_t transport_writev(struct imported_server_t *self_p,
+                                struct imported_server_client_t *client_p,
+                                const struct iovec *iov_p,
+                                int iovcnt)
+{
+    if (self_p->server.shm) {
+        return (messi_shm_writev(&client_p->shm, iov_p, iovcnt));
+    }
+
+    return (writev(client_p->client_fd, iov_p, iovcnt));
+}
+
+/* Enqueue data from given offset that could not be written. The
+   client is disconnected if it does not fit, as the stream would be
+   corrupt if any data was dropped. */
 static void client_output_append(struct imported_server_client_t *self_p,
                                  struct imported_server_t *server_p,
                                  uint8_t *buf_p,
-                                 size_t size)
+                                 size_t size,
+                                 size_t offset,
+                                 struct messi_shared_buffer_t **shared_pp)
 {
-    struct imported_server_client_output_item_t *item_p;
+    int res;
+    bool was_empty;
+    size_t output_size;
 
-    item_p = malloc(sizeof(*item_p) + size - 1);
+    was_empty = client_output_is_empty(self_p);
 
-    if (item_p == NULL) {
-        return;
+    if (self_p->output.ring.data.buf_p != NULL) {
+        res = messi_ring_write(&self_p->output.ring,
+                               &buf_p[offset],
+                               size - offset);
+    } else {
+        res = client_output_append_shared(self_p,
+                                          buf_p,
+                                          size,
+                                          offset,
+                                          shared_pp);
     }
 
-    item_p->offset = 0;
-    item_p->size = size;
-    item_p->next_p = NULL;
-    memcpy(&item_p->data[0], buf_p, size);
+    if (res != 0) {
+        client_pending_disconnect(self_p, server_p);
+
+        return;
+    }
 
-    if (self_p->output.head_p == NULL) {
-        self_p->output.head_p = item_p;
+    /* The socket of a shared memory client is made readable instead
+       of writable when there is free space again. */
+    if (was_empty && !server_p->server.shm) {
         epoll_ctl_mod(server_p, self_p->client_fd, EPOLLIN | EPOLLOUT);
-    } else {
-        self_p->output.tail_p->next_p = item_p;
     }
 
-    self_p->output.tail_p = item_p;
+    output_size = client_output_size(self_p);
+
+    if (output_size > self_p->stats.output_bytes_peak) {
+        self_p->stats.output_bytes_peak = output_size;
+    }
+
+    if (self_p->output.writable
+        && (server_p->watermarks.high > 0)
+        && (output_size >= server_p->watermarks.high)) {
+        client_set_writable(self_p, server_p, false);
+    }
 }
 
+/* Write given data to given client, or enqueue what could not be
+   written. Enqueued data references *shared_pp, which is created if
+   NULL. The caller releases it with messi_shared_buffer_unref(). */
 static void client_write(struct imported_server_t *self_p,
                          struct imported_server_client_t *client_p,
                          uint8_t *buf_p,
-                         size_t size)
+                         size_t size,
+                         struct messi_shared_buffer_t **shared_pp)
 {
     size_t offset;
     ssize_t res;
 
-    if (client_p->output.head_p != NULL) {
-        client_output_append(client_p, self_p, buf_p, size);
+    client_p->stats.messages_out++;
+
+    if (!client_output_is_empty(client_p)) {
+        client_output_append(client_p, self_p, buf_p, size, 0, shared_pp);
 
         return;
     }
 
     offset = 0;
 
-    while (size > 0) {
-        res = write(client_p->client_fd, &buf_p[offset], size);
+    while (offset < size) {
+        res = transport_write(self_p,
+                              client_p,
+                              &buf_p[offset],
+                              size - offset);
+        client_p->stats.writes++;
 
-        if (res == (ssize_t)size) {
-            break;
-        } else if (res > 0) {
+        if (res > 0) {
             offset += res;
-            size -= res;
+            client_p->stats.bytes_out += res;
         } else if ((res == -1) && (errno == EAGAIN)) {
-            client_output_append(client_p, self_p, &buf_p[offset], size);
+            client_p->stats.eagains++;
+            client_output_append(client_p,
+                                 self_p,
+                                 buf_p,
+                                 size,
+                                 offset,
+                                 shared_pp);
             break;
         } else {
             client_pending_disconnect(client_p, self_p);
@@ -355,28 +689,27 @@ static void client_write(struct imported_server_t *self_p,
 }
 
 static int handle_message_user(struct imported_server_t *self_p,
-                               struct imported_server_client_t *client_p)
+                               struct imported_server_client_t *client_p,
+                               struct messi_buffer_t *payload_p,
+                               struct messi_buffer_t *workspace_p)
 {
     int res;
     struct imported_client_to_server_t *message_p;
-    uint8_t *payload_buf_p;
-    size_t payload_size;
 
     self_p->input.message_p = imported_client_to_server_new(
-        &self_p->input.workspace.buf_p[0],
-        self_p->input.workspace.size);
+        &workspace_p->buf_p[0],
+        workspace_p->size);
     message_p = self_p->input.message_p;
 
     if (message_p == NULL) {
         return (-1);
     }
 
-    payload_buf_p = &client_p->input.data.buf_p[sizeof(struct messi_header_t)];
-    payload_size = client_p->input.size - sizeof(struct messi_header_t);
+    res = imported_client_to_server_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
 
-    res = imported_client_to_server_decode(message_p, payload_buf_p, payload_size);
-
-    if (res != (int)payload_size) {
+    if (res != (int)payload_p->size) {
         return (-1);
     }
 
@@ -403,32 +736,116 @@ static int handle_message_user(struct imported_server_t *self_p,
 static int handle_message_ping(struct imported_server_t *self_p,
                                struct imported_server_client_t *client_p)
 {
-    int res;
     struct messi_header_t header;
+    struct messi_shared_buffer_t *shared_p;
+
+    header.type = MESSI_MESSAGE_TYPE_PONG;
+    messi_header_set_size(&header, 0);
+    shared_p = NULL;
+    client_write(self_p,
+                 client_p,
+                 (uint8_t *)&header,
+                 sizeof(header),
+                 &shared_p);
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+
+    return (0);
+}
+
+/* Handle all messages in given batch in order. */
+static int handle_message_batch(struct imported_server_t *self_p,
+                                struct imported_server_client_t *client_p,
+                                struct messi_buffer_t *batch_p)
+{
+    int res;
+    uint8_t type;
+    size_t offset;
+    struct messi_buffer_t payload;
+
+    offset = 0;
+
+    while (true) {
+        res = messi_batch_next(batch_p, &offset, &type, &payload);
+
+        if (res == 0) {
+            break;
+        }
+
+        if ((res == -1) || (type != MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER)) {
+            return (-1);
+        }
+
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  &payload,
+                                  &self_p->input.workspace);
+
+        if (res != 0) {
+            return (res);
+        }
+
+        /* Disconnected by the user? */
+        if (client_p->client_fd == -1) {
+            break;
+        }
+    }
+
+    return (0);
+}
+
+/* Handle given request. Replies to it are responses with its
+   correlation id. */
+static int handle_message_request(struct imported_server_t *self_p,
+                                  struct imported_server_client_t *client_p,
+                                  struct messi_buffer_t *payload_p,
+                                  struct messi_buffer_t *workspace_p)
+{
+    int res;
+    struct messi_buffer_t message;
 
-    res = client_start_keep_alive_timer(client_p);
+    res = messi_request_id_parse(payload_p,
+                                 &self_p->input.request_id,
+                                 &message);
 
     if (res != 0) {
         return (res);
     }
 
-    header.type = MESSI_MESSAGE_TYPE_PONG;
-    messi_header_set_size(&header, 0);
-    client_write(self_p, client_p, (uint8_t *)&header, sizeof(header));
+    self_p->input.is_request = true;
+    res = handle_message_user(self_p, client_p, &message, workspace_p);
+    self_p->input.is_request = false;
 
-    return (0);
+    return (res);
 }
 
 static int handle_message(struct imported_server_t *self_p,
                           struct imported_server_client_t *client_p,
-                          uint32_t type)
+                          uint32_t type,
+                          struct messi_buffer_t *payload_p)
 {
     int res;
 
     switch (type) {
 
     case MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER:
-        res = handle_message_user(self_p, client_p);
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  payload_p,
+                                  &self_p->input.workspace);
+        break;
+
+    case MESSI_MESSAGE_TYPE_BATCH:
+        res = handle_message_batch(self_p, client_p, payload_p);
+        break;
+
+    case MESSI_MESSAGE_TYPE_REQUEST:
+        res = handle_message_request(self_p,
+                                     client_p,
+                                     payload_p,
+                                     &self_p->input.workspace);
         break;
 
     case MESSI_MESSAGE_TYPE_PING:
@@ -443,100 +860,287 @@ static int handle_message(struct imported_server_t *self_p,
     return (res);
 }
 
+/* Fill given array with enqueued data. Returns the number of used
+   elements. */
+static int client_output_get_iov(struct imported_server_client_t *self_p,
+                                 struct iovec *iov_p,
+                                 size_t *size_p)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        *size_p = messi_ring_used(&self_p->output.ring);
+
+        return (messi_ring_get_iov(&self_p->output.ring, iov_p));
+    }
+
+    return (messi_output_queue_get_iov(&self_p->output.queue,
+                                       iov_p,
+                                       IOV_MAX,
+                                       size_p));
+}
+
+/* Remove given number of written bytes from the output queue. */
+static void client_output_consume(struct imported_server_client_t *self_p,
+                                  size_t size)
+{
+    if (self_p->output.ring.data.buf_p != NULL) {
+        messi_ring_consume(&self_p->output.ring, size);
+    } else {
+        messi_output_queue_consume(&self_p->output.queue, size);
+    }
+}
+
 static void process_client_socket_out(struct imported_server_t *self_p,
                                       struct imported_server_client_t *client_p)
 {
-    struct imported_server_client_output_item_t *item_p;
-    struct imported_server_client_output_item_t *next_p;
+    struct iovec iov[IOV_MAX];
+    int iovcnt;
+    size_t size;
     ssize_t res;
 
-    item_p = client_p->output.head_p;
+    while (!client_output_is_empty(client_p)) {
+        iovcnt = client_output_get_iov(client_p, &iov[0], &size);
+        res = transport_writev(self_p, client_p, &iov[0], iovcnt);
+        client_p->stats.writes++;
 
-    while (item_p != NULL) {
-        res = write(client_p->client_fd,
-                    &item_p->data[item_p->offset],
-                    item_p->size);
+        if (res > 0) {
+            client_output_consume(client_p, res);
+            client_p->stats.bytes_out += res;
 
-        if (res == (ssize_t)item_p->size) {
-            next_p = item_p->next_p;
-            free(item_p);
-            item_p = next_p;
-        } else if (res > 0) {
-            item_p->offset += res;
-            item_p->size -= res;
+            /* The socket buffer is full if not everything was
+               written. Wait for the next EPOLLOUT. */
+            if ((size_t)res < size) {
+                break;
+            }
         } else if ((res == -1) && (errno == EAGAIN)) {
+            client_p->stats.eagains++;
             break;
         } else {
             client_pending_disconnect(client_p, self_p);
-            break;
+
+            return;
         }
     }
 
-    client_p->output.head_p = item_p;
-
-    if (item_p == NULL) {
+    if (client_output_is_empty(client_p) && !self_p->server.shm) {
         epoll_ctl_mod(self_p, client_p->client_fd, EPOLLIN);
     }
+
+    if (!client_p->output.writable
+        && (client_output_size(client_p) <= self_p->watermarks.low)) {
+        client_set_writable(client_p, self_p, true);
+    }
 }
 
-static void process_client_socket_in(struct imported_server_t *self_p,
-                                     struct imported_server_client_t *client_p)
+/* Decode and handle the received large message of given client, and
+   release its storage. */
+static int client_large_input_complete(struct imported_server_t *self_p,
+                                       struct imported_server_client_t *client_p)
 {
     int res;
-    ssize_t size;
-    struct messi_header_t *header_p;
+    struct messi_buffer_t payload;
 
-    header_p = (struct messi_header_t *)client_p->input.data.buf_p;
+    payload.buf_p = client_p->large_input.buf_p;
+    payload.size = client_p->large_input.size;
+    client_p->stats.messages_in++;
 
-    while (true) {
-        size = read(client_p->client_fd,
-                    &client_p->input.data.buf_p[client_p->input.size],
-                    client_p->input.left);
+    if (client_p->large_input.type == MESSI_MESSAGE_TYPE_REQUEST) {
+        res = handle_message_request(self_p,
+                                     client_p,
+                                     &payload,
+                                     &self_p->large.workspace);
+    } else {
+        res = handle_message_user(self_p,
+                                  client_p,
+                                  &payload,
+                                  &self_p->large.workspace);
+    }
 
-        if (size <= 0) {
-            if (!((size == -1) && (errno == EAGAIN))) {
-                client_pending_disconnect(client_p, self_p);
-            }
+    /* Released later if disconnected by the user. */
+    if (client_p->client_fd != -1) {
+        client_large_input_release(client_p, self_p);
+    }
+
+    return (res);
+}
+
+/* Start receiving a large message of given size. Its payload is moved
+   from the input buffer to its storage, and the rest read directly
+   into it. */
+static int client_large_input_begin(struct imported_server_t *self_p,
+                                    struct imported_server_client_t *client_p,
+                                    uint8_t type,
+                                    size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    if (((type != MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER)
+         && (type != MESSI_MESSAGE_TYPE_REQUEST))
+        || (size > self_p->large.max_size)) {
+        return (-1);
+    }
+
+    large_p = &client_p->large_input;
+    large_p->type = type;
+    large_p->size = size;
+    large_p->buf_p = self_p->large.on_client_large_message(self_p,
+                                                           client_p,
+                                                           size);
+    large_p->pooled = (large_p->buf_p == NULL);
+
+    if (large_p->pooled) {
+        large_p->pooled_size = size;
+        large_p->buf_p = messi_large_pool_alloc(&self_p->large.pool,
+                                                &large_p->pooled_size);
+
+        if (large_p->buf_p == NULL) {
+            return (-1);
+        }
+    }
+
+    large_p->offset = messi_framer_take(&client_p->input, large_p->buf_p, size);
+
+    if (large_p->offset == size) {
+        return (client_large_input_complete(self_p, client_p));
+    }
+
+    return (0);
+}
+
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be read from the client. */
+static int process_client_frames(struct imported_server_t *self_p,
+                                 struct imported_server_client_t *client_p)
+{
+    int res;
+    uint8_t type;
+    struct messi_buffer_t payload;
+
+    while (true) {
+        res = messi_framer_next(&client_p->input, &type, &payload);
 
+        if (res == 0) {
             break;
+        } else if (res == 1) {
+            client_p->stats.messages_in++;
+            res = handle_message(self_p, client_p, type, &payload);
+        } else if (res == 2) {
+            res = client_large_input_begin(self_p,
+                                           client_p,
+                                           type,
+                                           payload.size);
         }
 
-        client_p->input.size += size;
-        client_p->input.left -= size;
+        if (res != 0) {
+            client_pending_disconnect(client_p, self_p);
 
-        if (client_p->input.left > 0) {
-            continue;
+            return (-1);
+        }
+
+        /* Disconnected by the user? */
+        if (client_p->client_fd == -1) {
+            return (-1);
         }
+    }
 
-        if (client_p->input.state == imported_server_client_input_state_header_t) {
-            client_p->input.left = messi_header_get_size(header_p);
+    return (0);
+}
 
-            if ((client_p->input.left + sizeof(*header_p))
-                > client_p->input.data.size) {
-                client_pending_disconnect(client_p, self_p);
-                break;
-            }
+/* Add given number of bytes read into the storage of a large
+   message. Returns zero(0) if more data can be read from the
+   client. */
+static int process_client_large_input(struct imported_server_t *self_p,
+                                      struct imported_server_client_t *client_p,
+                                      size_t size)
+{
+    struct messi_large_input_t *large_p;
+
+    large_p = &client_p->large_input;
+    large_p->offset += size;
+
+    if (large_p->offset < large_p->size) {
+        return (0);
+    }
+
+    if (client_large_input_complete(self_p, client_p) != 0) {
+        client_pending_disconnect(client_p, self_p);
+
+        return (-1);
+    }
+
+    /* Disconnected by the user? */
+    if (client_p->client_fd == -1) {
+        return (-1);
+    }
+
+    return (0);
+}
+
+static void process_client_socket_in(struct imported_server_t *self_p,
+                                     struct imported_server_client_t *client_p)
+{
+    ssize_t size;
+    size_t free_size;
+    uint8_t *buf_p;
+    struct messi_large_input_t *large_p;
+    int res;
 
-            client_p->input.state = imported_server_client_input_state_payload_t;
+    large_p = &client_p->large_input;
+
+    do {
+        if (large_p->buf_p != NULL) {
+            buf_p = &large_p->buf_p[large_p->offset];
+            free_size = (large_p->size - large_p->offset);
+        } else {
+            buf_p = messi_framer_get_free(&client_p->input, &free_size);
         }
 
-        if (client_p->input.left == 0) {
-            res = handle_message(self_p, client_p, header_p->type);
+        size = transport_read(self_p, client_p, buf_p, free_size);
+        client_p->stats.reads++;
 
-            if (res == 0) {
-                client_reset_input(client_p);
+        if (size <= 0) {
+            if ((size == -1) && (errno == EAGAIN)) {
+                client_p->stats.eagains++;
             } else {
                 client_pending_disconnect(client_p, self_p);
-                break;
             }
+
+            break;
         }
-    }
+
+        client_p->stats.bytes_in += size;
+
+        /* Any received data proves that the client is alive. */
+        if (client_start_keep_alive_timer(client_p) != 0) {
+            client_pending_disconnect(client_p, self_p);
+            break;
+        }
+
+        if (large_p->buf_p != NULL) {
+            res = process_client_large_input(self_p, client_p, size);
+        } else {
+            messi_framer_commit(&client_p->input, size);
+            res = process_client_frames(self_p, client_p);
+        }
+
+        if (res != 0) {
+            break;
+        }
+
+        /* The socket is drained if the buffer was not filled. More
+           data is signalled by epoll. */
+    } while ((size_t)size == free_size);
 }
 
 static void process_client_socket(struct imported_server_t *self_p,
                                   struct imported_server_client_t *client_p,
                                   uint32_t events)
 {
+    if (self_p->server.shm
+        && (events & EPOLLIN)
+        && !client_output_is_empty(client_p)) {
+        events |= EPOLLOUT;
+    }
+
     if (events & EPOLLOUT) {
         process_client_socket_out(self_p, client_p);
     }
@@ -546,10 +1150,10 @@ static void process_client_socket(struct imported_server_t *self_p,
     }
 }
 
-static void process_client_keep_alive_timer(struct imported_server_t *self_p,
-                                            struct imported_server_client_t *client_p)
+static void on_client_keep_alive_timeout(struct imported_server_client_t *client_p)
 {
-    client_pending_disconnect(client_p, self_p);
+    client_p->stats.keep_alive_misses++;
+    client_pending_disconnect(client_p, client_p->server_p);
 }
 
 static void on_foo_default(
@@ -562,25 +1166,52 @@ static void on_foo_default(
     (void)message_p;
 }
 
-static int encode_user_message(struct imported_server_t *self_p)
+/* Encode the output message into a frame. A response starts with the
+   correlation id of the request being handled. */
+static int encode_user_message(struct imported_server_t *self_p, bool is_response)
 {
     int payload_size;
-    struct messi_header_t *header_p;
+    int size;
+    size_t offset;
+    uint8_t type;
+
+    offset = sizeof(struct messi_header_t);
+    type = MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER;
+
+    if (is_response) {
+        messi_request_id_write(&self_p->output.encoded.buf_p[offset],
+                               self_p->input.request_id);
+        offset += MESSI_REQUEST_ID_SIZE;
+        type = MESSI_MESSAGE_TYPE_RESPONSE;
+    }
 
     payload_size = imported_server_to_client_encode(
         self_p->output.message_p,
-        &self_p->output.encoded.buf_p[sizeof(*header_p)],
-        self_p->output.encoded.size - sizeof(*header_p));
+        &self_p->output.encoded.buf_p[offset],
+        self_p->output.encoded.size - offset);
 
     if (payload_size < 0) {
         return (payload_size);
     }
 
-    header_p = (struct messi_header_t *)self_p->output.encoded.buf_p;
-    header_p->type = MESSI_MESSAGE_TYPE_SERVER_TO_CLIENT_USER;
-    messi_header_set_size(header_p, payload_size);
+    payload_size += (offset - sizeof(struct messi_header_t));
+    size = messi_frame_create(self_p->output.encoded.buf_p,
+                              self_p->output.encoded.size,
+                              type,
+                              payload_size);
+
+    if ((size > 0)
+        && (self_p->compression.threshold > 0)
+        && ((size_t)payload_size >= self_p->compression.threshold)
+        && (payload_size <= MESSI_HEADER_SIZE_MAX)) {
+        size = messi_frame_compress(self_p->output.encoded.buf_p,
+                                    size,
+                                    self_p->compression.codec_p,
+                                    self_p->compression.buffer.buf_p,
+                                    self_p->compression.buffer.size);
+    }
 
-    return (payload_size + sizeof(*header_p));
+    return (size);
 }
 
 static void on_client_connected_default(struct imported_server_t *self_p,
@@ -597,6 +1228,28 @@ static void on_client_disconnected_default(struct imported_server_t *self_p,
         (void)client_p;
 }
 
+static uint8_t *on_client_large_message_default(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    size_t size)
+{
+        (void)self_p;
+        (void)client_p;
+        (void)size;
+
+        return (NULL);
+}
+
+static void on_client_writable_changed_default(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    bool writable)
+{
+        (void)self_p;
+        (void)client_p;
+        (void)writable;
+}
+
 void imported_server_new_output_message(struct imported_server_t *self_p)
 {
     self_p->output.message_p = imported_server_to_client_new(
@@ -604,6 +1257,38 @@ void imported_server_new_output_message(struct imported_server_t *self_p)
         self_p->output.workspace.size);
 }
 
+/* Clients connect over TCP, or over a unix domain socket, which
+   avoids the TCP stack for co-located processes. */
+static int parse_server_uri(struct imported_server_t *self_p,
+                            const char *server_uri_p)
+{
+    self_p->server.shm = (messi_is_shm_uri(server_uri_p)
+                          || messi_is_mem_uri(server_uri_p));
+
+    if (self_p->server.shm) {
+        self_p->server.domain = AF_UNIX;
+
+        return (messi_parse_shm_uri(server_uri_p,
+                                    &self_p->server.local_addr,
+                                    &self_p->server.local_addr_size));
+    }
+
+    if (messi_is_unix_uri(server_uri_p)) {
+        self_p->server.domain = AF_UNIX;
+
+        return (messi_parse_unix_uri(server_uri_p,
+                                     &self_p->server.local_addr,
+                                     &self_p->server.local_addr_size));
+    }
+
+    self_p->server.domain = AF_INET;
+
+    return (messi_parse_tcp_uri(server_uri_p,
+                                &self_p->server.address[0],
+                                sizeof(self_p->server.address),
+                                &self_p->server.port));
+}
+
 int imported_server_init(
     struct imported_server_t *self_p,
     const char *server_uri_p,
@@ -623,8 +1308,6 @@ int imported_server_init(
     int epoll_fd,
     messi_epoll_ctl_t epoll_ctl)
 {
-    (void)clients_max;
-
     int i;
     int res;
 
@@ -644,10 +1327,7 @@ int imported_server_init(
         epoll_ctl = messi_epoll_ctl_default;
     }
 
-    res = messi_parse_tcp_uri(server_uri_p,
-                              &self_p->server.address[0],
-                              sizeof(self_p->server.address),
-                              &self_p->server.port);
+    res = parse_server_uri(self_p, server_uri_p);
 
     if (res != 0) {
         return (res);
@@ -656,22 +1336,49 @@ int imported_server_init(
     self_p->on_foo = on_foo;
     self_p->epoll_fd = epoll_fd;
     self_p->epoll_ctl = epoll_ctl;
+    self_p->listener_fd = -1;
+    self_p->listen_backlog = 5;
+    self_p->keep_alive_timeout_ms = 3000;
+    self_p->accepts_per_event = 0;
+    self_p->watermarks.high = 0;
+    self_p->watermarks.low = 0;
+    self_p->watermarks.on_client_writable_changed =
+        on_client_writable_changed_default;
+    self_p->large.max_size = 0;
+    self_p->large.workspace.buf_p = NULL;
+    self_p->large.workspace.size = 0;
+    messi_large_pool_init(&self_p->large.pool);
+    self_p->large.on_client_large_message = on_client_large_message_default;
+    self_p->compression.threshold = 0;
+    self_p->compression.codec_p = &messi_codec_lz4;
+    self_p->compression.buffer.buf_p = NULL;
+    self_p->compression.buffer.size = 0;
+    self_p->timers.fd = -1;
+    self_p->reactor_p = NULL;
 
     /* Lists of clients. */
-    self_p->clients.free_list_p = &clients_p[0];
+    self_p->clients.clients_p = clients_p;
+    self_p->clients.max = clients_max;
+    self_p->clients.free_list_p = NULL;
     self_p->clients.input_buffer_size = client_input_size;
 
-    for (i = 0; i < clients_max - 1; i++) {
-        clients_p[i].next_p = &clients_p[i + 1];
-        clients_p[i].input.data.buf_p = &clients_input_bufs_p[i * client_input_size];
-        clients_p[i].input.data.size = client_input_size;
+    for (i = clients_max - 1; i >= 0; i--) {
+        client_setup(&clients_p[i],
+                     self_p,
+                     NULL,
+                     &clients_input_bufs_p[i * client_input_size]);
+        clients_p[i].next_p = self_p->clients.free_list_p;
+        self_p->clients.free_list_p = &clients_p[i];
     }
 
-    clients_p[i].next_p = NULL;
-    clients_p[i].input.data.buf_p = &clients_input_bufs_p[i * client_input_size];
-    clients_p[i].input.data.size = client_input_size;
+    self_p->clients.slabs.clients_per_slab = 0;
+    self_p->clients.slabs.clients_max = clients_max;
+    self_p->clients.slabs.size = 0;
+    self_p->clients.slabs.number_of_empty = 0;
+    self_p->clients.slabs.list_p = NULL;
     self_p->clients.connected_list_p = NULL;
     self_p->clients.pending_disconnect_list_p = NULL;
+    messi_fd_table_init(&self_p->clients.fds);
 
     self_p->input.workspace.buf_p = workspace_in_buf_p;
     self_p->input.workspace.size = workspace_in_size;
@@ -686,19 +1393,103 @@ int imported_server_init(
     return (0);
 }
 
-int imported_server_start(struct imported_server_t *self_p)
+void imported_server_set_clients_output_buffers(
+    struct imported_server_t *self_p,
+    uint8_t *clients_output_bufs_p,
+    size_t client_output_size)
 {
-    int res;
-    int listener_fd;
-    struct sockaddr_in addr;
-    int enable;
+    int i;
+
+    for (i = 0; i < self_p->clients.max; i++) {
+        messi_ring_init(&self_p->clients.clients_p[i].output.ring,
+                        &clients_output_bufs_p[i * client_output_size],
+                        client_output_size);
+    }
+}
+
+void imported_server_set_client_slabs(struct imported_server_t *self_p,
+                                  int clients_per_slab,
+                                  int clients_max)
+{
+    self_p->clients.slabs.clients_per_slab = clients_per_slab;
+    self_p->clients.slabs.clients_max = clients_max;
+}
 
-    listener_fd = socket(AF_INET, SOCK_STREAM, 0);
+void imported_server_set_listen_backlog(struct imported_server_t *self_p, int backlog)
+{
+    self_p->listen_backlog = backlog;
+}
 
-    if (listener_fd == -1) {
-        return (1);
+void imported_server_set_keep_alive_timeout(struct imported_server_t *self_p,
+                                        int timeout_ms)
+{
+    self_p->keep_alive_timeout_ms = timeout_ms;
+}
+
+void imported_server_set_accept_pacing(struct imported_server_t *self_p,
+                                   int accepts_per_event)
+{
+    self_p->accepts_per_event = accepts_per_event;
+}
+
+void imported_server_set_client_output_watermarks(
+    struct imported_server_t *self_p,
+    size_t high,
+    size_t low,
+    imported_server_on_client_writable_changed_t on_client_writable_changed)
+{
+    if (on_client_writable_changed == NULL) {
+        on_client_writable_changed = on_client_writable_changed_default;
     }
 
+    self_p->watermarks.high = high;
+    self_p->watermarks.low = low;
+    self_p->watermarks.on_client_writable_changed = on_client_writable_changed;
+}
+
+void imported_server_set_compression(struct imported_server_t *self_p,
+                                 size_t threshold,
+                                 const struct messi_codec_t *codec_p,
+                                 uint8_t *buf_p,
+                                 size_t size)
+{
+    if (codec_p == NULL) {
+        codec_p = &messi_codec_lz4;
+    }
+
+    self_p->compression.threshold = threshold;
+    self_p->compression.codec_p = codec_p;
+    self_p->compression.buffer.buf_p = buf_p;
+    self_p->compression.buffer.size = size;
+}
+
+void imported_server_set_large_messages(
+    struct imported_server_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    imported_server_on_client_large_message_t on_client_large_message)
+{
+    if (on_client_large_message == NULL) {
+        on_client_large_message = on_client_large_message_default;
+    }
+
+    self_p->large.max_size = max_size;
+    self_p->large.workspace.buf_p = workspace_buf_p;
+    self_p->large.workspace.size = workspace_size;
+    self_p->large.on_client_large_message = on_client_large_message;
+}
+
+/* Bind given listener socket to the server TCP address. Accepted
+   sockets inherit its TCP_NODELAY. */
+static int listener_bind_tcp(struct imported_server_t *self_p,
+                             int listener_fd,
+                             bool reuse_port)
+{
+    int res;
+    struct sockaddr_in addr;
+    int enable;
+
     enable = 1;
 
     res = setsockopt(listener_fd,
@@ -708,7 +1499,29 @@ int imported_server_start(struct imported_server_t *self_p)
                      sizeof(enable));
 
     if (res != 0) {
-        goto out;
+        return (-1);
+    }
+
+    if (reuse_port) {
+        res = setsockopt(listener_fd,
+                         SOL_SOCKET,
+                         SO_REUSEPORT,
+                         &enable,
+                         sizeof(enable));
+
+        if (res != 0) {
+            return (-1);
+        }
+    }
+
+    res = setsockopt(listener_fd,
+                     IPPROTO_TCP,
+                     TCP_NODELAY,
+                     &enable,
+                     sizeof(enable));
+
+    if (res != 0) {
+        return (-1);
     }
 
     memset(&addr, 0, sizeof(addr));
@@ -720,133 +1533,336 @@ int imported_server_start(struct imported_server_t *self_p)
                         (struct in_addr *)&addr.sin_addr.s_addr);
 
         if (res != 1) {
-            goto out;
+            return (-1);
         }
     } else {
         addr.sin_addr.s_addr = htonl(INADDR_ANY);
     }
 
-    res = bind(listener_fd, (struct sockaddr *)&addr, sizeof(addr));
+    return (bind(listener_fd, (struct sockaddr *)&addr, sizeof(addr)));
+}
+
+/* Bind given listener socket to the server unix domain socket
+   address. A socket file left by a previous server is removed, which
+   is why reuse port is not supported. */
+static int listener_bind_local(struct imported_server_t *self_p,
+                               int listener_fd,
+                               bool reuse_port)
+{
+    if (reuse_port) {
+        return (-1);
+    }
+
+    if (self_p->server.local_addr.sun_path[0] != '\0') {
+        unlink(&self_p->server.local_addr.sun_path[0]);
+    }
+
+    return (bind(listener_fd,
+                 (struct sockaddr *)&self_p->server.local_addr,
+                 self_p->server.local_addr_size));
+}
+
+/* Create a non-blocking listener socket bound to the server
+   address. Returns the socket, or -1 on failure. */
+static int listener_open(struct imported_server_t *self_p, bool reuse_port)
+{
+    int res;
+    int listener_fd;
+
+    listener_fd = socket(self_p->server.domain, SOCK_STREAM, 0);
+
+    if (listener_fd == -1) {
+        return (-1);
+    }
+
+    if (self_p->server.domain == AF_UNIX) {
+        res = listener_bind_local(self_p, listener_fd, reuse_port);
+    } else {
+        res = listener_bind_tcp(self_p, listener_fd, reuse_port);
+    }
 
     if (res == -1) {
-        goto out;
+        goto out1;
     }
 
-    res = listen(listener_fd, 5);
+    res = listen(listener_fd, self_p->listen_backlog);
 
     if (res == -1) {
-        goto out;
+        goto out1;
     }
 
     res = messi_make_non_blocking(listener_fd);
 
     if (res == -1) {
-        goto out;
+        goto out1;
+    }
+
+    return (listener_fd);
+
+ out1:
+    close(listener_fd);
+
+    return (-1);
+}
+
+/* Start serving clients, accepting them on given listener socket
+   unless it is -1. The listener is owned by the server if
+   successful. */
+static int start(struct imported_server_t *self_p, int listener_fd)
+{
+    int res;
+
+    if (listener_fd != -1) {
+        res = epoll_ctl_add(self_p, listener_fd);
+
+        if (res == -1) {
+            return (-1);
+        }
+    }
+
+    res = messi_timer_wheel_init(&self_p->timers, MESSI_TIMER_WHEEL_TICK_MS);
+
+    if (res != 0) {
+        goto out1;
     }
 
-    res = epoll_ctl_add(self_p, listener_fd);
+    res = epoll_ctl_add(self_p, self_p->timers.fd);
 
     if (res == -1) {
-        goto out;
+        goto out2;
     }
 
     self_p->listener_fd = listener_fd;
 
     return (0);
 
- out:
-    close(listener_fd);
+ out2:
+    close(self_p->timers.fd);
+
+ out1:
+    if (listener_fd != -1) {
+        epoll_ctl_del(self_p, listener_fd);
+    }
 
     return (-1);
 }
 
+int imported_server_start(struct imported_server_t *self_p)
+{
+    int res;
+    int listener_fd;
+
+    listener_fd = listener_open(self_p, false);
+
+    if (listener_fd == -1) {
+        return (-1);
+    }
+
+    res = start(self_p, listener_fd);
+
+    if (res != 0) {
+        close(listener_fd);
+    }
+
+    return (res);
+}
+
 void imported_server_stop(struct imported_server_t *self_p)
 {
     struct imported_server_client_t *client_p;
     struct imported_server_client_t *next_client_p;
+    struct imported_server_client_slab_t *slab_p;
+    struct imported_server_client_slab_t *next_slab_p;
+    int i;
+
+    if (self_p->listener_fd != -1) {
+        close_fd(self_p, self_p->listener_fd);
+    }
 
-    close_fd(self_p, self_p->listener_fd);
     client_p = self_p->clients.connected_list_p;
 
     while (client_p != NULL) {
         close_fd(self_p, client_p->client_fd);
-        close_fd(self_p, client_p->keep_alive_timer_fd);
+        messi_shm_close(&client_p->shm);
+        messi_timer_stop(&self_p->timers, &client_p->keep_alive_timer);
         free_client_output(client_p);
+        client_large_input_release(client_p, self_p);
         next_client_p = client_p->next_p;
-        client_p->next_p = self_p->clients.free_list_p;
-        self_p->clients.free_list_p = client_p;
+        push_free_client(self_p, client_p);
         client_p = next_client_p;
     }
-}
 
-void imported_server_process(struct imported_server_t *self_p, int fd, uint32_t events)
-{
-    struct imported_server_client_t *client_p;
+    self_p->clients.connected_list_p = NULL;
 
-    if (fd == self_p->listener_fd) {
+    for (i = 0; i < self_p->clients.max; i++) {
+        messi_output_queue_destroy(&self_p->clients.clients_p[i].output.queue);
+        client_large_input_release(&self_p->clients.clients_p[i], self_p);
+    }
+
+    /* Slabs with clients pending disconnect are freed once they are
+       destroyed. */
+    slab_p = self_p->clients.slabs.list_p;
+
+    while (slab_p != NULL) {
+        next_slab_p = slab_p->next_p;
+
+        if (slab_p->used == 0) {
+            slab_delete(self_p, slab_p);
+        }
+
+        slab_p = next_slab_p;
+    }
+
+    messi_large_pool_destroy(&self_p->large.pool);
+    messi_fd_table_destroy(&self_p->clients.fds);
+    close_fd(self_p, self_p->timers.fd);
+}
+
+int imported_server_process_event(struct imported_server_t *self_p,
+                              int fd,
+                              uint32_t events)
+{
+    struct imported_server_client_t *client_p;
+
+    if (fd == self_p->listener_fd) {
         process_listener(self_p, events);
+    } else if (fd == self_p->timers.fd) {
+        messi_timer_wheel_process(&self_p->timers);
     } else {
-        client_p = self_p->clients.connected_list_p;
-
-        while (client_p != NULL) {
-            if (fd == client_p->client_fd) {
-                process_client_socket(self_p, client_p, events);
-                break;
-            } else if (fd == client_p->keep_alive_timer_fd) {
-                process_client_keep_alive_timer(self_p, client_p);
-                break;
-            }
+        client_p = messi_fd_table_get(&self_p->clients.fds, fd);
 
-            client_p = client_p->next_p;
+        if (client_p == NULL) {
+            return (-1);
         }
+
+        process_client_socket(self_p, client_p, events);
     }
 
+    return (0);
+}
+
+void imported_server_process_deferred(struct imported_server_t *self_p)
+{
     destroy_pending_disconnect_clients(self_p);
 }
 
-void imported_server_send(
-    struct imported_server_t *self_p,
-    struct imported_server_client_t *client_p)
+void imported_server_process(struct imported_server_t *self_p, int fd, uint32_t events)
+{
+    imported_server_process_event(self_p, fd, events);
+    imported_server_process_deferred(self_p);
+}
+
+static void send_to_client(struct imported_server_t *self_p,
+                           struct imported_server_client_t *client_p,
+                           bool is_response)
 {
     int res;
+    struct messi_shared_buffer_t *shared_p;
 
-    res = encode_user_message(self_p);
+    res = encode_user_message(self_p, is_response);
 
     if (res < 0) {
         return;
     }
 
-    client_write(self_p, client_p, self_p->output.encoded.buf_p, res);
+    shared_p = NULL;
+    client_write(self_p, client_p, self_p->output.encoded.buf_p, res, &shared_p);
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+}
+
+void imported_server_send(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p)
+{
+    send_to_client(self_p, client_p, false);
 }
 
 void imported_server_reply(struct imported_server_t *self_p)
 {
     if (self_p->current_client_p != NULL) {
-        imported_server_send(self_p, self_p->current_client_p);
+        send_to_client(self_p,
+                       self_p->current_client_p,
+                       self_p->input.is_request);
     }
 }
 
-void imported_server_broadcast(struct imported_server_t *self_p)
+/* Send given message to all clients of given server. All clients
+   that can not write it immediately share one copy. */
+static void broadcast_to_clients(struct imported_server_t *self_p,
+                                 uint8_t *buf_p,
+                                 size_t size,
+                                 struct messi_shared_buffer_t **shared_pp)
 {
-    int res;
     struct imported_server_client_t *client_p;
     struct imported_server_client_t *next_client_p;
 
+    client_p = self_p->clients.connected_list_p;
+
+    while (client_p != NULL) {
+        next_client_p = client_p->next_p;
+        client_write(self_p, client_p, buf_p, size, shared_pp);
+        client_p = next_client_p;
+    }
+}
+
+static void reactors_post_broadcast(struct imported_server_reactor_t *self_p,
+                                    struct messi_shared_buffer_t *buffer_p);
+
+void imported_server_broadcast(struct imported_server_t *self_p)
+{
+    int res;
+    struct messi_shared_buffer_t *shared_p;
+
     /* Create the message. */
-    res = encode_user_message(self_p);
+    res = encode_user_message(self_p, false);
 
     if (res < 0) {
         return;
     }
 
     /* Send it to all clients. */
-    client_p = self_p->clients.connected_list_p;
+    shared_p = NULL;
+    broadcast_to_clients(self_p, self_p->output.encoded.buf_p, res, &shared_p);
+
+    /* Clients of other reactors are sent the same copy by their own
+       threads. */
+    if (self_p->reactor_p != NULL) {
+        if (shared_p == NULL) {
+            shared_p = messi_shared_buffer_new(self_p->output.encoded.buf_p,
+                                               res);
+        }
 
-    while (client_p != NULL) {
-        next_client_p = client_p->next_p;
-        client_write(self_p, client_p, self_p->output.encoded.buf_p, res);
-        client_p = next_client_p;
+        if (shared_p != NULL) {
+            reactors_post_broadcast(self_p->reactor_p, shared_p);
+        }
     }
+
+    if (shared_p != NULL) {
+        messi_shared_buffer_unref(shared_p);
+    }
+}
+
+size_t imported_server_client_output_bytes(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p)
+{
+    (void)self_p;
+
+    return (client_output_size(client_p));
+}
+
+void imported_server_client_get_stats(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    struct messi_stats_t *stats_p)
+{
+    (void)self_p;
+
+    *stats_p = client_p->stats;
+    stats_p->output_bytes = client_output_size(client_p);
 }
 
 void imported_server_disconnect(
@@ -864,6 +1880,518 @@ void imported_server_disconnect(
     client_pending_disconnect(client_p, self_p);
 }
 
+/* Append given work to given list. Returns zero(0) if successful. */
+static int work_list_append(struct imported_server_reactor_work_list_t *self_p,
+                            int client_fd,
+                            struct messi_shared_buffer_t *buffer_p)
+{
+    struct imported_server_reactor_work_t *items_p;
+    size_t max;
+
+    if (self_p->length == self_p->max) {
+        max = (self_p->max > 0 ? 2 * self_p->max : 16);
+        items_p = realloc(self_p->items_p, max * sizeof(*items_p));
+
+        if (items_p == NULL) {
+            return (-1);
+        }
+
+        self_p->items_p = items_p;
+        self_p->max = max;
+    }
+
+    self_p->items_p[self_p->length].client_fd = client_fd;
+    self_p->items_p[self_p->length].buffer_p = buffer_p;
+    self_p->length++;
+
+    return (0);
+}
+
+/* Release all work in given list and free it. */
+static void work_list_destroy(struct imported_server_reactor_work_list_t *self_p)
+{
+    size_t i;
+
+    for (i = 0; i < self_p->length; i++) {
+        if (self_p->items_p[i].client_fd != -1) {
+            close(self_p->items_p[i].client_fd);
+        } else {
+            messi_shared_buffer_unref(self_p->items_p[i].buffer_p);
+        }
+    }
+
+    free(self_p->items_p);
+    self_p->items_p = NULL;
+    self_p->length = 0;
+    self_p->max = 0;
+}
+
+/* Post work to given reactor, and wake it up if it had no posted
+   work. Returns zero(0) if successful. */
+static int reactor_post(struct imported_server_reactor_t *self_p,
+                        int client_fd,
+                        struct messi_shared_buffer_t *buffer_p)
+{
+    int res;
+    bool was_empty;
+    uint64_t value;
+
+    pthread_mutex_lock(&self_p->mutex);
+    was_empty = (self_p->posted.length == 0);
+    res = work_list_append(&self_p->posted, client_fd, buffer_p);
+    pthread_mutex_unlock(&self_p->mutex);
+
+    if ((res == 0) && was_empty) {
+        value = 1;
+
+        if (write(self_p->event_fd, &value, sizeof(value)) != sizeof(value)) {
+            res = -1;
+        }
+    }
+
+    return (res);
+}
+
+static void reactors_post_broadcast(struct imported_server_reactor_t *self_p,
+                                    struct messi_shared_buffer_t *buffer_p)
+{
+    struct imported_server_reactors_t *reactors_p;
+    struct imported_server_reactor_t *reactor_p;
+    int i;
+
+    reactors_p = self_p->reactors_p;
+
+    for (i = 0; i < reactors_p->number_of_reactors; i++) {
+        reactor_p = &reactors_p->reactors_p[i];
+
+        if (reactor_p == self_p) {
+            continue;
+        }
+
+        messi_shared_buffer_ref(buffer_p);
+
+        if (reactor_post(reactor_p, -1, buffer_p) != 0) {
+            messi_shared_buffer_unref(buffer_p);
+        }
+    }
+}
+
+/* Serve clients and send broadcasts posted by other threads, in
+   posting order. */
+static void reactor_process_posted(struct imported_server_reactor_t *self_p)
+{
+    struct imported_server_reactor_work_list_t work;
+    struct imported_server_reactor_work_t *item_p;
+    struct imported_server_t *server_p;
+    uint64_t value;
+    size_t i;
+
+    /* Read before taking the work to never miss a wakeup. */
+    if (read(self_p->event_fd, &value, sizeof(value)) != sizeof(value)) {
+        return;
+    }
+
+    pthread_mutex_lock(&self_p->mutex);
+    work = self_p->posted;
+    self_p->posted = self_p->work;
+    pthread_mutex_unlock(&self_p->mutex);
+
+    server_p = self_p->server_p;
+
+    for (i = 0; i < work.length; i++) {
+        item_p = &work.items_p[i];
+
+        if (item_p->client_fd != -1) {
+            if (add_client(server_p, item_p->client_fd) != 0) {
+                reactor_load_add(server_p, -1);
+            }
+        } else {
+            broadcast_to_clients(server_p,
+                                 &item_p->buffer_p->data[0],
+                                 item_p->buffer_p->size,
+                                 &item_p->buffer_p);
+            messi_shared_buffer_unref(item_p->buffer_p);
+        }
+    }
+
+    work.length = 0;
+    self_p->work = work;
+}
+
+static bool reactors_is_stopped(struct imported_server_reactors_t *self_p)
+{
+    return (__atomic_load_n(&self_p->stopped, __ATOMIC_ACQUIRE));
+}
+
+static void *reactor_main(struct imported_server_reactor_t *self_p)
+{
+    struct epoll_event events[REACTOR_EVENTS_MAX];
+    int nfds;
+    int i;
+
+    while (!reactors_is_stopped(self_p->reactors_p)) {
+        nfds = epoll_wait(self_p->epoll_fd, &events[0], REACTOR_EVENTS_MAX, -1);
+
+        if (nfds == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        for (i = 0; i < nfds; i++) {
+            if (events[i].data.fd == self_p->event_fd) {
+                reactor_process_posted(self_p);
+            } else {
+                imported_server_process_event(self_p->server_p,
+                                          events[i].data.fd,
+                                          events[i].events);
+            }
+        }
+
+        imported_server_process_deferred(self_p->server_p);
+    }
+
+    return (NULL);
+}
+
+/* Returns the reactor with the fewest clients. */
+static struct imported_server_reactor_t *reactors_least_loaded(
+    struct imported_server_reactors_t *self_p)
+{
+    struct imported_server_reactor_t *reactor_p;
+    int load;
+    int min_load;
+    int i;
+
+    reactor_p = &self_p->reactors_p[0];
+    min_load = __atomic_load_n(&reactor_p->load, __ATOMIC_RELAXED);
+
+    for (i = 1; i < self_p->number_of_reactors; i++) {
+        load = __atomic_load_n(&self_p->reactors_p[i].load, __ATOMIC_RELAXED);
+
+        if (load < min_load) {
+            reactor_p = &self_p->reactors_p[i];
+            min_load = load;
+        }
+    }
+
+    return (reactor_p);
+}
+
+/* Accept all pending connections and place each on the least loaded
+   reactor. */
+static void acceptor_process_listener(struct imported_server_reactors_t *self_p)
+{
+    struct imported_server_reactor_t *reactor_p;
+    int client_fd;
+
+    while (true) {
+        client_fd = accept4(self_p->acceptor.listener_fd,
+                            NULL,
+                            0,
+                            SOCK_NONBLOCK);
+
+        if (client_fd == -1) {
+            break;
+        }
+
+        reactor_p = reactors_least_loaded(self_p);
+        __atomic_add_fetch(&reactor_p->load, 1, __ATOMIC_RELAXED);
+
+        if (reactor_post(reactor_p, client_fd, NULL) != 0) {
+            __atomic_sub_fetch(&reactor_p->load, 1, __ATOMIC_RELAXED);
+            close(client_fd);
+        }
+    }
+}
+
+static void *acceptor_main(struct imported_server_reactors_t *self_p)
+{
+    struct epoll_event event;
+    int nfds;
+
+    while (!reactors_is_stopped(self_p)) {
+        nfds = epoll_wait(self_p->acceptor.epoll_fd, &event, 1, -1);
+
+        if (nfds == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        if ((nfds == 1) && (event.data.fd == self_p->acceptor.listener_fd)) {
+            acceptor_process_listener(self_p);
+        }
+    }
+
+    return (NULL);
+}
+
+static void close_if_open(int fd)
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+/* Create the epoll instance and the wakeup event of given reactor. */
+static int reactor_open(struct imported_server_reactor_t *self_p)
+{
+    int res;
+
+    self_p->epoll_fd = epoll_create1(0);
+
+    if (self_p->epoll_fd == -1) {
+        return (-1);
+    }
+
+    self_p->event_fd = eventfd(0, EFD_NONBLOCK);
+
+    if (self_p->event_fd == -1) {
+        return (-1);
+    }
+
+    res = messi_epoll_ctl_default(self_p->epoll_fd,
+                                  EPOLL_CTL_ADD,
+                                  self_p->event_fd,
+                                  EPOLLIN);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    self_p->server_p->epoll_fd = self_p->epoll_fd;
+
+    return (0);
+}
+
+static int acceptor_open(struct imported_server_reactors_t *self_p)
+{
+    int res;
+
+    self_p->acceptor.listener_fd = listener_open(self_p->reactors_p[0].server_p,
+                                                 false);
+
+    if (self_p->acceptor.listener_fd == -1) {
+        return (-1);
+    }
+
+    self_p->acceptor.epoll_fd = epoll_create1(0);
+
+    if (self_p->acceptor.epoll_fd == -1) {
+        return (-1);
+    }
+
+    self_p->acceptor.event_fd = eventfd(0, EFD_NONBLOCK);
+
+    if (self_p->acceptor.event_fd == -1) {
+        return (-1);
+    }
+
+    res = messi_epoll_ctl_default(self_p->acceptor.epoll_fd,
+                                  EPOLL_CTL_ADD,
+                                  self_p->acceptor.listener_fd,
+                                  EPOLLIN);
+
+    if (res != 0) {
+        return (-1);
+    }
+
+    return (messi_epoll_ctl_default(self_p->acceptor.epoll_fd,
+                                    EPOLL_CTL_ADD,
+                                    self_p->acceptor.event_fd,
+                                    EPOLLIN));
+}
+
+static void wake_up(int event_fd)
+{
+    uint64_t value;
+
+    value = 1;
+
+    if (write(event_fd, &value, sizeof(value)) != sizeof(value)) {
+        return;
+    }
+}
+
+/* Join given number of started reactor threads and the acceptor
+   thread if started, stop given number of started servers and
+   release all resources. */
+static void reactors_close(struct imported_server_reactors_t *self_p,
+                           int number_of_started_servers,
+                           int number_of_started_threads,
+                           bool acceptor_started)
+{
+    struct imported_server_reactor_t *reactor_p;
+    int i;
+
+    __atomic_store_n(&self_p->stopped, true, __ATOMIC_RELEASE);
+
+    if (acceptor_started) {
+        wake_up(self_p->acceptor.event_fd);
+        pthread_join(self_p->acceptor.thread, NULL);
+    }
+
+    for (i = 0; i < number_of_started_threads; i++) {
+        wake_up(self_p->reactors_p[i].event_fd);
+        pthread_join(self_p->reactors_p[i].thread, NULL);
+    }
+
+    close_if_open(self_p->acceptor.listener_fd);
+    close_if_open(self_p->acceptor.epoll_fd);
+    close_if_open(self_p->acceptor.event_fd);
+    self_p->acceptor.listener_fd = -1;
+    self_p->acceptor.epoll_fd = -1;
+    self_p->acceptor.event_fd = -1;
+
+    for (i = 0; i < self_p->number_of_reactors; i++) {
+        reactor_p = &self_p->reactors_p[i];
+
+        if (i < number_of_started_servers) {
+            imported_server_stop(reactor_p->server_p);
+        }
+
+        work_list_destroy(&reactor_p->posted);
+        work_list_destroy(&reactor_p->work);
+        close_if_open(reactor_p->epoll_fd);
+        close_if_open(reactor_p->event_fd);
+        reactor_p->epoll_fd = -1;
+        reactor_p->event_fd = -1;
+        reactor_p->load = 0;
+    }
+}
+
+int imported_server_reactors_init(
+    struct imported_server_reactors_t *self_p,
+    struct imported_server_reactor_t *reactors_p,
+    struct imported_server_t *servers_p,
+    int number_of_reactors)
+{
+    struct imported_server_reactor_t *reactor_p;
+    int i;
+
+    if (number_of_reactors < 1) {
+        return (-1);
+    }
+
+    self_p->reactors_p = reactors_p;
+    self_p->number_of_reactors = number_of_reactors;
+    self_p->reuse_port = false;
+    self_p->stopped = false;
+    self_p->acceptor.listener_fd = -1;
+    self_p->acceptor.epoll_fd = -1;
+    self_p->acceptor.event_fd = -1;
+
+    for (i = 0; i < number_of_reactors; i++) {
+        reactor_p = &reactors_p[i];
+        reactor_p->server_p = &servers_p[i];
+        reactor_p->reactors_p = self_p;
+        reactor_p->epoll_fd = -1;
+        reactor_p->event_fd = -1;
+        pthread_mutex_init(&reactor_p->mutex, NULL);
+        memset(&reactor_p->posted, 0, sizeof(reactor_p->posted));
+        memset(&reactor_p->work, 0, sizeof(reactor_p->work));
+        reactor_p->load = 0;
+        servers_p[i].reactor_p = reactor_p;
+    }
+
+    return (0);
+}
+
+void imported_server_reactors_set_reuse_port(struct imported_server_reactors_t *self_p)
+{
+    self_p->reuse_port = true;
+}
+
+int imported_server_reactors_start(struct imported_server_reactors_t *self_p)
+{
+    struct imported_server_reactor_t *reactor_p;
+    int listener_fd;
+    int res;
+    int i;
+    int j;
+
+    self_p->stopped = false;
+
+    /* Servers, each with a listener if the kernel shall place
+       connections. */
+    for (i = 0; i < self_p->number_of_reactors; i++) {
+        reactor_p = &self_p->reactors_p[i];
+
+        if (reactor_open(reactor_p) != 0) {
+            goto out1;
+        }
+
+        listener_fd = -1;
+
+        if (self_p->reuse_port) {
+            listener_fd = listener_open(reactor_p->server_p, true);
+
+            if (listener_fd == -1) {
+                goto out1;
+            }
+        }
+
+        if (start(reactor_p->server_p, listener_fd) != 0) {
+            close_if_open(listener_fd);
+            goto out1;
+        }
+    }
+
+    if (!self_p->reuse_port) {
+        if (acceptor_open(self_p) != 0) {
+            goto out1;
+        }
+    }
+
+    for (j = 0; j < self_p->number_of_reactors; j++) {
+        reactor_p = &self_p->reactors_p[j];
+        res = pthread_create(&reactor_p->thread,
+                             NULL,
+                             (void *(*)(void *))reactor_main,
+                             reactor_p);
+
+        if (res != 0) {
+            goto out2;
+        }
+    }
+
+    if (!self_p->reuse_port) {
+        res = pthread_create(&self_p->acceptor.thread,
+                             NULL,
+                             (void *(*)(void *))acceptor_main,
+                             self_p);
+
+        if (res != 0) {
+            goto out2;
+        }
+    }
+
+    return (0);
+
+ out2:
+    reactors_close(self_p, i, j, false);
+
+    return (-1);
+
+ out1:
+    reactors_close(self_p, i, 0, false);
+
+    return (-1);
+}
+
+void imported_server_reactors_stop(struct imported_server_reactors_t *self_p)
+{
+    reactors_close(self_p,
+                   self_p->number_of_reactors,
+                   self_p->number_of_reactors,
+                   !self_p->reuse_port);
+}
+
 struct types_bar_t *imported_server_init_bar(
     struct imported_server_t *self_p)
 {
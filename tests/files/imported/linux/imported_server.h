@@ -30,22 +30,21 @@
 #define IMPORTED_SERVER_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include "messi.h"
 #include "imported.h"
 
 struct imported_server_t;
 struct imported_server_client_t;
+struct imported_server_client_slab_t;
+struct imported_server_reactor_t;
+struct imported_server_reactors_t;
 
 typedef void (*imported_server_on_foo_t)(
     struct imported_server_t *self_p,
     struct imported_server_client_t *client_p,
     struct types_foo_t *message_p);
 
-enum imported_server_client_input_state_t {
-    imported_server_client_input_state_header_t = 0,
-    imported_server_client_input_state_payload_t
-};
-
 typedef void (*imported_server_on_client_connected_t)(
     struct imported_server_t *self_p,
     struct imported_server_client_t *client_p);
@@ -54,10 +53,24 @@ typedef void (*imported_server_on_client_disconnected_t)(
     struct imported_server_t *self_p,
     struct imported_server_client_t *client_p);
 
+typedef void (*imported_server_on_client_writable_changed_t)(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    bool writable);
+
+typedef uint8_t *(*imported_server_on_client_large_message_t)(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    size_t size);
+
 struct imported_server_t {
     struct {
+        int domain;
         char address[16];
         int port;
+        struct sockaddr_un local_addr;
+        socklen_t local_addr_size;
+        bool shm;
     } server;
     imported_server_on_client_connected_t on_client_connected;
     imported_server_on_client_disconnected_t on_client_disconnected;
@@ -65,16 +78,65 @@ struct imported_server_t {
     int epoll_fd;
     messi_epoll_ctl_t epoll_ctl;
     int listener_fd;
+    int listen_backlog;
+    /* Clients are disconnected if nothing is received within this
+       time. */
+    int keep_alive_timeout_ms;
+    /* Maximum number of connections accepted per listener event, or
+       zero(0) for all pending. */
+    int accepts_per_event;
+    /* Client output watermarks in bytes. Disabled if high is zero(0). */
+    struct {
+        size_t high;
+        size_t low;
+        imported_server_on_client_writable_changed_t on_client_writable_changed;
+    } watermarks;
+    /* Messages received in extended frames. Disabled if max_size is
+       zero(0). */
+    struct {
+        size_t max_size;
+        struct messi_buffer_t workspace;
+        struct messi_large_pool_t pool;
+        imported_server_on_client_large_message_t on_client_large_message;
+    } large;
+    /* Compression of user messages. Disabled if threshold is
+       zero(0). */
+    struct {
+        size_t threshold;
+        const struct messi_codec_t *codec_p;
+        struct messi_buffer_t buffer;
+    } compression;
+    struct messi_timer_wheel_t timers;
+    struct imported_server_reactor_t *reactor_p;
     struct imported_server_client_t *current_client_p;
     struct {
+        struct imported_server_client_t *clients_p;
+        int max;
         struct imported_server_client_t *connected_list_p;
         struct imported_server_client_t *free_list_p;
         struct imported_server_client_t *pending_disconnect_list_p;
         size_t input_buffer_size;
+        struct messi_fd_table_t fds;
+        /* Clients allocated in slabs once all given clients are
+           connected. Disabled if clients_per_slab is zero(0). */
+        struct {
+            int clients_per_slab;
+            /* Maximum number of clients, including given clients. */
+            int clients_max;
+            /* Number of clients in all slabs. */
+            int size;
+            /* Number of slabs without connected clients. */
+            int number_of_empty;
+            struct imported_server_client_slab_t *list_p;
+        } slabs;
     } clients;
     struct {
         struct imported_client_to_server_t *message_p;
         struct messi_buffer_t workspace;
+        /* Correlation id of the request being handled, echoed by
+           reply. */
+        bool is_request;
+        uint32_t request_id;
     } input;
     struct {
         struct imported_server_to_client_t *message_p;
@@ -83,30 +145,80 @@ struct imported_server_t {
     } output;
 };
 
-struct imported_server_client_output_item_t {
-    size_t offset;
-    size_t size;
-    struct imported_server_client_output_item_t *next_p;
-    uint8_t data[1];
-};
-
 struct imported_server_client_t {
+    struct imported_server_t *server_p;
     int client_fd;
-    int keep_alive_timer_fd;
-    struct {
-        enum imported_server_client_input_state_t state;
-        struct messi_buffer_t data;
-        size_t size;
-        size_t left;
-    } input;
+    struct messi_timer_t keep_alive_timer;
+    struct messi_framer_t input;
+    struct messi_large_input_t large_input;
     struct {
-        struct imported_server_client_output_item_t *head_p;
-        struct imported_server_client_output_item_t *tail_p;
+        struct messi_output_queue_t queue;
+        struct messi_ring_t ring;
+        /* False from reaching the high watermark until drained to
+           the low watermark. */
+        bool writable;
     } output;
+    struct messi_stats_t stats;
+    /* Only used by shm:// servers. */
+    struct messi_shm_t shm;
+    /* NULL if one of the clients given to init. */
+    struct imported_server_client_slab_t *slab_p;
     struct imported_server_client_t *next_p;
     struct imported_server_client_t *prev_p;
 };
 
+/* Clients allocated together, followed by their input buffers. */
+struct imported_server_client_slab_t {
+    struct imported_server_client_slab_t *next_p;
+    struct imported_server_client_slab_t *prev_p;
+    struct imported_server_client_t *free_list_p;
+    /* Number of clients not in the free list. */
+    int used;
+    int length;
+    struct imported_server_client_t clients[];
+};
+
+/* Work posted to a reactor by other threads. */
+struct imported_server_reactor_work_t {
+    /* An accepted client socket, or -1 for a broadcast. */
+    int client_fd;
+    struct messi_shared_buffer_t *buffer_p;
+};
+
+struct imported_server_reactor_work_list_t {
+    struct imported_server_reactor_work_t *items_p;
+    size_t length;
+    size_t max;
+};
+
+struct imported_server_reactor_t {
+    struct imported_server_t *server_p;
+    struct imported_server_reactors_t *reactors_p;
+    pthread_t thread;
+    int epoll_fd;
+    int event_fd;
+    pthread_mutex_t mutex;
+    /* Protected by the mutex. */
+    struct imported_server_reactor_work_list_t posted;
+    /* Only used by the reactor thread. */
+    struct imported_server_reactor_work_list_t work;
+    /* Number of clients placed on this reactor. */
+    int load;
+};
+
+struct imported_server_reactors_t {
+    struct imported_server_reactor_t *reactors_p;
+    int number_of_reactors;
+    bool reuse_port;
+    bool stopped;
+    struct {
+        pthread_t thread;
+        int listener_fd;
+        int epoll_fd;
+        int event_fd;
+    } acceptor;
+};
+
 /**
  * Initialize given server.
  */
@@ -129,6 +241,101 @@ int imported_server_init(
     int epoll_fd,
     messi_epoll_ctl_t epoll_ctl);
 
+/**
+ * Use given preallocated buffer for output that can not be written
+ * immediately, instead of allocating memory for it. Each client gets
+ * client_output_size bytes of given buffer, which must be at least
+ * clients_max * client_output_size bytes. A client is disconnected if
+ * its output buffer is full. Call before start.
+ */
+void imported_server_set_clients_output_buffers(
+    struct imported_server_t *self_p,
+    uint8_t *clients_output_bufs_p,
+    size_t client_output_size);
+
+/**
+ * Allocate more clients in slabs of given number of clients when all
+ * clients given to init are connected, up to clients_max clients in
+ * total. Slab clients use output queues, not the preallocated output
+ * buffers. A slab is freed when its last client disconnects, except
+ * that one empty slab is kept to absorb connection churn. Clients
+ * never move, so client pointers are valid until disconnected. Call
+ * before start.
+ */
+void imported_server_set_client_slabs(struct imported_server_t *self_p,
+                                  int clients_per_slab,
+                                  int clients_max);
+
+/**
+ * Set the maximum number of connections waiting to be accepted by
+ * the listener socket. Defaults to 5. Call before start.
+ */
+void imported_server_set_listen_backlog(struct imported_server_t *self_p, int backlog);
+
+/**
+ * Disconnect clients that have sent nothing for given number of
+ * milliseconds. Any received data proves that a client is alive, and
+ * clients only ping the server when idle. Defaults to 3000 ms. Call
+ * before start.
+ */
+void imported_server_set_keep_alive_timeout(struct imported_server_t *self_p,
+                                        int timeout_ms);
+
+/**
+ * Accept at most given number of connections each time the listener
+ * socket is readable. The rest are accepted on later events, so
+ * connected clients are served in between when many clients connect
+ * at once. Zero(0), the default, accepts all waiting connections.
+ */
+void imported_server_set_accept_pacing(struct imported_server_t *self_p,
+                                   int accepts_per_event);
+
+/**
+ * Call given callback with writable false when the output of a client
+ * not yet written reaches high bytes, and with writable true when it
+ * has been written down to low bytes. Stop producing messages for a
+ * client that is not writable, or its output keeps growing. The
+ * callback is called from within send, reply and broadcast when
+ * writable becomes false, and must then not send messages. Call
+ * before start.
+ */
+void imported_server_set_client_output_watermarks(
+    struct imported_server_t *self_p,
+    size_t high,
+    size_t low,
+    imported_server_on_client_writable_changed_t on_client_writable_changed);
+
+/**
+ * Receive messages of at most max_size bytes sent in extended
+ * frames, which may be larger than the client input buffer. The
+ * payload of such a message is received into storage of its size
+ * returned by given callback, or into storage allocated from a pool
+ * if the callback is NULL or returns NULL. It is decoded into given
+ * workspace once received. Messages larger than
+ * MESSI_HEADER_SIZE_MAX bytes are always sent in extended
+ * frames. Call before start.
+ */
+void imported_server_set_large_messages(
+    struct imported_server_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    imported_server_on_client_large_message_t on_client_large_message);
+
+/**
+ * Send user messages with payloads of at least threshold bytes in
+ * compressed frames, if smaller once compressed with given codec, or
+ * the built-in LZ4 codec if NULL. The compressed payload is written
+ * to given buffer, which should be as large as the encoded message
+ * buffer. All clients must support compressed frames. Call before
+ * start.
+ */
+void imported_server_set_compression(struct imported_server_t *self_p,
+                                 size_t threshold,
+                                 const struct messi_codec_t *codec_p,
+                                 uint8_t *buf_p,
+                                 size_t size);
+
 /**
  * Start serving clients.
  */
@@ -145,6 +352,22 @@ void imported_server_stop(struct imported_server_t *self_p);
  */
 void imported_server_process(struct imported_server_t *self_p, int fd, uint32_t events);
 
+/**
+ * As imported_server_process(), but work that can be done once for many
+ * events, such as destroying disconnected clients, is deferred until
+ * imported_server_process_deferred() is called. Returns zero(0) if given
+ * file descriptor belongs to given server. Suitable as the process
+ * function of a messi_loop_t member.
+ */
+int imported_server_process_event(struct imported_server_t *self_p,
+                              int fd,
+                              uint32_t events);
+
+/**
+ * Perform work deferred by imported_server_process_event().
+ */
+void imported_server_process_deferred(struct imported_server_t *self_p);
+
 /**
  * Send prepared message to given client.
  */
@@ -153,7 +376,8 @@ void imported_server_send(
     struct imported_server_client_t *client_p);
 
 /**
- * Send prepared message to current client.
+ * Send prepared message to current client. If the message being
+ * handled is a request, the reply is its response.
  */
 void imported_server_reply(struct imported_server_t *self_p);
 
@@ -162,6 +386,23 @@ void imported_server_reply(struct imported_server_t *self_p);
  */
 void imported_server_broadcast(struct imported_server_t *self_p);
 
+/**
+ * Returns the number of bytes of given client's output not yet
+ * written to its socket.
+ */
+size_t imported_server_client_output_bytes(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p);
+
+/**
+ * Copy the traffic statistics of given client's connection to given
+ * structure.
+ */
+void imported_server_client_get_stats(
+    struct imported_server_t *self_p,
+    struct imported_server_client_t *client_p,
+    struct messi_stats_t *stats_p);
+
 /**
  * Disconnect given client. If given client is NULL, the currect
  * client is disconnected.
@@ -170,6 +411,39 @@ void imported_server_disconnect(
     struct imported_server_t *self_p,
     struct imported_server_client_t *client_p);
 
+/**
+ * Initialize given multi-reactor server. Each of given servers runs
+ * in its own event loop thread and owns the clients placed on
+ * it. The servers must be initialized with the same URI, epoll_fd -1
+ * and epoll_ctl NULL. Callbacks are called in the thread of the
+ * server they belong to, and a server may only be used from its own
+ * thread. Broadcast reaches the clients of all servers, in the same
+ * order as broadcast was called by any one server.
+ */
+int imported_server_reactors_init(
+    struct imported_server_reactors_t *self_p,
+    struct imported_server_reactor_t *reactors_p,
+    struct imported_server_t *servers_p,
+    int number_of_reactors);
+
+/**
+ * Let each reactor accept its own connections on a listener socket
+ * with SO_REUSEPORT, instead of one acceptor thread placing new
+ * connections on the least loaded reactor. TCP only. Call before
+ * start.
+ */
+void imported_server_reactors_set_reuse_port(struct imported_server_reactors_t *self_p);
+
+/**
+ * Start all reactor threads.
+ */
+int imported_server_reactors_start(struct imported_server_reactors_t *self_p);
+
+/**
+ * Stop and join all reactor threads, and stop their servers.
+ */
+void imported_server_reactors_stop(struct imported_server_reactors_t *self_p);
+
 /**
  * Prepare a bar message. Call `send()`, `reply()` or `broadcast()`
  * to send it.
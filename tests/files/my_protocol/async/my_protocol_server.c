@@ -29,13 +29,6 @@
 #include "messi.h"
 #include "my_protocol_server.h"
 
-static void client_reset_input(struct my_protocol_server_client_t *self_p)
-{
-    self_p->input.state = my_protocol_server_client_input_state_header_t;
-    self_p->input.size = 0;
-    self_p->input.left = sizeof(struct messi_header_t);
-}
-
 static void on_client_connected_default(struct my_protocol_server_t *self_p,
                                         struct my_protocol_server_client_t *client_p)
 {
@@ -56,7 +49,7 @@ static void on_stcp_client_connected(struct async_stcp_server_client_t *stcp_p)
 
     self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
 
-    client_reset_input(self_p);
+    messi_framer_reset(&self_p->input);
     self_p->server_p->on_client_connected(self_p->server_p, self_p);
 }
 
@@ -70,12 +63,11 @@ static void on_stcp_client_disconnected(struct async_stcp_server_client_t *stcp_
 }
 
 static int handle_message_user(struct my_protocol_server_t *self_p,
-                               struct my_protocol_server_client_t *client_p)
+                               struct my_protocol_server_client_t *client_p,
+                               struct messi_buffer_t *payload_p)
 {
     int res;
     struct my_protocol_client_to_server_t *message_p;
-    uint8_t *payload_buf_p;
-    size_t payload_size;
 
     self_p->input.message_p = my_protocol_client_to_server_new(
         &self_p->input.workspace.buf_p[0],
@@ -86,12 +78,11 @@ static int handle_message_user(struct my_protocol_server_t *self_p,
         return (-1);
     }
 
-    payload_buf_p = &client_p->input.data.buf_p[sizeof(struct messi_header_t)];
-    payload_size = client_p->input.size - sizeof(struct messi_header_t);
+    res = my_protocol_client_to_server_decode(message_p,
+                                       payload_p->buf_p,
+                                       payload_p->size);
 
-    res = my_protocol_client_to_server_decode(message_p, payload_buf_p, payload_size);
-
-    if (res != (int)payload_size) {
+    if (res != (int)payload_p->size) {
         return (-1);
     }
 
@@ -143,14 +134,15 @@ static int handle_message_ping(struct my_protocol_server_client_t *client_p)
 
 static int handle_message(struct my_protocol_server_t *self_p,
                           struct my_protocol_server_client_t *client_p,
-                          uint32_t type)
+                          uint32_t type,
+                          struct messi_buffer_t *payload_p)
 {
     int res;
 
     switch (type) {
 
     case MESSI_MESSAGE_TYPE_CLIENT_TO_SERVER_USER:
-        res = handle_message_user(self_p, client_p);
+        res = handle_message_user(self_p, client_p, payload_p);
         break;
 
     case MESSI_MESSAGE_TYPE_PING:
@@ -165,56 +157,60 @@ static int handle_message(struct my_protocol_server_t *self_p,
     return (res);
 }
 
-static void on_stcp_client_input(struct async_stcp_server_client_t *stcp_p)
+/* Handle all complete frames in the input buffer. Returns zero(0) if
+   more data can be read from the client. */
+static int process_client_frames(struct my_protocol_server_client_t *self_p)
 {
     int res;
-    ssize_t size;
-    struct messi_header_t *header_p;
-    struct my_protocol_server_client_t *self_p;
-
-    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
-    header_p = (struct messi_header_t *)self_p->input.data.buf_p;
+    uint8_t type;
+    struct messi_buffer_t payload;
 
     while (true) {
-        size = async_stcp_server_client_read(
-            &self_p->stcp,
-            &self_p->input.data.buf_p[self_p->input.size],
-            self_p->input.left);
+        res = messi_framer_next(&self_p->input, &type, &payload);
 
-        if (size == 0) {
+        if (res == 0) {
             break;
+        } else if (res == 1) {
+            res = handle_message(self_p->server_p, self_p, type, &payload);
+        } else if (res == 2) {
+            /* Extended frames are not supported by this platform. */
+            res = -1;
         }
 
-        self_p->input.size += size;
-        self_p->input.left -= size;
+        /* The framer is out of sync after an error. */
+        if (res != 0) {
+            async_stcp_server_client_disconnect(&self_p->stcp);
 
-        if (self_p->input.left > 0) {
-            continue;
+            return (-1);
         }
+    }
 
-        if (self_p->input.state == my_protocol_server_client_input_state_header_t) {
-            self_p->input.left = messi_header_get_size(header_p);
+    return (0);
+}
+
+static void on_stcp_client_input(struct async_stcp_server_client_t *stcp_p)
+{
+    size_t size;
+    size_t free_size;
+    uint8_t *buf_p;
+    struct my_protocol_server_client_t *self_p;
 
-            if ((self_p->input.left + sizeof(*header_p))
-                > self_p->input.data.size) {
-                /* client_pending_disconnect(client_p, self_p); */
-                break;
-            }
+    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
 
-            self_p->input.state = my_protocol_server_client_input_state_payload_t;
+    do {
+        buf_p = messi_framer_get_free(&self_p->input, &free_size);
+        size = async_stcp_server_client_read(&self_p->stcp, buf_p, free_size);
+
+        if (size == 0) {
+            break;
         }
 
-        if (self_p->input.left == 0) {
-            res = handle_message(self_p->server_p, self_p, header_p->type);
+        messi_framer_commit(&self_p->input, size);
 
-            if (res == 0) {
-                client_reset_input(self_p);
-            } else {
-                //client_pending_disconnect(client_p, self_p);
-                break;
-            }
+        if (process_client_frames(self_p) != 0) {
+            break;
         }
-    }
+    } while (size == free_size);
 }
 
 void my_protocol_server_new_output_message(struct my_protocol_server_t *self_p)
@@ -347,8 +343,10 @@ int my_protocol_server_init(
                            async_p);
 
     for (i = 0; i < clients_max; i++) {
-        clients_p[i].input.data.buf_p = &clients_input_bufs_p[i * client_input_size];
-        clients_p[i].input.data.size = client_input_size;
+        clients_p[i].server_p = self_p;
+        messi_framer_init(&clients_p[i].input,
+                          &clients_input_bufs_p[i * client_input_size],
+                          client_input_size);
         async_stcp_server_add_client(&self_p->stcp, &clients_p[i].stcp);
     }
 
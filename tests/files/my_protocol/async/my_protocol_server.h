@@ -52,11 +52,6 @@ typedef void (*my_protocol_server_on_fie_rsp_t)(
     struct my_protocol_server_client_t *client_p,
     struct my_protocol_fie_rsp_t *message_p);
 
-enum my_protocol_server_client_input_state_t {
-    my_protocol_server_client_input_state_header_t = 0,
-    my_protocol_server_client_input_state_payload_t
-};
-
 typedef void (*my_protocol_server_on_client_connected_t)(
     struct my_protocol_server_t *self_p,
     struct my_protocol_server_client_t *client_p);
@@ -99,12 +94,7 @@ struct my_protocol_server_client_t {
     struct my_protocol_server_t *server_p;
     struct async_stcp_server_client_t stcp;
     struct async_timer_t keep_alive_timer;
-    struct {
-        enum my_protocol_server_client_input_state_t state;
-        struct messi_buffer_t data;
-        size_t size;
-        size_t left;
-    } input;
+    struct messi_framer_t input;
     struct my_protocol_server_client_t *next_p;
     struct my_protocol_server_client_t *prev_p;
 };
@@ -0,0 +1,279 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* This file was generated by Messi. */
+
+#ifndef MY_PROTOCOL_CLIENT_H
+#define MY_PROTOCOL_CLIENT_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "messi.h"
+#include "messi_uring.h"
+#include "my_protocol.h"
+
+/* Maximum number of buffers sent in one operation. */
+#define MY_PROTOCOL_CLIENT_IOV_MAX 64
+
+struct my_protocol_client_t;
+
+typedef void (*my_protocol_client_on_connected_t)(struct my_protocol_client_t *self_p);
+
+typedef void (*my_protocol_client_on_disconnected_t)(
+    struct my_protocol_client_t *self_p,
+    enum messi_disconnect_reason_t disconnect_reason);
+
+typedef uint8_t *(*my_protocol_client_on_large_message_t)(
+    struct my_protocol_client_t *self_p,
+    size_t size);
+
+typedef void (*my_protocol_client_on_foo_rsp_t)(
+    struct my_protocol_client_t *self_p,
+    struct my_protocol_foo_rsp_t *message_p);
+
+typedef void (*my_protocol_client_on_fie_req_t)(
+    struct my_protocol_client_t *self_p,
+    struct my_protocol_fie_req_t *message_p);
+
+struct my_protocol_client_t {
+    struct {
+        char address[16];
+        int port;
+        struct sockaddr_in addr;
+    } server;
+    enum messi_disconnect_reason_t disconnect_reason;
+    my_protocol_client_on_connected_t on_connected;
+    my_protocol_client_on_disconnected_t on_disconnected;
+    my_protocol_client_on_foo_rsp_t on_foo_rsp;
+    my_protocol_client_on_fie_req_t on_fie_req;
+    int epoll_fd;
+    messi_epoll_ctl_t epoll_ctl;
+    int server_fd;
+    bool connected;
+    struct messi_uring_t uring;
+    struct messi_uring_buf_ring_t input_buffers;
+    struct __kernel_timespec tick;
+    /* Submission is delayed until all completions are handled. */
+    bool processing;
+    /* Number of connect, receive and send operations in progress. A
+       new connection is not made until they are completed. */
+    int operations;
+    struct messi_timer_wheel_t timers;
+    struct messi_timer_t keep_alive_timer;
+    struct messi_timer_t reconnect_timer;
+    /* Delay before each reconnect attempt. Reset once anything is
+       received from the server. */
+    struct messi_backoff_t backoff;
+    bool pong_received;
+    bool pending_disconnect;
+    struct {
+        struct my_protocol_server_to_client_t *message_p;
+        struct messi_buffer_t workspace;
+        struct messi_framer_t encoded;
+        struct messi_large_input_t large;
+        /* Decompresses compressed frames. */
+        const struct messi_codec_t *codec_p;
+    } input;
+    /* Messages received in extended frames. Disabled if max_size is
+       zero(0). */
+    struct {
+        size_t max_size;
+        struct messi_buffer_t workspace;
+        struct messi_large_pool_t pool;
+        my_protocol_client_on_large_message_t on_large_message;
+    } large;
+    struct {
+        struct my_protocol_client_to_server_t *message_p;
+        struct messi_buffer_t workspace;
+        struct messi_buffer_t encoded;
+        /* Size of the batch in the encoded buffer, or zero(0) if no
+           messages are batched. */
+        size_t batch_size;
+        struct messi_output_queue_t queue;
+        /* The operation in progress sends the first size bytes. */
+        size_t size;
+        struct msghdr msg;
+        struct iovec iov[MY_PROTOCOL_CLIENT_IOV_MAX];
+    } output;
+    struct messi_stats_t stats;
+};
+
+/**
+ * Initialize given client. The client owns one io_uring instance,
+ * whose file descriptor is added to given epoll instance.
+ */
+int my_protocol_client_init(
+    struct my_protocol_client_t *self_p,
+    const char *server_uri_p,
+    uint8_t *encoded_in_buf_p,
+    size_t encoded_in_size,
+    uint8_t *workspace_in_buf_p,
+    size_t workspace_in_size,
+    uint8_t *encoded_out_buf_p,
+    size_t encoded_out_size,
+    uint8_t *workspace_out_buf_p,
+    size_t workspace_out_size,
+    my_protocol_client_on_connected_t on_connected,
+    my_protocol_client_on_disconnected_t on_disconnected,
+    my_protocol_client_on_foo_rsp_t on_foo_rsp,
+    my_protocol_client_on_fie_req_t on_fie_req,
+    int epoll_fd,
+    messi_epoll_ctl_t epoll_ctl);
+
+/**
+ * Receive messages of at most max_size bytes sent in extended
+ * frames, which may be larger than the input buffer. The payload of
+ * such a message is received into storage of its size returned by
+ * given callback, or into storage allocated from a pool if the
+ * callback is NULL or returns NULL. It is decoded into given
+ * workspace once received. Messages larger than
+ * MESSI_HEADER_SIZE_MAX bytes are always sent in extended
+ * frames. Call before start.
+ */
+void my_protocol_client_set_large_messages(
+    struct my_protocol_client_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    my_protocol_client_on_large_message_t on_large_message);
+
+/**
+ * Decompress compressed frames with given codec instead of the
+ * built-in LZ4 codec. Call before start.
+ */
+void my_protocol_client_set_codec(struct my_protocol_client_t *self_p,
+                           const struct messi_codec_t *codec_p);
+
+/**
+ * Wait initial_ms milliseconds before the first reconnect attempt,
+ * and multiplier times longer before each following attempt, but at
+ * most max_ms milliseconds. With jitter, the delay is instead random
+ * between zero(0) and that delay, so that clients disconnected at the
+ * same time do not reconnect at the same time. Restarts from
+ * initial_ms once anything is received from the server. Defaults to a
+ * fixed delay of 1000 ms without jitter. Call before start.
+ */
+void my_protocol_client_set_reconnect_backoff(struct my_protocol_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter);
+
+/**
+ * Returns the number of the next reconnect attempt, starting at one
+ * when the connection is lost or a connection attempt fails, and
+ * increasing until anything is received from the server. Failed
+ * connection attempts do not call the disconnected callback, so the
+ * number seen there is one unless the connection was lost before
+ * anything was received from the server. Read it when connected to
+ * see how many attempts were needed.
+ */
+unsigned int my_protocol_client_get_reconnect_attempt(struct my_protocol_client_t *self_p);
+
+/**
+ * Connect to the server. The connected callback is called once
+ * connected. Automatic reconnect if disconnected. If the client
+ * cannot be started, the disconnected callback is called with
+ * messi_disconnect_reason_general_error_t before returning.
+ */
+void my_protocol_client_start(struct my_protocol_client_t *self_p);
+
+/**
+ * Disconnect from the server. Call start to connect again.
+ */
+void my_protocol_client_stop(struct my_protocol_client_t *self_p);
+
+/**
+ * Copy the traffic statistics of all connections since init to given
+ * structure. Reads and writes are completed receive and send
+ * operations.
+ */
+void my_protocol_client_get_stats(struct my_protocol_client_t *self_p,
+                           struct messi_stats_t *stats_p);
+
+/**
+ * Process all pending events on given file descriptor (if it belongs
+ * to given client).
+ */
+void my_protocol_client_process(
+    struct my_protocol_client_t *self_p,
+    int fd,
+    uint32_t events);
+
+/**
+ * As my_protocol_client_process(), but handling of a lost connection is
+ * deferred until my_protocol_client_process_deferred() is called. Returns
+ * zero(0) if given file descriptor belongs to given client. Suitable
+ * as the process function of a messi_loop_t member.
+ */
+int my_protocol_client_process_event(
+    struct my_protocol_client_t *self_p,
+    int fd,
+    uint32_t events);
+
+/**
+ * Perform work deferred by my_protocol_client_process_event().
+ */
+void my_protocol_client_process_deferred(struct my_protocol_client_t *self_p);
+
+/**
+ * Send prepared message the server. Batched messages are sent first.
+ */
+void my_protocol_client_send(struct my_protocol_client_t *self_p);
+
+/**
+ * Add prepared message to the batch of messages sent to the server
+ * in one frame by my_protocol_client_send_batch(), instead of one frame and
+ * write each. The batch is built in the encoded output buffer, and is
+ * sent first if the message does not fit.
+ */
+void my_protocol_client_add_to_batch(struct my_protocol_client_t *self_p);
+
+/**
+ * Send all batched messages to the server, if any.
+ */
+void my_protocol_client_send_batch(struct my_protocol_client_t *self_p);
+
+/**
+ * Prepare a foo_req message. Call `send()` to send it.
+ */
+struct my_protocol_foo_req_t *my_protocol_client_init_foo_req(
+    struct my_protocol_client_t *self_p);
+
+/**
+ * Prepare a bar_ind message. Call `send()` to send it.
+ */
+struct my_protocol_bar_ind_t *my_protocol_client_init_bar_ind(
+    struct my_protocol_client_t *self_p);
+
+/**
+ * Prepare a fie_rsp message. Call `send()` to send it.
+ */
+struct my_protocol_fie_rsp_t *my_protocol_client_init_fie_rsp(
+    struct my_protocol_client_t *self_p);
+
+#endif
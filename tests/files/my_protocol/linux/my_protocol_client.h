@@ -41,6 +41,33 @@ typedef void (*my_protocol_client_on_disconnected_t)(
     struct my_protocol_client_t *self_p,
     enum messi_disconnect_reason_t disconnect_reason);
 
+typedef void (*my_protocol_client_on_writable_changed_t)(
+    struct my_protocol_client_t *self_p,
+    bool writable);
+
+typedef uint8_t *(*my_protocol_client_on_large_message_t)(
+    struct my_protocol_client_t *self_p,
+    size_t size);
+
+/* The message is NULL unless the status is ok. */
+typedef void (*my_protocol_client_on_response_t)(
+    struct my_protocol_client_t *self_p,
+    enum messi_request_status_t status,
+    struct my_protocol_server_to_client_t *message_p,
+    void *obj_p);
+
+/* A request waiting for its response. */
+struct my_protocol_client_request_t {
+    /* Sequence number in the upper 16 bits and index in the window in
+       the lower 16 bits. */
+    uint32_t id;
+    my_protocol_client_on_response_t on_response;
+    void *obj_p;
+    struct messi_timer_t timer;
+    struct my_protocol_client_t *client_p;
+    struct my_protocol_client_request_t *next_free_p;
+};
+
 typedef void (*my_protocol_client_on_foo_rsp_t)(
     struct my_protocol_client_t *self_p,
     struct my_protocol_foo_rsp_t *message_p);
@@ -49,15 +76,14 @@ typedef void (*my_protocol_client_on_fie_req_t)(
     struct my_protocol_client_t *self_p,
     struct my_protocol_fie_req_t *message_p);
 
-enum my_protocol_client_input_state_t {
-    my_protocol_client_input_state_header_t = 0,
-    my_protocol_client_input_state_payload_t
-};
-
 struct my_protocol_client_t {
     struct {
+        int domain;
         char address[16];
         int port;
+        struct sockaddr_un local_addr;
+        socklen_t local_addr_size;
+        bool shm;
     } server;
     enum messi_disconnect_reason_t disconnect_reason;
     my_protocol_client_on_connected_t on_connected;
@@ -67,25 +93,80 @@ struct my_protocol_client_t {
     int epoll_fd;
     messi_epoll_ctl_t epoll_ctl;
     int server_fd;
-    int keep_alive_timer_fd;
-    int reconnect_timer_fd;
-    bool pong_received;
+    struct messi_timer_wheel_t timers;
+    struct messi_timer_t keep_alive_timer;
+    struct messi_timer_t reconnect_timer;
+    struct messi_timer_t connect_timer;
+    /* Delay before each reconnect attempt. Reset once anything is
+       received from the server. */
+    struct messi_backoff_t backoff;
+    /* True while a non-blocking connect is in progress. */
+    bool connecting;
+    /* Ticks of the last input and output. A ping is sent when
+       either has been idle for the interval. */
+    struct {
+        int interval_ms;
+        uint64_t input_tick;
+        uint64_t output_tick;
+        bool ping_sent;
+    } keep_alive;
     bool pending_disconnect;
+    /* Only used by shm:// clients. */
+    struct messi_shm_t shm;
     struct {
         struct my_protocol_server_to_client_t *message_p;
         struct messi_buffer_t workspace;
-        struct {
-            struct messi_buffer_t data;
-            size_t size;
-            size_t left;
-            enum my_protocol_client_input_state_t state;
-        } encoded;
+        struct messi_framer_t encoded;
+        struct messi_large_input_t large;
+        /* Decompresses compressed frames. */
+        const struct messi_codec_t *codec_p;
     } input;
+    /* Messages received in extended frames. Disabled if max_size is
+       zero(0). */
+    struct {
+        size_t max_size;
+        struct messi_buffer_t workspace;
+        struct messi_large_pool_t pool;
+        my_protocol_client_on_large_message_t on_large_message;
+    } large;
     struct {
         struct my_protocol_client_to_server_t *message_p;
         struct messi_buffer_t workspace;
         struct messi_buffer_t encoded;
+        /* Size of the batch in the encoded buffer, or zero(0) if no
+           messages are batched. */
+        size_t batch_size;
+        /* Data not yet written. In the ring if it has a buffer,
+           otherwise in the queue. */
+        struct messi_output_queue_t queue;
+        struct messi_ring_t ring;
+        /* False from reaching the high watermark until drained to
+           the low watermark. */
+        bool writable;
     } output;
+    /* Output watermarks in bytes. Disabled if high is zero(0). */
+    struct {
+        size_t high;
+        size_t low;
+        my_protocol_client_on_writable_changed_t on_writable_changed;
+    } watermarks;
+    /* Requests in flight. Disabled if max is zero(0). */
+    struct {
+        struct my_protocol_client_request_t *requests_p;
+        size_t max;
+        size_t length;
+        struct my_protocol_client_request_t *free_list_p;
+        uint16_t sequence;
+    } requests;
+    struct messi_stats_t stats;
+};
+
+/* Connections to the same server. */
+struct my_protocol_client_group_t {
+    struct my_protocol_client_t *clients_p;
+    size_t length;
+    /* Index of the next client to try in round-robin order. */
+    size_t next;
 };
 
 /**
@@ -109,9 +190,103 @@ int my_protocol_client_init(
     int epoll_fd,
     messi_epoll_ctl_t epoll_ctl);
 
+/**
+ * Receive messages of at most max_size bytes sent in extended
+ * frames, which may be larger than the input buffer. The payload of
+ * such a message is received into storage of its size returned by
+ * given callback, or into storage allocated from a pool if the
+ * callback is NULL or returns NULL. It is decoded into given
+ * workspace once received. Messages larger than
+ * MESSI_HEADER_SIZE_MAX bytes are always sent in extended
+ * frames. Call before start.
+ */
+void my_protocol_client_set_large_messages(
+    struct my_protocol_client_t *self_p,
+    size_t max_size,
+    uint8_t *workspace_buf_p,
+    size_t workspace_size,
+    my_protocol_client_on_large_message_t on_large_message);
+
+/**
+ * Decompress compressed frames with given codec instead of the
+ * built-in LZ4 codec. Call before start.
+ */
+void my_protocol_client_set_codec(struct my_protocol_client_t *self_p,
+                           const struct messi_codec_t *codec_p);
+
+/**
+ * Enqueue output that could not be written at once in given buffer
+ * instead of in dynamically allocated memory. The client is
+ * disconnected if the buffer is full. Call before start.
+ */
+void my_protocol_client_set_output_buffer(struct my_protocol_client_t *self_p,
+                                   uint8_t *buf_p,
+                                   size_t size);
+
+/**
+ * Call given callback with writable false when the output not yet
+ * written reaches high bytes, and with writable true when it has
+ * been written down to low bytes. Stop producing messages while not
+ * writable, or the output keeps growing. The callback is called from
+ * within send when writable becomes false, and must then not send
+ * messages. The output is writable again once connected. Call before
+ * start.
+ */
+void my_protocol_client_set_output_watermarks(
+    struct my_protocol_client_t *self_p,
+    size_t high,
+    size_t low,
+    my_protocol_client_on_writable_changed_t on_writable_changed);
+
+/**
+ * Allow at most length requests in flight, stored in given array of
+ * at most 65536 requests. Call before start.
+ */
+void my_protocol_client_set_requests(struct my_protocol_client_t *self_p,
+                              struct my_protocol_client_request_t *requests_p,
+                              size_t length);
+
+/**
+ * Send a ping when nothing has been sent to, or nothing received
+ * from, the server for given number of milliseconds, and disconnect
+ * if nothing is received within that time after the ping. Any received frame
+ * proves that the server is alive. Must be shorter than the server's
+ * keep alive timeout. Defaults to 2000 ms. Call before start.
+ */
+void my_protocol_client_set_keep_alive_interval(struct my_protocol_client_t *self_p,
+                                         int interval_ms);
+
+/**
+ * Wait initial_ms milliseconds before the first reconnect attempt,
+ * and multiplier times longer before each following attempt, but at
+ * most max_ms milliseconds. With jitter, the delay is instead random
+ * between zero(0) and that delay, so that clients disconnected at the
+ * same time do not reconnect at the same time. Restarts from
+ * initial_ms once anything is received from the server. Defaults to a
+ * fixed delay of 1000 ms without jitter. Call before start.
+ */
+void my_protocol_client_set_reconnect_backoff(struct my_protocol_client_t *self_p,
+                                       int initial_ms,
+                                       int multiplier,
+                                       int max_ms,
+                                       bool jitter);
+
+/**
+ * Returns the number of the next reconnect attempt, starting at one
+ * when the connection is lost or a connection attempt fails, and
+ * increasing until anything is received from the server. Failed
+ * connection attempts do not call the disconnected callback, so the
+ * number seen there is one unless the connection was lost before
+ * anything was received from the server. Read it when connected to
+ * see how many attempts were needed.
+ */
+unsigned int my_protocol_client_get_reconnect_attempt(struct my_protocol_client_t *self_p);
+
 /**
  * Connect to the server. The connected callback is called once
- * connected. Automatic reconnect if disconnected.
+ * connected. Automatic reconnect if disconnected. If the client
+ * cannot be started, the disconnected callback is called with
+ * messi_disconnect_reason_general_error_t before returning.
  */
 void my_protocol_client_start(struct my_protocol_client_t *self_p);
 
@@ -120,6 +295,18 @@ void my_protocol_client_start(struct my_protocol_client_t *self_p);
  */
 void my_protocol_client_stop(struct my_protocol_client_t *self_p);
 
+/**
+ * Copy the traffic statistics of all connections since init to given
+ * structure.
+ */
+void my_protocol_client_get_stats(struct my_protocol_client_t *self_p,
+                           struct messi_stats_t *stats_p);
+
+/**
+ * Returns the number of enqueued output bytes not yet written.
+ */
+size_t my_protocol_client_output_bytes(struct my_protocol_client_t *self_p);
+
 /**
  * Process all pending events on given file descriptor (if it belongs
  * to given client).
@@ -130,10 +317,124 @@ void my_protocol_client_process(
     uint32_t events);
 
 /**
- * Send prepared message the server.
+ * As my_protocol_client_process(), but handling of a lost connection is
+ * deferred until my_protocol_client_process_deferred() is called. Returns
+ * zero(0) if given file descriptor belongs to given client. Suitable
+ * as the process function of a messi_loop_t member.
+ */
+int my_protocol_client_process_event(
+    struct my_protocol_client_t *self_p,
+    int fd,
+    uint32_t events);
+
+/**
+ * Perform work deferred by my_protocol_client_process_event().
+ */
+void my_protocol_client_process_deferred(struct my_protocol_client_t *self_p);
+
+/**
+ * Send prepared message the server. Batched messages are sent first.
  */
 void my_protocol_client_send(struct my_protocol_client_t *self_p);
 
+/**
+ * Add prepared message to the batch of messages sent to the server
+ * in one frame by my_protocol_client_send_batch(), instead of one frame and
+ * write each. The batch is built in the encoded output buffer, and is
+ * sent first if the message does not fit.
+ */
+void my_protocol_client_add_to_batch(struct my_protocol_client_t *self_p);
+
+/**
+ * Send all batched messages to the server, if any.
+ */
+void my_protocol_client_send_batch(struct my_protocol_client_t *self_p);
+
+/**
+ * Send prepared message to the server as a request, without waiting
+ * for earlier requests to complete. The server's reply to it is its
+ * response, given to the response callback with given object. The
+ * callback is instead called with status timeout if no response is
+ * received within given number of milliseconds, and with status
+ * disconnected if disconnected first. Returns zero(0) if sent, or -1
+ * if not connected or all requests are in flight.
+ */
+int my_protocol_client_request(struct my_protocol_client_t *self_p,
+                        int timeout_ms,
+                        my_protocol_client_on_response_t on_response,
+                        void *obj_p);
+
+/**
+ * Returns the number of requests in flight.
+ */
+size_t my_protocol_client_requests_in_flight(struct my_protocol_client_t *self_p);
+
+/**
+ * Returns true if connected to the server.
+ */
+bool my_protocol_client_is_connected(struct my_protocol_client_t *self_p);
+
+/**
+ * Initialize given group of clients, each connected to the server
+ * over its own connection. The clients must be initialized with
+ * my_protocol_client_init(), typically with the same server URI and
+ * callbacks, before initializing the group. Each client reconnects
+ * and is kept alive on its own. Returns zero(0) if successful, or
+ * -1 if length is zero(0), as a group must have at least one client.
+ */
+int my_protocol_client_group_init(struct my_protocol_client_group_t *self_p,
+                           struct my_protocol_client_t *clients_p,
+                           size_t length);
+
+/**
+ * Start all clients in given group.
+ */
+void my_protocol_client_group_start(struct my_protocol_client_group_t *self_p);
+
+/**
+ * Stop all clients in given group.
+ */
+void my_protocol_client_group_stop(struct my_protocol_client_group_t *self_p);
+
+/**
+ * Returns the next connected client in round-robin order, or NULL if
+ * no client is connected. Prepare a message and send it with the
+ * returned client.
+ */
+struct my_protocol_client_t *my_protocol_client_group_next(
+    struct my_protocol_client_group_t *self_p);
+
+/**
+ * Returns the client for given key hash. Messages sent with the
+ * client of a key are received by the server in order, as they share
+ * one connection. The client may not be connected.
+ */
+struct my_protocol_client_t *my_protocol_client_group_select(
+    struct my_protocol_client_group_t *self_p,
+    uint32_t key_hash);
+
+/**
+ * As my_protocol_client_process(), but for the client in given group that
+ * given file descriptor belongs to, if any.
+ */
+void my_protocol_client_group_process(struct my_protocol_client_group_t *self_p,
+                               int fd,
+                               uint32_t events);
+
+/**
+ * As my_protocol_client_process_event(), but for the client in given group
+ * that given file descriptor belongs to. Returns zero(0) if it
+ * belongs to a client in given group.
+ */
+int my_protocol_client_group_process_event(struct my_protocol_client_group_t *self_p,
+                                    int fd,
+                                    uint32_t events);
+
+/**
+ * Perform work deferred by my_protocol_client_group_process_event().
+ */
+void my_protocol_client_group_process_deferred(struct my_protocol_client_group_t *self_p);
+
 /**
  * Prepare a foo_req message. Call `send()` to send it.
  */
@@ -2,6 +2,7 @@
 
 import asyncio
 import logging
+import random
 import bitstruct
 
 import my_protocol_pb2
@@ -10,6 +11,12 @@ import my_protocol_pb2
 LOGGER = logging.getLogger(__name__)
 
 CF_HEADER = bitstruct.compile('u8u24')
+CF_EXTENDED_HEADER = bitstruct.compile('u8u64')
+CF_COMPRESSED_HEADER = bitstruct.compile('u8u8u32')
+
+# Maximum payload size of a frame with a basic header. Larger
+# payloads are sent in extended frames.
+HEADER_SIZE_MAX = 0xffffff
 
 
 class MessageType:
@@ -18,6 +25,68 @@ class MessageType:
     SERVER_TO_CLIENT_USER = 2
     PING = 3
     PONG = 4
+    EXTENDED = 5
+    BATCH = 6
+    COMPRESSED = 7
+
+
+class Codec:
+
+    LZ4 = 1
+
+
+def lz4_decompress(data, size):
+    """Decompress given LZ4 block of given decompressed size.
+
+    """
+
+    output = bytearray()
+    offset = 0
+
+    def read_length(length):
+        nonlocal offset
+
+        while True:
+            value = data[offset]
+            offset += 1
+            length += value
+
+            if value != 255:
+                return length
+
+    while offset < len(data):
+        token = data[offset]
+        offset += 1
+        length = token >> 4
+
+        if length == 15:
+            length = read_length(length)
+
+        output += data[offset:offset + length]
+        offset += length
+
+        if offset == len(data):
+            break
+
+        distance = data[offset] | (data[offset + 1] << 8)
+        offset += 2
+        length = token & 15
+
+        if length == 15:
+            length = read_length(length)
+
+        length += 4
+
+        if distance == 0 or distance > len(output):
+            raise ValueError('Malformed LZ4 block.')
+
+        for _ in range(length):
+            output.append(output[-distance])
+
+    if len(output) != size:
+        raise ValueError('Malformed LZ4 block.')
+
+    return bytes(output)
 
 
 def parse_tcp_uri(uri):
@@ -37,10 +106,34 @@ def parse_tcp_uri(uri):
             f"Expected URI on the form tcp://<host>:<port>, but got '{uri}'.")
 
 
+def parse_unix_uri(uri):
+    """Parse unix://<path>, or unix://@<name> for a socket in the
+    abstract namespace. Returns the socket path.
+
+    """
+
+    if uri[:7] != 'unix://' or uri[7:] in ['', '@']:
+        raise ValueError(
+            f"Expected URI on the form unix://<path> or unix://@<name>, but "
+            f"got '{uri}'.")
+
+    path = uri[7:]
+
+    if path[0] == '@':
+        path = '\0' + path[1:]
+
+    return path
+
+
 class MyProtocolClient:
 
     def __init__(self, uri, keep_alive_interval=2, connect_timeout=5):
-        self._address, self._port = parse_tcp_uri(uri)
+        if uri[:7] == 'unix://':
+            self._path = parse_unix_uri(uri)
+        else:
+            self._address, self._port = parse_tcp_uri(uri)
+            self._path = None
+
         self._uri = uri
         self._keep_alive_interval = keep_alive_interval
         self._connect_timeout = connect_timeout
@@ -48,8 +141,33 @@ class MyProtocolClient:
         self._writer = None
         self._task = None
         self._keep_alive_task = None
-        self._pong_event = None
+        self._input_event = None
+        self._input_time = 0
+        self._output_time = 0
         self._output = None
+        self._batch = []
+        self._batch_size = 0
+        self._reconnect_backoff = (1, 1, 1, False)
+        self._reconnect_backoff_delay = 0
+        self._reconnect_delay = 0
+        self.reconnect_attempt = 0
+
+    def set_reconnect_backoff(self,
+                              initial_delay,
+                              multiplier=2,
+                              max_delay=30,
+                              jitter=True):
+        """Wait `initial_delay` seconds before the first reconnect attempt,
+        and `multiplier` times longer before each following attempt,
+        but at most `max_delay` seconds. With `jitter`, the delay is
+        instead random between zero and that delay. Restarts from
+        `initial_delay` once anything is received from the
+        server. Defaults to a fixed delay of one second without
+        jitter.
+
+        """
+
+        self._reconnect_backoff = (initial_delay, multiplier, max_delay, jitter)
 
     def start(self):
         """Connect to the server. `on_connected()` is called once
@@ -58,6 +176,7 @@ class MyProtocolClient:
         """
 
         if self._task is None:
+            self.reconnect_attempt = 0
             self._task = asyncio.create_task(self._main())
 
     def stop(self):
@@ -71,15 +190,53 @@ class MyProtocolClient:
             self._task = None
 
     def send(self):
-        """Send prepared message to the server.
+        """Send prepared message to the server. Batched messages are sent
+        first.
 
         """
 
+        self.send_batch()
         encoded = self._output.SerializeToString()
-        header = CF_HEADER.pack(MessageType.CLIENT_TO_SERVER_USER, len(encoded))
 
-        if self._writer is not None:
-            self._writer.write(header + encoded)
+        if len(encoded) <= HEADER_SIZE_MAX:
+            header = CF_HEADER.pack(MessageType.CLIENT_TO_SERVER_USER,
+                                    len(encoded))
+        else:
+            header = CF_HEADER.pack(MessageType.EXTENDED, 0)
+            header += CF_EXTENDED_HEADER.pack(MessageType.CLIENT_TO_SERVER_USER,
+                                              len(encoded))
+
+        self._write(header + encoded)
+
+    def add_to_batch(self):
+        """Add prepared message to the batch of messages sent to the
+        server in one frame by `send_batch()`.
+
+        """
+
+        encoded = self._output.SerializeToString()
+        entry = CF_HEADER.pack(MessageType.CLIENT_TO_SERVER_USER, len(encoded))
+        entry += encoded
+
+        if self._batch_size + len(entry) > HEADER_SIZE_MAX:
+            self.send_batch()
+
+        self._batch.append(entry)
+        self._batch_size += len(entry)
+
+    def send_batch(self):
+        """Send all batched messages to the server, if any.
+
+        """
+
+        if not self._batch:
+            return
+
+        payload = b''.join(self._batch)
+        self._batch = []
+        self._batch_size = 0
+
+        self._write(CF_HEADER.pack(MessageType.BATCH, len(payload)) + payload)
 
     async def on_connected(self):
         """Called when connected to the server.
@@ -87,21 +244,22 @@ class MyProtocolClient:
         """
 
     async def on_disconnected(self):
-        """Called when disconnected from the server.
+        """Called when disconnected from the server. `reconnect_attempt` is
+        the number of the next reconnect attempt, one unless the
+        connection was lost before anything was received from the
+        server.
 
         """
 
     async def on_connect_failure(self, exception):
         """Called when a connection attempt to the server fails. Returns the
         number of seconds to wait before trying to connect again, or
-        ``None`` never to connect again.
+        ``None`` never to connect again. Returns the reconnect backoff
+        delay by default.
 
         """
 
-        if isinstance(exception, asyncio.TimeoutError):
-            return 0
-        else:
-            return 1
+        return self._reconnect_delay
 
     async def on_foo_rsp(self, message):
         """Called when a foo_rsp message is received from the server.
@@ -148,8 +306,10 @@ class MyProtocolClient:
             if not await self._connect():
                 break
 
+            self._input_event = asyncio.Event()
+            self._input_time = asyncio.get_running_loop().time()
+            self._output_time = self._input_time
             await self.on_connected()
-            self._pong_event = asyncio.Event()
             self._keep_alive_task = asyncio.create_task(self._keep_alive_main())
 
             try:
@@ -159,7 +319,15 @@ class MyProtocolClient:
                 self._close()
 
             self._keep_alive_task.cancel()
+            self._next_reconnect_delay()
             await self.on_disconnected()
+            await asyncio.sleep(self._reconnect_delay)
+
+    def _open_connection(self):
+        if self._path is None:
+            return asyncio.open_connection(self._address, self._port)
+        else:
+            return asyncio.open_unix_connection(self._path)
 
     async def _connect(self):
         """Repeatedly try to connect to the server. Returns ``True`` if a
@@ -170,18 +338,21 @@ class MyProtocolClient:
         while True:
             try:
                 self._reader, self._writer = await asyncio.wait_for(
-                    asyncio.open_connection(self._address, self._port),
+                    self._open_connection(),
                     self._connect_timeout)
 
                 return True
             except ConnectionRefusedError as e:
                 LOGGER.info("Connection refused.")
+                self._next_reconnect_delay()
                 delay = await self.on_connect_failure(e)
             except asyncio.TimeoutError as e:
                 LOGGER.info("Connect timeout.")
+                self._next_reconnect_delay()
                 delay = await self.on_connect_failure(e)
             except OSError as e:
                 LOGGER.info("OS error: %s", e)
+                self._next_reconnect_delay()
                 delay = await self.on_connect_failure(e)
 
             if delay is None:
@@ -199,26 +370,75 @@ class MyProtocolClient:
         elif choice == 'fie_req':
             await self.on_fie_req(message.fie_req)
 
-    def _handle_pong(self):
-        self._pong_event.set()
+    async def _handle_batch(self, payload):
+        offset = 0
+
+        while offset < len(payload):
+            message_type, size = CF_HEADER.unpack(payload[offset:offset + 4])
+            offset += 4
+
+            if message_type == MessageType.SERVER_TO_CLIENT_USER:
+                await self._handle_user_message(payload[offset:offset + size])
+
+            offset += size
+
+    async def _handle_compressed(self, payload):
+        message_type, codec, size = CF_COMPRESSED_HEADER.unpack(payload[:6])
+
+        if codec != Codec.LZ4:
+            raise ValueError(f'Unsupported codec {codec}.')
+
+        payload = lz4_decompress(payload[6:], size)
+
+        if message_type == MessageType.SERVER_TO_CLIENT_USER:
+            await self._handle_user_message(payload)
+        elif message_type == MessageType.BATCH:
+            await self._handle_batch(payload)
 
     async def _reader_loop(self):
         while True:
             header = await self._reader.readexactly(4)
             message_type, size = CF_HEADER.unpack(header)
+
+            if message_type == MessageType.EXTENDED:
+                header = await self._reader.readexactly(9)
+                message_type, size = CF_EXTENDED_HEADER.unpack(header)
+
             payload = await self._reader.readexactly(size)
 
+            # Any received frame proves that the server is alive.
+            self._input_time = asyncio.get_running_loop().time()
+            self._input_event.set()
+            self.reconnect_attempt = 0
+
             if message_type == MessageType.SERVER_TO_CLIENT_USER:
                 await self._handle_user_message(payload)
-            elif message_type == MessageType.PONG:
-                self._handle_pong()
+            elif message_type == MessageType.BATCH:
+                await self._handle_batch(payload)
+            elif message_type == MessageType.COMPRESSED:
+                await self._handle_compressed(payload)
 
     async def _keep_alive_loop(self):
+        """Ping the server when nothing has been sent, or nothing
+        received, for the keep alive interval. Only received data
+        proves that the server is alive, and only sent data restarts
+        the server's keep alive timer. Any received frame answers the
+        ping.
+
+        """
+
+        loop = asyncio.get_running_loop()
+
         while True:
-            await asyncio.sleep(self._keep_alive_interval)
-            self._pong_event.clear()
-            self._writer.write(CF_HEADER.pack(MessageType.PING, 0))
-            await asyncio.wait_for(self._pong_event.wait(),
+            idle = loop.time() - min(self._input_time, self._output_time)
+
+            if idle < self._keep_alive_interval:
+                await asyncio.sleep(self._keep_alive_interval - idle)
+                continue
+
+            self._input_event.clear()
+            self._write(CF_HEADER.pack(MessageType.PING, 0))
+            await asyncio.wait_for(self._input_event.wait(),
                                    self._keep_alive_interval)
 
     async def _keep_alive_main(self):
@@ -228,6 +448,31 @@ class MyProtocolClient:
             LOGGER.info('Keep alive task stopped by %r.', e)
             self._close()
 
+    def _next_reconnect_delay(self):
+        """Start a new reconnect attempt and calculate the delay before it.
+
+        """
+
+        initial_delay, multiplier, max_delay, jitter = self._reconnect_backoff
+
+        if self.reconnect_attempt == 0:
+            delay = initial_delay
+        else:
+            delay = min(self._reconnect_backoff_delay * multiplier, max_delay)
+
+        self._reconnect_backoff_delay = delay
+        self.reconnect_attempt += 1
+
+        if jitter:
+            delay = random.uniform(0, delay)
+
+        self._reconnect_delay = delay
+
+    def _write(self, data):
+        if self._writer is not None:
+            self._writer.write(data)
+            self._output_time = asyncio.get_running_loop().time()
+
     def _close(self):
         if self._writer is not None:
             self._writer.close()
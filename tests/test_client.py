@@ -3,6 +3,8 @@ import asyncio
 import unittest
 from unittest.mock import patch
 import shutil
+import tempfile
+import os
 
 import messi
 messi.py_source.generate_files(['tests/files/chat/chat.proto'], 'both')
@@ -71,6 +73,18 @@ async def server_main(listener):
 
 CONNECT_REQ = b'\x01\x00\x00\x08\n\x06\n\x04Erik'
 CONNECT_RSP = b'\x02\x00\x00\x02\x0a\x00'
+CONNECT_RSP_BATCH = b'\x06\x00\x00\x06\x02\x00\x00\x02\x0a\x00'
+MESSAGE_IND_BATCH = (b'\x06\x00\x00\x20'
+                     b'\x01\x00\x00\x0c\x12\x0a\x0a\x04Erik\x12\x02Hi'
+                     b'\x01\x00\x00\x0c\x12\x0a\x0a\x04Erik\x12\x02Ho')
+CONNECT_RSP_EXTENDED = (b'\x05\x00\x00\x00'
+                        b'\x02\x00\x00\x00\x00\x00\x00\x00\x02'
+                        b'\x0a\x00')
+CONNECT_RSP_COMPRESSED = b'\x07\x00\x00\x09\x02\x01\x00\x00\x00\x02\x20\x0a\x00'
+MESSAGE_IND_COMPRESSED = (b'\x07\x00\x00\x1b\x02\x01\x00\x00\x00\x6e'
+                          b'\xbf\x12\x6c\x0a\x04Erik\x12\x64\x61\x01\x00\x4b'
+                          b'\x50aaaaa')
+MESSAGE_IND = b'\x02\x00\x00\x0c\x12\x0a\x0a\x04Erik\x12\x02Hi'
 PING = b'\x03\x00\x00\x00'
 PONG = b'\x04\x00\x00\x00'
 
@@ -109,6 +123,114 @@ class ClientTest(unittest.TestCase):
         await asyncio.wait_for(
             asyncio.gather(server_main(listener), client_main()), 2)
 
+    def test_extended_frame(self):
+        asyncio.run(self.extended_frame())
+
+    async def extended_frame(self):
+        async def on_client_connected(reader, writer):
+            await self.read_connect_req(reader)
+            writer.write(CONNECT_RSP_EXTENDED)
+            writer.close()
+
+        listener = await asyncio.start_server(on_client_connected, 'localhost', 0)
+
+        async def client_main():
+            client = ChatClient(create_tcp_uri(listener))
+            client.start()
+            await asyncio.wait_for(client.connected_queue.get(), 2)
+            client.stop()
+            listener.close()
+
+        await asyncio.wait_for(
+            asyncio.gather(server_main(listener), client_main()), 2)
+
+    def test_batch(self):
+        asyncio.run(self.batch())
+
+    async def batch(self):
+        async def on_client_connected(reader, writer):
+            await self.read_connect_req(reader)
+            writer.write(CONNECT_RSP_BATCH)
+            message_ind_batch = await reader.readexactly(len(MESSAGE_IND_BATCH))
+            self.assertEqual(message_ind_batch, MESSAGE_IND_BATCH)
+            writer.close()
+
+        listener = await asyncio.start_server(on_client_connected, 'localhost', 0)
+
+        async def client_main():
+            client = ChatClient(create_tcp_uri(listener))
+            client.start()
+            await asyncio.wait_for(client.connected_queue.get(), 2)
+
+            for text in ['Hi', 'Ho']:
+                message = client.init_message_ind()
+                message.user = 'Erik'
+                message.text = text
+                client.add_to_batch()
+
+            client.send_batch()
+            await asyncio.wait_for(client.disconnected_queue.get(), 2)
+            client.stop()
+            listener.close()
+
+        await asyncio.wait_for(
+            asyncio.gather(server_main(listener), client_main()), 2)
+
+    def test_compressed(self):
+        asyncio.run(self.compressed())
+
+    async def compressed(self):
+        async def on_client_connected(reader, writer):
+            await self.read_connect_req(reader)
+            writer.write(CONNECT_RSP_COMPRESSED)
+            writer.write(MESSAGE_IND_COMPRESSED)
+            writer.close()
+
+        listener = await asyncio.start_server(on_client_connected, 'localhost', 0)
+        message_ind_queue = asyncio.Queue()
+
+        async def on_message_ind(message):
+            await message_ind_queue.put(message)
+
+        async def client_main():
+            client = ChatClient(create_tcp_uri(listener),
+                                connection_refused_delay=None)
+            client.on_message_ind = on_message_ind
+            client.start()
+            await asyncio.wait_for(client.connected_queue.get(), 2)
+            message = await asyncio.wait_for(message_ind_queue.get(), 2)
+            self.assertEqual(message.user, 'Erik')
+            self.assertEqual(message.text, 100 * 'a')
+            client.stop()
+            listener.close()
+
+        await asyncio.wait_for(
+            asyncio.gather(server_main(listener), client_main()), 2)
+
+    def test_unix_socket(self):
+        asyncio.run(self.unix_socket())
+
+    async def unix_socket(self):
+        async def on_client_connected(reader, writer):
+            await self.read_connect_req(reader)
+            writer.write(CONNECT_RSP)
+            writer.close()
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            path = os.path.join(tmpdir, 'chat.sock')
+            listener = await asyncio.start_unix_server(on_client_connected,
+                                                       path)
+
+            async def client_main():
+                client = ChatClient(f'unix://{path}')
+                client.start()
+                await asyncio.wait_for(client.connected_queue.get(), 2)
+                client.stop()
+                listener.close()
+
+            await asyncio.wait_for(
+                asyncio.gather(server_main(listener), client_main()), 2)
+
     def test_reconnect_on_missing_pong(self):
         asyncio.run(self.reconnect_on_missing_pong())
 
@@ -168,6 +290,46 @@ class ClientTest(unittest.TestCase):
         await asyncio.wait_for(
             asyncio.gather(server_main(listener), client_main()), 10)
 
+    def test_keep_alive_no_ping_when_busy(self):
+        asyncio.run(self.keep_alive_no_ping_when_busy())
+
+    async def keep_alive_no_ping_when_busy(self):
+
+        async def on_client_connected(reader, writer):
+            await self.read_connect_req(reader)
+            writer.write(CONNECT_RSP)
+
+            # No ping while messages are sent in both directions.
+            for _ in range(8):
+                message_ind = await reader.readexactly(16)
+                self.assertEqual(message_ind, MESSAGE_IND_BATCH[4:20])
+                writer.write(MESSAGE_IND)
+
+            # Ping once idle.
+            await self.read_ping(reader)
+            writer.close()
+
+        listener = await asyncio.start_server(on_client_connected, 'localhost', 0)
+
+        async def client_main():
+            client = ChatClient(create_tcp_uri(listener), keep_alive_interval=1)
+            client.start()
+            await asyncio.wait_for(client.connected_queue.get(), 10)
+
+            for _ in range(8):
+                message = client.init_message_ind()
+                message.user = 'Erik'
+                message.text = 'Hi'
+                client.send()
+                await asyncio.sleep(0.25)
+
+            await client.disconnected_queue.get()
+            client.stop()
+            listener.close()
+
+        await asyncio.wait_for(
+            asyncio.gather(server_main(listener), client_main()), 10)
+
     def test_connection_refused(self):
         asyncio.run(self.connection_refused())
 
@@ -230,6 +392,52 @@ class ClientTest(unittest.TestCase):
 
             client.stop()
 
+    def test_reconnect_backoff(self):
+        asyncio.run(self.reconnect_backoff())
+
+    async def reconnect_backoff(self):
+        async def open_connection(host, port):
+            raise ConnectionRefusedError()
+
+        delays = []
+        delays_queue = asyncio.Queue()
+
+        async def on_connect_failure(exception):
+            delay = await chat_client.ChatClient.on_connect_failure(client,
+                                                                    exception)
+            delays.append((client.reconnect_attempt, delay))
+
+            if len(delays) == 5:
+                await delays_queue.put(None)
+                delay = None
+
+            return delay
+
+        with patch('asyncio.open_connection', open_connection):
+            client = ChatClient('tcp://1.2.3.4:5000')
+            client.set_reconnect_backoff(0.01, 2, 0.05, jitter=False)
+            client.on_connect_failure = on_connect_failure
+            client.start()
+            await asyncio.wait_for(delays_queue.get(), 2)
+            client.stop()
+
+        self.assertEqual(delays,
+                         [(1, 0.01), (2, 0.02), (3, 0.04), (4, 0.05), (5, 0.05)])
+
+    def test_reconnect_backoff_jitter(self):
+        asyncio.run(self.reconnect_backoff_jitter())
+
+    async def reconnect_backoff_jitter(self):
+        client = ChatClient('tcp://1.2.3.4:5000')
+        client.set_reconnect_backoff(1, 2, 4)
+
+        for _ in range(100):
+            client._next_reconnect_delay()
+            self.assertGreaterEqual(client._reconnect_delay, 0)
+            self.assertLessEqual(client._reconnect_delay, 4)
+
+        self.assertEqual(client.reconnect_attempt, 100)
+
     def test_parse_tcp_uri(self):
         self.assertEqual(chat_client.parse_tcp_uri('tcp://127.0.0.1:6000'),
                          ('127.0.0.1', 6000));
@@ -256,5 +464,22 @@ class ClientTest(unittest.TestCase):
             "Expected URI on the form tcp://<host>:<port>, but got "
             "'tcp://127.0.0.1 6000'.")
 
+    def test_parse_unix_uri(self):
+        self.assertEqual(chat_client.parse_unix_uri('unix:///tmp/chat.sock'),
+                         '/tmp/chat.sock')
+
+    def test_parse_unix_uri_abstract(self):
+        self.assertEqual(chat_client.parse_unix_uri('unix://@chat'),
+                         '\0chat')
+
+    def test_parse_unix_uri_no_path(self):
+        with self.assertRaises(ValueError) as cm:
+            chat_client.parse_unix_uri('unix://')
+
+        self.assertEqual(
+            str(cm.exception),
+            "Expected URI on the form unix://<path> or unix://@<name>, but "
+            "got 'unix://'.")
+
 
 logging.basicConfig(level=logging.DEBUG)
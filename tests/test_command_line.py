@@ -94,6 +94,29 @@ class CommandLineTest(unittest.TestCase):
 
             self.assert_generated_c_files(protocol, 'linux')
 
+    def test_generate_c_source_io_uring(self):
+        protocols = [
+            'chat',
+            'my_protocol'
+        ]
+
+        for protocol in protocols:
+            argv = [
+                'messi',
+                'generate_c_source',
+                '-o', 'generated',
+                '-p', 'io_uring',
+                f'tests/files/{protocol}/{protocol}.proto'
+            ]
+
+            remove_directory('generated')
+            os.mkdir('generated')
+
+            with patch('sys.argv', argv):
+                messi.main()
+
+            self.assert_generated_c_files(protocol, 'io_uring')
+
     def test_generate_c_source_async(self):
         protocols = [
             'chat',
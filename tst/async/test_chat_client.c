@@ -1,11 +1,11 @@
 #include "nala.h"
 #include "chat_client.h"
 
-#define HEADER_SIZE sizeof(struct messi_header_t)
+#define INPUT_BUFFER_SIZE 128
 
 static struct async_t async;
 static struct chat_client_t client;
-static uint8_t encoded_in[128];
+static uint8_t encoded_in[INPUT_BUFFER_SIZE];
 static uint8_t encoded_out[128];
 static uint8_t workspace_in[128];
 static uint8_t workspace_out[128];
@@ -75,6 +75,10 @@ static void mock_prepare_stop_keep_alive_timer()
 
 static void mock_prepare_start_reconnect_timer()
 {
+    /* Default backoff, a fixed delay of one second. */
+    async_timer_set_initial_mock_once(1000);
+    async_timer_set_initial_mock_set_self_p_in_pointer(
+        reconnect_params_p->self_p);
     async_timer_start_mock_once();
     async_timer_start_mock_set_self_p_in_pointer(reconnect_params_p->self_p);
 }
@@ -85,15 +89,17 @@ static void mock_prepare_write(const uint8_t *buf_p, size_t size)
     async_stcp_client_write_mock_set_buf_p_in(buf_p, size);
 }
 
-static void mock_prepare_read_try_again()
+/* Read into given free space of the input buffer. A read that does
+   not fill the buffer ends reading. */
+static void mock_prepare_read_free(size_t free_size, uint8_t *buf_p, size_t res)
 {
-    async_stcp_client_read_mock_once(HEADER_SIZE, 0);
+    async_stcp_client_read_mock_once(free_size, res);
+    async_stcp_client_read_mock_set_buf_p_out(buf_p, res);
 }
 
-static void mock_prepare_read(size_t size, uint8_t *buf_p, size_t res)
+static void mock_prepare_read(uint8_t *buf_p, size_t res)
 {
-    async_stcp_client_read_mock_once(size, res);
-    async_stcp_client_read_mock_set_buf_p_out(buf_p, res);
+    mock_prepare_read_free(INPUT_BUFFER_SIZE, buf_p, res);
 }
 
 static int mock_prepare_disconnect_and_start_reconnect_timer(
@@ -142,7 +148,6 @@ static void start_client_and_connect_to_server()
     int stcp_init_handle;
     int keep_alive_handle;
     int reconnect_handle;
-    size_t payload_size;
 
     stcp_init_handle = async_stcp_client_init_mock_once();
     keep_alive_handle = async_timer_init_mock_once(2000, 0);
@@ -181,10 +186,7 @@ static void start_client_and_connect_to_server()
     stcp_init_params_p->on_connected(stcp_init_params_p->self_p, 0);
 
     /* Server responds with ConnectRsp. */
-    payload_size = (sizeof(connect_rsp) - HEADER_SIZE);
-    mock_prepare_read(HEADER_SIZE, &connect_rsp[0], HEADER_SIZE);
-    mock_prepare_read(payload_size, &connect_rsp[HEADER_SIZE], payload_size);
-    mock_prepare_read_try_again();
+    mock_prepare_read(&connect_rsp[0], sizeof(connect_rsp));
     client_on_connect_rsp_mock_once();
 
     stcp_init_params_p->on_input(stcp_init_params_p->self_p);
@@ -279,8 +281,7 @@ TEST(keep_alive)
     keep_alive_params_p->on_timeout(keep_alive_params_p->obj_p);
 
     /* Send a pong message to the client. */
-    mock_prepare_read(sizeof(pong), &pong[0], sizeof(pong));
-    mock_prepare_read_try_again();
+    mock_prepare_read(&pong[0], sizeof(pong));
 
     stcp_init_params_p->on_input(stcp_init_params_p->self_p);
 
@@ -338,12 +339,8 @@ TEST(partial_message_read)
 
     start_client_and_connect_to_server();
 
-    /* Read a message partially (in multiple chunks). */
-    mock_prepare_read(4, &message_ind[0], 1);
-    mock_prepare_read(3, &message_ind[1], 2);
-    mock_prepare_read(1, &message_ind[3], 1);
-    mock_prepare_read(16, &message_ind[4], 5);
-    async_stcp_client_read_mock_once(11, 0);
+    /* Read a message partially. */
+    mock_prepare_read(&message_ind[0], 9);
 
     stcp_init_params_p->on_input(stcp_init_params_p->self_p);
 
@@ -355,8 +352,7 @@ TEST(partial_message_read)
     chat_client_send(&client);
 
     /* Read the end of the message. */
-    mock_prepare_read(11, &message_ind[9], 11);
-    mock_prepare_read_try_again();
+    mock_prepare_read_free(INPUT_BUFFER_SIZE - 9, &message_ind[9], 11);
     client_on_message_ind_mock_once();
     message.user_p = "Erik";
     message.text_p = "Hello.";
@@ -422,9 +418,7 @@ TEST(decode_error)
     async_call_handle = mock_prepare_disconnect_and_start_reconnect_timer(
         messi_disconnect_reason_message_decode_error_t);
 
-    mock_prepare_read(4, &malformed_message[0], 4);
-    mock_prepare_read(1, &malformed_message[4], 1);
-    mock_prepare_read_try_again();
+    mock_prepare_read(&malformed_message[0], sizeof(malformed_message));
 
     stcp_init_params_p->on_input(stcp_init_params_p->self_p);
 
@@ -471,7 +465,30 @@ TEST(received_message_too_big)
     start_client_and_connect_to_server();
 
     /* Read a message that does not fit in the receive buffer. */
-    mock_prepare_read(4, &big_message[0], 4);
+    mock_prepare_read(&big_message[0], 4);
+    async_call_handle = mock_prepare_disconnect_and_start_reconnect_timer(
+        messi_disconnect_reason_message_too_big_t);
+
+    stcp_init_params_p->on_input(stcp_init_params_p->self_p);
+
+    params_p = async_call_mock_get_params_in(async_call_handle);
+    params_p->func(params_p->obj_p, params_p->arg_p);
+}
+
+TEST(received_extended_frame)
+{
+    uint8_t header[] = {
+        /* Extended header. */
+        0x05, 0x00, 0x00, 0x00,
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+    };
+    int async_call_handle;
+    struct nala_async_call_params_t *params_p;
+
+    start_client_and_connect_to_server();
+
+    /* Extended frames are not supported. */
+    mock_prepare_read(&header[0], sizeof(header));
     async_call_handle = mock_prepare_disconnect_and_start_reconnect_timer(
         messi_disconnect_reason_message_too_big_t);
 
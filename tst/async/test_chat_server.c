@@ -1,6 +1,56 @@
 #include "nala.h"
 #include "chat_server.h"
 
+static struct async_t async;
+static struct chat_server_t server;
+static struct chat_server_client_t clients[1];
+static uint8_t clients_input_buffers[1][128];
+static uint8_t message[128];
+static uint8_t workspace_in[128];
+static uint8_t workspace_out[128];
+static struct nala_async_stcp_server_init_params_t *stcp_init_params_p;
+
+static void mock_prepare_read(uint8_t *buf_p, size_t size, size_t res)
+{
+    async_stcp_server_client_read_mock_once(size, res);
+    async_stcp_server_client_read_mock_set_buf_p_out(buf_p, res);
+}
+
+static void start_server_and_connect_client()
+{
+    int stcp_init_handle;
+
+    stcp_init_handle = async_stcp_server_init_mock_once("127.0.0.1", 7840);
+    async_stcp_server_add_client_mock_once();
+
+    ASSERT_EQ(chat_server_init(&server,
+                               "tcp://127.0.0.1:7840",
+                               &clients[0],
+                               1,
+                               &clients_input_buffers[0][0],
+                               sizeof(clients_input_buffers[0]),
+                               &message[0],
+                               sizeof(message),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               NULL,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &async), 0);
+
+    stcp_init_params_p = async_stcp_server_init_mock_get_params_in(
+        stcp_init_handle);
+
+    async_stcp_server_start_mock_once();
+
+    chat_server_start(&server);
+
+    stcp_init_params_p->on_client_connected(&clients[0].stcp);
+}
+
 TEST(connect_and_disconnect_clients)
 {
     async_stcp_server_init_mock_none();
@@ -10,3 +60,39 @@ TEST(connect_and_disconnect_clients)
     async_stcp_server_client_write_mock_none();
     async_stcp_server_client_read_mock_none();
 }
+
+TEST(received_message_too_big)
+{
+    uint8_t header[] = {
+        0x01, 0x00, 0x00, 0xff
+    };
+
+    start_server_and_connect_client();
+
+    /* The frame does not fit in the input buffer. The client is
+       disconnected, as the rest of the frame would otherwise be
+       parsed as frames. */
+    mock_prepare_read(&header[0], sizeof(clients_input_buffers[0]), 4);
+    async_stcp_server_client_disconnect_mock_once();
+
+    stcp_init_params_p->on_client_input(&clients[0].stcp);
+}
+
+TEST(received_extended_frame)
+{
+    uint8_t header[] = {
+        /* Extended header. */
+        0x05, 0x00, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+    };
+
+    start_server_and_connect_client();
+
+    /* Extended frames are not supported. */
+    mock_prepare_read(&header[0],
+                      sizeof(clients_input_buffers[0]),
+                      sizeof(header));
+    async_stcp_server_client_disconnect_mock_once();
+
+    stcp_init_params_p->on_client_input(&clients[0].stcp);
+}
@@ -0,0 +1,474 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "nala.h"
+#include "chat_client.h"
+
+/* The io_uring client is tested against a server socket owned by the
+   test, as its operations are performed by the kernel. */
+
+#define SERVER_URI                          "tcp://127.0.0.1:6201"
+#define SERVER_PORT                         6201
+
+#define INPUT_BUFFER_SIZE                   128
+
+/* Number of times to process events while waiting for something to
+   happen. */
+#define PROCESS_ATTEMPTS                    500
+
+static uint8_t connect_req[] = {
+    /* Header. */
+    0x01, 0x00, 0x00, 0x08,
+    /* Payload. */
+    0x0a, 0x06, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b
+};
+
+static uint8_t connect_rsp[] = {
+    /* Header. */
+    0x02, 0x00, 0x00, 0x02,
+    /* Payload. */
+    0x0a, 0x00
+};
+
+static uint8_t message_ind_in[] = {
+    /* Header. */
+    0x02, 0x00, 0x00, 0x10,
+    /* Payload. */
+    0x12, 0x0e, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+    0x12, 0x06, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e
+};
+
+static uint8_t message_ind_out[] = {
+    /* Header. */
+    0x01, 0x00, 0x00, 0x09,
+    /* Payload. */
+    0x12, 0x07, 0x0a, 0x05, 0x4b, 0x61, 0x6c, 0x6c,
+    0x65
+};
+
+static uint8_t ping[] = {
+    0x03, 0x00, 0x00, 0x00
+};
+
+static uint8_t pong[] = {
+    0x04, 0x00, 0x00, 0x00
+};
+
+static struct chat_client_t client;
+static uint8_t encoded_in[INPUT_BUFFER_SIZE];
+static uint8_t encoded_out[128];
+static uint8_t workspace_in[128];
+static uint8_t workspace_out[128];
+static int epoll_fd;
+static int listener_fd;
+static int number_of_connected;
+static int number_of_disconnected;
+static enum messi_disconnect_reason_t last_disconnect_reason;
+static unsigned int last_disconnect_reconnect_attempt;
+static int number_of_connect_rsps;
+static int number_of_message_inds;
+static char last_message_ind_user[16];
+static char last_message_ind_text[16];
+
+static void on_connected(struct chat_client_t *self_p)
+{
+    struct chat_connect_req_t *message_p;
+
+    number_of_connected++;
+    message_p = chat_client_init_connect_req(self_p);
+    message_p->user_p = "Erik";
+    chat_client_send(self_p);
+}
+
+static void on_disconnected(struct chat_client_t *self_p,
+                            enum messi_disconnect_reason_t disconnect_reason)
+{
+    number_of_disconnected++;
+    last_disconnect_reason = disconnect_reason;
+    last_disconnect_reconnect_attempt =
+        chat_client_get_reconnect_attempt(self_p);
+}
+
+static void on_connect_rsp(struct chat_client_t *self_p,
+                           struct chat_connect_rsp_t *message_p)
+{
+    (void)self_p;
+    (void)message_p;
+
+    number_of_connect_rsps++;
+}
+
+static void on_message_ind(struct chat_client_t *self_p,
+                           struct chat_message_ind_t *message_p)
+{
+    (void)self_p;
+
+    number_of_message_inds++;
+    strncpy(&last_message_ind_user[0],
+            message_p->user_p,
+            sizeof(last_message_ind_user) - 1);
+    strncpy(&last_message_ind_text[0],
+            message_p->text_p,
+            sizeof(last_message_ind_text) - 1);
+}
+
+static void send_message_ind(void)
+{
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_client_init_message_ind(&client);
+    message_p->user_p = "Kalle";
+    chat_client_send(&client);
+}
+
+/* Wait at most given number of milliseconds for events, and process
+   them. */
+static void process(int timeout_ms)
+{
+    struct epoll_event event;
+
+    if (epoll_wait(epoll_fd, &event, 1, timeout_ms) == 1) {
+        chat_client_process(&client, event.data.fd, event.events);
+    }
+}
+
+/* Process events until given counter reaches given value. */
+static void process_until(int *counter_p, int value)
+{
+    int i;
+
+    for (i = 0; (i < PROCESS_ATTEMPTS) && (*counter_p != value); i++) {
+        process(10);
+    }
+
+    ASSERT_EQ(*counter_p, value);
+}
+
+static void listener_open(void)
+{
+    struct sockaddr_in addr;
+    int enable;
+
+    listener_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    ASSERT_NE(listener_fd, -1);
+    enable = 1;
+    ASSERT_EQ(setsockopt(listener_fd,
+                         SOL_SOCKET,
+                         SO_REUSEADDR,
+                         &enable,
+                         sizeof(enable)), 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listener_fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(listener_fd, 5), 0);
+}
+
+/* Process events until the client connects, and accept it. */
+static int server_accept(int receive_buffer_size)
+{
+    int fd;
+    int i;
+
+    fd = -1;
+
+    for (i = 0; (i < PROCESS_ATTEMPTS) && (fd == -1); i++) {
+        fd = accept(listener_fd, NULL, NULL);
+
+        if (fd == -1) {
+            process(10);
+        }
+    }
+
+    ASSERT_NE(fd, -1);
+
+    if (receive_buffer_size > 0) {
+        ASSERT_EQ(setsockopt(fd,
+                             SOL_SOCKET,
+                             SO_RCVBUF,
+                             &receive_buffer_size,
+                             sizeof(receive_buffer_size)), 0);
+    }
+
+    return (fd);
+}
+
+/* Process events until given number of bytes are read from the
+   client, and compare them to the expected. */
+static void server_read(int fd, const uint8_t *expected_p, size_t size)
+{
+    uint8_t buf[64];
+    size_t offset;
+    ssize_t res;
+    int i;
+
+    offset = 0;
+
+    for (i = 0; (i < PROCESS_ATTEMPTS) && (offset < size); i++) {
+        res = recv(fd, &buf[offset], size - offset, MSG_DONTWAIT);
+
+        if (res > 0) {
+            offset += (size_t)res;
+        } else {
+            ASSERT_NE(res, 0);
+            process(10);
+        }
+    }
+
+    ASSERT_EQ(offset, size);
+    ASSERT_MEMORY_EQ(&buf[0], expected_p, size);
+}
+
+static void server_write(int fd, const uint8_t *buf_p, size_t size)
+{
+    ASSERT_EQ(write(fd, buf_p, size), (ssize_t)size);
+}
+
+static void start_client(void)
+{
+    epoll_fd = epoll_create1(0);
+    ASSERT_NE(epoll_fd, -1);
+    ASSERT_EQ(chat_client_init(&client,
+                               SERVER_URI,
+                               &encoded_in[0],
+                               sizeof(encoded_in),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &encoded_out[0],
+                               sizeof(encoded_out),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               on_connected,
+                               on_disconnected,
+                               on_connect_rsp,
+                               on_message_ind,
+                               epoll_fd,
+                               NULL), 0);
+}
+
+/* Start the client, accept it, and exchange connect request and
+   response. */
+static int start_client_and_connect_to_server(void)
+{
+    int fd;
+
+    listener_open();
+    start_client();
+    chat_client_start(&client);
+    fd = server_accept(0);
+    server_read(fd, &connect_req[0], sizeof(connect_req));
+    server_write(fd, &connect_rsp[0], sizeof(connect_rsp));
+    process_until(&number_of_connect_rsps, 1);
+    ASSERT_EQ(number_of_connected, 1);
+
+    return (fd);
+}
+
+static void stop_client(void)
+{
+    chat_client_stop(&client);
+    close(listener_fd);
+    close(epoll_fd);
+}
+
+TEST(connect_and_disconnect)
+{
+    uint8_t byte;
+    int fd;
+
+    fd = start_client_and_connect_to_server();
+    stop_client();
+
+    /* Stop closes the connection. */
+    ASSERT_EQ(read(fd, &byte, sizeof(byte)), 0);
+    ASSERT_EQ(number_of_disconnected, 0);
+
+    close(fd);
+}
+
+TEST(many_messages_in_one_read)
+{
+    uint8_t buf[2 * sizeof(message_ind_in)];
+    int fd;
+
+    fd = start_client_and_connect_to_server();
+
+    memcpy(&buf[0], &message_ind_in[0], sizeof(message_ind_in));
+    memcpy(&buf[sizeof(message_ind_in)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+    server_write(fd, &buf[0], sizeof(buf));
+    process_until(&number_of_message_inds, 2);
+    ASSERT_EQ(&last_message_ind_user[0], "Erik");
+    ASSERT_EQ(&last_message_ind_text[0], "Hello.");
+
+    stop_client();
+    close(fd);
+}
+
+TEST(partial_message_read)
+{
+    int fd;
+    int i;
+
+    fd = start_client_and_connect_to_server();
+
+    /* The header and the beginning of the payload. */
+    server_write(fd, &message_ind_in[0], 6);
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    ASSERT_EQ(number_of_message_inds, 0);
+    server_write(fd, &message_ind_in[6], sizeof(message_ind_in) - 6);
+    process_until(&number_of_message_inds, 1);
+    ASSERT_EQ(&last_message_ind_user[0], "Erik");
+    ASSERT_EQ(&last_message_ind_text[0], "Hello.");
+
+    stop_client();
+    close(fd);
+}
+
+TEST(send_message)
+{
+    int fd;
+
+    fd = start_client_and_connect_to_server();
+
+    send_message_ind();
+    server_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+
+    stop_client();
+    close(fd);
+}
+
+TEST(output_buffering)
+{
+    struct messi_stats_t stats;
+    int size;
+    int fd;
+    int i;
+
+    listener_open();
+    start_client();
+    chat_client_start(&client);
+
+    /* Small socket buffers to make the client send partially. */
+    fd = server_accept(4096);
+    size = 4096;
+    ASSERT_EQ(setsockopt(client.server_fd,
+                         SOL_SOCKET,
+                         SO_SNDBUF,
+                         &size,
+                         sizeof(size)), 0);
+    server_read(fd, &connect_req[0], sizeof(connect_req));
+
+    for (i = 0; i < 20000; i++) {
+        send_message_ind();
+    }
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    /* The server does not read, so output is queued. */
+    chat_client_get_stats(&client, &stats);
+    ASSERT_GT(stats.output_bytes, 0);
+
+    /* All messages are sent in order once the server reads. */
+    for (i = 0; i < 20000; i++) {
+        server_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+    }
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    chat_client_get_stats(&client, &stats);
+    ASSERT_EQ(stats.output_bytes, 0);
+
+    stop_client();
+    close(fd);
+}
+
+TEST(keep_alive)
+{
+    int fd;
+
+    fd = start_client_and_connect_to_server();
+
+    /* Pinged after two seconds, and again two seconds after the
+       pong. */
+    server_read(fd, &ping[0], sizeof(ping));
+    server_write(fd, &pong[0], sizeof(pong));
+    server_read(fd, &ping[0], sizeof(ping));
+    ASSERT_EQ(number_of_disconnected, 0);
+
+    /* Disconnected if no pong is received. */
+    process_until(&number_of_disconnected, 1);
+    ASSERT_EQ(last_disconnect_reason,
+              messi_disconnect_reason_keep_alive_timeout_t);
+
+    stop_client();
+    close(fd);
+}
+
+TEST(server_disconnects)
+{
+    int fd;
+
+    fd = start_client_and_connect_to_server();
+
+    close(fd);
+    process_until(&number_of_disconnected, 1);
+    ASSERT_EQ(last_disconnect_reason,
+              messi_disconnect_reason_connection_closed_t);
+
+    stop_client();
+}
+
+TEST(reconnect_backoff)
+{
+    int fd;
+    int i;
+
+    listener_open();
+    start_client();
+    chat_client_set_reconnect_backoff(&client, 50, 2, 1000, false);
+    chat_client_start(&client);
+    fd = server_accept(0);
+    server_read(fd, &connect_req[0], sizeof(connect_req));
+    server_write(fd, &connect_rsp[0], sizeof(connect_rsp));
+    process_until(&number_of_connect_rsps, 1);
+
+    /* Lost connection. The server is gone, so attempts are refused
+       after 50, 100 and 200 ms. */
+    close(fd);
+    close(listener_fd);
+    process_until(&number_of_disconnected, 1);
+    ASSERT_EQ(last_disconnect_reconnect_attempt, 1U);
+
+    for (i = 0; i < 50; i++) {
+        process(10);
+    }
+
+    ASSERT_GE(chat_client_get_reconnect_attempt(&client), 3U);
+
+    /* Connected again once the server is back. */
+    listener_open();
+    fd = server_accept(0);
+    process_until(&number_of_connected, 2);
+    ASSERT_GE(chat_client_get_reconnect_attempt(&client), 3U);
+
+    /* Restarts from the initial delay once anything is received. */
+    server_read(fd, &connect_req[0], sizeof(connect_req));
+    server_write(fd, &connect_rsp[0], sizeof(connect_rsp));
+    process_until(&number_of_connect_rsps, 2);
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 0U);
+
+    stop_client();
+    close(fd);
+}
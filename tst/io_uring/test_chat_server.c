@@ -0,0 +1,513 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "nala.h"
+#include "chat_server.h"
+
+/* The io_uring server is tested on real sockets, as its operations
+   are performed by the kernel. */
+
+#define SERVER_URI                          "tcp://127.0.0.1:6200"
+#define SERVER_PORT                         6200
+
+#define INPUT_BUFFER_SIZE                   128
+
+/* Number of times to process events while waiting for something to
+   happen. */
+#define PROCESS_ATTEMPTS                    500
+
+static uint8_t connect_req_erik[] = {
+    /* Header. */
+    0x01, 0x00, 0x00, 0x08,
+    /* Payload. */
+    0x0a, 0x06, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b
+};
+
+static uint8_t connect_req_kalle[] = {
+    /* Header. */
+    0x01, 0x00, 0x00, 0x09,
+    /* Payload. */
+    0x0a, 0x07, 0x0a, 0x05, 0x4b, 0x61, 0x6c, 0x6c, 0x65
+};
+
+static uint8_t connect_rsp[] = {
+    /* Header. */
+    0x02, 0x00, 0x00, 0x02,
+    /* Payload. */
+    0x0a, 0x00
+};
+
+/**
+ * user: Erik
+ * text: Hello.
+ */
+static uint8_t message_ind_in[] = {
+    /* Header. */
+    0x01, 0x00, 0x00, 0x10,
+    /* Payload. */
+    0x12, 0x0e, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+    0x12, 0x06, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e
+};
+
+/**
+ * user: Erik
+ * text: Hello.
+ */
+static uint8_t message_ind_out[] = {
+    /* Header. */
+    0x02, 0x00, 0x00, 0x10,
+    /* Payload. */
+    0x12, 0x0e, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+    0x12, 0x06, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e
+};
+
+static uint8_t ping[] = {
+    0x03, 0x00, 0x00, 0x00
+};
+
+static uint8_t pong[] = {
+    0x04, 0x00, 0x00, 0x00
+};
+
+static struct chat_server_t server;
+static struct chat_server_client_t clients[3];
+static uint8_t clients_input_buffers[3][INPUT_BUFFER_SIZE];
+static uint8_t message[128];
+static uint8_t workspace_in[128];
+static uint8_t workspace_out[128];
+static int epoll_fd;
+static int number_of_connected;
+static int number_of_disconnected;
+static struct chat_server_client_t *last_connected_client_p;
+/* Send buffer size of accepted clients, or zero(0) for the
+   default. */
+static int client_send_buffer_size;
+
+static void on_client_connected(struct chat_server_t *self_p,
+                                struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+
+    if (client_send_buffer_size > 0) {
+        ASSERT_EQ(setsockopt(client_p->client_fd,
+                             SOL_SOCKET,
+                             SO_SNDBUF,
+                             &client_send_buffer_size,
+                             sizeof(client_send_buffer_size)), 0);
+    }
+
+    number_of_connected++;
+    last_connected_client_p = client_p;
+}
+
+static void on_client_disconnected(struct chat_server_t *self_p,
+                                   struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+    (void)client_p;
+
+    number_of_disconnected++;
+}
+
+static void on_connect_req(struct chat_server_t *self_p,
+                           struct chat_server_client_t *client_p,
+                           struct chat_connect_req_t *message_p)
+{
+    (void)client_p;
+    (void)message_p;
+
+    chat_server_init_connect_rsp(self_p);
+    chat_server_reply(self_p);
+}
+
+static void on_message_ind(struct chat_server_t *self_p,
+                           struct chat_server_client_t *client_p,
+                           struct chat_message_ind_t *message_in_p)
+{
+    (void)client_p;
+
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_server_init_message_ind(self_p);
+    message_p->user_p = message_in_p->user_p;
+    message_p->text_p = message_in_p->text_p;
+    chat_server_broadcast(self_p);
+}
+
+/* Wait at most given number of milliseconds for events, and process
+   them. */
+static void process(int timeout_ms)
+{
+    struct epoll_event event;
+
+    if (epoll_wait(epoll_fd, &event, 1, timeout_ms) == 1) {
+        chat_server_process(&server, event.data.fd, event.events);
+    }
+}
+
+/* Process events until given counter reaches given value. */
+static void process_until(int *counter_p, int value)
+{
+    int i;
+
+    for (i = 0; (i < PROCESS_ATTEMPTS) && (*counter_p != value); i++) {
+        process(10);
+    }
+
+    ASSERT_EQ(*counter_p, value);
+}
+
+static void start_server(void)
+{
+    epoll_fd = epoll_create1(0);
+    ASSERT_NE(epoll_fd, -1);
+    ASSERT_EQ(chat_server_init(&server,
+                               SERVER_URI,
+                               &clients[0],
+                               3,
+                               &clients_input_buffers[0][0],
+                               sizeof(clients_input_buffers[0]),
+                               &message[0],
+                               sizeof(message),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               on_client_connected,
+                               on_client_disconnected,
+                               on_connect_req,
+                               on_message_ind,
+                               epoll_fd,
+                               NULL), 0);
+}
+
+static void stop_server(void)
+{
+    chat_server_stop(&server);
+    close(epoll_fd);
+}
+
+/* Process events until given number of bytes are read from given
+   client, and compare them to the expected. */
+static void client_read(int fd, const uint8_t *expected_p, size_t size)
+{
+    uint8_t buf[64];
+    size_t offset;
+    ssize_t res;
+    int i;
+
+    offset = 0;
+
+    for (i = 0; (i < PROCESS_ATTEMPTS) && (offset < size); i++) {
+        res = recv(fd, &buf[offset], size - offset, MSG_DONTWAIT);
+
+        if (res > 0) {
+            offset += (size_t)res;
+        } else {
+            ASSERT_NE(res, 0);
+            process(10);
+        }
+    }
+
+    ASSERT_EQ(offset, size);
+    ASSERT_MEMORY_EQ(&buf[0], expected_p, size);
+}
+
+static void client_write(int fd, const uint8_t *buf_p, size_t size)
+{
+    ASSERT_EQ(write(fd, buf_p, size), (ssize_t)size);
+}
+
+/* Process events until the server has closed given client. */
+static void client_read_closed(int fd)
+{
+    uint8_t byte;
+    ssize_t res;
+    int i;
+
+    for (i = 0; i < PROCESS_ATTEMPTS; i++) {
+        res = recv(fd, &byte, sizeof(byte), MSG_DONTWAIT);
+
+        if (res == 0) {
+            break;
+        }
+
+        ASSERT_EQ(res, -1);
+        process(10);
+    }
+
+    ASSERT_EQ(res, 0);
+}
+
+static int client_open(int receive_buffer_size)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+
+    if (receive_buffer_size > 0) {
+        ASSERT_EQ(setsockopt(fd,
+                             SOL_SOCKET,
+                             SO_RCVBUF,
+                             &receive_buffer_size,
+                             sizeof(receive_buffer_size)), 0);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+    return (fd);
+}
+
+/* Connect a client and wait for its connect response. */
+static int connect_client(uint8_t *connect_req_p, size_t size)
+{
+    int fd;
+
+    fd = client_open(0);
+    client_write(fd, connect_req_p, size);
+    client_read(fd, &connect_rsp[0], sizeof(connect_rsp));
+
+    return (fd);
+}
+
+static int connect_erik(void)
+{
+    return (connect_client(&connect_req_erik[0], sizeof(connect_req_erik)));
+}
+
+static int connect_kalle(void)
+{
+    return (connect_client(&connect_req_kalle[0], sizeof(connect_req_kalle)));
+}
+
+TEST(connect_and_disconnect_clients)
+{
+    int erik_fd;
+    int kalle_fd;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    erik_fd = connect_erik();
+    kalle_fd = connect_kalle();
+    ASSERT_EQ(number_of_connected, 2);
+
+    close(erik_fd);
+    process_until(&number_of_disconnected, 1);
+    close(kalle_fd);
+    process_until(&number_of_disconnected, 2);
+
+    stop_server();
+}
+
+TEST(broadcast_message)
+{
+    int erik_fd;
+    int kalle_fd;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    erik_fd = connect_erik();
+    kalle_fd = connect_kalle();
+
+    client_write(erik_fd, &message_ind_in[0], sizeof(message_ind_in));
+    client_read(erik_fd, &message_ind_out[0], sizeof(message_ind_out));
+    client_read(kalle_fd, &message_ind_out[0], sizeof(message_ind_out));
+
+    close(erik_fd);
+    close(kalle_fd);
+    stop_server();
+}
+
+TEST(many_messages_in_one_write)
+{
+    uint8_t buf[sizeof(connect_req_erik) + 2 * sizeof(message_ind_in)];
+    int fd;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    memcpy(&buf[0], &connect_req_erik[0], sizeof(connect_req_erik));
+    memcpy(&buf[sizeof(connect_req_erik)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+    memcpy(&buf[sizeof(connect_req_erik) + sizeof(message_ind_in)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+
+    fd = client_open(0);
+    client_write(fd, &buf[0], sizeof(buf));
+    client_read(fd, &connect_rsp[0], sizeof(connect_rsp));
+    client_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+    client_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+
+    close(fd);
+    stop_server();
+}
+
+TEST(partial_message_write)
+{
+    int fd;
+    int i;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    fd = connect_erik();
+
+    /* The header and the beginning of the payload. */
+    client_write(fd, &message_ind_in[0], 6);
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    client_write(fd, &message_ind_in[6], sizeof(message_ind_in) - 6);
+    client_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+
+    close(fd);
+    stop_server();
+}
+
+TEST(output_buffering)
+{
+    struct chat_server_client_t *client_p;
+    struct chat_message_ind_t *message_p;
+    int fd;
+    int i;
+
+    /* Small socket buffers to make the server send partially. */
+    client_send_buffer_size = 4096;
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    fd = client_open(4096);
+    client_write(fd, &connect_req_erik[0], sizeof(connect_req_erik));
+    client_read(fd, &connect_rsp[0], sizeof(connect_rsp));
+    client_p = last_connected_client_p;
+
+    for (i = 0; i < 5000; i++) {
+        message_p = chat_server_init_message_ind(&server);
+        message_p->user_p = "Erik";
+        message_p->text_p = "Hello.";
+        chat_server_send(&server, client_p);
+    }
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    /* The client does not read, so output is queued. */
+    ASSERT_GT(chat_server_client_output_bytes(&server, client_p), 0);
+
+    /* All messages are sent in order once the client reads. */
+    for (i = 0; i < 5000; i++) {
+        client_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+    }
+
+    for (i = 0; i < 10; i++) {
+        process(10);
+    }
+
+    ASSERT_EQ(chat_server_client_output_bytes(&server, client_p), 0);
+
+    close(fd);
+    stop_server();
+}
+
+TEST(ping_pong)
+{
+    int fd;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    fd = connect_erik();
+    client_write(fd, &ping[0], sizeof(ping));
+    client_read(fd, &pong[0], sizeof(pong));
+
+    close(fd);
+    stop_server();
+}
+
+TEST(keep_alive)
+{
+    struct messi_stats_t stats;
+    int fd;
+
+    start_server();
+    chat_server_set_keep_alive_timeout(&server, 300);
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    fd = connect_erik();
+
+    /* Disconnected as nothing is received within the timeout. */
+    client_read_closed(fd);
+    ASSERT_EQ(number_of_disconnected, 1);
+    chat_server_client_get_stats(&server, last_connected_client_p, &stats);
+    ASSERT_EQ(stats.keep_alive_misses, 1);
+
+    close(fd);
+    stop_server();
+}
+
+TEST(keep_alive_restarted_by_any_data)
+{
+    int fd;
+    int i;
+
+    start_server();
+    chat_server_set_keep_alive_timeout(&server, 300);
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    fd = connect_erik();
+
+    /* Messages keep the client alive well beyond the timeout. */
+    for (i = 0; i < 50; i++) {
+        client_write(fd, &message_ind_in[0], sizeof(message_ind_in));
+        client_read(fd, &message_ind_out[0], sizeof(message_ind_out));
+        process(20);
+    }
+
+    ASSERT_EQ(number_of_disconnected, 0);
+    client_read_closed(fd);
+    ASSERT_EQ(number_of_disconnected, 1);
+
+    close(fd);
+    stop_server();
+}
+
+TEST(too_many_clients)
+{
+    int fds[3];
+    int fd;
+    int i;
+
+    start_server();
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    for (i = 0; i < 3; i++) {
+        fds[i] = connect_erik();
+    }
+
+    /* The fourth client is closed once accepted. */
+    fd = client_open(0);
+    client_read_closed(fd);
+    ASSERT_EQ(number_of_connected, 3);
+
+    close(fd);
+
+    for (i = 0; i < 3; i++) {
+        close(fds[i]);
+    }
+
+    stop_server();
+}
@@ -0,0 +1,79 @@
+#include "nala.h"
+#include "messi_uring.h"
+
+static void prepare_nop(struct io_uring_sqe *sqe_p, uint64_t user_data)
+{
+    sqe_p->opcode = IORING_OP_NOP;
+    sqe_p->user_data = user_data;
+}
+
+TEST(get_sqe_submits_full_queue)
+{
+    struct messi_uring_t uring;
+    struct io_uring_sqe *sqe_p;
+    struct io_uring_cqe *cqe_p;
+    unsigned i;
+
+    ASSERT_EQ(messi_uring_init(&uring, 4, 16), 0);
+    ASSERT_EQ(uring.sq.entries, 4U);
+
+    for (i = 0; i < 4; i++) {
+        sqe_p = messi_uring_get_sqe(&uring);
+        ASSERT_NE(sqe_p, NULL);
+        prepare_nop(sqe_p, i);
+    }
+
+    /* Nothing is completed until submitted. */
+    ASSERT_EQ(messi_uring_peek_cqe(&uring), NULL);
+
+    /* The full queue is submitted to make room for another entry. */
+    sqe_p = messi_uring_get_sqe(&uring);
+    ASSERT_NE(sqe_p, NULL);
+    prepare_nop(sqe_p, 4);
+    ASSERT_EQ(messi_uring_submit(&uring), 0);
+
+    for (i = 0; i < 5; i++) {
+        cqe_p = messi_uring_peek_cqe(&uring);
+        ASSERT_NE(cqe_p, NULL);
+        ASSERT_EQ(cqe_p->user_data, (uint64_t)i);
+        ASSERT_EQ(cqe_p->res, 0);
+        messi_uring_cqe_seen(&uring);
+    }
+
+    ASSERT_EQ(messi_uring_peek_cqe(&uring), NULL);
+
+    messi_uring_destroy(&uring);
+}
+
+TEST(get_sqe_reuses_consumed_entries)
+{
+    struct messi_uring_t uring;
+    struct io_uring_sqe *sqe_p;
+    struct io_uring_cqe *cqe_p;
+    unsigned i;
+
+    ASSERT_EQ(messi_uring_init(&uring, 4, 64), 0);
+
+    /* Entries consumed by the kernel are free again, however many
+       times the queue wraps around. */
+    for (i = 0; i < 40; i++) {
+        sqe_p = messi_uring_get_sqe(&uring);
+        ASSERT_NE(sqe_p, NULL);
+        prepare_nop(sqe_p, i);
+
+        if ((i % 3) == 2) {
+            ASSERT_EQ(messi_uring_submit(&uring), 0);
+        }
+    }
+
+    ASSERT_EQ(messi_uring_submit(&uring), 0);
+
+    for (i = 0; i < 40; i++) {
+        cqe_p = messi_uring_peek_cqe(&uring);
+        ASSERT_NE(cqe_p, NULL);
+        ASSERT_EQ(cqe_p->user_data, (uint64_t)i);
+        messi_uring_cqe_seen(&uring);
+    }
+
+    messi_uring_destroy(&uring);
+}
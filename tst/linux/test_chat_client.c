@@ -4,20 +4,16 @@
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
+#include <sys/uio.h>
 #include "nala.h"
 #include "chat_client.h"
 
 #define EPOLL_FD                                       9
 #define SERVER_FD                                     10
-#define KEEP_ALIVE_TIMER_FD                           17
-#define RECONNECT_TIMER_FD                            18
+#define TIMERS_FD                                     17
 
 #define HEADER_SIZE sizeof(struct messi_header_t)
-
-static inline int client_to_timer_fd(int client_fd)
-{
-    return (client_fd + 3);
-}
+#define INPUT_BUFFER_SIZE                            128
 
 static uint8_t connect_req[] = {
     /* Header. */
@@ -50,10 +46,11 @@ static uint8_t message_ind_out[] = {
 };
 
 static struct chat_client_t client;
-static uint8_t encoded_in[128];
+static uint8_t encoded_in[INPUT_BUFFER_SIZE];
 static uint8_t encoded_out[128];
 static uint8_t workspace_in[128];
 static uint8_t workspace_out[128];
+static bool timers_armed;
 
 static void mock_prepare_make_non_blocking(int fd)
 {
@@ -76,12 +73,22 @@ static void mock_prepare_write(int fd, const uint8_t *buf_p, size_t size)
     write_mock_set_buf_in(buf_p, size);
 }
 
-static void mock_prepare_read(int fd, uint8_t *buf_p, size_t size)
+/* Read into given free space of the input buffer. A read that does
+   not fill the buffer ends reading as the socket is drained. */
+static void mock_prepare_read_free(int fd,
+                                   size_t free_size,
+                                   uint8_t *buf_p,
+                                   size_t size)
 {
-    read_mock_once(fd, size, size);
+    read_mock_once(fd, free_size, size);
     read_mock_set_buf_out(buf_p, size);
 }
 
+static void mock_prepare_read(int fd, uint8_t *buf_p, size_t size)
+{
+    mock_prepare_read_free(fd, INPUT_BUFFER_SIZE, buf_p, size);
+}
+
 void client_on_disconnected(struct chat_client_t *self_p,
                             enum messi_disconnect_reason_t disconnect_reason)
 {
@@ -109,6 +116,54 @@ void client_on_message_ind(struct chat_client_t *self_p,
     FAIL("Must be mocked.");
 }
 
+void client_on_writable_changed(struct chat_client_t *self_p, bool writable)
+{
+    (void)self_p;
+    (void)writable;
+
+    FAIL("Must be mocked.");
+}
+
+static void assert_iov(const struct iovec *actual_p,
+                       const struct iovec *expected_p,
+                       size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size / sizeof(*actual_p); i++) {
+        ASSERT_EQ(actual_p[i].iov_len, expected_p[i].iov_len);
+        ASSERT_MEMORY_EQ(actual_p[i].iov_base,
+                         expected_p[i].iov_base,
+                         expected_p[i].iov_len);
+    }
+}
+
+static void mock_prepare_writev(int fd,
+                                struct iovec *iov_p,
+                                int iovcnt,
+                                ssize_t res)
+{
+    writev_mock_once(fd, iovcnt, res);
+    writev_mock_set_iov_in(iov_p, sizeof(*iov_p) * iovcnt);
+    writev_mock_set_iov_in_assert(assert_iov);
+}
+
+static void mock_prepare_write_eagain(int fd, const uint8_t *buf_p, size_t size)
+{
+    write_mock_once(fd, size, -1);
+    write_mock_set_buf_in(buf_p, size);
+    write_mock_set_errno(EAGAIN);
+}
+
+static void send_message_ind()
+{
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_client_init_message_ind(&client);
+    message_p->user_p = "Kalle";
+    chat_client_send(&client);
+}
+
 static void assert_on_message_ind(struct chat_message_ind_t *actual_p,
                                   struct chat_message_ind_t *expected_p,
                                   size_t size)
@@ -130,66 +185,64 @@ static void mock_prepare_connect(int fd, const char *address_p, int port, int re
     connect_mock_set_addr_in((const struct sockaddr *)&addr, sizeof(addr));
 }
 
-static void mock_prepare_connect_to_server(const char *address_p, int port)
+static void mock_prepare_timers_settime(long period_ms)
 {
     struct itimerspec timeout;
 
-    socket_mock_once(AF_INET, SOCK_STREAM, 0, SERVER_FD);
-    mock_prepare_connect(SERVER_FD, address_p, port, 0);
-    mock_prepare_make_non_blocking(SERVER_FD);
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, SERVER_FD, 0);
-    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, KEEP_ALIVE_TIMER_FD);
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, KEEP_ALIVE_TIMER_FD, 0);
     memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 2;
-    timerfd_settime_mock_once(KEEP_ALIVE_TIMER_FD, 0, 0);
+    timeout.it_value.tv_nsec = (1000000L * period_ms);
+    timeout.it_interval = timeout.it_value;
+    timerfd_settime_mock_once(TIMERS_FD, 0, 0);
     timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
-    mock_prepare_write(SERVER_FD, &connect_req[0], sizeof(connect_req));
 }
 
-static void mock_prepare_start_reconnect_timer()
+static void mock_prepare_start_timer()
 {
-    struct itimerspec timeout;
-
-    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, RECONNECT_TIMER_FD);
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, RECONNECT_TIMER_FD, 0);
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 1;
-    timerfd_settime_mock_once(RECONNECT_TIMER_FD, 0, 0);
-    timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
+    /* The timerfd is only armed when the first timer is started. */
+    if (!timers_armed) {
+        mock_prepare_timers_settime(100);
+        timers_armed = true;
+    }
 }
 
-static void mock_prepare_start_keep_alive_timer()
+static void mock_prepare_disarm_timers()
 {
-    struct itimerspec timeout;
+    mock_prepare_timers_settime(0);
+    timers_armed = false;
+}
 
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 2;
-    timerfd_settime_mock_once(KEEP_ALIVE_TIMER_FD, 0, 0);
-    timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
+static void mock_prepare_timers_read(uint64_t ticks)
+{
+    read_mock_once(TIMERS_FD, sizeof(ticks), sizeof(ticks));
+    read_mock_set_buf_out(&ticks, sizeof(ticks));
 }
 
-static void mock_prepare_close_fd(int fd)
+static void mock_prepare_start_client()
 {
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_DEL, fd, 0);
-    close_mock_once(fd, 0);
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, TIMERS_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, TIMERS_FD, 0);
+    timers_armed = false;
 }
 
-static void mock_prepare_read_try_again()
+static void mock_prepare_connect_to_server(const char *address_p, int port)
 {
-    read_mock_once(SERVER_FD, HEADER_SIZE, -1);
-    read_mock_set_errno(EAGAIN);
+    socket_mock_once(AF_INET, SOCK_STREAM, 0, SERVER_FD);
+    mock_prepare_make_non_blocking(SERVER_FD);
+    mock_prepare_connect(SERVER_FD, address_p, port, 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, SERVER_FD, 0);
+    mock_prepare_start_timer();
+    mock_prepare_write(SERVER_FD, &connect_req[0], sizeof(connect_req));
 }
 
-static void mock_prepare_timer_read(int fd)
+static void mock_prepare_close_fd(int fd)
 {
-    read_mock_once(fd, sizeof(uint64_t), sizeof(uint64_t));
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_DEL, fd, 0);
+    close_mock_once(fd, 0);
 }
 
 static void mock_prepare_disconnect()
 {
     mock_prepare_close_fd(SERVER_FD);
-    mock_prepare_close_fd(KEEP_ALIVE_TIMER_FD);
 }
 
 static void mock_prepare_disconnect_and_start_reconnect_timer(
@@ -197,13 +250,11 @@ static void mock_prepare_disconnect_and_start_reconnect_timer(
 {
     mock_prepare_disconnect();
     client_on_disconnected_mock_once(disconnect_reason);
-    mock_prepare_start_reconnect_timer();
+    mock_prepare_start_timer();
 }
 
 static void start_client_and_connect_to_server()
 {
-    size_t payload_size;
-
     ASSERT_EQ(chat_client_init(&client,
                                "tcp://127.0.0.1:6000",
                                &encoded_in[0],
@@ -222,15 +273,13 @@ static void start_client_and_connect_to_server()
                                NULL), 0);
 
     /* TCP connect to the server and send ConnectReq. */
+    mock_prepare_start_client();
     mock_prepare_connect_to_server("127.0.0.1", 6000);
 
     chat_client_start(&client);
 
     /* Server responds with ConnectRsp. */
-    payload_size = (sizeof(connect_rsp) - HEADER_SIZE);
-    mock_prepare_read(SERVER_FD, &connect_rsp[0], HEADER_SIZE);
-    mock_prepare_read(SERVER_FD, &connect_rsp[HEADER_SIZE], payload_size);
-    mock_prepare_read_try_again();
+    mock_prepare_read(SERVER_FD, &connect_rsp[0], sizeof(connect_rsp));
     client_on_connect_rsp_mock_once();
 
     chat_client_process(&client, SERVER_FD, EPOLLIN);
@@ -242,10 +291,54 @@ TEST(connect_and_disconnect)
 
     /* Disconnect from the server. */
     mock_prepare_disconnect();
+    mock_prepare_close_fd(TIMERS_FD);
 
     chat_client_stop(&client);
 }
 
+static void init_client()
+{
+    ASSERT_EQ(chat_client_init(&client,
+                               "tcp://127.0.0.1:6000",
+                               &encoded_in[0],
+                               sizeof(encoded_in),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &encoded_out[0],
+                               sizeof(encoded_out),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               on_connected,
+                               client_on_disconnected,
+                               client_on_connect_rsp,
+                               client_on_message_ind,
+                               EPOLL_FD,
+                               NULL), 0);
+}
+
+TEST(start_timers_create_error)
+{
+    init_client();
+
+    /* The failure is reported with the disconnected callback. */
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, -1);
+    client_on_disconnected_mock_once(messi_disconnect_reason_general_error_t);
+
+    chat_client_start(&client);
+}
+
+TEST(start_add_timers_to_epoll_error)
+{
+    init_client();
+
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, TIMERS_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, TIMERS_FD, -1);
+    close_mock_once(TIMERS_FD, 0);
+    client_on_disconnected_mock_once(messi_disconnect_reason_general_error_t);
+
+    chat_client_start(&client);
+}
+
 TEST(connect_successful_on_second_attempt)
 {
     ASSERT_EQ(chat_client_init(&client,
@@ -267,23 +360,206 @@ TEST(connect_successful_on_second_attempt)
 
     /* TCP connect to the server fails. Reconnect timer should be
        started. */
+    mock_prepare_start_client();
     socket_mock_once(AF_INET, SOCK_STREAM, 0, SERVER_FD);
+    mock_prepare_make_non_blocking(SERVER_FD);
     mock_prepare_connect(SERVER_FD, "10.20.30.40", 40234, -1);
+    connect_mock_set_errno(ECONNREFUSED);
     close_mock_once(SERVER_FD, 0);
-    mock_prepare_start_reconnect_timer();
+    mock_prepare_start_timer();
 
     chat_client_start(&client);
 
-    /* Make the reconnect timer expire and then successfully connect
-       to the server. */
-    mock_prepare_close_fd(RECONNECT_TIMER_FD);
+    /* Make the reconnect timer expire after one second and then
+       successfully connect to the server. */
+    mock_prepare_timers_read(10);
     mock_prepare_connect_to_server("10.20.30.40", 40234);
 
-    chat_client_process(&client, RECONNECT_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+}
+
+static void mock_prepare_connect_refused()
+{
+    socket_mock_once(AF_INET, SOCK_STREAM, 0, SERVER_FD);
+    mock_prepare_make_non_blocking(SERVER_FD);
+    mock_prepare_connect(SERVER_FD, "10.20.30.40", 40234, -1);
+    connect_mock_set_errno(ECONNREFUSED);
+    close_mock_once(SERVER_FD, 0);
+}
+
+TEST(reconnect_backoff)
+{
+    ASSERT_EQ(chat_client_init(&client,
+                               "tcp://10.20.30.40:40234",
+                               &encoded_in[0],
+                               sizeof(encoded_in),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &encoded_out[0],
+                               sizeof(encoded_out),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               on_connected,
+                               client_on_disconnected,
+                               client_on_connect_rsp,
+                               client_on_message_ind,
+                               EPOLL_FD,
+                               NULL), 0);
+    chat_client_set_reconnect_backoff(&client, 1000, 2, 3000, false);
+
+    /* TCP connect to the server fails. Reconnect after one second. */
+    mock_prepare_start_client();
+    mock_prepare_connect_refused();
+    mock_prepare_start_timer();
+
+    chat_client_start(&client);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 1u);
+
+    /* Fails again. Reconnect after two seconds (and one tick, as the
+       current tick has already started). */
+    mock_prepare_timers_read(10);
+    mock_prepare_connect_refused();
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 2u);
+
+    mock_prepare_timers_read(20);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    /* Fails again. Reconnect after at most three seconds. */
+    mock_prepare_timers_read(1);
+    mock_prepare_connect_refused();
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 3u);
+
+    mock_prepare_timers_read(30);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    /* Successfully connect to the server. The backoff is restarted
+       once the server responds. */
+    mock_prepare_timers_read(1);
+    mock_prepare_connect_to_server("10.20.30.40", 40234);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 3u);
+
+    mock_prepare_read(SERVER_FD, &connect_rsp[0], sizeof(connect_rsp));
+    client_on_connect_rsp_mock_once();
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 0u);
+
+    /* The server disconnects. Reconnect after one second. */
+    read_mock_once(SERVER_FD, INPUT_BUFFER_SIZE, 0);
+    mock_prepare_disconnect();
+    client_on_disconnected_mock_once(messi_disconnect_reason_connection_closed_t);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_get_reconnect_attempt(&client), 1u);
+
+    mock_prepare_timers_read(10);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    mock_prepare_timers_read(1);
+    mock_prepare_connect_to_server("10.20.30.40", 40234);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+}
+
+static void mock_prepare_getsockopt_so_error(int error)
+{
+    getsockopt_mock_once(SERVER_FD, SOL_SOCKET, SO_ERROR, 0);
+    getsockopt_mock_set_optval_out(&error, sizeof(error));
+}
+
+static void start_client_and_begin_connect()
+{
+    ASSERT_EQ(chat_client_init(&client,
+                               "tcp://10.20.30.40:40234",
+                               &encoded_in[0],
+                               sizeof(encoded_in),
+                               &workspace_in[0],
+                               sizeof(workspace_in),
+                               &encoded_out[0],
+                               sizeof(encoded_out),
+                               &workspace_out[0],
+                               sizeof(workspace_out),
+                               on_connected,
+                               client_on_disconnected,
+                               client_on_connect_rsp,
+                               client_on_message_ind,
+                               EPOLL_FD,
+                               NULL), 0);
+
+    /* The connect is in progress. Wait for the socket to become
+       writable and start the connect timer. */
+    mock_prepare_start_client();
+    socket_mock_once(AF_INET, SOCK_STREAM, 0, SERVER_FD);
+    mock_prepare_make_non_blocking(SERVER_FD);
+    mock_prepare_connect(SERVER_FD, "10.20.30.40", 40234, -1);
+    connect_mock_set_errno(EINPROGRESS);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, SERVER_FD, 0);
+    mock_prepare_start_timer();
+
+    chat_client_start(&client);
+}
+
+TEST(connect_in_progress)
+{
+    start_client_and_begin_connect();
+
+    /* The connect completes. Wait for input and send ConnectReq. */
+    mock_prepare_getsockopt_so_error(0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, SERVER_FD, 0);
+    mock_prepare_write(SERVER_FD, &connect_req[0], sizeof(connect_req));
+
+    chat_client_process(&client, SERVER_FD, EPOLLOUT);
+
+    /* Server responds with ConnectRsp. */
+    mock_prepare_read(SERVER_FD, &connect_rsp[0], sizeof(connect_rsp));
+    client_on_connect_rsp_mock_once();
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+}
+
+TEST(connect_in_progress_refused)
+{
+    start_client_and_begin_connect();
+
+    /* The connect fails. The reconnect timer is started without
+       calling the disconnected callback, as the client never was
+       connected. */
+    mock_prepare_getsockopt_so_error(ECONNREFUSED);
+    mock_prepare_disconnect();
+
+    chat_client_process(&client, SERVER_FD, EPOLLOUT | EPOLLERR);
+}
+
+TEST(connect_timeout)
+{
+    start_client_and_begin_connect();
+
+    /* No response from the server within three seconds. Abort the
+       connect and try again later. */
+    mock_prepare_timers_read(30);
+    mock_prepare_disconnect();
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 }
 
 TEST(keep_alive)
 {
+    struct messi_stats_t stats;
     uint8_t ping[] = {
         /* Header. */
         0x03, 0x00, 0x00, 0x00
@@ -295,42 +571,118 @@ TEST(keep_alive)
 
     start_client_and_connect_to_server();
 
-    /* Make the keep alive timer expire and receive a ping message. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_start_keep_alive_timer();
+    /* Make the keep alive timer expire after two seconds and receive
+       a ping message. The timer is restarted one tick later as the
+       current tick has already started. */
+    mock_prepare_timers_read(20);
     mock_prepare_write(SERVER_FD, &ping[0], sizeof(ping));
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 
     /* Send a pong message to the client. */
     mock_prepare_read(SERVER_FD, &pong[0], sizeof(pong));
-    mock_prepare_read_try_again();
 
     chat_client_process(&client, SERVER_FD, EPOLLIN);
 
     /* Make the keep alive timer expire again, receive a ping message,
        but do not respond with a pong message. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_start_keep_alive_timer();
+    mock_prepare_timers_read(21);
     mock_prepare_write(SERVER_FD, &ping[0], sizeof(ping));
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 
     /* Make the keep alive timer expire to detect the missing pong and
-       start the reconnect timer. Verify that the disconnected
-       callback is called. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_disconnect_and_start_reconnect_timer(
+       start the reconnect timer. The timerfd is disarmed when no
+       timer is running and armed again by the reconnect
+       timer. Verify that the disconnected callback is called. */
+    mock_prepare_timers_read(21);
+    mock_prepare_disconnect();
+    mock_prepare_disarm_timers();
+    client_on_disconnected_mock_once(
         messi_disconnect_reason_keep_alive_timeout_t);
+    mock_prepare_start_timer();
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 
     /* Make the reconnect timer expire and perform a successful
        connect to the server. */
-    mock_prepare_close_fd(RECONNECT_TIMER_FD);
+    mock_prepare_timers_read(10);
     mock_prepare_connect_to_server("127.0.0.1", 6000);
 
-    chat_client_process(&client, RECONNECT_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    /* Statistics of both connections. */
+    chat_client_get_stats(&client, &stats);
+    ASSERT_EQ(stats.messages_in, 2);
+    ASSERT_EQ(stats.messages_out, 4);
+    ASSERT_EQ(stats.bytes_in, sizeof(connect_rsp) + sizeof(pong));
+    ASSERT_EQ(stats.bytes_out, 2 * sizeof(connect_req) + 2 * sizeof(ping));
+    ASSERT_EQ(stats.reads, 2);
+    ASSERT_EQ(stats.writes, 4);
+    ASSERT_EQ(stats.eagains, 0);
+    ASSERT_EQ(stats.keep_alive_misses, 1);
+}
+
+static void receive_message_ind()
+{
+    struct chat_message_ind_t message;
+
+    mock_prepare_read(SERVER_FD, &message_ind_in[0], sizeof(message_ind_in));
+    message.user_p = "Erik";
+    message.text_p = "Hello.";
+    client_on_message_ind_mock_once();
+    client_on_message_ind_mock_set_message_p_in(&message, sizeof(message));
+    client_on_message_ind_mock_set_message_p_in_assert(assert_on_message_ind);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+}
+
+TEST(keep_alive_suppressed_by_traffic)
+{
+    uint8_t ping[] = {
+        /* Header. */
+        0x03, 0x00, 0x00, 0x00
+    };
+
+    start_client_and_connect_to_server();
+
+    /* Receive and send a message after one second. */
+    mock_prepare_timers_read(10);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    receive_message_ind();
+    mock_prepare_write(SERVER_FD, &message_ind_out[0], sizeof(message_ind_out));
+    send_message_ind();
+
+    /* The keep alive timer expires after two seconds, but no ping is
+       sent as the connection was used one second ago. The timer is
+       restarted to expire one second (and one tick) later. */
+    mock_prepare_timers_read(10);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    /* Only receive a message. */
+    mock_prepare_timers_read(5);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    receive_message_ind();
+
+    /* Nothing has been sent for more than two seconds, so a ping is
+       sent. */
+    mock_prepare_timers_read(6);
+    mock_prepare_write(SERVER_FD, &ping[0], sizeof(ping));
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    /* Any message, not only a pong, is accepted as the ping response,
+       and a new ping is sent when idle again. */
+    receive_message_ind();
+    mock_prepare_timers_read(21);
+    mock_prepare_write(SERVER_FD, &ping[0], sizeof(ping));
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 }
 
 TEST(keep_alive_ping_write_error_disconnect)
@@ -343,14 +695,13 @@ TEST(keep_alive_ping_write_error_disconnect)
     start_client_and_connect_to_server();
 
     /* Make the keep alive timer expire and receive a ping message. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_start_keep_alive_timer();
+    mock_prepare_timers_read(20);
     write_mock_once(SERVER_FD, sizeof(ping), -1);
     write_mock_set_errno(EIO);
     mock_prepare_disconnect_and_start_reconnect_timer(
-        messi_disconnect_reason_general_error_t);
+        messi_disconnect_reason_connection_closed_t);
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 }
 
 TEST(server_disconnects)
@@ -358,7 +709,7 @@ TEST(server_disconnects)
     start_client_and_connect_to_server();
 
     /* Make the server disconnect from the client. */
-    read_mock_once(SERVER_FD, HEADER_SIZE, 0);
+    read_mock_once(SERVER_FD, INPUT_BUFFER_SIZE, 0);
     mock_prepare_disconnect_and_start_reconnect_timer(
         messi_disconnect_reason_connection_closed_t);
 
@@ -373,16 +724,14 @@ TEST(partial_message_read)
     start_client_and_connect_to_server();
 
     /* Read a message partially (in multiple chunks). */
-    read_mock_once(SERVER_FD, 4, 1);
-    read_mock_set_buf_out(&message_ind_in[0], 1);
-    read_mock_once(SERVER_FD, 3, 2);
-    read_mock_set_buf_out(&message_ind_in[1], 2);
-    read_mock_once(SERVER_FD, 1, 1);
-    read_mock_set_buf_out(&message_ind_in[3], 1);
-    read_mock_once(SERVER_FD, 16, 5);
-    read_mock_set_buf_out(&message_ind_in[4], 5);
-    read_mock_once(SERVER_FD, 11, -1);
-    read_mock_set_errno(EAGAIN);
+    mock_prepare_read(SERVER_FD, &message_ind_in[0], 3);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    mock_prepare_read_free(SERVER_FD,
+                           INPUT_BUFFER_SIZE - 3,
+                           &message_ind_in[3],
+                           6);
 
     chat_client_process(&client, SERVER_FD, EPOLLIN);
 
@@ -394,8 +743,10 @@ TEST(partial_message_read)
     chat_client_send(&client);
 
     /* Read the end of the message. */
-    mock_prepare_read(SERVER_FD, &message_ind_in[9], 11);
-    mock_prepare_read_try_again(SERVER_FD);
+    mock_prepare_read_free(SERVER_FD,
+                           INPUT_BUFFER_SIZE - 9,
+                           &message_ind_in[9],
+                           11);
     client_on_message_ind_mock_once();
     message.user_p = "Erik";
     message.text_p = "Hello.";
@@ -405,6 +756,31 @@ TEST(partial_message_read)
     chat_client_process(&client, SERVER_FD, EPOLLIN);
 }
 
+TEST(many_messages_in_one_read)
+{
+    struct chat_message_ind_t message;
+    uint8_t messages[2 * sizeof(message_ind_in)];
+
+    start_client_and_connect_to_server();
+
+    /* Two messages in a single read. */
+    memcpy(&messages[0], &message_ind_in[0], sizeof(message_ind_in));
+    memcpy(&messages[sizeof(message_ind_in)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+    mock_prepare_read(SERVER_FD, &messages[0], sizeof(messages));
+    message.user_p = "Erik";
+    message.text_p = "Hello.";
+    client_on_message_ind_mock_once();
+    client_on_message_ind_mock_set_message_p_in(&message, sizeof(message));
+    client_on_message_ind_mock_set_message_p_in_assert(assert_on_message_ind);
+    client_on_message_ind_mock_once();
+    client_on_message_ind_mock_set_message_p_in(&message, sizeof(message));
+    client_on_message_ind_mock_set_message_p_in_assert(assert_on_message_ind);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+}
+
 TEST(send_another_message_after_first_failed)
 {
     struct chat_message_ind_t *message_p;
@@ -414,6 +790,7 @@ TEST(send_another_message_after_first_failed)
     /* Send a message to the server with write failing. The client
        will be put in the pending disconnect state. */
     write_mock_once(SERVER_FD, sizeof(message_ind_out), -1);
+    write_mock_set_errno(EIO);
     mock_prepare_close_fd(SERVER_FD);
 
     message_p = chat_client_init_message_ind(&client);
@@ -427,14 +804,125 @@ TEST(send_another_message_after_first_failed)
 
     /* Make the keep alive timer expire. The client should be
        disconnected and start the reconnect timer. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_start_keep_alive_timer();
+    mock_prepare_timers_read(20);
     write_mock_once(-1, HEADER_SIZE, -1);
-    mock_prepare_close_fd(KEEP_ALIVE_TIMER_FD);
     client_on_disconnected_mock_once(messi_disconnect_reason_connection_closed_t);
-    mock_prepare_start_reconnect_timer();
+    mock_prepare_start_timer();
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+}
+
+TEST(send_partial_write)
+{
+    struct iovec iov[2];
+
+    start_client_and_connect_to_server();
+
+    /* Only five bytes are written. The rest is enqueued and written
+       when the socket is writable. */
+    write_mock_once(SERVER_FD, sizeof(message_ind_out), 5);
+    write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
+    mock_prepare_write_eagain(SERVER_FD,
+                              &message_ind_out[5],
+                              sizeof(message_ind_out) - 5);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, SERVER_FD, 0);
+
+    send_message_ind();
+
+    ASSERT_EQ(chat_client_output_bytes(&client), sizeof(message_ind_out) - 5);
+
+    /* Enqueued after the first message without writing. */
+    send_message_ind();
+
+    ASSERT_EQ(chat_client_output_bytes(&client),
+              2 * sizeof(message_ind_out) - 5);
+
+    /* Write both, and only wait for input again. */
+    iov[0].iov_base = &message_ind_out[5];
+    iov[0].iov_len = sizeof(message_ind_out) - 5;
+    iov[1].iov_base = &message_ind_out[0];
+    iov[1].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(SERVER_FD, &iov[0], 2, 2 * sizeof(message_ind_out) - 5);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, SERVER_FD, 0);
+
+    chat_client_process(&client, SERVER_FD, EPOLLOUT);
+
+    ASSERT_EQ(chat_client_output_bytes(&client), 0);
+}
+
+TEST(output_watermarks)
+{
+    struct iovec iov[3];
+
+    start_client_and_connect_to_server();
+    chat_client_set_output_watermarks(&client,
+                                      2 * sizeof(message_ind_out),
+                                      sizeof(message_ind_out),
+                                      client_on_writable_changed);
+
+    /* The first message is enqueued, below the high watermark. */
+    mock_prepare_write_eagain(SERVER_FD,
+                              &message_ind_out[0],
+                              sizeof(message_ind_out));
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, SERVER_FD, 0);
+
+    send_message_ind();
+
+    /* The second message reaches the high watermark. */
+    client_on_writable_changed_mock_once(false);
+
+    send_message_ind();
+
+    /* Already not writable. */
+    send_message_ind();
+
+    /* Written down to above the low watermark. */
+    iov[0].iov_base = &message_ind_out[0];
+    iov[0].iov_len = sizeof(message_ind_out);
+    iov[1].iov_base = &message_ind_out[0];
+    iov[1].iov_len = sizeof(message_ind_out);
+    iov[2].iov_base = &message_ind_out[0];
+    iov[2].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(SERVER_FD, &iov[0], 3, sizeof(message_ind_out) + 5);
+
+    chat_client_process(&client, SERVER_FD, EPOLLOUT);
+
+    /* Written down to the low watermark. Writable again. */
+    iov[0].iov_base = &message_ind_out[5];
+    iov[0].iov_len = sizeof(message_ind_out) - 5;
+    mock_prepare_writev(SERVER_FD, &iov[0], 2, sizeof(message_ind_out) - 5);
+    client_on_writable_changed_mock_once(true);
+
+    chat_client_process(&client, SERVER_FD, EPOLLOUT);
+
+    ASSERT_EQ(chat_client_output_bytes(&client), sizeof(message_ind_out));
+}
+
+TEST(output_buffer_full)
+{
+    static uint8_t buf[sizeof(message_ind_out) + 4];
+
+    start_client_and_connect_to_server();
+    chat_client_set_output_buffer(&client, &buf[0], sizeof(buf));
+
+    /* The first message is enqueued in given buffer. */
+    mock_prepare_write_eagain(SERVER_FD,
+                              &message_ind_out[0],
+                              sizeof(message_ind_out));
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, SERVER_FD, 0);
+
+    send_message_ind();
+
+    /* The second does not fit. Disconnect, as the stream would be
+       corrupt if it was dropped. */
+    mock_prepare_close_fd(SERVER_FD);
+
+    send_message_ind();
+
+    client_on_disconnected_mock_once(messi_disconnect_reason_connection_closed_t);
+    mock_prepare_start_timer();
+
+    chat_client_process_deferred(&client);
 }
 
 TEST(encode_error)
@@ -460,14 +948,12 @@ TEST(encode_error)
 
     /* Make the keep alive timer expire. The client should be
        disconnected and start the reconnect timer. */
-    mock_prepare_timer_read(KEEP_ALIVE_TIMER_FD);
-    mock_prepare_start_keep_alive_timer();
+    mock_prepare_timers_read(20);
     write_mock_once(-1, HEADER_SIZE, -1);
-    mock_prepare_close_fd(KEEP_ALIVE_TIMER_FD);
     client_on_disconnected_mock_once(messi_disconnect_reason_message_encode_error_t);
-    mock_prepare_start_reconnect_timer();
+    mock_prepare_start_timer();
 
-    chat_client_process(&client, KEEP_ALIVE_TIMER_FD, EPOLLIN);
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
 }
 
 TEST(decode_error)
@@ -484,10 +970,7 @@ TEST(decode_error)
     mock_prepare_disconnect_and_start_reconnect_timer(
         messi_disconnect_reason_message_decode_error_t);
 
-    mock_prepare_read(SERVER_FD, &malformed_message[0], 4);
-    mock_prepare_read(SERVER_FD, &malformed_message[4], 1);
-    read_mock_once(-1, HEADER_SIZE, -1);
-    read_mock_set_errno(EIO);
+    mock_prepare_read(SERVER_FD, &malformed_message[0], sizeof(malformed_message));
 
     chat_client_process(&client, SERVER_FD, EPOLLIN);
 }
@@ -529,9 +1012,325 @@ TEST(received_message_too_big)
     start_client_and_connect_to_server();
 
     /* Read a message that does not fit in the receive buffer. */
-    mock_prepare_read(SERVER_FD, &big_message[0], 4);
+    mock_prepare_read(SERVER_FD, &big_message[0], HEADER_SIZE);
     mock_prepare_disconnect_and_start_reconnect_timer(
         messi_disconnect_reason_message_too_big_t);
 
     chat_client_process(&client, SERVER_FD, EPOLLIN);
 }
+
+TEST(send_batch)
+{
+    struct chat_message_ind_t *message_p;
+    uint8_t batch[4 + 2 * sizeof(message_ind_out)];
+    int i;
+
+    start_client_and_connect_to_server();
+
+    /* Both messages in one frame and write. */
+    memcpy(&batch[0], "\x06\x00\x00\x1a", 4);
+    memcpy(&batch[4], &message_ind_out[0], sizeof(message_ind_out));
+    memcpy(&batch[4 + sizeof(message_ind_out)],
+           &message_ind_out[0],
+           sizeof(message_ind_out));
+    mock_prepare_write(SERVER_FD, &batch[0], sizeof(batch));
+
+    for (i = 0; i < 2; i++) {
+        message_p = chat_client_init_message_ind(&client);
+        message_p->user_p = "Kalle";
+        chat_client_add_to_batch(&client);
+    }
+
+    chat_client_send_batch(&client);
+
+    /* Nothing more to send. */
+    chat_client_send_batch(&client);
+}
+
+TEST(receive_batch)
+{
+    struct chat_message_ind_t message;
+    uint8_t batch[4 + 2 * sizeof(message_ind_in)];
+    int i;
+
+    start_client_and_connect_to_server();
+
+    memcpy(&batch[0], "\x06\x00\x00\x28", 4);
+    memcpy(&batch[4], &message_ind_in[0], sizeof(message_ind_in));
+    memcpy(&batch[4 + sizeof(message_ind_in)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+    mock_prepare_read(SERVER_FD, &batch[0], sizeof(batch));
+    message.user_p = "Erik";
+    message.text_p = "Hello.";
+
+    for (i = 0; i < 2; i++) {
+        client_on_message_ind_mock_once();
+        client_on_message_ind_mock_set_message_p_in(&message, sizeof(message));
+        client_on_message_ind_mock_set_message_p_in_assert(assert_on_message_ind);
+    }
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+}
+
+TEST(receive_compressed)
+{
+    struct chat_message_ind_t message;
+    uint8_t compressed[10 + 2 + sizeof(message_ind_in) - 4];
+
+    start_client_and_connect_to_server();
+
+    /* A literals only LZ4 block. */
+    memcpy(&compressed[0], "\x07\x00\x00\x18\x02\x01\x00\x00\x00\x10", 10);
+    memcpy(&compressed[10], "\xf0\x01", 2);
+    memcpy(&compressed[12], &message_ind_in[4], sizeof(message_ind_in) - 4);
+    mock_prepare_read(SERVER_FD, &compressed[0], sizeof(compressed));
+    message.user_p = "Erik";
+    message.text_p = "Hello.";
+    client_on_message_ind_mock_once();
+    client_on_message_ind_mock_set_message_p_in(&message, sizeof(message));
+    client_on_message_ind_mock_set_message_p_in_assert(assert_on_message_ind);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+}
+
+static struct {
+    int count;
+    enum messi_request_status_t status;
+    int choice;
+    void *obj_p;
+} response;
+
+static void on_response(struct chat_client_t *self_p,
+                        enum messi_request_status_t status,
+                        struct chat_server_to_client_t *message_p,
+                        void *obj_p)
+{
+    (void)self_p;
+
+    response.count++;
+    response.status = status;
+    response.obj_p = obj_p;
+
+    if (message_p != NULL) {
+        response.choice = message_p->messages.choice;
+    } else {
+        response.choice = -1;
+    }
+}
+
+/* Send a MessageInd request with given id. */
+static int request_message_ind(int timeout_ms,
+                               const uint8_t *id_p,
+                               void *obj_p)
+{
+    struct chat_message_ind_t *message_p;
+    uint8_t request[4 + 4 + sizeof(message_ind_out) - 4];
+
+    memcpy(&request[0], "\x08\x00\x00\x0d", 4);
+    memcpy(&request[4], id_p, 4);
+    memcpy(&request[8], &message_ind_out[4], sizeof(message_ind_out) - 4);
+    mock_prepare_write(SERVER_FD, &request[0], sizeof(request));
+    message_p = chat_client_init_message_ind(&client);
+    message_p->user_p = "Kalle";
+
+    return (chat_client_request(&client, timeout_ms, on_response, obj_p));
+}
+
+TEST(request_response)
+{
+    static struct chat_client_request_t requests[2];
+    int a;
+    int b;
+    uint8_t response_a[] = {
+        /* Header. */
+        0x09, 0x00, 0x00, 0x06,
+        /* Correlation id. */
+        0x00, 0x01, 0x00, 0x00,
+        /* Payload. */
+        0x0a, 0x00
+    };
+    uint8_t response_b[4 + 4 + sizeof(message_ind_in) - 4];
+
+    memset(&response, 0, sizeof(response));
+    start_client_and_connect_to_server();
+
+    /* Requests are disabled by default. */
+    chat_client_init_message_ind(&client);
+
+    ASSERT_EQ(chat_client_request(&client, 1000, on_response, NULL), -1);
+
+    /* Two requests in flight, with sequence number and window index
+       in their ids. */
+    chat_client_set_requests(&client, &requests[0], 2);
+
+    ASSERT_EQ(request_message_ind(1000, (uint8_t *)"\x00\x01\x00\x00", &a), 0);
+    ASSERT_EQ(request_message_ind(1000, (uint8_t *)"\x00\x02\x00\x01", &b), 0);
+    ASSERT_EQ(chat_client_requests_in_flight(&client), 2);
+
+    /* The window is full. */
+    chat_client_init_message_ind(&client);
+
+    ASSERT_EQ(chat_client_request(&client, 1000, on_response, NULL), -1);
+
+    /* Responses in any order. */
+    memcpy(&response_b[0], "\x09\x00\x00\x14\x00\x02\x00\x01", 8);
+    memcpy(&response_b[8], &message_ind_in[4], sizeof(message_ind_in) - 4);
+    mock_prepare_read(SERVER_FD, &response_b[0], sizeof(response_b));
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 1);
+    ASSERT_EQ(response.status, messi_request_status_ok_t);
+    ASSERT_EQ(response.choice, chat_server_to_client_messages_choice_message_ind_e);
+    ASSERT_EQ(response.obj_p, &b);
+    ASSERT_EQ(chat_client_requests_in_flight(&client), 1);
+
+    /* A response to no request in flight is dropped. */
+    mock_prepare_read(SERVER_FD, &response_b[0], sizeof(response_b));
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 1);
+
+    mock_prepare_read(SERVER_FD, &response_a[0], sizeof(response_a));
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 2);
+    ASSERT_EQ(response.status, messi_request_status_ok_t);
+    ASSERT_EQ(response.choice, chat_server_to_client_messages_choice_connect_rsp_e);
+    ASSERT_EQ(response.obj_p, &a);
+    ASSERT_EQ(chat_client_requests_in_flight(&client), 0);
+}
+
+TEST(request_timeout)
+{
+    static struct chat_client_request_t requests[1];
+    uint8_t late_response[] = {
+        /* Header. */
+        0x09, 0x00, 0x00, 0x06,
+        /* Correlation id. */
+        0x00, 0x01, 0x00, 0x00,
+        /* Payload. */
+        0x0a, 0x00
+    };
+
+    memset(&response, 0, sizeof(response));
+    start_client_and_connect_to_server();
+    chat_client_set_requests(&client, &requests[0], 1);
+
+    ASSERT_EQ(request_message_ind(500, (uint8_t *)"\x00\x01\x00\x00", NULL), 0);
+
+    /* No response within 500 ms. The timer expires one tick later as
+       the current tick has already started. */
+    mock_prepare_timers_read(6);
+
+    chat_client_process(&client, TIMERS_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 1);
+    ASSERT_EQ(response.status, messi_request_status_timeout_t);
+    ASSERT_EQ(response.choice, -1);
+    ASSERT_EQ(chat_client_requests_in_flight(&client), 0);
+
+    /* The late response is dropped. */
+    mock_prepare_read(SERVER_FD, &late_response[0], sizeof(late_response));
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 1);
+}
+
+TEST(request_disconnected)
+{
+    static struct chat_client_request_t requests[1];
+
+    memset(&response, 0, sizeof(response));
+    start_client_and_connect_to_server();
+    chat_client_set_requests(&client, &requests[0], 1);
+
+    ASSERT_EQ(request_message_ind(1000, (uint8_t *)"\x00\x01\x00\x00", NULL), 0);
+
+    /* Completed when disconnected. */
+    read_mock_once(SERVER_FD, INPUT_BUFFER_SIZE, 0);
+    mock_prepare_disconnect_and_start_reconnect_timer(
+        messi_disconnect_reason_connection_closed_t);
+
+    chat_client_process(&client, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(response.count, 1);
+    ASSERT_EQ(response.status, messi_request_status_disconnected_t);
+    ASSERT_EQ(chat_client_requests_in_flight(&client), 0);
+
+    /* No requests while disconnected. */
+    chat_client_init_message_ind(&client);
+
+    ASSERT_EQ(chat_client_request(&client, 1000, on_response, NULL), -1);
+}
+
+TEST(client_group)
+{
+    static struct chat_client_t clients[2];
+    static uint8_t clients_encoded_in[2][INPUT_BUFFER_SIZE];
+    static uint8_t clients_workspace_in[2][128];
+    static uint8_t clients_encoded_out[2][128];
+    static uint8_t clients_workspace_out[2][128];
+    struct chat_client_group_t group;
+    int i;
+
+    /* Each client has its own buffers. */
+    for (i = 0; i < 2; i++) {
+        ASSERT_EQ(chat_client_init(&clients[i],
+                                   "tcp://127.0.0.1:6000",
+                                   &clients_encoded_in[i][0],
+                                   sizeof(clients_encoded_in[i]),
+                                   &clients_workspace_in[i][0],
+                                   sizeof(clients_workspace_in[i]),
+                                   &clients_encoded_out[i][0],
+                                   sizeof(clients_encoded_out[i]),
+                                   &clients_workspace_out[i][0],
+                                   sizeof(clients_workspace_out[i]),
+                                   on_connected,
+                                   client_on_disconnected,
+                                   client_on_connect_rsp,
+                                   client_on_message_ind,
+                                   EPOLL_FD,
+                                   NULL), 0);
+    }
+
+    /* A group must have at least one client. */
+    ASSERT_EQ(chat_client_group_init(&group, &clients[0], 0), -1);
+    ASSERT_EQ(chat_client_group_init(&group, &clients[0], 2), 0);
+
+    /* No client is connected. */
+    ASSERT_EQ(chat_client_group_next(&group), NULL);
+
+    /* Connect the first client only. */
+    mock_prepare_start_client();
+    mock_prepare_connect_to_server("127.0.0.1", 6000);
+
+    chat_client_start(&clients[0]);
+
+    /* Round-robin over connected clients. */
+    ASSERT_EQ(chat_client_group_next(&group), &clients[0]);
+    ASSERT_EQ(chat_client_group_next(&group), &clients[0]);
+
+    /* A key always selects the same client, connected or not. */
+    ASSERT_EQ(chat_client_group_select(&group, 4), &clients[0]);
+    ASSERT_EQ(chat_client_group_select(&group, 7), &clients[1]);
+
+    /* Events are processed by the client they belong to. */
+    mock_prepare_read(SERVER_FD, &connect_rsp[0], sizeof(connect_rsp));
+    client_on_connect_rsp_mock_once();
+
+    chat_client_group_process(&group, SERVER_FD, EPOLLIN);
+
+    ASSERT_EQ(chat_client_group_process_event(&group, 99, EPOLLIN), -1);
+
+    /* Stop both clients. */
+    mock_prepare_disconnect();
+    mock_prepare_close_fd(TIMERS_FD);
+    mock_prepare_close_fd(-1);
+
+    chat_client_group_stop(&group);
+}
@@ -1,9 +1,13 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include "nala.h"
 #include "chat_server.h"
@@ -13,19 +17,12 @@
 #define ERIK_FD                             11
 #define KALLE_FD                            12
 #define FIA_FD                              13
-#define ERIK_TIMER_FD                       14
-#define KALLE_TIMER_FD                      15
-#define FIA_TIMER_FD                        16
-#define KEEP_ALIVE_TIMER_FD                 17
+#define TIMERS_FD                           17
 #define LISA_FD                             18
-#define LISA_TIMER_FD                       21
+#define JOHN_FD                             19
 
 #define HEADER_SIZE sizeof(struct messi_header_t)
-
-static inline int client_to_timer_fd(int client_fd)
-{
-    return (client_fd + 3);
-}
+#define INPUT_BUFFER_SIZE                   128
 
 static uint8_t connect_req_erik[] = {
     /* Header. */
@@ -79,12 +76,26 @@ static uint8_t message_ind_out[] = {
     0x12, 0x06, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e
 };
 
+/**
+ * user: Erik
+ * text: Hello.
+ */
+static uint8_t message_ind_in_extended[] = {
+    /* Extended header. */
+    0x05, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    /* Payload. */
+    0x12, 0x0e, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+    0x12, 0x06, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e
+};
+
 static struct chat_server_t server;
 static struct chat_server_client_t clients[3];
-static uint8_t clients_input_buffers[3][128];
+static uint8_t clients_input_buffers[3][INPUT_BUFFER_SIZE];
 static uint8_t message[128];
 static uint8_t workspace_in[128];
 static uint8_t workspace_out[128];
+static bool timers_armed;
 
 static void mock_prepare_make_non_blocking(int fd)
 {
@@ -92,6 +103,17 @@ static void mock_prepare_make_non_blocking(int fd)
     fcntl_mock_once(fd, F_SETFL, O_NONBLOCK, "");
 }
 
+static void mock_prepare_accept(int client_fd)
+{
+    accept4_mock_once(LISTENER_FD, SOCK_NONBLOCK, client_fd);
+}
+
+static void mock_prepare_accept_queue_empty(void)
+{
+    accept4_mock_once(LISTENER_FD, SOCK_NONBLOCK, -1);
+    accept4_mock_set_errno(EAGAIN);
+}
+
 static void mock_prepare_tcp_nodelay(int fd)
 {
     int yes;
@@ -101,20 +123,51 @@ static void mock_prepare_tcp_nodelay(int fd)
     setsockopt_mock_set_optval_in(&yes, sizeof(yes));
 }
 
-static void mock_prepare_read(int client_fd, uint8_t *buf_p, size_t size)
+static void mock_prepare_timers_settime(long period_ms)
 {
-    read_mock_once(client_fd, HEADER_SIZE, HEADER_SIZE);
-    read_mock_set_buf_out(&buf_p[0], HEADER_SIZE);
+    struct itimerspec timeout;
+
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.it_value.tv_nsec = (1000000L * period_ms);
+    timeout.it_interval = timeout.it_value;
+    timerfd_settime_mock_once(TIMERS_FD, 0, 0);
+    timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
+}
 
-    if (size > HEADER_SIZE) {
-        read_mock_once(client_fd, size - HEADER_SIZE, size - HEADER_SIZE);
-        read_mock_set_buf_out(&buf_p[HEADER_SIZE], size - HEADER_SIZE);
+static void mock_prepare_start_keep_alive_timer(void)
+{
+    /* The timerfd is only armed when the first timer is started. */
+    if (!timers_armed) {
+        mock_prepare_timers_settime(100);
+        timers_armed = true;
     }
 }
 
+static void mock_prepare_timers_read(uint64_t ticks)
+{
+    read_mock_once(TIMERS_FD, sizeof(ticks), sizeof(ticks));
+    read_mock_set_buf_out(&ticks, sizeof(ticks));
+}
+
+/* Read into given free space of the input buffer. A read that does
+   not fill the buffer ends reading as the socket is drained. */
+static void mock_prepare_read_free(int client_fd,
+                                   size_t free_size,
+                                   uint8_t *buf_p,
+                                   size_t size)
+{
+    read_mock_once(client_fd, free_size, size);
+    read_mock_set_buf_out(buf_p, size);
+}
+
+static void mock_prepare_read(int client_fd, uint8_t *buf_p, size_t size)
+{
+    mock_prepare_read_free(client_fd, INPUT_BUFFER_SIZE, buf_p, size);
+}
+
 static void mock_prepare_read_try_again(int client_fd)
 {
-    read_mock_once(client_fd, HEADER_SIZE, -1);
+    read_mock_once(client_fd, INPUT_BUFFER_SIZE, -1);
     read_mock_set_errno(EAGAIN);
 }
 
@@ -129,6 +182,32 @@ static void mock_prepare_write(int client_fd,
     write_mock_set_errno(error);
 }
 
+static void assert_iov(const struct iovec *actual_p,
+                       const struct iovec *expected_p,
+                       size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size / sizeof(*actual_p); i++) {
+        ASSERT_EQ(actual_p[i].iov_len, expected_p[i].iov_len);
+        ASSERT_MEMORY_EQ(actual_p[i].iov_base,
+                         expected_p[i].iov_base,
+                         expected_p[i].iov_len);
+    }
+}
+
+static void mock_prepare_writev(int client_fd,
+                                struct iovec *iov_p,
+                                int iovcnt,
+                                ssize_t res,
+                                int error)
+{
+    writev_mock_once(client_fd, iovcnt, res);
+    writev_mock_set_iov_in(iov_p, sizeof(*iov_p) * iovcnt);
+    writev_mock_set_iov_in_assert(assert_iov);
+    writev_mock_set_errno(error);
+}
+
 static void on_connect_req(struct chat_server_t *self_p,
                            struct chat_server_client_t *client_p,
                            struct chat_connect_req_t *message_p)
@@ -159,27 +238,19 @@ static struct chat_server_client_t *connect_client(uint8_t *connect_req_buf_p,
                                                    size_t connect_req_size,
                                                    int client_fd)
 {
-    struct itimerspec timeout;
     int handle;
 
     /* TCP connect. */
-    accept_mock_once(LISTENER_FD, client_fd);
-    mock_prepare_make_non_blocking(client_fd);
-    mock_prepare_tcp_nodelay(client_fd);
-    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, client_to_timer_fd(client_fd));
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 3;
-    timerfd_settime_mock_once(client_to_timer_fd(client_fd), 0, 0);
-    timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, client_to_timer_fd(client_fd), 0);
+    mock_prepare_accept(client_fd);
+    mock_prepare_start_keep_alive_timer();
     epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, client_fd, 0);
     handle = server_on_client_connected_mock_once();
+    mock_prepare_accept_queue_empty();
 
     chat_server_process(&server, LISTENER_FD, EPOLLIN);
 
     /* Chat connect messages. */
     mock_prepare_read(client_fd, connect_req_buf_p, connect_req_size);
-    mock_prepare_read_try_again(client_fd);
     write_mock_once(client_fd, sizeof(connect_rsp), sizeof(connect_rsp));
     write_mock_set_buf_in(&connect_rsp[0], sizeof(connect_rsp));
 
@@ -194,23 +265,18 @@ static void mock_prepare_client_pending_disconnect(int client_fd)
     close_mock_once(client_fd, 0);
 }
 
-static void mock_prepare_destroy_pending_disconnect_client(int client_fd)
+static void mock_prepare_destroy_pending_disconnect_client(void)
 {
-    close_mock_once(client_to_timer_fd(client_fd), 0);
-    epoll_ctl_mock_once(EPOLL_FD,
-                        EPOLL_CTL_DEL,
-                        client_to_timer_fd(client_fd),
-                        0);
     server_on_client_disconnected_mock_once();
 }
 
 static void disconnect_client(int client_fd)
 {
     /* TCP disconnect. */
-    read_mock_once(client_fd, HEADER_SIZE, -1);
+    read_mock_once(client_fd, INPUT_BUFFER_SIZE, -1);
     read_mock_set_errno(EPIPE);
     mock_prepare_client_pending_disconnect(client_fd);
-    mock_prepare_destroy_pending_disconnect_client(client_fd);
+    mock_prepare_destroy_pending_disconnect_client();
 
     chat_server_process(&server, client_fd, EPOLLIN);
 }
@@ -269,10 +335,19 @@ void server_on_client_disconnected(struct chat_server_t *self_p,
     FAIL("Must be mocked.");
 }
 
-static void start_server_with_three_clients()
+void server_on_client_writable_changed(struct chat_server_t *self_p,
+                                       struct chat_server_client_t *client_p,
+                                       bool writable)
 {
-    int enable;
+    (void)self_p;
+    (void)client_p;
+    (void)writable;
+
+    FAIL("Must be mocked.");
+}
 
+static void init_server_with_three_clients()
+{
     ASSERT_EQ(chat_server_init(&server,
                                "tcp://127.0.0.1:6000",
                                &clients[0],
@@ -291,20 +366,35 @@ static void start_server_with_three_clients()
                                server_on_message_ind,
                                EPOLL_FD,
                                NULL), 0);
+}
+
+static void start_server()
+{
+    int enable;
 
     /* Start creates a socket and starts listening for clients. */
     socket_mock_once(AF_INET, SOCK_STREAM, 0, LISTENER_FD);
     enable = 1;
     setsockopt_mock_once(LISTENER_FD, SOL_SOCKET, SO_REUSEADDR, sizeof(enable), 0);
     setsockopt_mock_set_optval_in(&enable, sizeof(enable));
+    mock_prepare_tcp_nodelay(LISTENER_FD);
     bind_mock_once(LISTENER_FD, sizeof(struct sockaddr_in), 0);
     listen_mock_once(LISTENER_FD, 5, 0);
     mock_prepare_make_non_blocking(LISTENER_FD);
     epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, LISTENER_FD, 0);
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, TIMERS_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, TIMERS_FD, 0);
+    timers_armed = false;
 
     ASSERT_EQ(chat_server_start(&server), 0);
 }
 
+static void start_server_with_three_clients()
+{
+    init_server_with_three_clients();
+    start_server();
+}
+
 TEST(connect_and_disconnect_clients)
 {
     start_server_with_three_clients();
@@ -323,11 +413,8 @@ TEST(connect_and_disconnect_clients)
     close_mock_once(LISTENER_FD, 0);
     epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_DEL, KALLE_FD, 0);
     close_mock_once(KALLE_FD, 0);
-    epoll_ctl_mock_once(EPOLL_FD,
-                        EPOLL_CTL_DEL,
-                        client_to_timer_fd(KALLE_FD),
-                        0);
-    close_mock_once(client_to_timer_fd(KALLE_FD), 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_DEL, TIMERS_FD, 0);
+    close_mock_once(TIMERS_FD, 0);
 
     chat_server_stop(&server);
 }
@@ -343,7 +430,6 @@ TEST(broadcast_message)
 
     /* Broadcast a message as Fia. */
     mock_prepare_read(FIA_FD, &message_ind_in[0], sizeof(message_ind_in));
-    mock_prepare_read_try_again(FIA_FD);
     write_mock_once(FIA_FD, sizeof(message_ind_out), sizeof(message_ind_out));
     write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
     write_mock_once(KALLE_FD, sizeof(message_ind_out), sizeof(message_ind_out));
@@ -380,10 +466,12 @@ TEST(broadcast_message_one_client_fails)
     message_p->text_p = "Hello.";
     chat_server_broadcast(&server);
 
-    /* Make the keep alive timer expire to trigger disconnection. */
-    mock_prepare_destroy_pending_disconnect_client(KALLE_FD);
+    /* Process the timers to trigger disconnection. No keep alive
+       timer expires. */
+    mock_prepare_timers_read(1);
+    mock_prepare_destroy_pending_disconnect_client();
 
-    chat_server_process(&server, client_to_timer_fd(KALLE_FD), EPOLLIN);
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
 }
 
 TEST(keep_alive)
@@ -403,67 +491,90 @@ TEST(keep_alive)
     connect_erik();
 
     /* Send a ping message, the keep alive timer should be restarted
-       and a pong mesage should be sent. */
+       (without any system call) and a pong mesage should be sent. */
     mock_prepare_read(ERIK_FD, &ping[0], sizeof(ping));
-    mock_prepare_read_try_again(ERIK_FD);
-
-    timerfd_settime_mock_once(ERIK_TIMER_FD, 0, 0);
 
     write_mock_once(ERIK_FD, sizeof(pong), sizeof(pong));
     write_mock_set_buf_in(&pong[0], sizeof(pong));
 
     chat_server_process(&server, ERIK_FD, EPOLLIN);
 
+    /* Three seconds passes. The restarted keep alive timer should not
+       expire yet. */
+    mock_prepare_timers_read(30);
+
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
+
     /* Make the keep alive timer expire. The client should be
-       disconnected. */
+       disconnected and the timerfd disarmed as no timers are
+       running. */
+    mock_prepare_timers_read(1);
     mock_prepare_client_pending_disconnect(ERIK_FD);
-    mock_prepare_destroy_pending_disconnect_client(ERIK_FD);
+    mock_prepare_timers_settime(0);
+    mock_prepare_destroy_pending_disconnect_client();
 
-    chat_server_process(&server, ERIK_TIMER_FD, EPOLLIN);
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
 }
 
-TEST(error_starting_client_keep_alive_timer_in_init)
+TEST(keep_alive_restarted_by_any_data)
 {
-    struct itimerspec timeout;
+    init_server_with_three_clients();
+    chat_server_set_keep_alive_timeout(&server, 1000);
+    start_server();
+    connect_erik();
+
+    /* One second passes. */
+    mock_prepare_timers_read(10);
+
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
 
+    /* A user message restarts the keep alive timer like a ping. */
+    mock_prepare_read(ERIK_FD, &message_ind_in[0], sizeof(message_ind_in));
+    write_mock_once(ERIK_FD, sizeof(message_ind_out), sizeof(message_ind_out));
+    write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+
+    /* Another second passes. The restarted keep alive timer should
+       not expire yet. */
+    mock_prepare_timers_read(10);
+
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
+
+    /* Make the keep alive timer expire. */
+    mock_prepare_timers_read(1);
+    mock_prepare_client_pending_disconnect(ERIK_FD);
+    mock_prepare_timers_settime(0);
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
+}
+
+TEST(error_starting_client_keep_alive_timer_in_init)
+{
     start_server_with_three_clients();
 
-    /* Make starting the timer fail. Verify that file descriptors are
-       closed. */
-    accept_mock_once(LISTENER_FD, ERIK_FD);
-    mock_prepare_make_non_blocking(ERIK_FD);
-    mock_prepare_tcp_nodelay(ERIK_FD);
-    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, ERIK_TIMER_FD);
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 3;
-    timerfd_settime_mock_once(ERIK_TIMER_FD, 0, -1);
-    close_mock_once(ERIK_TIMER_FD, 0);
+    /* Make arming the timerfd fail. Verify that the client file
+       descriptor is closed. */
+    mock_prepare_accept(ERIK_FD);
+    timerfd_settime_mock_once(TIMERS_FD, 0, -1);
     close_mock_once(ERIK_FD, 0);
+    mock_prepare_accept_queue_empty();
 
     chat_server_process(&server, LISTENER_FD, EPOLLIN);
 }
 
 TEST(error_adding_client_fd_to_epoll)
 {
-    struct itimerspec timeout;
-
     start_server_with_three_clients();
 
     /* Make adding the client file descriptor to epoll instance
        fail. Verify that cleanup is ok. */
-    accept_mock_once(LISTENER_FD, ERIK_FD);
-    mock_prepare_make_non_blocking(ERIK_FD);
-    mock_prepare_tcp_nodelay(ERIK_FD);
-    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, ERIK_TIMER_FD);
-    memset(&timeout, 0, sizeof(timeout));
-    timeout.it_value.tv_sec = 3;
-    timerfd_settime_mock_once(ERIK_TIMER_FD, 0, 0);
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, ERIK_TIMER_FD, 0);
+    mock_prepare_accept(ERIK_FD);
+    mock_prepare_start_keep_alive_timer();
     epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, ERIK_FD, -1);
-
-    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_DEL, ERIK_TIMER_FD, 0);
-    close_mock_once(ERIK_TIMER_FD, 0);
     close_mock_once(ERIK_FD, 0);
+    mock_prepare_accept_queue_empty();
 
     chat_server_process(&server, LISTENER_FD, EPOLLIN);
 }
@@ -478,10 +589,9 @@ TEST(too_many_clients)
     connect_fia();
 
     /* Cannot connect another client. */
-    accept_mock_once(LISTENER_FD, LISA_FD);
-    mock_prepare_make_non_blocking(LISA_FD);
-    mock_prepare_tcp_nodelay(LISA_FD);
+    mock_prepare_accept(LISA_FD);
     close_mock_once(LISA_FD, 0);
+    mock_prepare_accept_queue_empty();
 
     chat_server_process(&server, LISTENER_FD, EPOLLIN);
 
@@ -518,6 +628,7 @@ TEST(listener_bind_error)
     enable = 1;
     setsockopt_mock_once(LISTENER_FD, SOL_SOCKET, SO_REUSEADDR, sizeof(enable), 0);
     setsockopt_mock_set_optval_in(&enable, sizeof(enable));
+    mock_prepare_tcp_nodelay(LISTENER_FD);
     bind_mock_once(LISTENER_FD, sizeof(struct sockaddr_in), -1);
     close_mock_once(LISTENER_FD, 0);
 
@@ -526,25 +637,26 @@ TEST(listener_bind_error)
 
 static void read_first_chunk_of_message(int client_fd)
 {
-    read_mock_once(client_fd, 4, 1);
-    read_mock_set_buf_out(&message_ind_in[0], 1);
-    read_mock_once(client_fd, 3, 2);
-    read_mock_set_buf_out(&message_ind_in[1], 2);
-    read_mock_once(client_fd, 1, 1);
-    read_mock_set_buf_out(&message_ind_in[3], 1);
-    read_mock_once(client_fd, 16, 5);
-    read_mock_set_buf_out(&message_ind_in[4], 5);
-    read_mock_once(client_fd, 11, -1);
-    read_mock_set_errno(EAGAIN);
+    /* Part of the header. */
+    mock_prepare_read(client_fd, &message_ind_in[0], 3);
+
+    chat_server_process(&server, client_fd, EPOLLIN);
+
+    /* The rest of the header and part of the payload. */
+    mock_prepare_read_free(client_fd,
+                           INPUT_BUFFER_SIZE - 3,
+                           &message_ind_in[3],
+                           6);
 
     chat_server_process(&server, client_fd, EPOLLIN);
 }
 
 static void read_last_chunk_of_message(int client_fd)
 {
-    read_mock_once(client_fd, 11, 11);
-    read_mock_set_buf_out(&message_ind_in[9], 11);
-    mock_prepare_read_try_again(client_fd);
+    mock_prepare_read_free(client_fd,
+                           INPUT_BUFFER_SIZE - 9,
+                           &message_ind_in[9],
+                           11);
 
     /* The received message is broadcasted. */
     write_mock_once(FIA_FD, sizeof(message_ind_out), sizeof(message_ind_out));
@@ -638,11 +750,11 @@ TEST(send_another_message_after_first_failed)
 
     chat_server_send(&server, kalle_p);
 
-    /* Make the keep alive timer expire. The client should be
-       disconnected. */
-    mock_prepare_destroy_pending_disconnect_client(KALLE_FD);
+    /* Process the timers. The client should be disconnected. */
+    mock_prepare_timers_read(1);
+    mock_prepare_destroy_pending_disconnect_client();
 
-    chat_server_process(&server, KALLE_TIMER_FD, EPOLLIN);
+    chat_server_process(&server, TIMERS_FD, EPOLLIN);
 }
 
 TEST(reply_with_no_currect_client)
@@ -674,7 +786,7 @@ TEST(disconnect_client_fia)
     chat_server_disconnect(&server, fia_p);
 
     /* Acutal disconnect next time process is called. */
-    mock_prepare_destroy_pending_disconnect_client(FIA_FD);
+    mock_prepare_destroy_pending_disconnect_client();
 
     chat_server_process(&server, ERIK_FD, EPOLLIN);
 }
@@ -696,17 +808,47 @@ TEST(disconnect_current_client)
 
     /* Make the server disconnect the client. */
     mock_prepare_read(FIA_FD, &message_ind_in[0], sizeof(message_ind_in));
-    /* The client fd is set to -1 by pending disconnect function,
-       ok? */
-    read_mock_once(-1, HEADER_SIZE, -1);
-    read_mock_set_errno(EIO);
     server_on_message_ind_mock_implementation(on_message_ind_disconnect);
     mock_prepare_client_pending_disconnect(FIA_FD);
-    mock_prepare_destroy_pending_disconnect_client(FIA_FD);
+    mock_prepare_destroy_pending_disconnect_client();
 
     chat_server_process(&server, FIA_FD, EPOLLIN);
 }
 
+TEST(many_messages_in_one_read)
+{
+    uint8_t pings[INPUT_BUFFER_SIZE];
+    uint8_t pong[] = {
+        /* Header. */
+        0x04, 0x00, 0x00, 0x00
+    };
+    size_t i;
+
+    start_server_with_three_clients();
+    connect_erik();
+
+    /* Fill the input buffer with ping messages in a single read. All
+       are handled before reading again, as the socket may have more
+       data. */
+    for (i = 0; i < sizeof(pings); i += HEADER_SIZE) {
+        pings[i + 0] = 0x03;
+        pings[i + 1] = 0x00;
+        pings[i + 2] = 0x00;
+        pings[i + 3] = 0x00;
+    }
+
+    mock_prepare_read(ERIK_FD, &pings[0], sizeof(pings));
+
+    for (i = 0; i < sizeof(pings); i += HEADER_SIZE) {
+        write_mock_once(ERIK_FD, sizeof(pong), sizeof(pong));
+        write_mock_set_buf_in(&pong[0], sizeof(pong));
+    }
+
+    mock_prepare_read_try_again(ERIK_FD);
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
 TEST(received_message_too_big)
 {
     uint8_t big_message[] = {
@@ -721,7 +863,7 @@ TEST(received_message_too_big)
        that does not fit in the receive buffer. */
     mock_prepare_read(FIA_FD, &big_message[0], sizeof(big_message));
     mock_prepare_client_pending_disconnect(FIA_FD);
-    mock_prepare_destroy_pending_disconnect_client(FIA_FD);
+    mock_prepare_destroy_pending_disconnect_client();
 
     chat_server_process(&server, FIA_FD, EPOLLIN);
 }
@@ -730,6 +872,7 @@ TEST(output_buffering)
 {
     struct chat_message_ind_t *message_p;
     struct chat_server_client_t *kalle_p;
+    struct iovec iov[2];
 
     start_server_with_three_clients();
     kalle_p = connect_kalle();
@@ -759,38 +902,927 @@ TEST(output_buffering)
     message_p->text_p = "Hello.";
     chat_server_send(&server, kalle_p);
 
-    /* Now set EPOLLOUT and transmit most of the enqueued data. */
+    /* Now set EPOLLOUT and transmit most of the enqueued data in a
+       single gather write. The socket buffer is full as not all data
+       was written, so no more writes are made. */
+    iov[0].iov_base = &message_ind_out[1];
+    iov[0].iov_len = sizeof(message_ind_out) - 1;
+    iov[1].iov_base = &message_ind_out[0];
+    iov[1].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(KALLE_FD,
+                        &iov[0],
+                        2,
+                        sizeof(message_ind_out) - 1 + 5,
+                        0);
+    epoll_ctl_mock_none();
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    /* Transmit remaining data. */
+    iov[0].iov_base = &message_ind_out[5];
+    iov[0].iov_len = sizeof(message_ind_out) - 5;
+    mock_prepare_writev(KALLE_FD, &iov[0], 1, sizeof(message_ind_out) - 5, 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN);
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+}
+
+TEST(output_buffering_write_error)
+{
+    struct chat_message_ind_t *message_p;
+    struct chat_server_client_t *kalle_p;
+    struct iovec iov[1];
+
+    start_server_with_three_clients();
+    kalle_p = connect_kalle();
+
+    /* Send a message to Kalle. It is enqueued. */
     mock_prepare_write(KALLE_FD,
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
+                       -1,
+                       EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+
+    message_p = chat_server_init_message_ind(&server);
+    message_p->user_p = "Erik";
+    message_p->text_p = "Hello.";
+    chat_server_send(&server, kalle_p);
+
+    /* Writing the enqueued data fails. The client is disconnected. */
+    iov[0].iov_base = &message_ind_out[0];
+    iov[0].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(KALLE_FD, &iov[0], 1, -1, EPIPE);
+    mock_prepare_client_pending_disconnect(KALLE_FD);
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+}
+
+TEST(output_buffering_broadcast_shares_buffer)
+{
+    struct chat_message_ind_t *message_p;
+    struct chat_server_client_t *erik_p;
+    struct chat_server_client_t *kalle_p;
+    struct messi_output_queue_item_t *erik_item_p;
+    struct messi_output_queue_item_t *kalle_item_p;
+    struct iovec iov[1];
+
+    start_server_with_three_clients();
+    erik_p = connect_erik();
+    kalle_p = connect_kalle();
+
+    /* Broadcast a message. Kalle's socket is full and Erik's accepts
+       one byte. */
+    mock_prepare_write(KALLE_FD,
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
+                       -1,
+                       EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+    mock_prepare_write(ERIK_FD,
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
+                       1,
+                       0);
+    mock_prepare_write(ERIK_FD,
                        &message_ind_out[1],
                        sizeof(message_ind_out) - 1,
-                       2,
-                       0);
+                       -1,
+                       EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, ERIK_FD, EPOLLIN | EPOLLOUT);
+
+    message_p = chat_server_init_message_ind(&server);
+    message_p->user_p = "Erik";
+    message_p->text_p = "Hello.";
+    chat_server_broadcast(&server);
+
+    /* Both clients reference the same encoded message. */
+    erik_item_p = &erik_p->output.queue.items_p[erik_p->output.queue.head];
+    kalle_item_p = &kalle_p->output.queue.items_p[kalle_p->output.queue.head];
+    ASSERT_EQ(erik_item_p->buffer_p, kalle_item_p->buffer_p);
+    ASSERT_EQ(kalle_item_p->buffer_p->count, 2);
+    ASSERT_EQ(erik_item_p->offset, 1);
+    ASSERT_EQ(kalle_item_p->offset, 0);
+
+    /* Kalle writes the message. Erik still references it. */
+    iov[0].iov_base = &message_ind_out[0];
+    iov[0].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(KALLE_FD, &iov[0], 1, sizeof(message_ind_out), 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN);
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    ASSERT_EQ(erik_item_p->buffer_p->count, 1);
+
+    /* Erik writes the rest of the message. */
+    iov[0].iov_base = &message_ind_out[1];
+    iov[0].iov_len = sizeof(message_ind_out) - 1;
+    mock_prepare_writev(ERIK_FD, &iov[0], 1, sizeof(message_ind_out) - 1, 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, ERIK_FD, EPOLLIN);
+
+    chat_server_process(&server, ERIK_FD, EPOLLOUT);
+
+    ASSERT_TRUE(messi_output_queue_is_empty(&erik_p->output.queue));
+}
+
+static void send_message_ind_to(struct chat_server_client_t *client_p)
+{
+    struct chat_message_ind_t *message_p;
+
+    message_p = chat_server_init_message_ind(&server);
+    message_p->user_p = "Erik";
+    message_p->text_p = "Hello.";
+    chat_server_send(&server, client_p);
+}
+
+TEST(output_buffering_in_preallocated_buffers)
+{
+    struct chat_server_client_t *kalle_p;
+    uint8_t clients_output_buffers[3][32];
+    uint8_t expected[32];
+    struct iovec iov[2];
+
+    init_server_with_three_clients();
+    chat_server_set_clients_output_buffers(&server,
+                                           &clients_output_buffers[0][0],
+                                           sizeof(clients_output_buffers[0]));
+    start_server();
+    kalle_p = connect_kalle();
+
+    /* Send a message to Kalle. It is only partly sent, and the rest
+       is enqueued in Kalle's output buffer. */
     mock_prepare_write(KALLE_FD,
-                       &message_ind_out[3],
-                       sizeof(message_ind_out) - 3,
-                       sizeof(message_ind_out) - 3,
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
+                       15,
                        0);
+    mock_prepare_write(KALLE_FD, &message_ind_out[15], 5, -1, EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+
+    send_message_ind_to(kalle_p);
+
+    /* Send another message. It is enqueued as well. */
+    send_message_ind_to(kalle_p);
+
+    /* Write 20 of 25 enqueued bytes. */
+    memcpy(&expected[0], &message_ind_out[15], 5);
+    memcpy(&expected[5], &message_ind_out[0], sizeof(message_ind_out));
+    iov[0].iov_base = &expected[0];
+    iov[0].iov_len = 25;
+    mock_prepare_writev(KALLE_FD, &iov[0], 1, 20, 0);
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    /* A third message wraps around the end of the output buffer. */
+    send_message_ind_to(kalle_p);
+
+    /* Write all enqueued data using two buffers. */
+    memcpy(&expected[0], &message_ind_out[15], 5);
+    memcpy(&expected[5], &message_ind_out[0], 7);
+    iov[0].iov_base = &expected[0];
+    iov[0].iov_len = 12;
+    iov[1].iov_base = &message_ind_out[7];
+    iov[1].iov_len = 13;
+    mock_prepare_writev(KALLE_FD, &iov[0], 2, 25, 0);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN);
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    /* Fill the output buffer. Kalle is disconnected when a message
+       does not fit. */
     mock_prepare_write(KALLE_FD,
                        &message_ind_out[0],
                        sizeof(message_ind_out),
-                       5,
-                       0);
+                       -1,
+                       EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+
+    send_message_ind_to(kalle_p);
+
+    mock_prepare_client_pending_disconnect(KALLE_FD);
+
+    send_message_ind_to(kalle_p);
+
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+}
+
+TEST(output_watermarks)
+{
+    struct chat_server_client_t *kalle_p;
+    struct iovec iov[3];
+
+    init_server_with_three_clients();
+    chat_server_set_client_output_watermarks(&server,
+                                             2 * sizeof(message_ind_out),
+                                             sizeof(message_ind_out),
+                                             server_on_client_writable_changed);
+    start_server();
+    kalle_p = connect_kalle();
+
+    /* The first message is enqueued, below the high watermark. */
     mock_prepare_write(KALLE_FD,
-                       &message_ind_out[5],
-                       sizeof(message_ind_out) - 5,
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
                        -1,
                        EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+
+    send_message_ind_to(kalle_p);
+
+    ASSERT_EQ(chat_server_client_output_bytes(&server, kalle_p),
+              sizeof(message_ind_out));
+
+    /* The second message reaches the high watermark. Kalle is not
+       writable. */
+    server_on_client_writable_changed_mock_once(false);
+
+    send_message_ind_to(kalle_p);
+
+    ASSERT_EQ(chat_server_client_output_bytes(&server, kalle_p),
+              2 * sizeof(message_ind_out));
+
+    /* Already not writable. */
+    send_message_ind_to(kalle_p);
+
+    /* Written down to above the low watermark. */
+    iov[0].iov_base = &message_ind_out[0];
+    iov[0].iov_len = sizeof(message_ind_out);
+    iov[1].iov_base = &message_ind_out[0];
+    iov[1].iov_len = sizeof(message_ind_out);
+    iov[2].iov_base = &message_ind_out[0];
+    iov[2].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(KALLE_FD, &iov[0], 3, sizeof(message_ind_out) + 15, 0);
     epoll_ctl_mock_none();
 
     chat_server_process(&server, KALLE_FD, EPOLLOUT);
 
-    /* Transmit remaining data. */
+    /* Written down to the low watermark. Kalle is writable again. */
+    iov[0].iov_base = &message_ind_out[15];
+    iov[0].iov_len = sizeof(message_ind_out) - 15;
+    mock_prepare_writev(KALLE_FD,
+                        &iov[0],
+                        2,
+                        sizeof(message_ind_out) - 15,
+                        0);
+    server_on_client_writable_changed_mock_once(true);
+
+    chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    ASSERT_EQ(chat_server_client_output_bytes(&server, kalle_p),
+              sizeof(message_ind_out));
+}
+
+TEST(client_stats)
+{
+    struct chat_server_client_t *kalle_p;
+    struct messi_stats_t stats;
+    struct iovec iov[1];
+
+    start_server_with_three_clients();
+    kalle_p = connect_kalle();
+
+    /* Connect request and response. */
+    chat_server_client_get_stats(&server, kalle_p, &stats);
+    ASSERT_EQ(stats.messages_in, 1);
+    ASSERT_EQ(stats.messages_out, 1);
+    ASSERT_EQ(stats.bytes_in, sizeof(connect_req_kalle));
+    ASSERT_EQ(stats.bytes_out, sizeof(connect_rsp));
+    ASSERT_EQ(stats.reads, 1);
+    ASSERT_EQ(stats.writes, 1);
+    ASSERT_EQ(stats.eagains, 0);
+    ASSERT_EQ(stats.output_bytes, 0);
+    ASSERT_EQ(stats.output_bytes_peak, 0);
+    ASSERT_EQ(stats.keep_alive_misses, 0);
+
+    /* A message that is enqueued. */
     mock_prepare_write(KALLE_FD,
-                       &message_ind_out[5],
-                       sizeof(message_ind_out) - 5,
-                       sizeof(message_ind_out) - 5,
-                       0);
+                       &message_ind_out[0],
+                       sizeof(message_ind_out),
+                       -1,
+                       EAGAIN);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN | EPOLLOUT);
+
+    send_message_ind_to(kalle_p);
+
+    chat_server_client_get_stats(&server, kalle_p, &stats);
+    ASSERT_EQ(stats.messages_out, 2);
+    ASSERT_EQ(stats.writes, 2);
+    ASSERT_EQ(stats.eagains, 1);
+    ASSERT_EQ(stats.output_bytes, sizeof(message_ind_out));
+    ASSERT_EQ(stats.output_bytes_peak, sizeof(message_ind_out));
+
+    /* Written. */
+    iov[0].iov_base = &message_ind_out[0];
+    iov[0].iov_len = sizeof(message_ind_out);
+    mock_prepare_writev(KALLE_FD, &iov[0], 1, sizeof(message_ind_out), 0);
     epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_MOD, KALLE_FD, EPOLLIN);
 
     chat_server_process(&server, KALLE_FD, EPOLLOUT);
+
+    chat_server_client_get_stats(&server, kalle_p, &stats);
+    ASSERT_EQ(stats.bytes_out, sizeof(connect_rsp) + sizeof(message_ind_out));
+    ASSERT_EQ(stats.writes, 3);
+    ASSERT_EQ(stats.output_bytes, 0);
+    ASSERT_EQ(stats.output_bytes_peak, sizeof(message_ind_out));
+}
+
+TEST(accept_all_waiting_clients)
+{
+    start_server_with_three_clients();
+
+    /* Erik and Kalle are accepted in the same event, until the
+       accept queue is empty. */
+    mock_prepare_accept(ERIK_FD);
+    mock_prepare_start_keep_alive_timer();
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, ERIK_FD, 0);
+    server_on_client_connected_mock_once();
+    mock_prepare_accept(KALLE_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, KALLE_FD, 0);
+    server_on_client_connected_mock_once();
+    mock_prepare_accept_queue_empty();
+
+    chat_server_process(&server, LISTENER_FD, EPOLLIN);
+}
+
+TEST(accept_pacing_and_listen_backlog)
+{
+    int enable;
+
+    init_server_with_three_clients();
+    chat_server_set_listen_backlog(&server, 128);
+    chat_server_set_accept_pacing(&server, 1);
+
+    socket_mock_once(AF_INET, SOCK_STREAM, 0, LISTENER_FD);
+    enable = 1;
+    setsockopt_mock_once(LISTENER_FD, SOL_SOCKET, SO_REUSEADDR, sizeof(enable), 0);
+    setsockopt_mock_set_optval_in(&enable, sizeof(enable));
+    mock_prepare_tcp_nodelay(LISTENER_FD);
+    bind_mock_once(LISTENER_FD, sizeof(struct sockaddr_in), 0);
+    listen_mock_once(LISTENER_FD, 128, 0);
+    mock_prepare_make_non_blocking(LISTENER_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, LISTENER_FD, 0);
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, TIMERS_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, TIMERS_FD, 0);
+    timers_armed = false;
+
+    ASSERT_EQ(chat_server_start(&server), 0);
+
+    /* Only one client is accepted per event. The listener stays
+       readable while more clients are waiting. */
+    mock_prepare_accept(ERIK_FD);
+    mock_prepare_start_keep_alive_timer();
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, ERIK_FD, 0);
+    server_on_client_connected_mock_once();
+
+    chat_server_process(&server, LISTENER_FD, EPOLLIN);
+
+    mock_prepare_accept(KALLE_FD);
+    epoll_ctl_mock_once(EPOLL_FD, EPOLL_CTL_ADD, KALLE_FD, 0);
+    server_on_client_connected_mock_once();
+
+    chat_server_process(&server, LISTENER_FD, EPOLLIN);
+}
+
+static uint8_t large_message[32];
+static uint8_t large_workspace[128];
+
+static uint8_t *on_client_large_message(struct chat_server_t *self_p,
+                                        struct chat_server_client_t *client_p,
+                                        size_t size)
+{
+    (void)self_p;
+    (void)client_p;
+
+    ASSERT_EQ(size, 16);
+
+    return (&large_message[0]);
+}
+
+TEST(large_message_read_into_user_storage)
+{
+    start_server_with_three_clients();
+    chat_server_set_large_messages(&server,
+                                   sizeof(large_message),
+                                   &large_workspace[0],
+                                   sizeof(large_workspace),
+                                   on_client_large_message);
+    connect_erik();
+
+    /* The extended header and the first part of the payload, which
+       is moved to the user storage. */
+    mock_prepare_read(ERIK_FD, &message_ind_in_extended[0], 20);
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+
+    /* The rest of the payload is read directly into the user
+       storage. The message is broadcasted once complete. */
+    read_mock_once(ERIK_FD, 9, 9);
+    read_mock_set_buf_out(&message_ind_in_extended[20], 9);
+    write_mock_once(ERIK_FD, sizeof(message_ind_out), sizeof(message_ind_out));
+    write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
+    mock_prepare_read_try_again(ERIK_FD);
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+
+    ASSERT_MEMORY_EQ(&large_message[0], &message_ind_in_extended[13], 16);
+}
+
+TEST(large_message_too_big)
+{
+    start_server_with_three_clients();
+    connect_erik();
+
+    /* Large messages are not enabled. */
+    mock_prepare_read(ERIK_FD, &message_ind_in_extended[0], 13);
+    mock_prepare_client_pending_disconnect(ERIK_FD);
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
+TEST(clients_in_slabs)
+{
+    struct chat_server_client_t *lisa_p;
+
+    init_server_with_three_clients();
+    chat_server_set_client_slabs(&server, 1, 4);
+    start_server();
+    connect_erik();
+    connect_kalle();
+    connect_fia();
+
+    /* Lisa is allocated in a slab as all given clients are
+       connected. */
+    lisa_p = connect_client(connect_req_erik, sizeof(connect_req_erik), LISA_FD);
+    ASSERT_NE(lisa_p, &clients[0]);
+    ASSERT_NE(lisa_p, &clients[1]);
+    ASSERT_NE(lisa_p, &clients[2]);
+    ASSERT_EQ(server.clients.slabs.size, 1);
+
+    /* Cannot connect another client. */
+    mock_prepare_accept(JOHN_FD);
+    close_mock_once(JOHN_FD, 0);
+    mock_prepare_accept_queue_empty();
+
+    chat_server_process(&server, LISTENER_FD, EPOLLIN);
+
+    /* The only empty slab is kept. */
+    disconnect_client(LISA_FD);
+    ASSERT_EQ(server.clients.slabs.size, 1);
+    ASSERT_EQ(server.clients.slabs.number_of_empty, 1);
+
+    /* Lisa gets the same client again. */
+    ASSERT_EQ(connect_client(connect_req_erik, sizeof(connect_req_erik), LISA_FD),
+              lisa_p);
+}
+
+TEST(batch_of_messages_read)
+{
+    uint8_t batch[4 + 2 * sizeof(message_ind_in)];
+    int i;
+
+    start_server_with_three_clients();
+    connect_erik();
+
+    /* Both messages are broadcasted in order. */
+    memcpy(&batch[0], "\x06\x00\x00\x28", 4);
+    memcpy(&batch[4], &message_ind_in[0], sizeof(message_ind_in));
+    memcpy(&batch[4 + sizeof(message_ind_in)],
+           &message_ind_in[0],
+           sizeof(message_ind_in));
+    mock_prepare_read(ERIK_FD, &batch[0], sizeof(batch));
+
+    for (i = 0; i < 2; i++) {
+        write_mock_once(ERIK_FD, sizeof(message_ind_out), sizeof(message_ind_out));
+        write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
+    }
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
+TEST(batch_with_bad_message_type)
+{
+    uint8_t batch[4 + sizeof(message_ind_in)];
+
+    start_server_with_three_clients();
+    connect_erik();
+
+    memcpy(&batch[0], "\x06\x00\x00\x14", 4);
+    memcpy(&batch[4], &message_ind_in[0], sizeof(message_ind_in));
+    batch[4] = MESSI_MESSAGE_TYPE_PING;
+    mock_prepare_read(ERIK_FD, &batch[0], sizeof(batch));
+    mock_prepare_client_pending_disconnect(ERIK_FD);
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
+TEST(request_replied_with_response)
+{
+    uint8_t request[] = {
+        /* Header. */
+        0x08, 0x00, 0x00, 0x0c,
+        /* Correlation id. */
+        0x12, 0x34, 0x56, 0x78,
+        /* Payload. */
+        0x0a, 0x06, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b
+    };
+    uint8_t response[] = {
+        /* Header. */
+        0x09, 0x00, 0x00, 0x06,
+        /* Correlation id. */
+        0x12, 0x34, 0x56, 0x78,
+        /* Payload. */
+        0x0a, 0x00
+    };
+    uint8_t request_message_ind[4 + 4 + sizeof(message_ind_in) - 4];
+
+    start_server_with_three_clients();
+    connect_erik();
+
+    /* The reply echoes the id of the request. */
+    mock_prepare_read(ERIK_FD, &request[0], sizeof(request));
+    write_mock_once(ERIK_FD, sizeof(response), sizeof(response));
+    write_mock_set_buf_in(&response[0], sizeof(response));
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+
+    /* A broadcast while handling a request is not a response. */
+    memcpy(&request_message_ind[0], "\x08\x00\x00\x14\x00\x00\x00\x01", 8);
+    memcpy(&request_message_ind[8],
+           &message_ind_in[4],
+           sizeof(message_ind_in) - 4);
+    mock_prepare_read(ERIK_FD,
+                      &request_message_ind[0],
+                      sizeof(request_message_ind));
+    write_mock_once(ERIK_FD, sizeof(message_ind_out), sizeof(message_ind_out));
+    write_mock_set_buf_in(&message_ind_out[0], sizeof(message_ind_out));
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+
+    /* A plain message is replied to with a plain message. */
+    mock_prepare_read(ERIK_FD, &connect_req_erik[0], sizeof(connect_req_erik));
+    write_mock_once(ERIK_FD, sizeof(connect_rsp), sizeof(connect_rsp));
+    write_mock_set_buf_in(&connect_rsp[0], sizeof(connect_rsp));
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
+TEST(request_without_id)
+{
+    uint8_t request[] = {
+        /* Header. */
+        0x08, 0x00, 0x00, 0x03,
+        /* Too short correlation id. */
+        0x12, 0x34, 0x56
+    };
+
+    start_server_with_three_clients();
+    connect_erik();
+
+    mock_prepare_read(ERIK_FD, &request[0], sizeof(request));
+    mock_prepare_client_pending_disconnect(ERIK_FD);
+    mock_prepare_destroy_pending_disconnect_client();
+
+    chat_server_process(&server, ERIK_FD, EPOLLIN);
+}
+
+/* The multi-reactor tests below run real threads on real sockets. */
+
+#define REACTORS_URI                        "tcp://127.0.0.1:6100"
+#define REACTORS_PORT                       6100
+#define NUMBER_OF_REACTORS                  3
+
+/**
+ * user: Erik
+ * text: 1, 2 and 3.
+ */
+static uint8_t reactors_message_ind_out[3][15] = {
+    {
+        /* Header. */
+        0x02, 0x00, 0x00, 0x0b,
+        /* Payload. */
+        0x12, 0x09, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+        0x12, 0x01, 0x31
+    },
+    {
+        /* Header. */
+        0x02, 0x00, 0x00, 0x0b,
+        /* Payload. */
+        0x12, 0x09, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+        0x12, 0x01, 0x32
+    },
+    {
+        /* Header. */
+        0x02, 0x00, 0x00, 0x0b,
+        /* Payload. */
+        0x12, 0x09, 0x0a, 0x04, 0x45, 0x72, 0x69, 0x6b,
+        0x12, 0x01, 0x33
+    }
+};
+
+static struct chat_server_reactors_t reactors;
+static struct chat_server_reactor_t reactors_list[NUMBER_OF_REACTORS];
+static struct chat_server_t reactors_servers[NUMBER_OF_REACTORS];
+static struct chat_server_client_t reactors_clients[NUMBER_OF_REACTORS][2];
+static uint8_t reactors_input_buffers[NUMBER_OF_REACTORS][2][INPUT_BUFFER_SIZE];
+static uint8_t reactors_message[NUMBER_OF_REACTORS][128];
+static uint8_t reactors_workspace_in[NUMBER_OF_REACTORS][128];
+static uint8_t reactors_workspace_out[NUMBER_OF_REACTORS][128];
+/* First letter of the user connected last to each reactor. */
+static char reactors_placements[NUMBER_OF_REACTORS];
+static int reactors_shared_buffers_created;
+static int reactors_threads_joined;
+
+struct messi_shared_buffer_t *__real_messi_shared_buffer_new(
+    const uint8_t *buf_p,
+    size_t size);
+
+int __real_pthread_join(pthread_t thread, void **retval_pp);
+
+static struct messi_shared_buffer_t *reactors_shared_buffer_new(
+    const uint8_t *buf_p,
+    size_t size)
+{
+    __atomic_add_fetch(&reactors_shared_buffers_created, 1, __ATOMIC_RELAXED);
+
+    return (__real_messi_shared_buffer_new(buf_p, size));
+}
+
+static int reactors_pthread_join(pthread_t thread, void **retval_pp)
+{
+    reactors_threads_joined++;
+
+    return (__real_pthread_join(thread, retval_pp));
+}
+
+static void reactors_on_client_connected(struct chat_server_t *self_p,
+                                         struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+    (void)client_p;
+}
+
+static void reactors_on_client_disconnected(
+    struct chat_server_t *self_p,
+    struct chat_server_client_t *client_p)
+{
+    (void)self_p;
+    (void)client_p;
+}
+
+static void reactors_on_connect_req(struct chat_server_t *self_p,
+                                    struct chat_server_client_t *client_p,
+                                    struct chat_connect_req_t *message_p)
+{
+    (void)client_p;
+
+    __atomic_store_n(&reactors_placements[self_p - &reactors_servers[0]],
+                     message_p->user_p[0],
+                     __ATOMIC_RELEASE);
+    chat_server_init_connect_rsp(self_p);
+    chat_server_reply(self_p);
+}
+
+/* Broadcast three messages in a row. */
+static void reactors_on_message_ind(struct chat_server_t *self_p,
+                                    struct chat_server_client_t *client_p,
+                                    struct chat_message_ind_t *message_in_p)
+{
+    (void)client_p;
+
+    static const char *texts[] = { "1", "2", "3" };
+    struct chat_message_ind_t *message_p;
+    size_t i;
+
+    for (i = 0; i < 3; i++) {
+        message_p = chat_server_init_message_ind(self_p);
+        message_p->user_p = message_in_p->user_p;
+        message_p->text_p = (char *)texts[i];
+        chat_server_broadcast(self_p);
+    }
+}
+
+static char reactors_placement(int index)
+{
+    return (__atomic_load_n(&reactors_placements[index], __ATOMIC_ACQUIRE));
+}
+
+static int reactors_load(int index)
+{
+    return (__atomic_load_n(&reactors_list[index].load, __ATOMIC_RELAXED));
+}
+
+static void reactors_init(int number_of_reactors)
+{
+    int i;
+
+    for (i = 0; i < number_of_reactors; i++) {
+        ASSERT_EQ(chat_server_init(&reactors_servers[i],
+                                   REACTORS_URI,
+                                   &reactors_clients[i][0],
+                                   2,
+                                   &reactors_input_buffers[i][0][0],
+                                   sizeof(reactors_input_buffers[i][0]),
+                                   &reactors_message[i][0],
+                                   sizeof(reactors_message[i]),
+                                   &reactors_workspace_in[i][0],
+                                   sizeof(reactors_workspace_in[i]),
+                                   &reactors_workspace_out[i][0],
+                                   sizeof(reactors_workspace_out[i]),
+                                   reactors_on_client_connected,
+                                   reactors_on_client_disconnected,
+                                   reactors_on_connect_req,
+                                   reactors_on_message_ind,
+                                   -1,
+                                   NULL), 0);
+    }
+
+    ASSERT_EQ(chat_server_reactors_init(&reactors,
+                                        &reactors_list[0],
+                                        &reactors_servers[0],
+                                        number_of_reactors), 0);
+}
+
+static void reactors_assert_closed(int number_of_reactors)
+{
+    int i;
+
+    ASSERT_EQ(reactors.acceptor.listener_fd, -1);
+    ASSERT_EQ(reactors.acceptor.epoll_fd, -1);
+    ASSERT_EQ(reactors.acceptor.event_fd, -1);
+
+    for (i = 0; i < number_of_reactors; i++) {
+        ASSERT_EQ(reactors_list[i].epoll_fd, -1);
+        ASSERT_EQ(reactors_list[i].event_fd, -1);
+        ASSERT_EQ(reactors_load(i), 0);
+    }
+}
+
+/* Read given number of bytes and compare them to the expected. */
+static void reactors_client_read(int fd, const uint8_t *expected_p, size_t size)
+{
+    uint8_t buf[64];
+    size_t offset;
+    ssize_t res;
+
+    offset = 0;
+
+    while (offset < size) {
+        res = read(fd, &buf[offset], size - offset);
+        ASSERT_GT(res, 0);
+        offset += (size_t)res;
+    }
+
+    ASSERT_MEMORY_EQ(&buf[0], expected_p, size);
+}
+
+/* Connect a client and wait for its connect response. */
+static int reactors_client_connect(uint8_t *connect_req_p, size_t size)
+{
+    struct sockaddr_in addr;
+    struct timeval timeout;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(REACTORS_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    ASSERT_EQ(setsockopt(fd,
+                         SOL_SOCKET,
+                         SO_RCVTIMEO,
+                         &timeout,
+                         sizeof(timeout)), 0);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(write(fd, connect_req_p, size), (ssize_t)size);
+    reactors_client_read(fd, &connect_rsp[0], sizeof(connect_rsp));
+
+    return (fd);
+}
+
+TEST(reactors_place_clients_on_least_loaded)
+{
+    int erik_fd;
+    int kalle_fd;
+    int fia_fd;
+    int i;
+
+    reactors_init(NUMBER_OF_REACTORS);
+    ASSERT_EQ(chat_server_reactors_start(&reactors), 0);
+
+    erik_fd = reactors_client_connect(&connect_req_erik[0],
+                                      sizeof(connect_req_erik));
+    kalle_fd = reactors_client_connect(&connect_req_kalle[0],
+                                       sizeof(connect_req_kalle));
+    fia_fd = reactors_client_connect(&connect_req_fia[0],
+                                     sizeof(connect_req_fia));
+    ASSERT_EQ(reactors_placement(0), 'E');
+    ASSERT_EQ(reactors_placement(1), 'K');
+    ASSERT_EQ(reactors_placement(2), 'F');
+
+    /* Kalle is placed on the same reactor again, as it is the only
+       one without clients. */
+    close(kalle_fd);
+
+    for (i = 0; (i < 500) && (reactors_load(1) != 0); i++) {
+        usleep(10000);
+    }
+
+    ASSERT_EQ(reactors_load(1), 0);
+    kalle_fd = reactors_client_connect(&connect_req_kalle[0],
+                                       sizeof(connect_req_kalle));
+    ASSERT_EQ(reactors_placement(1), 'K');
+    ASSERT_EQ(reactors_load(0), 1);
+    ASSERT_EQ(reactors_load(1), 1);
+    ASSERT_EQ(reactors_load(2), 1);
+
+    close(erik_fd);
+    close(kalle_fd);
+    close(fia_fd);
+    chat_server_reactors_stop(&reactors);
+}
+
+TEST(reactors_broadcast_in_order)
+{
+    int erik_fd;
+    int kalle_fd;
+    int fia_fd;
+    int i;
+
+    messi_shared_buffer_new_mock_implementation(reactors_shared_buffer_new);
+    reactors_init(NUMBER_OF_REACTORS);
+    ASSERT_EQ(chat_server_reactors_start(&reactors), 0);
+
+    erik_fd = reactors_client_connect(&connect_req_erik[0],
+                                      sizeof(connect_req_erik));
+    kalle_fd = reactors_client_connect(&connect_req_kalle[0],
+                                       sizeof(connect_req_kalle));
+    fia_fd = reactors_client_connect(&connect_req_fia[0],
+                                     sizeof(connect_req_fia));
+
+    /* Erik's reactor broadcasts three messages, which the clients of
+       all reactors receive in order. */
+    ASSERT_EQ(write(erik_fd, &message_ind_in[0], sizeof(message_ind_in)),
+              (ssize_t)sizeof(message_ind_in));
+
+    for (i = 0; i < 3; i++) {
+        reactors_client_read(erik_fd,
+                             &reactors_message_ind_out[i][0],
+                             sizeof(reactors_message_ind_out[i]));
+        reactors_client_read(kalle_fd,
+                             &reactors_message_ind_out[i][0],
+                             sizeof(reactors_message_ind_out[i]));
+        reactors_client_read(fia_fd,
+                             &reactors_message_ind_out[i][0],
+                             sizeof(reactors_message_ind_out[i]));
+    }
+
+    /* All reactors share one copy of each broadcast. */
+    ASSERT_EQ(__atomic_load_n(&reactors_shared_buffers_created,
+                              __ATOMIC_RELAXED),
+              3);
+
+    close(erik_fd);
+    close(kalle_fd);
+    close(fia_fd);
+    chat_server_reactors_stop(&reactors);
+}
+
+TEST(reactors_start_failure_unwinds)
+{
+    reactors_init(2);
+
+    /* The second reactor thread can not be created. The first one is
+       joined and everything is closed. */
+    pthread_create_mock_once(0);
+    pthread_create_mock_once(EAGAIN);
+    pthread_join_mock_ignore_in_once(0);
+
+    ASSERT_EQ(chat_server_reactors_start(&reactors), -1);
+    reactors_assert_closed(2);
+
+    /* The listener is closed, so the address can be bound again. */
+    ASSERT_EQ(chat_server_reactors_start(&reactors), 0);
+    chat_server_reactors_stop(&reactors);
+}
+
+TEST(reactors_stop_joins_all_threads)
+{
+    reactors_init(2);
+    ASSERT_EQ(chat_server_reactors_start(&reactors), 0);
+
+    pthread_join_mock_implementation(reactors_pthread_join);
+
+    chat_server_reactors_stop(&reactors);
+
+    /* The acceptor and both reactors. */
+    ASSERT_EQ(reactors_threads_joined, 3);
+    reactors_assert_closed(2);
 }
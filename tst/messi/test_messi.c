@@ -1,6 +1,36 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include "nala.h"
 #include "messi.h"
 
+#define TIMERS_FD 5
+
+static void on_timeout(int *count_p)
+{
+    (*count_p)++;
+}
+
+static void mock_prepare_timers_settime(long period_ms)
+{
+    struct itimerspec timeout;
+
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.it_value.tv_nsec = (1000000L * period_ms);
+    timeout.it_interval = timeout.it_value;
+    timerfd_settime_mock_once(TIMERS_FD, 0, 0);
+    timerfd_settime_mock_set_new_value_in(&timeout, sizeof(timeout));
+}
+
+static void mock_prepare_timers_read(uint64_t ticks)
+{
+    read_mock_once(TIMERS_FD, sizeof(ticks), sizeof(ticks));
+    read_mock_set_buf_out(&ticks, sizeof(ticks));
+}
+
 TEST(parse_uri_tcp)
 {
     const char uri[] = "tcp://127.0.0.1:6000";
@@ -70,6 +100,885 @@ TEST(parse_uri_tcp_only_scheme)
     ASSERT_EQ(messi_parse_tcp_uri(&uri[0], &host[0], sizeof(host), &port), -1);
 }
 
+TEST(parse_uri_unix)
+{
+    struct sockaddr_un addr;
+    socklen_t size;
+
+    ASSERT_EQ(messi_parse_unix_uri("unix:///tmp/chat.sock", &addr, &size), 0);
+    ASSERT_EQ(addr.sun_family, AF_UNIX);
+    ASSERT_EQ(&addr.sun_path[0], "/tmp/chat.sock");
+    ASSERT_EQ(size, offsetof(struct sockaddr_un, sun_path) + 15);
+}
+
+TEST(parse_uri_unix_abstract)
+{
+    struct sockaddr_un addr;
+    socklen_t size;
+
+    ASSERT_EQ(messi_parse_unix_uri("unix://@chat", &addr, &size), 0);
+    ASSERT_EQ(addr.sun_family, AF_UNIX);
+    ASSERT_MEMORY_EQ(&addr.sun_path[0], "\0chat", 5);
+    ASSERT_EQ(size, offsetof(struct sockaddr_un, sun_path) + 5);
+}
+
+TEST(parse_uri_unix_bad)
+{
+    struct sockaddr_un addr;
+    socklen_t size;
+    char uri[sizeof(addr.sun_path) + 8];
+
+    ASSERT_EQ(messi_parse_unix_uri("unix://", &addr, &size), -1);
+    ASSERT_EQ(messi_parse_unix_uri("unix://@", &addr, &size), -1);
+    ASSERT_EQ(messi_parse_unix_uri("tcp://127.0.0.1:6000", &addr, &size), -1);
+
+    /* Too long path. */
+    memset(&uri[0], 'a', sizeof(uri) - 1);
+    memcpy(&uri[0], "unix://", 7);
+    uri[sizeof(uri) - 1] = '\0';
+    ASSERT_EQ(messi_parse_unix_uri(&uri[0], &addr, &size), -1);
+}
+
+TEST(parse_uri_shm)
+{
+    struct sockaddr_un addr;
+    socklen_t size;
+
+    ASSERT_EQ(messi_parse_shm_uri("shm://chat", &addr, &size), 0);
+    ASSERT_EQ(addr.sun_family, AF_UNIX);
+    ASSERT_MEMORY_EQ(&addr.sun_path[0], "\0messi-shm-chat", 15);
+    ASSERT_EQ(size, offsetof(struct sockaddr_un, sun_path) + 15);
+    ASSERT_EQ(messi_parse_shm_uri("shm://", &addr, &size), -1);
+    ASSERT_EQ(messi_parse_shm_uri("unix://@chat", &addr, &size), -1);
+}
+
+TEST(parse_uri_mem)
+{
+    struct sockaddr_un addr;
+    socklen_t size;
+    char name[64];
+    int name_size;
+
+    name_size = snprintf(&name[0],
+                         sizeof(name),
+                         "messi-mem-%d-bench",
+                         (int)getpid());
+
+    ASSERT_EQ(messi_parse_shm_uri("mem://bench", &addr, &size), 0);
+    ASSERT_EQ(addr.sun_family, AF_UNIX);
+    ASSERT_EQ(addr.sun_path[0], '\0');
+    ASSERT_MEMORY_EQ(&addr.sun_path[1], &name[0], name_size);
+    ASSERT_EQ(size, offsetof(struct sockaddr_un, sun_path) + 1 + name_size);
+    ASSERT_EQ(messi_parse_shm_uri("mem://", &addr, &size), -1);
+}
+
+TEST(shm)
+{
+    int fds[2];
+    struct messi_shm_t server;
+    struct messi_shm_t client;
+    static uint8_t buf[MESSI_SHM_RING_SIZE + 16];
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[0]), 0);
+    messi_shm_init(&server, fds[0]);
+    messi_shm_init(&client, fds[1]);
+
+    /* Not yet created by the server. */
+    ASSERT_EQ(messi_shm_open(&client), -1);
+    ASSERT_EQ(errno, EAGAIN);
+    ASSERT_EQ(messi_shm_write(&client, "hi", 2), -1);
+    ASSERT_EQ(errno, ENOTCONN);
+
+    ASSERT_EQ(messi_shm_create(&server), 0);
+    ASSERT_EQ(messi_shm_open(&client), 0);
+    ASSERT_TRUE(messi_shm_is_open(&client));
+
+    /* Both directions. */
+    ASSERT_EQ(messi_shm_write(&client, "hello", 5), 5);
+    ASSERT_EQ(messi_shm_read(&server, &buf[0], sizeof(buf)), 5);
+    ASSERT_MEMORY_EQ(&buf[0], "hello", 5);
+    ASSERT_EQ(messi_shm_read(&server, &buf[0], sizeof(buf)), -1);
+    ASSERT_EQ(errno, EAGAIN);
+    ASSERT_EQ(messi_shm_write(&server, "hi", 2), 2);
+    ASSERT_EQ(messi_shm_read(&client, &buf[0], sizeof(buf)), 2);
+    ASSERT_MEMORY_EQ(&buf[0], "hi", 2);
+
+    /* Partial write when the ring is full, and free space after a
+       read. */
+    memset(&buf[0], 0x5a, sizeof(buf));
+    ASSERT_EQ(messi_shm_write(&client, &buf[0], sizeof(buf)),
+              MESSI_SHM_RING_SIZE);
+    ASSERT_EQ(messi_shm_write(&client, &buf[0], 1), -1);
+    ASSERT_EQ(errno, EAGAIN);
+    ASSERT_EQ(messi_shm_read(&server, &buf[0], 16), 16);
+    ASSERT_EQ(messi_shm_write(&client, &buf[0], 32), 16);
+
+    /* Buffered data is read before the closed socket is noticed. */
+    messi_shm_close(&client);
+    close(fds[1]);
+    ASSERT_EQ(messi_shm_read(&server, &buf[0], sizeof(buf)),
+              MESSI_SHM_RING_SIZE);
+    ASSERT_EQ(messi_shm_read(&server, &buf[0], sizeof(buf)), 0);
+    messi_shm_close(&server);
+    close(fds[0]);
+}
+
+TEST(fd_table)
+{
+    struct messi_fd_table_t table;
+    int a;
+    int b;
+
+    messi_fd_table_init(&table);
+    ASSERT_EQ(messi_fd_table_get(&table, 3), NULL);
+    ASSERT_EQ(messi_fd_table_get(&table, -1), NULL);
+
+    /* Set entries, growing the table. */
+    ASSERT_EQ(messi_fd_table_set(&table, 3, &a), 0);
+    ASSERT_EQ(messi_fd_table_set(&table, 1000, &b), 0);
+    ASSERT_EQ(messi_fd_table_get(&table, 3), &a);
+    ASSERT_EQ(messi_fd_table_get(&table, 1000), &b);
+    ASSERT_EQ(messi_fd_table_get(&table, 4), NULL);
+    ASSERT_EQ(messi_fd_table_get(&table, 100000), NULL);
+
+    /* Negative file descriptors are not allowed. */
+    ASSERT_EQ(messi_fd_table_set(&table, -1, &a), -1);
+
+    /* Clear an entry. */
+    messi_fd_table_clear(&table, 3);
+    ASSERT_EQ(messi_fd_table_get(&table, 3), NULL);
+    ASSERT_EQ(messi_fd_table_get(&table, 1000), &b);
+    messi_fd_table_clear(&table, 100000);
+
+    messi_fd_table_destroy(&table);
+    ASSERT_EQ(messi_fd_table_get(&table, 1000), NULL);
+}
+
+TEST(framer)
+{
+    struct messi_framer_t framer;
+    uint8_t buf[12];
+    uint8_t *buf_p;
+    size_t size;
+    uint8_t type;
+    struct messi_buffer_t payload;
+    uint8_t frames[] = {
+        /* Ping. */
+        0x03, 0x00, 0x00, 0x00,
+        /* User message with two bytes payload. */
+        0x01, 0x00, 0x00, 0x02, 0x11, 0x22,
+        /* Start of user message with three bytes payload. */
+        0x01, 0x00
+    };
+
+    messi_framer_init(&framer, &buf[0], sizeof(buf));
+
+    /* Nothing received. */
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+
+    /* Fill the buffer with two complete frames and a partial one. */
+    buf_p = messi_framer_get_free(&framer, &size);
+    ASSERT_EQ(buf_p, &buf[0]);
+    ASSERT_EQ(size, sizeof(buf));
+    memcpy(buf_p, &frames[0], sizeof(frames));
+    messi_framer_commit(&framer, sizeof(frames));
+
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 1);
+    ASSERT_EQ(type, 3);
+    ASSERT_EQ(payload.size, 0);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 1);
+    ASSERT_EQ(type, 1);
+    ASSERT_EQ(payload.size, 2);
+    ASSERT_EQ(payload.buf_p, &buf[8]);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+
+    /* The partial frame is moved to the beginning of the buffer. */
+    buf_p = messi_framer_get_free(&framer, &size);
+    ASSERT_EQ(buf_p, &buf[2]);
+    ASSERT_EQ(size, sizeof(buf) - 2);
+    ASSERT_EQ(buf[0], 0x01);
+    ASSERT_EQ(buf[1], 0x00);
+    memcpy(buf_p, "\x00\x03\x33\x44", 4);
+    messi_framer_commit(&framer, 4);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+    buf_p = messi_framer_get_free(&framer, &size);
+    buf_p[0] = 0x55;
+    messi_framer_commit(&framer, 1);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 1);
+    ASSERT_EQ(type, 1);
+    ASSERT_EQ(payload.size, 3);
+    ASSERT_EQ(payload.buf_p[2], 0x55);
+
+    /* A frame that does not fit in the buffer. */
+    buf_p = messi_framer_get_free(&framer, &size);
+    ASSERT_EQ(size, sizeof(buf));
+    memcpy(buf_p, "\x01\x00\x00\x09", 4);
+    messi_framer_commit(&framer, 4);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), -1);
+
+    /* Reset discards everything. */
+    messi_framer_reset(&framer);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+}
+
+TEST(framer_extended)
+{
+    struct messi_framer_t framer;
+    uint8_t buf[16];
+    uint8_t *buf_p;
+    size_t size;
+    uint8_t type;
+    struct messi_buffer_t payload;
+    uint8_t large[5];
+    uint8_t frames[] = {
+        /* Extended header of a user message with five bytes
+           payload. */
+        0x05, 0x00, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+        /* Start of the payload. */
+        0x11, 0x22
+    };
+
+    messi_framer_init(&framer, &buf[0], sizeof(buf));
+
+    /* A partial extended header. */
+    buf_p = messi_framer_get_free(&framer, &size);
+    memcpy(buf_p, &frames[0], 8);
+    messi_framer_commit(&framer, 8);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+
+    /* The complete header starts an extended frame. */
+    buf_p = messi_framer_get_free(&framer, &size);
+    memcpy(buf_p, &frames[8], sizeof(frames) - 8);
+    messi_framer_commit(&framer, sizeof(frames) - 8);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 2);
+    ASSERT_EQ(type, 1);
+    ASSERT_EQ(payload.size, 5);
+    ASSERT_EQ(payload.buf_p, NULL);
+
+    /* Take the buffered part of the payload. */
+    ASSERT_EQ(messi_framer_take(&framer, &large[0], sizeof(large)), 2);
+    ASSERT_MEMORY_EQ(&large[0], "\x11\x22", 2);
+    ASSERT_EQ(messi_framer_next(&framer, &type, &payload), 0);
+    buf_p = messi_framer_get_free(&framer, &size);
+    ASSERT_EQ(size, sizeof(buf));
+}
+
+TEST(frame_create)
+{
+    uint8_t buf[8];
+    uint8_t *large_p;
+    size_t payload_size;
+
+    /* A basic header. */
+    memcpy(&buf[4], "\x11\x22", 2);
+    ASSERT_EQ(messi_frame_create(&buf[0], sizeof(buf), 1, 2), 6);
+    ASSERT_MEMORY_EQ(&buf[0], "\x01\x00\x00\x02\x11\x22", 6);
+
+    /* An extended header. The payload is moved. */
+    payload_size = (MESSI_HEADER_SIZE_MAX + 1);
+    large_p = malloc(payload_size + sizeof(struct messi_extended_header_t));
+    ASSERT_NE(large_p, NULL);
+    large_p[4] = 0x33;
+    large_p[4 + payload_size - 1] = 0x44;
+    ASSERT_EQ(messi_frame_create(large_p,
+                                 payload_size + 4,
+                                 2,
+                                 payload_size), -1);
+    ASSERT_EQ(messi_frame_create(large_p,
+                                 payload_size + 13,
+                                 2,
+                                 payload_size),
+              (int)payload_size + 13);
+    ASSERT_MEMORY_EQ(&large_p[0],
+                     "\x05\x00\x00\x00"
+                     "\x02\x00\x00\x00\x00\x01\x00\x00\x00",
+                     13);
+    ASSERT_EQ(large_p[13], 0x33);
+    ASSERT_EQ(large_p[13 + payload_size - 1], 0x44);
+    free(large_p);
+}
+
+TEST(batch_next)
+{
+    uint8_t buf[] = {
+        0x01, 0x00, 0x00, 0x02, 0x11, 0x22,
+        0x01, 0x00, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0x05, 0x33
+    };
+    struct messi_buffer_t batch;
+    struct messi_buffer_t payload;
+    size_t offset;
+    uint8_t type;
+
+    batch.buf_p = &buf[0];
+    batch.size = 10;
+    offset = 0;
+
+    ASSERT_EQ(messi_batch_next(&batch, &offset, &type, &payload), 1);
+    ASSERT_EQ(type, 1);
+    ASSERT_EQ(payload.size, 2);
+    ASSERT_EQ(payload.buf_p, &buf[4]);
+    ASSERT_EQ(offset, 6);
+
+    /* An empty message. */
+    ASSERT_EQ(messi_batch_next(&batch, &offset, &type, &payload), 1);
+    ASSERT_EQ(payload.size, 0);
+    ASSERT_EQ(offset, 10);
+
+    ASSERT_EQ(messi_batch_next(&batch, &offset, &type, &payload), 0);
+
+    /* A message larger than the rest of the batch. */
+    batch.size = sizeof(buf);
+
+    ASSERT_EQ(messi_batch_next(&batch, &offset, &type, &payload), -1);
+
+    /* A partial header. */
+    batch.size = 12;
+
+    ASSERT_EQ(messi_batch_next(&batch, &offset, &type, &payload), -1);
+}
+
+TEST(request_id)
+{
+    uint8_t buf[6];
+    struct messi_buffer_t payload;
+    struct messi_buffer_t message;
+    uint32_t id;
+
+    messi_request_id_write(&buf[0], 0x12345678);
+    buf[4] = 0x11;
+    buf[5] = 0x22;
+
+    ASSERT_MEMORY_EQ(&buf[0], "\x12\x34\x56\x78", 4);
+
+    payload.buf_p = &buf[0];
+    payload.size = sizeof(buf);
+
+    ASSERT_EQ(messi_request_id_parse(&payload, &id, &message), 0);
+    ASSERT_EQ(id, 0x12345678);
+    ASSERT_EQ(message.buf_p, &buf[4]);
+    ASSERT_EQ(message.size, 2);
+
+    /* An empty message. */
+    payload.size = 4;
+
+    ASSERT_EQ(messi_request_id_parse(&payload, &id, &message), 0);
+    ASSERT_EQ(message.size, 0);
+
+    /* Too short for an id. */
+    payload.size = 3;
+
+    ASSERT_EQ(messi_request_id_parse(&payload, &id, &message), -1);
+}
+
+TEST(codec_lz4)
+{
+    uint8_t src[300];
+    uint8_t compressed[300];
+    uint8_t decompressed[300];
+    int size;
+    size_t i;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = "Hello there! "[i % 13];
+    }
+
+    size = messi_codec_lz4.compress(&src[0],
+                                    sizeof(src),
+                                    &compressed[0],
+                                    sizeof(compressed));
+    ASSERT_GT(size, 0);
+    ASSERT_LT(size, 50);
+    ASSERT_EQ(messi_codec_lz4.decompress(&compressed[0],
+                                         size,
+                                         &decompressed[0],
+                                         sizeof(decompressed)),
+              sizeof(src));
+    ASSERT_MEMORY_EQ(&decompressed[0], &src[0], sizeof(src));
+
+    /* Too small destination buffers. */
+    ASSERT_EQ(messi_codec_lz4.compress(&src[0], sizeof(src), &compressed[0], 5),
+              -1);
+    ASSERT_EQ(messi_codec_lz4.decompress(&compressed[0],
+                                         size,
+                                         &decompressed[0],
+                                         sizeof(src) - 1),
+              -1);
+
+    /* A match offset before the start of the output. */
+    compressed[0] = 0x10;
+    compressed[1] = 'a';
+    compressed[2] = 0x02;
+    compressed[3] = 0x00;
+    ASSERT_EQ(messi_codec_lz4.decompress(&compressed[0],
+                                         4,
+                                         &decompressed[0],
+                                         sizeof(decompressed)),
+              -1);
+
+    /* Literals only. */
+    size = messi_codec_lz4.compress(&src[0],
+                                    3,
+                                    &compressed[0],
+                                    sizeof(compressed));
+    ASSERT_EQ(size, 4);
+    ASSERT_EQ(compressed[0], 0x30);
+}
+
+TEST(frame_compress)
+{
+    uint8_t buf[4 + 200];
+    uint8_t scratch[200];
+    struct messi_buffer_t payload;
+    struct messi_buffer_t data;
+    uint8_t decompressed[200];
+    uint8_t type;
+    uint8_t codec;
+    size_t size;
+
+    memset(&buf[4], 'x', 200);
+    messi_header_create((struct messi_header_t *)&buf[0], 2, 200);
+    size = messi_frame_compress(&buf[0],
+                                sizeof(buf),
+                                &messi_codec_lz4,
+                                &scratch[0],
+                                sizeof(scratch));
+    ASSERT_LT(size, 30);
+    ASSERT_EQ(buf[0], MESSI_MESSAGE_TYPE_COMPRESSED);
+    ASSERT_EQ(messi_header_get_size((struct messi_header_t *)&buf[0]),
+              size - 4);
+
+    payload.buf_p = &buf[4];
+    payload.size = size - 4;
+    ASSERT_EQ(messi_compressed_parse(&payload, &type, &codec, &size, &data), 0);
+    ASSERT_EQ(type, 2);
+    ASSERT_EQ(codec, MESSI_CODEC_LZ4);
+    ASSERT_EQ(size, 200);
+    ASSERT_EQ(messi_codec_lz4.decompress(data.buf_p,
+                                         data.size,
+                                         &decompressed[0],
+                                         sizeof(decompressed)),
+              200);
+    ASSERT_EQ(decompressed[0], 'x');
+    ASSERT_EQ(decompressed[199], 'x');
+
+    /* A payload that does not compress is left as is. */
+    buf[4] = 0x12;
+    buf[5] = 0x34;
+    messi_header_create((struct messi_header_t *)&buf[0], 2, 2);
+    ASSERT_EQ(messi_frame_compress(&buf[0],
+                                   6,
+                                   &messi_codec_lz4,
+                                   &scratch[0],
+                                   sizeof(scratch)),
+              6);
+    ASSERT_EQ(buf[0], 2);
+    ASSERT_EQ(buf[4], 0x12);
+
+    /* A too short compressed header. */
+    payload.size = 5;
+    ASSERT_EQ(messi_compressed_parse(&payload, &type, &codec, &size, &data), -1);
+}
+
+TEST(large_pool)
+{
+    struct messi_large_pool_t pool;
+    uint8_t *buf_p;
+    uint8_t *kept_p;
+    size_t size;
+
+    messi_large_pool_init(&pool);
+
+    /* Allocate and release a buffer. It is kept for reuse. */
+    size = 100;
+    buf_p = messi_large_pool_alloc(&pool, &size);
+    ASSERT_NE(buf_p, NULL);
+    ASSERT_EQ(size, 100);
+    messi_large_pool_free(&pool, buf_p, size);
+    kept_p = buf_p;
+
+    /* A smaller buffer reuses it. */
+    size = 50;
+    buf_p = messi_large_pool_alloc(&pool, &size);
+    ASSERT_EQ(buf_p, kept_p);
+    ASSERT_EQ(size, 100);
+    messi_large_pool_free(&pool, buf_p, size);
+
+    /* A larger buffer is allocated, and replaces the kept one when
+       released. */
+    size = 200;
+    buf_p = messi_large_pool_alloc(&pool, &size);
+    ASSERT_NE(buf_p, kept_p);
+    ASSERT_EQ(size, 200);
+    messi_large_pool_free(&pool, buf_p, size);
+    ASSERT_EQ(pool.buf_p, buf_p);
+    ASSERT_EQ(pool.size, 200);
+
+    messi_large_pool_destroy(&pool);
+    ASSERT_EQ(pool.buf_p, NULL);
+}
+
+TEST(ring)
+{
+    struct messi_ring_t ring;
+    uint8_t buf[8];
+    struct iovec iov[2];
+
+    messi_ring_init(&ring, &buf[0], sizeof(buf));
+    ASSERT_EQ(messi_ring_used(&ring), 0);
+    ASSERT_EQ(messi_ring_get_iov(&ring, &iov[0]), 0);
+
+    /* Contiguous data. */
+    ASSERT_EQ(messi_ring_write(&ring, (uint8_t *)"12345", 5), 0);
+    ASSERT_EQ(messi_ring_used(&ring), 5);
+    ASSERT_EQ(messi_ring_get_iov(&ring, &iov[0]), 1);
+    ASSERT_EQ(iov[0].iov_base, &buf[0]);
+    ASSERT_EQ(iov[0].iov_len, 5);
+
+    /* Does not fit. */
+    ASSERT_EQ(messi_ring_write(&ring, (uint8_t *)"6789", 4), -1);
+    ASSERT_EQ(messi_ring_used(&ring), 5);
+
+    /* Wrap around the end. */
+    messi_ring_consume(&ring, 3);
+    ASSERT_EQ(messi_ring_write(&ring, (uint8_t *)"6789", 4), 0);
+    ASSERT_EQ(messi_ring_used(&ring), 6);
+    ASSERT_EQ(messi_ring_get_iov(&ring, &iov[0]), 2);
+    ASSERT_EQ(iov[0].iov_base, &buf[3]);
+    ASSERT_EQ(iov[0].iov_len, 5);
+    ASSERT_MEMORY_EQ(iov[0].iov_base, "45678", 5);
+    ASSERT_EQ(iov[1].iov_base, &buf[0]);
+    ASSERT_EQ(iov[1].iov_len, 1);
+    ASSERT_MEMORY_EQ(iov[1].iov_base, "9", 1);
+
+    /* Consume past the end. */
+    messi_ring_consume(&ring, 5);
+    ASSERT_EQ(messi_ring_get_iov(&ring, &iov[0]), 1);
+    ASSERT_EQ(iov[0].iov_base, &buf[0]);
+    ASSERT_EQ(iov[0].iov_len, 1);
+
+    /* An empty ring starts over at the beginning of the buffer. */
+    messi_ring_consume(&ring, 1);
+    ASSERT_EQ(messi_ring_used(&ring), 0);
+    ASSERT_EQ(messi_ring_write(&ring, (uint8_t *)"abcdefgh", 8), 0);
+    ASSERT_EQ(messi_ring_get_iov(&ring, &iov[0]), 1);
+    ASSERT_EQ(iov[0].iov_base, &buf[0]);
+    ASSERT_EQ(iov[0].iov_len, 8);
+
+    messi_ring_reset(&ring);
+    ASSERT_EQ(messi_ring_used(&ring), 0);
+}
+
+TEST(output_queue)
+{
+    struct messi_output_queue_t first;
+    struct messi_output_queue_t second;
+    struct messi_shared_buffer_t *buffer_p;
+    struct iovec iov[2];
+    size_t size;
+    int i;
+
+    messi_output_queue_init(&first);
+    messi_output_queue_init(&second);
+    ASSERT_TRUE(messi_output_queue_is_empty(&first));
+
+    /* Both queues reference the same buffer. */
+    buffer_p = messi_shared_buffer_new((uint8_t *)"12345", 5);
+    ASSERT_NE(buffer_p, NULL);
+    ASSERT_EQ(messi_output_queue_push(&first, buffer_p, 0), 0);
+    ASSERT_EQ(messi_output_queue_push(&second, buffer_p, 2), 0);
+    messi_shared_buffer_unref(buffer_p);
+    ASSERT_EQ(buffer_p->count, 2);
+    ASSERT_EQ(messi_output_queue_get_iov(&first, &iov[0], 2, &size), 1);
+    ASSERT_EQ(size, 5);
+    ASSERT_EQ(iov[0].iov_base, &buffer_p->data[0]);
+    ASSERT_EQ(messi_output_queue_get_iov(&second, &iov[0], 2, &size), 1);
+    ASSERT_EQ(size, 3);
+    ASSERT_EQ(messi_output_queue_size(&second), 3);
+    ASSERT_MEMORY_EQ(iov[0].iov_base, "345", 3);
+
+    /* Partly written. */
+    messi_output_queue_consume(&first, 4);
+    ASSERT_EQ(messi_output_queue_size(&first), 1);
+    ASSERT_EQ(messi_output_queue_get_iov(&first, &iov[0], 2, &size), 1);
+    ASSERT_EQ(size, 1);
+    ASSERT_MEMORY_EQ(iov[0].iov_base, "5", 1);
+    ASSERT_EQ(buffer_p->count, 2);
+    messi_output_queue_consume(&first, 1);
+    ASSERT_TRUE(messi_output_queue_is_empty(&first));
+    ASSERT_EQ(buffer_p->count, 1);
+
+    /* Grow beyond the initial item array with the first item partly
+       written. */
+    for (i = 0; i < 20; i++) {
+        buffer_p = messi_shared_buffer_new((uint8_t *)"ab", 2);
+        ASSERT_EQ(messi_output_queue_push(&second, buffer_p, 0), 0);
+        messi_shared_buffer_unref(buffer_p);
+    }
+
+    ASSERT_EQ(second.length, 21);
+    ASSERT_EQ(messi_output_queue_get_iov(&second, &iov[0], 2, &size), 2);
+    ASSERT_EQ(size, 5);
+    ASSERT_MEMORY_EQ(iov[0].iov_base, "345", 3);
+    ASSERT_MEMORY_EQ(iov[1].iov_base, "ab", 2);
+    messi_output_queue_consume(&second, 4);
+    ASSERT_EQ(second.length, 20);
+    ASSERT_EQ(messi_output_queue_size(&second), 39);
+    ASSERT_EQ(messi_output_queue_get_iov(&second, &iov[0], 2, &size), 2);
+    ASSERT_MEMORY_EQ(iov[0].iov_base, "b", 1);
+
+    /* Destroy releases all references. */
+    messi_output_queue_destroy(&first);
+    messi_output_queue_destroy(&second);
+    ASSERT_TRUE(messi_output_queue_is_empty(&second));
+    ASSERT_EQ(messi_output_queue_size(&second), 0);
+    ASSERT_EQ(second.items_p, NULL);
+}
+
+TEST(timer_wheel)
+{
+    struct messi_timer_wheel_t wheel;
+    struct messi_timer_t short_timer;
+    struct messi_timer_t long_timer;
+    int short_count;
+    int long_count;
+
+    timerfd_create_mock_once(CLOCK_MONOTONIC, 0, TIMERS_FD);
+
+    ASSERT_EQ(messi_timer_wheel_init(&wheel, 100), 0);
+
+    short_count = 0;
+    long_count = 0;
+    messi_timer_init(&short_timer,
+                     (messi_timer_on_timeout_t)on_timeout,
+                     &short_count);
+    messi_timer_init(&long_timer,
+                     (messi_timer_on_timeout_t)on_timeout,
+                     &long_count);
+    ASSERT_FALSE(messi_timer_is_running(&short_timer));
+
+    /* The timerfd is armed by the first timer. The long timer is on
+       the second level of the wheel. */
+    mock_prepare_timers_settime(100);
+
+    ASSERT_EQ(messi_timer_start(&wheel, &short_timer, 250), 0);
+    ASSERT_EQ(messi_timer_start(&wheel, &long_timer, 30000), 0);
+    ASSERT_TRUE(messi_timer_is_running(&short_timer));
+
+    /* The short timer expires after three ticks. */
+    mock_prepare_timers_read(2);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), 0);
+    ASSERT_EQ(short_count, 0);
+
+    mock_prepare_timers_read(1);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), 0);
+    ASSERT_EQ(short_count, 1);
+    ASSERT_FALSE(messi_timer_is_running(&short_timer));
+
+    /* The long timer was started when the timerfd was already armed,
+       so it expires one tick later than requested. */
+    mock_prepare_timers_read(297);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), 0);
+    ASSERT_EQ(long_count, 0);
+
+    /* The timerfd is disarmed when no timers are running. */
+    mock_prepare_timers_read(1);
+    mock_prepare_timers_settime(0);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), 0);
+    ASSERT_EQ(long_count, 1);
+
+    /* A stopped timer never expires. */
+    mock_prepare_timers_settime(100);
+
+    ASSERT_EQ(messi_timer_start(&wheel, &short_timer, 100), 0);
+    messi_timer_stop(&wheel, &short_timer);
+    messi_timer_stop(&wheel, &short_timer);
+
+    mock_prepare_timers_read(5);
+    mock_prepare_timers_settime(0);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), 0);
+    ASSERT_EQ(short_count, 1);
+
+    /* Read error. */
+    read_mock_once(TIMERS_FD, sizeof(uint64_t), -1);
+
+    ASSERT_EQ(messi_timer_wheel_process(&wheel), -1);
+}
+
+TEST(timer_wheel_external)
+{
+    struct messi_timer_wheel_t wheel;
+    struct messi_timer_t timer;
+    int count;
+
+    /* No timerfd is created or armed. The owner advances the
+       wheel. */
+    messi_timer_wheel_init_external(&wheel, 100);
+    count = 0;
+    messi_timer_init(&timer, (messi_timer_on_timeout_t)on_timeout, &count);
+
+    ASSERT_EQ(messi_timer_start(&wheel, &timer, 250), 0);
+
+    ASSERT_EQ(messi_timer_wheel_advance(&wheel, 2), 0);
+    ASSERT_EQ(count, 0);
+
+    ASSERT_EQ(messi_timer_wheel_advance(&wheel, 1), 0);
+    ASSERT_EQ(count, 1);
+    ASSERT_FALSE(messi_timer_is_running(&timer));
+
+    /* Ticks without running timers. */
+    ASSERT_EQ(messi_timer_wheel_advance(&wheel, 10), 0);
+    ASSERT_EQ(count, 1);
+}
+
+struct loop_member_t {
+    int fds[2];
+    int processed;
+    int rejected;
+    int deferred;
+};
+
+static int loop_member_process(struct loop_member_t *self_p,
+                               int fd,
+                               uint32_t events)
+{
+    ASSERT_EQ(events, EPOLLIN);
+
+    if ((fd != self_p->fds[0]) && (fd != self_p->fds[1])) {
+        self_p->rejected++;
+
+        return (-1);
+    }
+
+    self_p->processed++;
+
+    return (0);
+}
+
+static void loop_member_process_deferred(struct loop_member_t *self_p)
+{
+    self_p->deferred++;
+}
+
+static int loop_member_add_fd(struct messi_loop_t *loop_p)
+{
+    int fd;
+
+    fd = eventfd(1, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(messi_epoll_ctl_default(loop_p->epoll_fd,
+                                      EPOLL_CTL_ADD,
+                                      fd,
+                                      EPOLLIN), 0);
+
+    return (fd);
+}
+
+TEST(loop)
+{
+    struct messi_loop_t loop;
+    struct messi_loop_member_t members[2];
+    struct loop_member_t first;
+    struct loop_member_t second;
+
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+    ASSERT_EQ(messi_loop_init(&loop), 0);
+    messi_loop_add(&loop,
+                   &members[0],
+                   &first,
+                   (messi_loop_process_t)loop_member_process,
+                   (messi_loop_process_deferred_t)loop_member_process_deferred);
+    messi_loop_add(&loop,
+                   &members[1],
+                   &second,
+                   (messi_loop_process_t)loop_member_process,
+                   NULL);
+
+    /* The first member owns two readable file descriptors and the
+       second one. */
+    first.fds[0] = loop_member_add_fd(&loop);
+    first.fds[1] = loop_member_add_fd(&loop);
+    second.fds[0] = loop_member_add_fd(&loop);
+    second.fds[1] = -1;
+
+    /* Owners are found by asking the members. Deferred work is done
+       once for the batch. */
+    ASSERT_EQ(messi_loop_run_once(&loop, 0), 3);
+    ASSERT_EQ(first.processed, 2);
+    ASSERT_EQ(second.processed, 1);
+    ASSERT_EQ(first.deferred, 1);
+    ASSERT_EQ(second.rejected, 2);
+
+    /* Owners are remembered. */
+    ASSERT_EQ(messi_loop_run_once(&loop, 0), 3);
+    ASSERT_EQ(first.processed, 4);
+    ASSERT_EQ(second.processed, 2);
+    ASSERT_EQ(first.deferred, 2);
+    ASSERT_EQ(first.rejected, 0);
+    ASSERT_EQ(second.rejected, 2);
+
+    /* A file descriptor reused by another member. */
+    close(second.fds[0]);
+    close(first.fds[1]);
+    second.fds[0] = loop_member_add_fd(&loop);
+    first.fds[1] = -1;
+    ASSERT_EQ(messi_loop_run_once(&loop, 0), 2);
+    ASSERT_EQ(first.processed, 5);
+    ASSERT_EQ(second.processed, 3);
+    ASSERT_EQ(first.rejected, 1);
+
+    close(first.fds[0]);
+    close(second.fds[0]);
+    messi_loop_destroy(&loop);
+}
+
+TEST(backoff)
+{
+    struct messi_backoff_t backoff;
+    int i;
+    int delay_ms;
+
+    /* Doubled up to the maximum delay. */
+    messi_backoff_init(&backoff, 100, 2, 1000, false);
+    ASSERT_EQ(messi_backoff_next(&backoff), 100);
+    ASSERT_EQ(messi_backoff_next(&backoff), 200);
+    ASSERT_EQ(messi_backoff_next(&backoff), 400);
+    ASSERT_EQ(messi_backoff_next(&backoff), 800);
+    ASSERT_EQ(messi_backoff_next(&backoff), 1000);
+    ASSERT_EQ(messi_backoff_next(&backoff), 1000);
+    ASSERT_EQ(backoff.attempt, 6u);
+
+    /* Restart from the initial delay. */
+    messi_backoff_reset(&backoff);
+    ASSERT_EQ(backoff.attempt, 0u);
+    ASSERT_EQ(messi_backoff_next(&backoff), 100);
+
+    /* Fixed delay. */
+    messi_backoff_init(&backoff, 1000, 1, 1000, false);
+
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQ(messi_backoff_next(&backoff), 1000);
+    }
+
+    /* Full jitter, never longer than the delay without jitter. */
+    messi_backoff_init(&backoff, 100, 2, 1000, true);
+
+    for (i = 0; i < 1000; i++) {
+        delay_ms = messi_backoff_next(&backoff);
+        ASSERT_GE(delay_ms, 0);
+        ASSERT_LE(delay_ms, backoff.delay_ms);
+    }
+
+    ASSERT_EQ(backoff.delay_ms, 1000);
+}
+
 TEST(disconnect_reason_string)
 {
     ASSERT_EQ(messi_disconnect_reason_string(